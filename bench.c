@@ -0,0 +1,481 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "ltjson.h"
+
+
+/*  Parse speed benchmark
+
+    bench [-t secs] [-m MB] [file ...]
+
+    Each text is parsed over and over for at least secs (CPU time) each
+    way: whole in fresh and in recycled trees, then in chunks of the
+    CHUNKS sizes as a stream would be (the EAGAIN continuations), all
+    with and without LTJSON_PARSE_USEHASH. Reported are MB of text per
+    second, ns per node made and the memory of the parsed tree, which
+    is the most it had as trees only grow while parsing.
+
+    The texts are the files given or, with none, made up ones of about
+    MB each, shaped like the usual benchmark documents:
+
+        tweets   - Objects of strings, escapes and nested objects
+                   (as twitter.json)
+        geo      - Coordinate arrays of long doubles (as canada.json)
+        catalog  - Wide objects with numeric names and many repeated
+                   members (as citm_catalog.json)
+        wide     - One object of many members
+        deep     - Arrays nested a thousand deep
+        numbers  - An array of integers and doubles
+*/
+
+#define CHUNKS      { 64, 1024, 16384 }
+#define NCHUNKS     3
+
+struct text {
+    const char *name;
+    char *s;
+    size_t len;
+    size_t size;
+};
+
+static double mintime = 0.5;        /* CPU seconds per measurement */
+static size_t textsize = 4 << 20;   /* Bytes per made up text      */
+static unsigned long seed = 1;
+
+
+
+
+/* Append printf style to a text */
+
+static void add(struct text *t, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for (;;)
+    {
+        va_start(ap, fmt);
+        n = vsnprintf(t->s + t->len, t->size - t->len, fmt, ap);
+        va_end(ap);
+
+        if (n < 0)
+            exit(1);
+
+        if ((size_t)n < t->size - t->len)
+            break;
+
+        t->size = t->size * 2 + n;
+        if ((t->s = realloc(t->s, t->size)) == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    t->len += n;
+}
+
+
+
+
+static unsigned long rnd(unsigned long n)
+{
+    seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (seed >> 8) % n;
+}
+
+
+
+
+static const char *words[] =
+{
+    "the", "json", "parser", "light", "caf\\u00e9", "stream", "tree",
+    "node", "hash", "\\\"quoted\\\"", "line\\nbreak", "memory", "fast",
+    "\xc3\xa9t\xc3\xa9", "reuse", "http:\\/\\/example.com\\/a", "tab\\t"
+};
+
+#define NWORDS  (int)(sizeof(words) / sizeof(words[0]))
+
+
+
+
+static void make_tweets(struct text *t)
+{
+    int i, n;
+
+    add(t, "{\"statuses\": [");
+
+    for (i = 0; t->len < textsize; i++)
+    {
+        add(t, "%s{\"created_at\": \"Sun Aug 31 00:29:%02lu +0000 2014\", "
+               "\"id\": %lu%06lu, \"id_str\": \"%lu\", \"text\": \"",
+            i ? ", " : "", rnd(60), rnd(100000) + 500000, rnd(1000000),
+            rnd(1000000000));
+
+        for (n = 5 + (int)rnd(15); n; n--)
+            add(t, "%s ", words[rnd(NWORDS)]);
+
+        add(t, "\", \"truncated\": false, \"user\": {\"id\": %lu, "
+               "\"name\": \"%s %s\", \"screen_name\": \"user%lu\", "
+               "\"followers_count\": %lu, \"verified\": %s, "
+               "\"profile_image_url\": null}, \"entities\": "
+               "{\"hashtags\": [",
+            rnd(100000000), words[rnd(NWORDS)], words[rnd(NWORDS)],
+            rnd(10000), rnd(100000), rnd(10) ? "false" : "true");
+
+        for (n = (int)rnd(4); n; n--)
+            add(t, "{\"text\": \"%s\", \"indices\": [%lu, %lu]}%s",
+                words[rnd(NWORDS)], rnd(70), 70 + rnd(70), n > 1 ? ", " : "");
+
+        add(t, "], \"urls\": []}, \"retweet_count\": %lu, "
+               "\"favorited\": false, \"lang\": \"en\"}", rnd(1000));
+    }
+
+    add(t, "]}");
+}
+
+
+
+
+static void make_geo(struct text *t)
+{
+    int i;
+
+    add(t, "{\"type\": \"FeatureCollection\", \"features\": [{\"type\": "
+           "\"Feature\", \"geometry\": {\"type\": \"Polygon\", "
+           "\"coordinates\": [");
+
+    for (i = 0; t->len < textsize; i++)
+    {
+        add(t, "%s[", i ? ", " : "");
+
+        while (t->len < textsize && rnd(500))
+            add(t, "[-%lu.%09lu%06lu, %lu.%09lu%06lu], ", 50 + rnd(90),
+                rnd(1000000000), rnd(1000000), 40 + rnd(40),
+                rnd(1000000000), rnd(1000000));
+
+        add(t, "[-65.613616999999977, 43.420273000000009]]");
+    }
+
+    add(t, "]}}]}");
+}
+
+
+
+
+static void make_catalog(struct text *t)
+{
+    int i, n;
+
+    add(t, "{\"areaNames\": {");
+
+    for (i = 0; i < 500; i++)
+        add(t, "%s\"%d\": \"Area %s %d\"", i ? ", " : "", 205705993 + i,
+            words[rnd(NWORDS)], i);
+
+    add(t, "}, \"performances\": [");
+
+    for (i = 0; t->len < textsize; i++)
+    {
+        add(t, "%s{\"eventId\": %lu, \"id\": %d, \"logo\": null, "
+               "\"name\": null, \"prices\": [", i ? ", " : "",
+            138586341 + rnd(500), 339887544 + i);
+
+        for (n = 1 + (int)rnd(6); n; n--)
+            add(t, "{\"amount\": %lu, \"audienceSubCategoryId\": 337100890, "
+                   "\"seatCategoryId\": %lu}%s", rnd(100000),
+                338937295 + rnd(20), n > 1 ? ", " : "");
+
+        add(t, "], \"seatCategories\": [{\"areas\": [{\"areaId\": %lu, "
+               "\"blockIds\": []}], \"seatCategoryId\": %lu}], "
+               "\"seatMapImage\": null, \"start\": %lu000, "
+               "\"venueCode\": \"PLEYEL_PLEYEL\"}",
+            205705993 + rnd(500), 338937295 + rnd(20),
+            1372700000 + rnd(10000000));
+    }
+
+    add(t, "]}");
+}
+
+
+
+
+static void make_wide(struct text *t)
+{
+    int i;
+
+    add(t, "{");
+
+    for (i = 0; t->len < textsize; i++)
+        add(t, "%s\"member%07d\": %lu", i ? ", " : "", i, rnd(1000000));
+
+    add(t, "}");
+}
+
+
+
+
+static void make_deep(struct text *t)
+{
+    int i, depth = 1000;
+
+    add(t, "[");
+
+    while (t->len < textsize)
+    {
+        for (i = 0; i < depth; i++)
+            add(t, "[");
+
+        add(t, "%lu", rnd(1000));
+
+        for (i = 0; i < depth; i++)
+            add(t, i % 2 ? ", true]" : "]");
+
+        add(t, ", ");
+    }
+
+    add(t, "null]");
+}
+
+
+
+
+static void make_numbers(struct text *t)
+{
+    int i;
+
+    add(t, "[");
+
+    for (i = 0; t->len < textsize; i++)
+    {
+        switch (rnd(4))
+        {
+        case 0:
+            add(t, "%s%lu", i ? ", " : "", rnd(2000000000));
+            break;
+        case 1:
+            add(t, "%s-%lu%06lu", i ? ", " : "", rnd(1000000), rnd(1000000));
+            break;
+        case 2:
+            add(t, "%s%lu.%lu", i ? ", " : "", rnd(1000), rnd(100000));
+            break;
+        default:
+            add(t, "%s%lu.%06lue-%lu", i ? ", " : "", rnd(10), rnd(1000000),
+                rnd(300));
+        }
+    }
+
+    add(t, "]");
+}
+
+
+
+
+static int read_text(struct text *t, const char *filename)
+{
+    FILE *fp;
+    size_t n;
+    char buf[65536];
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        perror(filename);
+        return 0;
+    }
+
+    while ((n = fread(buf, 1, sizeof(buf) - 1, fp)) > 0)
+    {
+        buf[n] = 0;
+
+        if (strlen(buf) != n)
+        {
+            fprintf(stderr, "%s: has a null character\n", filename);
+            fclose(fp);
+            return 0;
+        }
+
+        add(t, "%s", buf);
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+
+
+
+/* Parse all of t once into *treeptr, in chunks of chunk bytes (or
+   whole if 0). A fresh tree is freed first. Returns 1 on success */
+
+static int parse_once(ltjson_node_t **treeptr, const struct text *t,
+                      int flags, int fresh, size_t chunk, char *chunkbuf)
+{
+    size_t pos, n;
+    int ret;
+
+    if (fresh)
+        ltjson_free(treeptr);
+
+    if (!chunk)
+        return ltjson_parse(treeptr, t->s, flags);
+
+    for (pos = 0; pos < t->len; pos += n)
+    {
+        n = t->len - pos < chunk ? t->len - pos : chunk;
+
+        memcpy(chunkbuf, t->s + pos, n);
+        chunkbuf[n] = 0;
+
+        if ((ret = ltjson_parse(treeptr, chunkbuf, flags)) != 0)
+            return ret;
+
+        if (errno != EAGAIN)
+            return 0;
+    }
+
+    ltjson_parse(treeptr, NULL, 0);
+    return 0;
+}
+
+
+
+
+static void run(const struct text *t, int flags, int fresh, size_t chunk)
+{
+    ltjson_node_t *tree = 0;
+    int stats[LTJSON_MEMSTATS];
+    char *chunkbuf = 0, how[32];
+    clock_t start, used;
+    long reps = 0;
+    double secs;
+
+    if (chunk && (chunkbuf = malloc(chunk + 1)) == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    start = clock();
+
+    do
+    {
+        if (!parse_once(&tree, t, flags, fresh, chunk, chunkbuf))
+        {
+            printf("%-10s parse fails: %s\n", t->name,
+                   tree ? ltjson_lasterror(tree) : strerror(errno));
+            ltjson_free(&tree);
+            free(chunkbuf);
+            return;
+        }
+
+        reps++;
+        used = clock() - start;
+    }
+    while ((double)used / CLOCKS_PER_SEC < mintime);
+
+    secs = (double)used / CLOCKS_PER_SEC / reps;
+    ltjson_memstat(tree, stats, LTJSON_MEMSTATS);
+
+    if (chunk)
+        sprintf(how, "chunks %lu", (unsigned long)chunk);
+    else
+        sprintf(how, "%s", fresh ? "fresh" : "recycled");
+
+    /* Stats 0 and 2 are the total memory and the nodes filled */
+
+    printf("%-10s %-12s %-4s %9.1f %9.1f %11d\n", t->name, how,
+           flags & LTJSON_PARSE_USEHASH ? "yes" : "no",
+           t->len / secs / 1e6, secs * 1e9 / stats[2], stats[0] / 1024);
+
+    ltjson_free(&tree);
+    free(chunkbuf);
+}
+
+
+
+
+int main(int argc, char *argv[])
+{
+    static void (*makers[])(struct text *) =
+    {
+        make_tweets, make_geo, make_catalog, make_wide, make_deep,
+        make_numbers
+    };
+    static const char *names[] =
+    {
+        "tweets", "geo", "catalog", "wide", "deep", "numbers"
+    };
+    size_t chunks[NCHUNKS] = CHUNKS;
+    struct text *texts;
+    int ntexts, first, i, j, k, flags;
+
+    for (first = 1; first < argc - 1 && argv[first][0] == '-'; first += 2)
+    {
+        if (!strcmp(argv[first], "-t"))
+            mintime = atof(argv[first + 1]);
+        else if (!strcmp(argv[first], "-m"))
+            textsize = (size_t)(atof(argv[first + 1]) * (1 << 20));
+        else
+            break;
+    }
+
+    if (first < argc && argv[first][0] == '-')
+    {
+        fprintf(stderr, "Usage: %s [-t secs] [-m MB] [file ...]\n",
+                argv[0]);
+        return 1;
+    }
+
+    ntexts = (first < argc) ? argc - first : 6;
+    texts = calloc(ntexts, sizeof(struct text));
+    if (!texts)
+        return 1;
+
+    for (j = 0; j < ntexts; j++)
+    {
+        texts[j].size = textsize + 4096;
+        texts[j].s = malloc(texts[j].size);
+        if (!texts[j].s)
+            return 1;
+        texts[j].s[0] = 0;
+
+        if (first < argc)
+        {
+            texts[j].name = argv[first + j];
+            if (!read_text(&texts[j], argv[first + j]))
+                return 1;
+        }
+        else
+        {
+            texts[j].name = names[j];
+            makers[j](&texts[j]);
+        }
+    }
+
+    printf("%-10s %-12s %-4s %9s %9s %11s\n", "text", "parse", "hash",
+           "MB/s", "ns/node", "tree KB");
+
+    for (j = 0; j < ntexts; j++)
+    {
+        for (k = 0; k < 2; k++)
+        {
+            flags = k ? LTJSON_PARSE_USEHASH : 0;
+
+            run(&texts[j], flags, 1, 0);
+            run(&texts[j], flags, 0, 0);
+
+            for (i = 0; i < NCHUNKS; i++)
+                run(&texts[j], flags, 0, chunks[i]);
+        }
+
+        free(texts[j].s);
+    }
+
+    free(texts);
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ *  ltalloc.c (as include): Tree memory allocation
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  All of a tree's memory (the info structure, node blocks, string
+    stores, hash and index tables, working store and filter levels) is
+    got through mem_alloc and friends with the tree's allocator, which
+    is NULL for the C library (see ltjson_setalloc). Dictionaries,
+    compiled paths and pools belong to no tree and always use the C
+    library.
+
+    The arena allocator (ltjson_setarena) hands out a caller's buffer
+    from the bottom up. Its state is kept at the start of the buffer.
+    Only the last block allocated can be freed or grown in place, which
+    suits a tree: recycling reuses its memory rather than freeing it
+    and what is freed is mostly a table being replaced by a bigger one.
+*/
+
+
+/*
+ *  mem_alloc(alloc, size) - Allocate size bytes
+ *
+ *  Returns the memory or NULL (errno to ENOMEM)
+ */
+
+static void *mem_alloc(const ltjson_alloc_t *alloc, size_t size)
+{
+    void *mem;
+
+    mem = alloc ? alloc->alloc(alloc->ctx, size) : malloc(size);
+    if (!mem)
+        errno = ENOMEM;
+
+    return mem;
+}
+
+
+
+
+/*
+ *  mem_zalloc(alloc, size) - Allocate size bytes of zeros
+ */
+
+static void *mem_zalloc(const ltjson_alloc_t *alloc, size_t size)
+{
+    void *mem;
+
+    if (!alloc)
+    {
+        if ((mem = calloc(1, size)) == NULL)
+            errno = ENOMEM;
+        return mem;
+    }
+
+    if ((mem = mem_alloc(alloc, size)) != NULL)
+        memset(mem, 0, size);
+
+    return mem;
+}
+
+
+
+
+/*
+ *  mem_realloc(alloc, mem, size) - Change the size of mem (or allocate)
+ *
+ *  Returns the memory or NULL (errno to ENOMEM) with mem left as it was
+ */
+
+static void *mem_realloc(const ltjson_alloc_t *alloc, void *mem, size_t size)
+{
+    void *newmem;
+
+    newmem = alloc ? alloc->resize(alloc->ctx, mem, size)
+                   : realloc(mem, size);
+    if (!newmem)
+        errno = ENOMEM;
+
+    return newmem;
+}
+
+
+
+
+/*
+ *  mem_free(alloc, mem) - Free mem (which can be NULL)
+ */
+
+static void mem_free(const ltjson_alloc_t *alloc, void *mem)
+{
+    if (!mem)
+        return;
+
+    if (alloc)
+        alloc->release(alloc->ctx, mem);
+    else
+        free(mem);
+}
+
+
+
+
+/* Arena state, which is at the (aligned) start of the caller's buffer.
+   Each block starts with a header holding its size. */
+
+struct arena {
+    char *base;         /* First byte for blocks              */
+    size_t size;        /* Bytes from base                    */
+    size_t used;        /* Bytes from base given out          */
+    size_t last;        /* Offset of the last block or ~0     */
+};
+
+#define ARENA_ALIGN         16
+#define ARENA_HDRSIZE       ARENA_ALIGN
+#define arena_round(n)      (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define arena_blksize(p)    (*(size_t *)((char *)(p) - ARENA_HDRSIZE))
+
+
+
+
+/*
+ *  arena_init(buf, size) - Set up an arena in buf
+ *
+ *  Returns the arena or NULL if buf is too small to hold its state
+ */
+
+static struct arena *arena_init(void *buf, size_t size)
+{
+    struct arena *arena;
+    size_t skip, hdr;
+
+    skip = arena_round((size_t)buf) - (size_t)buf;
+    hdr = arena_round(sizeof(struct arena));
+
+    if (size < skip + hdr)
+        return NULL;
+
+    arena = (struct arena *)((char *)buf + skip);
+    arena->base = (char *)arena + hdr;
+    arena->size = size - skip - hdr;
+    arena->used = 0;
+    arena->last = ~(size_t)0;
+
+    return arena;
+}
+
+
+
+
+/*
+ *  arena_alloc(ctx, size) - Allocator alloc for an arena
+ */
+
+static void *arena_alloc(void *ctx, size_t size)
+{
+    struct arena *arena = ctx;
+    size_t need;
+    char *blk;
+
+    need = ARENA_HDRSIZE + arena_round(size);
+
+    if (need < size || arena->size - arena->used < need)
+        return NULL;
+
+    blk = arena->base + arena->used + ARENA_HDRSIZE;
+    arena_blksize(blk) = size;
+
+    arena->last = arena->used;
+    arena->used += need;
+
+    return blk;
+}
+
+
+
+
+/*
+ *  arena_release(ctx, mem) - Allocator release for an arena
+ *
+ *  Only the last block is given back
+ */
+
+static void arena_release(void *ctx, void *mem)
+{
+    struct arena *arena = ctx;
+
+    if ((char *)mem - ARENA_HDRSIZE == arena->base + arena->last)
+    {
+        arena->used = arena->last;
+        arena->last = ~(size_t)0;
+    }
+}
+
+
+
+
+/*
+ *  arena_resize(ctx, mem, size) - Allocator resize for an arena
+ *
+ *  The last block is resized where it is, others are copied
+ */
+
+static void *arena_resize(void *ctx, void *mem, size_t size)
+{
+    struct arena *arena = ctx;
+    size_t need, oldsize;
+    void *newmem;
+
+    if (!mem)
+        return arena_alloc(ctx, size);
+
+    if ((char *)mem - ARENA_HDRSIZE == arena->base + arena->last)
+    {
+        need = ARENA_HDRSIZE + arena_round(size);
+
+        if (need < size || arena->size - arena->last < need)
+            return NULL;
+
+        arena_blksize(mem) = size;
+        arena->used = arena->last + need;
+        return mem;
+    }
+
+    if ((newmem = arena_alloc(ctx, size)) == NULL)
+        return NULL;
+
+    oldsize = arena_blksize(mem);
+    memcpy(newmem, mem, oldsize < size ? oldsize : size);
+
+    return newmem;
+}
+
+
+
+
+/*
+ *  mem_canfree(alloc) - Can memory given back to alloc be used again?
+ *
+ *  Not so for an arena, so blocks are not swapped for bigger ones there
+ */
+
+static int mem_canfree(const ltjson_alloc_t *alloc)
+{
+    return !alloc || alloc->release != arena_release;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,678 @@
+/*
+ *  ltbatch.c (as include): Parsing on threads
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A batch is a set of texts, each parsed into its own tree. Nothing
+    is shared between trees but a frozen dictionary, so the texts are
+    handed out to the worker threads BATCH_CHUNK at a time from a
+    locked counter and each worker parses them with ltjson_parse as
+    the caller would. The calling thread is one of the workers.
+
+    A parallel parse is a batch of one text cut into parts. A quick
+    pass over the text with scan_structure finds commas between the
+    elements of the root array to cut it at and each part is parsed
+    into a tree of its own, in the state the tree would be in after
+    such a comma. The parts' element lists are then linked together
+    under the root. The part trees are kept in .parts of the tree and
+    are recycled with it, so their nodes and strings stay where they
+    are. Anything going wrong in a part just means the whole text is
+    parsed again in the usual way, which gives the same result (and
+    error) as if it had been in the first place.
+
+    Threads are POSIX threads, or Windows threads under _WIN32. Define
+    LTJSON_NO_THREADS to build without either, when batches are always
+    parsed in the calling thread.
+*/
+
+#if !defined(LTJSON_NO_THREADS) && defined(_WIN32)
+  #include <windows.h>
+  #define BATCH_WIN32
+#elif !defined(LTJSON_NO_THREADS)
+  #include <pthread.h>
+  #define BATCH_PTHREADS
+#endif
+
+#define BATCH_CHUNK     8       /* Texts a worker takes at a time */
+#define PARA_MINPART    65536   /* Smallest part worth a thread   */
+
+struct batch {
+    int (*parse)(struct batch *b, int i);      /* Parse item i */
+    int nitems;                 /* Texts or parts                  */
+    int chunk;                  /* Items a worker takes at a time  */
+    int flags;
+    int next;                   /* Next item to be handed out      */
+    int nparsed;                /* Items parsed so far             */
+    int locked;                 /* Set if lock is in use           */
+
+    ltjson_node_t **trees;      /* ltjson_parse_batch              */
+    const char **texts;
+    int *errs;                  /* Optional errno of each text     */
+    ltjson_dict_t *dict;
+
+    ltjson_info_t *jsoninfo;    /* ltjson_parse_parallel           */
+    const char *cuts[LTJSON_BATCH_MAXTHREADS + 1];
+    ltjson_node_t *firsts[LTJSON_BATCH_MAXTHREADS];
+    ltjson_node_t *lasts[LTJSON_BATCH_MAXTHREADS];
+
+#if defined(BATCH_WIN32)
+    CRITICAL_SECTION lock;
+#elif defined(BATCH_PTHREADS)
+    pthread_mutex_t lock;
+#endif
+};
+
+/*
+ *  batch_lock(b), batch_unlock(b) - Take and give back the batch lock
+ */
+
+static void batch_lock(struct batch *b)
+{
+#if defined(BATCH_WIN32)
+    if (b->locked)
+        EnterCriticalSection(&b->lock);
+#elif defined(BATCH_PTHREADS)
+    if (b->locked)
+        pthread_mutex_lock(&b->lock);
+#else
+    (void)b;
+#endif
+}
+
+
+static void batch_unlock(struct batch *b)
+{
+#if defined(BATCH_WIN32)
+    if (b->locked)
+        LeaveCriticalSection(&b->lock);
+#elif defined(BATCH_PTHREADS)
+    if (b->locked)
+        pthread_mutex_unlock(&b->lock);
+#else
+    (void)b;
+#endif
+}
+
+
+
+
+/*
+ *  batch_parse(b, i) - Parse text i of the batch into tree i
+ *
+ *  A tree left open by an incomplete text is forced closed so that
+ *  it can be recycled by the next batch.
+ *
+ *  Returns 1 if the tree is parsed and closed, 0 if not
+ */
+
+static int batch_parse(struct batch *b, int i)
+{
+    ltjson_node_t **treeptr = &b->trees[i];
+    ltjson_info_t *jsoninfo = (ltjson_info_t *)(*treeptr);
+    int ret = 0, err;
+
+    if (b->dict && (!jsoninfo || jsoninfo->dict != b->dict) &&
+        !ltjson_setdict(treeptr, b->dict))
+    {
+        err = errno;
+    }
+    else if (!b->texts[i])
+    {
+        err = EINVAL;
+    }
+    else if ((ret = ltjson_parse(treeptr, b->texts[i], b->flags)) != 0)
+    {
+        err = 0;
+    }
+    else
+    {
+        err = errno;
+        if (err == EAGAIN)
+            ltjson_parse(treeptr, NULL, 0);
+    }
+
+    if (b->errs)
+        b->errs[i] = err;
+
+    return ret;
+}
+
+
+
+
+/*
+ *  batch_work(b) - Parse items of the batch until there are none left
+ */
+
+static void batch_work(struct batch *b)
+{
+    int i, first, last, nparsed = 0;
+
+    for (;;)
+    {
+        batch_lock(b);
+        first = b->next;
+        b->next = first < b->nitems - b->chunk ? first + b->chunk
+                                               : b->nitems;
+        last = b->next;
+        batch_unlock(b);
+
+        if (first == last)
+            break;
+
+        for (i = first; i < last; i++)
+            nparsed += b->parse(b, i);
+    }
+
+    batch_lock(b);
+    b->nparsed += nparsed;
+    batch_unlock(b);
+}
+
+
+
+
+/*
+ *  batch_thread(arg) - Thread start for a batch worker
+ */
+
+#if defined(BATCH_WIN32)
+
+static DWORD WINAPI batch_thread(LPVOID arg)
+{
+    batch_work(arg);
+    return 0;
+}
+
+#elif defined(BATCH_PTHREADS)
+
+static void *batch_thread(void *arg)
+{
+    batch_work(arg);
+    return NULL;
+}
+
+#endif
+
+
+
+
+/*
+ *  batch_run(b, nthreads) - Parse the batch on nthreads threads
+ *
+ *  nthreads - 1 threads are started to work alongside the caller. If
+ *  some can't be started the batch is parsed by those that could be.
+ */
+
+static void batch_run(struct batch *b, int nthreads)
+{
+#if defined(BATCH_WIN32)
+    HANDLE tids[LTJSON_BATCH_MAXTHREADS];
+#elif defined(BATCH_PTHREADS)
+    pthread_t tids[LTJSON_BATCH_MAXTHREADS];
+#endif
+    int i, nstarted = 0;
+
+    if (nthreads > LTJSON_BATCH_MAXTHREADS)
+        nthreads = LTJSON_BATCH_MAXTHREADS;
+
+    if (nthreads > (b->nitems + b->chunk - 1) / b->chunk)
+        nthreads = (b->nitems + b->chunk - 1) / b->chunk;
+
+#if defined(BATCH_WIN32)
+    if (nthreads > 1)
+    {
+        InitializeCriticalSection(&b->lock);
+        b->locked = 1;
+    }
+
+    for (i = 1; i < nthreads; i++)
+    {
+        tids[nstarted] = CreateThread(NULL, 0, batch_thread, b, 0, NULL);
+        if (tids[nstarted] == NULL)
+            break;
+        nstarted++;
+    }
+#elif defined(BATCH_PTHREADS)
+    if (nthreads > 1 && pthread_mutex_init(&b->lock, NULL) == 0)
+        b->locked = 1;
+    else
+        nthreads = 1;           /* Not safe to start any */
+
+    for (i = 1; i < nthreads; i++)
+    {
+        if (pthread_create(&tids[nstarted], NULL, batch_thread, b) != 0)
+            break;
+        nstarted++;
+    }
+#else
+    (void)nthreads;
+#endif
+
+    batch_work(b);
+
+    for (i = 0; i < nstarted; i++)
+    {
+#if defined(BATCH_WIN32)
+        WaitForSingleObject(tids[i], INFINITE);
+        CloseHandle(tids[i]);
+#elif defined(BATCH_PTHREADS)
+        pthread_join(tids[i], NULL);
+#endif
+    }
+
+#if defined(BATCH_WIN32)
+    if (b->locked)
+        DeleteCriticalSection(&b->lock);
+#elif defined(BATCH_PTHREADS)
+    if (b->locked)
+        pthread_mutex_destroy(&b->lock);
+#endif
+}
+
+
+
+
+/**
+ *  ltjson_parse_batch(trees, texts, errs, ntexts, flags, dict, nthreads)
+ *                                  - Parse many texts into many trees
+ *      @trees:     Array of @ntexts trees (each NULL or closed)
+ *      @texts:     Array of @ntexts complete texts
+ *      @errs:      Optional array of @ntexts for the errno of each text
+ *      @ntexts:    Number of texts
+ *      @flags:     LTJSON_PARSE_* flags for each tree
+ *      @dict:      Optional frozen dictionary for all of the trees
+ *      @nthreads:  Number of threads to parse on (1 for the caller only)
+ *
+ *  Each @texts[i] is parsed into @trees[i] as ltjson_parse would, on
+ *  up to @nthreads threads. The trees are recycled as usual, so a
+ *  program can keep its array of trees from one batch to the next.
+ *  A text that is incomplete leaves its tree in an error state.
+ *
+ *  Returns: Number of texts parsed with their trees closed, or 0 and
+ *  errno set to EINVAL (bad argument), EBUSY (a tree is open) or EPERM
+ *  (dict is not frozen). errno is 0 after a batch, however many failed.
+ */
+
+int ltjson_parse_batch(ltjson_node_t **trees, const char **texts, int *errs,
+                       int ntexts, int flags, ltjson_dict_t *dict,
+                       int nthreads)
+{
+    struct batch b;
+    int i;
+
+    if (!trees || !texts || ntexts < 0)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (i = 0; i < ntexts; i++)
+    {
+        if (!trees[i])
+            continue;
+
+        if (!is_valid_tree(trees[i]))
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        if (((ltjson_info_t *)trees[i])->open)
+        {
+            errno = EBUSY;
+            return 0;
+        }
+    }
+
+    if (dict && !dict->frozen && nthreads > 1)
+    {
+        errno = EPERM;
+        return 0;
+    }
+
+    b.parse = batch_parse;
+    b.nitems = ntexts;
+    b.chunk = BATCH_CHUNK;
+    b.flags = flags;
+    b.next = 0;
+    b.nparsed = 0;
+    b.locked = 0;
+    b.trees = trees;
+    b.texts = texts;
+    b.errs = errs;
+    b.dict = dict;
+
+    batch_run(&b, nthreads);
+
+    errno = 0;
+    return b.nparsed;
+}
+
+
+
+
+/*
+ *  para_split(b, s, end, nparts) - Cut the root array into nparts parts
+ *
+ *  s is just after the [ of the root. Each cut is just after the first
+ *  comma between elements past where an even share of the text ends.
+ *  The text is not checked here: a bad one just fails in some part.
+ *
+ *  Returns the number of parts, with cuts[0] to cuts[parts] set
+ */
+
+static int para_split(struct batch *b, const char *s, const char *end,
+                      int nparts)
+{
+    size_t share = (size_t)(end - s) / nparts;
+    int depth = 0, n = 1;
+
+    b->cuts[0] = s;
+
+    while (n < nparts && (s = scan_structure(s, end)) < end)
+    {
+        switch (*s++)
+        {
+            case '"':
+                while ((s = scan_strbody(s, end)) < end && *s == '\\')
+                    s += (end - s > 1) ? 2 : 1;
+
+                if (s < end)
+                    s++;                /* Closing quote */
+                break;
+
+            case '{':
+            case '[':
+                depth++;
+                break;
+
+            case '}':
+            case ']':
+                if (depth-- == 0)
+                    s = end;            /* Root closed */
+                break;
+
+            default:                    /* Comma */
+                if (!depth && (size_t)(s - b->cuts[0]) > n * share)
+                    b->cuts[n++] = s;
+                break;
+        }
+    }
+
+    b->cuts[n] = end;
+    return n;
+}
+
+
+
+
+/*
+ *  para_part(b, i) - Parse part i of the text into part tree i
+ *
+ *  Parts start as the tree would be after the [ of the root (part 0)
+ *  or a comma between its elements (the others). All but the last
+ *  part must end open at the empty node after the comma they end
+ *  with, which is then dropped. The elements are given the root of
+ *  the whole tree as their ancnode.
+ *
+ *  Returns 1 if the part parsed as it should, 0 if not
+ */
+
+static int para_part(struct batch *b, int i)
+{
+    ltjson_node_t **treeptr = &b->jsoninfo->parts[i];
+    ltjson_node_t *curnode, *node;
+    ltjson_info_t *part;
+    int ret;
+
+    if ((part = start_tree(treeptr, b->flags)) == NULL)
+        return 0;
+
+    part->textend = b->cuts[i + 1];
+
+    curnode = begin_tree(part, '[');
+
+    if (i > 0)
+    {
+        if ((node = get_new_node(part)) == NULL)
+            return 0;
+
+        curnode->val.subnode = node;
+        node->ancnode = curnode;
+        curnode = node;
+    }
+
+    ret = parse_values(part, treeptr, curnode, b->cuts[i]);
+
+    if (i == b->nitems - 1)
+    {
+        if (!ret)
+            return 0;
+    }
+    else if (ret || errno != EAGAIN || part->incomplete ||
+             part->open->ntype != LTJSON_NTYPE_EMPTY ||
+             part->open->ancnode != part->root)
+    {
+        return 0;
+    }
+
+    b->firsts[i] = part->root->val.subnode;
+
+    for (node = b->firsts[i]; ; node = node->next)
+    {
+        node->ancnode = b->jsoninfo->root;
+
+        if (!node->next || node->next == part->open)
+            break;
+    }
+
+    node->next = NULL;
+    b->lasts[i] = node;
+    part->open = 0;
+
+#ifdef LTJSON_COUNTERS
+    if (i < b->nitems - 1)
+        part->counters.nodes--;     /* The empty node after the comma */
+#endif
+
+    return 1;
+}
+
+
+
+
+/*
+ *  para_intern(jsoninfo, part) - Put the names of part into the tree hash
+ *
+ *  Parts have their own hash (or none), so when the tree has one (or a
+ *  dictionary) the names are swapped for its copies.
+ *
+ *  Returns 1 on success, 0 if out of memory (errno to ENOMEM)
+ */
+
+static int para_intern(ltjson_info_t *jsoninfo, ltjson_info_t *part)
+{
+    ltjson_node_t *basenode, *node, *endnode;
+
+    if (!part->cbasenode)
+        return 1;
+
+    basenode = part->cbasenode->ancnode;    /* First basenode */
+
+    do {
+        endnode = basenode + basenode->val.nused;
+
+        for (node = basenode + 1; node < endnode; node++)
+        {
+            if (node->name &&
+                !(node->name = nhash_insert(jsoninfo, node->name,
+                                            &node->namehash)))
+                return 0;
+        }
+
+        basenode = basenode->next;
+
+    } while (basenode != basenode->ancnode);
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_parse_parallel(treeptr, text, flags, nthreads)
+ *                                  - Parse a big array on many threads
+ *      @treeptr:   Pointer to json tree root
+ *      @text:      UTF-8 text
+ *      @flags:     LTJSON_PARSE_* flags for a new or recycled tree
+ *      @nthreads:  Number of threads to parse on
+ *
+ *  As ltjson_parse, except that if @text is a whole array big enough to
+ *  be worth it, its elements are parsed on up to @nthreads threads. The
+ *  tree is just as ltjson_parse would have made it. Anything else is
+ *  given to ltjson_parse, as are LTJSON_PARSE_INSITU texts (a part
+ *  that fails has already changed the text) and trees with events, a
+ *  filter, a tape or their own allocator.
+ *
+ *  Returns:  as ltjson_parse
+ */
+
+int ltjson_parse_parallel(ltjson_node_t **treeptr, const char *text,
+                          int flags, int nthreads)
+{
+    ltjson_info_t *jsoninfo = 0;
+    ltjson_node_t *root;
+    struct batch b;
+    const char *s, *end;
+    int i, nparts;
+#ifdef LTJSON_COUNTERS
+    unsigned long long start = count_now();
+#endif
+
+    if (treeptr && is_valid_tree(*treeptr))
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+
+    if (!treeptr || !text || nthreads < 2 || (*treeptr && !jsoninfo) ||
+        (flags & LTJSON_PARSE_INSITU) ||
+        (jsoninfo && (jsoninfo->open || jsoninfo->alloc || jsoninfo->sax ||
+                      jsoninfo->filter || jsoninfo->tape)))
+        return ltjson_parse(treeptr, text, flags);
+
+    end = text + strlen(text);
+    s = skip_space(text, end);
+
+    nparts = nthreads;
+    if (nparts > LTJSON_BATCH_MAXTHREADS)
+        nparts = LTJSON_BATCH_MAXTHREADS;
+    if (nparts > (end - s) / PARA_MINPART)
+        nparts = (int)((end - s) / PARA_MINPART);
+
+    if (nparts < 2 || *s != '[' || (nparts = para_split(&b, s + 1, end,
+                                                        nparts)) < 2)
+        return ltjson_parse(treeptr, text, flags);
+
+    if ((jsoninfo = start_tree(treeptr, flags)) == NULL)
+        return 0;
+
+    jsoninfo->textend = end;
+
+    if (!jsoninfo->parts)
+    {
+        jsoninfo->parts = mem_zalloc(NULL, LTJSON_BATCH_MAXTHREADS *
+                                           sizeof(ltjson_node_t *));
+        if (!jsoninfo->parts)
+            return ltjson_parse(treeptr, text, flags);
+    }
+
+    for (i = nparts; i < LTJSON_BATCH_MAXTHREADS; i++)
+    {
+        /* Don't keep memory for parts this text hasn't got */
+
+        destroy_tree((ltjson_info_t *)jsoninfo->parts[i]);
+        jsoninfo->parts[i] = NULL;
+    }
+
+    /* Parts keep their names from one parse to the next if the tree's
+       names are hashed. Their hashes are only to save on copies. */
+
+    b.parse = para_part;
+    b.nitems = nparts;
+    b.chunk = 1;
+    b.flags = (flags & LTJSON_PARSE_RAWNUM) |
+              (nhash_ishashed(jsoninfo) ? LTJSON_PARSE_KEEPHASH : 0);
+    b.next = 0;
+    b.nparsed = 0;
+    b.locked = 0;
+    b.trees = 0;
+    b.texts = 0;
+    b.errs = 0;
+    b.dict = 0;
+    b.jsoninfo = jsoninfo;
+
+    batch_run(&b, nparts);
+
+#ifdef LTJSON_COUNTERS
+    for (i = 0; i < nparts; i++)
+    {
+        if (jsoninfo->parts[i])
+            count_merge(jsoninfo, (ltjson_info_t *)jsoninfo->parts[i]);
+    }
+#endif
+
+    if (b.nparsed < nparts)
+    {
+        /* Bad or incomplete text, or short of memory. Parsing it all
+           over again gets the tree (and lasterr) right */
+
+        return ltjson_parse(treeptr, text, flags);
+    }
+
+    root = jsoninfo->root;
+    root->ntype = LTJSON_NTYPE_ARRAY;
+    root->nflags = 0;
+    root->val.subnode = b.firsts[0];
+
+    for (i = 1; i < nparts; i++)
+        b.lasts[i - 1]->next = b.firsts[i];
+
+    if (nhash_ishashed(jsoninfo))
+    {
+        for (i = 0; i < nparts; i++)
+        {
+            if (!para_intern(jsoninfo,
+                             (ltjson_info_t *)jsoninfo->parts[i]))
+            {
+                destroy_tree(jsoninfo);
+                *treeptr = NULL;
+                errno = ENOMEM;
+                return 0;
+            }
+        }
+    }
+
+#ifdef LTJSON_COUNTERS
+    jsoninfo->counters.bytes += end - text;
+    count_call(&jsoninfo->counters.nparses, &jsoninfo->counters.parse_ns,
+               start);
+#endif
+
+    return 1;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
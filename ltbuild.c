@@ -0,0 +1,577 @@
+/*
+ *  ltbuild.c (as include): Building trees with a cursor
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A cursor is checked against its tree once, by ltjson_cursor_init,
+    and keeps the object or array it adds to and the last child of it.
+    Each add is then a node off the node sets, linked in after .last,
+    with no walk up to the root or along the children. Names go into
+    the tree's hash as usual (or the string store if it has none).
+    String values are copied, unless the cursor has the flag
+    LTJSON_CURSOR_NOCOPY when they're pointed to as they are.
+
+    Nodes are added in the order they will be written, so building a
+    response is a matter of adding each value as it comes. Nothing else
+    may add to the cursor's object or array while the cursor is in use
+    (ltjson_addnode_under would leave .last behind).
+*/
+
+
+
+
+/*
+ *  cursor_add(cur, ntype, name) - Append an empty node to the cursor
+ *
+ *  The node's value is for the caller to set.
+ *
+ *  Returns: (as ltjson_cursor_add)
+ */
+
+static ltjson_node_t *cursor_add(ltjson_cursor_t *cur, short int ntype,
+                                 const char *name)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *newnode, *parent;
+    unsigned int hashval;
+    const char *nvstr;
+
+    if (!cur || !cur->tree)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    jsoninfo = (ltjson_info_t *)cur->tree;
+    parent = cur->parent;
+
+    nvstr = NULL;
+    hashval = 0;
+
+    if (parent->ntype == LTJSON_NTYPE_OBJECT)
+    {
+        if (!name)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        if ((nvstr = nhash_insert(jsoninfo, name, &hashval)) == NULL)
+            return NULL;
+    }
+    else if (name)
+    {
+        errno = EINVAL;         /* Elements have no names */
+        return NULL;
+    }
+
+    if ((newnode = get_new_node(jsoninfo)) == NULL)
+        return NULL;
+
+    newnode->name     = nvstr;
+    newnode->ntype    = ntype;
+    newnode->namehash = hashval;
+    newnode->ancnode  = parent;
+    newnode->val.ll   = 0;
+
+    if (cur->last)
+        cur->last->next = newnode;
+    else
+        parent->val.subnode = newnode;
+
+    cur->last = newnode;
+
+    if (parent->ntype == LTJSON_NTYPE_OBJECT)
+        mindex_added(jsoninfo, parent, newnode);
+
+    nindex_free(jsoninfo);
+    return newnode;
+}
+
+
+
+
+/*
+ *  cursor_string(cur, s) - The string value of a node to add
+ *
+ *  Returns: s itself for LTJSON_CURSOR_NOCOPY or "", otherwise a copy
+ *           NULL if out of memory (errno to ENOMEM)
+ */
+
+static const char *cursor_string(ltjson_cursor_t *cur, const char *s)
+{
+    ltjson_info_t *jsoninfo = (ltjson_info_t *)cur->tree;
+
+    if (!s || !*s)
+        return ltjson_empty_name;
+
+    if (cur->flags & LTJSON_CURSOR_NOCOPY)
+        return s;
+
+    return sstore_add(jsoninfo->alloc, &jsoninfo->sstore, s);
+}
+
+
+
+
+/*
+ *  cursor_array(cur, n) - Check a batch of n elements can be added
+ *
+ *  The cursor must be on an array. Nodes for the batch are reserved.
+ *
+ *  Returns 1 if so, 0 if not with errno set (EINVAL, EPERM or ENOMEM)
+ */
+
+static int cursor_array(ltjson_cursor_t *cur, int n)
+{
+    if (!cur || !cur->tree || n < 0)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (cur->parent->ntype != LTJSON_NTYPE_ARRAY)
+    {
+        errno = EPERM;
+        return 0;
+    }
+
+    return reserve_nodes((ltjson_info_t *)cur->tree, n);
+}
+
+
+
+
+/**
+ *  ltjson_cursor_init(cur, tree, parent, flags) - Start building at a node
+ *      @cur:    Cursor to set up
+ *      @tree:   Valid closed tree
+ *      @parent: Object or array of @tree to add to, or NULL for the root
+ *      @flags:  Optional cursor flags
+ *
+ *  Set up @cur to append nodes to @parent, after any it already has.
+ *  This is the only call that checks the tree or walks it.
+ *
+ *  Flags supported are: LTJSON_CURSOR_NOCOPY to keep pointers to the
+ *  string values given rather than copies, so they must last as long
+ *  as the tree does (to be recycled or freed).
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if passed null parameters, tree is not valid and
+ *                     closed or @parent is not in it
+ *              EPERM  if @parent is not an object or array
+ */
+
+int ltjson_cursor_init(ltjson_cursor_t *cur, ltjson_node_t *tree,
+                       ltjson_node_t *parent, int flags)
+{
+    ltjson_node_t *node;
+
+    if (!cur || !is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (!parent)
+        parent = tree;
+
+    for (node = parent; node->ancnode; node = node->ancnode)
+        ;
+
+    if (node != tree)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (parent->ntype != LTJSON_NTYPE_OBJECT &&
+        parent->ntype != LTJSON_NTYPE_ARRAY)
+    {
+        errno = EPERM;
+        return 0;
+    }
+
+    cur->tree = tree;
+    cur->parent = parent;
+    cur->depth = 0;
+    cur->flags = flags;
+
+    for (node = parent->val.subnode; node && node->next; node = node->next)
+        ;
+
+    cur->last = node;
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_cursor_add(cur, ntype, name) - Append a node
+ *      @cur:    Cursor from ltjson_cursor_init
+ *      @ntype:  New node type
+ *      @name:   New node name in an object, NULL in an array
+ *
+ *  Append a node of type @ntype to the cursor's object or array. Its
+ *  value is 0 (false for a bool), "" for a string and empty for an
+ *  object or an array. The typed calls below set the value as well.
+ *
+ *  Returns: Pointer to the new node on success
+ *           NULL on failure with errno set to:
+ *              EINVAL if passed incorrect parameters (no name in an
+ *                     object, or a name in an array)
+ *              ERANGE if ntype out of range for a node
+ *              ENOMEM if out of memory (the tree remains)
+ */
+
+ltjson_node_t *ltjson_cursor_add(ltjson_cursor_t *cur, short int ntype,
+                                 const char *name)
+{
+    ltjson_node_t *newnode;
+
+    if (ntype <= LTJSON_NTYPE_BASENODE || ntype > LTJSON_NTYPE_STRING)
+    {
+        errno = ERANGE;
+        return NULL;
+    }
+
+    if ((newnode = cursor_add(cur, ntype, name)) == NULL)
+        return NULL;
+
+    if (ntype == LTJSON_NTYPE_ARRAY || ntype == LTJSON_NTYPE_OBJECT)
+        newnode->val.subnode = NULL;
+    else if (ntype == LTJSON_NTYPE_FLOAT)
+        newnode->val.d = 0.0;
+    else if (ntype == LTJSON_NTYPE_STRING)
+        newnode->val.s = ltjson_empty_name;
+
+    return newnode;
+}
+
+
+
+
+/**
+ *  ltjson_cursor_addll(cur, name, value) - Append an integer
+ *  ltjson_cursor_adddouble(cur, name, value) - Append a float
+ *  ltjson_cursor_addbool(cur, name, value) - Append a bool
+ *  ltjson_cursor_addstring(cur, name, s) - Append a string
+ *      @cur:    Cursor from ltjson_cursor_init
+ *      @name:   New node name in an object, NULL in an array
+ *      @value:  Value of the new node (a bool is true if not 0)
+ *      @s:      String value of the new node (NULL is "")
+ *
+ *  As ltjson_cursor_add with the node's type and value.
+ *
+ *  Returns: (as ltjson_cursor_add)
+ */
+
+ltjson_node_t *ltjson_cursor_addll(ltjson_cursor_t *cur, const char *name,
+                                   long long value)
+{
+    ltjson_node_t *newnode;
+
+    if ((newnode = cursor_add(cur, LTJSON_NTYPE_INTEGER, name)) != NULL)
+        newnode->val.ll = value;
+
+    return newnode;
+}
+
+
+ltjson_node_t *ltjson_cursor_adddouble(ltjson_cursor_t *cur,
+                                       const char *name, double value)
+{
+    ltjson_node_t *newnode;
+
+    if ((newnode = cursor_add(cur, LTJSON_NTYPE_FLOAT, name)) != NULL)
+        newnode->val.d = value;
+
+    return newnode;
+}
+
+
+ltjson_node_t *ltjson_cursor_addbool(ltjson_cursor_t *cur, const char *name,
+                                     int value)
+{
+    ltjson_node_t *newnode;
+
+    if ((newnode = cursor_add(cur, LTJSON_NTYPE_BOOL, name)) != NULL)
+        newnode->val.ll = value != 0;
+
+    return newnode;
+}
+
+
+ltjson_node_t *ltjson_cursor_addstring(ltjson_cursor_t *cur,
+                                       const char *name, const char *s)
+{
+    ltjson_node_t *newnode;
+    const char *sval;
+
+    if (!cur || !cur->tree)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((cur->parent->ntype == LTJSON_NTYPE_OBJECT) != (name != NULL))
+    {
+        errno = EINVAL;         /* Saves copying s for nothing */
+        return NULL;
+    }
+
+    /* The string first, so a failure adds nothing */
+
+    if ((sval = cursor_string(cur, s)) == NULL)
+        return NULL;
+
+    if ((newnode = cursor_add(cur, LTJSON_NTYPE_STRING, name)) != NULL)
+        newnode->val.s = sval;
+
+    return newnode;
+}
+
+
+
+
+/**
+ *  ltjson_cursor_open(cur, ntype, name) - Append an object or array, go in
+ *      @cur:    Cursor from ltjson_cursor_init
+ *      @ntype:  LTJSON_NTYPE_OBJECT or LTJSON_NTYPE_ARRAY
+ *      @name:   New node name in an object, NULL in an array
+ *
+ *  As ltjson_cursor_add, then the cursor adds to the new node until a
+ *  ltjson_cursor_close.
+ *
+ *  Returns: (as ltjson_cursor_add, ERANGE for any other ntype)
+ */
+
+ltjson_node_t *ltjson_cursor_open(ltjson_cursor_t *cur, short int ntype,
+                                  const char *name)
+{
+    ltjson_node_t *newnode;
+
+    if (ntype != LTJSON_NTYPE_OBJECT && ntype != LTJSON_NTYPE_ARRAY)
+    {
+        errno = ERANGE;
+        return NULL;
+    }
+
+    if ((newnode = cursor_add(cur, ntype, name)) == NULL)
+        return NULL;
+
+    newnode->val.subnode = NULL;
+
+    cur->parent = newnode;
+    cur->last = NULL;
+    cur->depth++;
+
+    return newnode;
+}
+
+
+
+
+/**
+ *  ltjson_cursor_close(cur) - Go back out of an object or array
+ *      @cur:    Cursor from ltjson_cursor_init
+ *
+ *  The cursor adds to where it was before the last ltjson_cursor_open,
+ *  after the node that opened.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if passed null parameters
+ *              EPERM  if nothing is opened (the cursor is where it was
+ *                     set up)
+ */
+
+int ltjson_cursor_close(ltjson_cursor_t *cur)
+{
+    if (!cur || !cur->tree)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (cur->depth == 0)
+    {
+        errno = EPERM;
+        return 0;
+    }
+
+    cur->last = cur->parent;
+    cur->parent = cur->parent->ancnode;
+    cur->depth--;
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_cursor_addlls(cur, values, n) - Append integer elements
+ *  ltjson_cursor_adddoubles(cur, values, n) - Append float elements
+ *  ltjson_cursor_addstrings(cur, strs, n) - Append string elements
+ *      @cur:    Cursor from ltjson_cursor_init, on an array
+ *      @values: Array of @n values
+ *      @strs:   Array of @n strings (NULL ones are "")
+ *      @n:      Number of elements to append
+ *
+ *  Append @n elements to the cursor's array in one go. The nodes (and
+ *  string space for copies) are reserved first, so either all of them
+ *  are added or none.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if passed incorrect parameters
+ *              EPERM  if the cursor isn't on an array
+ *              ENOMEM if out of memory (nothing is added)
+ */
+
+int ltjson_cursor_addlls(ltjson_cursor_t *cur, const long long *values,
+                         int n)
+{
+    int i;
+
+    if (!values && n)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (!cursor_array(cur, n))
+        return 0;
+
+    /* Array elements have no name, so with the nodes reserved these
+       adds can't fail */
+
+    for (i = 0; i < n; i++)
+        cursor_add(cur, LTJSON_NTYPE_INTEGER, NULL)->val.ll = values[i];
+
+    return 1;
+}
+
+
+int ltjson_cursor_adddoubles(ltjson_cursor_t *cur, const double *values,
+                             int n)
+{
+    int i;
+
+    if (!values && n)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (!cursor_array(cur, n))
+        return 0;
+
+    for (i = 0; i < n; i++)
+        cursor_add(cur, LTJSON_NTYPE_FLOAT, NULL)->val.d = values[i];
+
+    return 1;
+}
+
+
+int ltjson_cursor_addstrings(ltjson_cursor_t *cur, const char **strs, int n)
+{
+    ltjson_info_t *jsoninfo;
+    size_t total;
+    int i;
+
+    if (!strs && n)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (!cursor_array(cur, n))
+        return 0;
+
+    jsoninfo = (ltjson_info_t *)cur->tree;
+
+    if (!(cur->flags & LTJSON_CURSOR_NOCOPY))
+    {
+        for (total = 0, i = 0; i < n; i++)
+        {
+            if (strs[i] && *strs[i])
+                total += strlen(strs[i]) + 1;
+        }
+
+        if (total > INT_MAX)
+        {
+            errno = ENOMEM;
+            return 0;
+        }
+
+        if (!sstore_reserve(jsoninfo->alloc, &jsoninfo->sstore, (int)total))
+            return 0;
+    }
+
+    for (i = 0; i < n; i++)
+        cursor_add(cur, LTJSON_NTYPE_STRING, NULL)->val.s =
+            cursor_string(cur, strs[i]);
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_reserve(tree, nnodes, nbytes) - Reserve room for adding to a tree
+ *      @tree:    Valid closed tree
+ *      @nnodes:  Number of nodes to be added
+ *      @nbytes:  Bytes of strings to be added (each with its terminator)
+ *
+ *  Make room so that @nnodes nodes and @nbytes of names and strings can
+ *  be added to the tree (by a cursor or ltjson_addnode_*) without any
+ *  more allocation. That only holds for the names of a tree without a
+ *  hash (or a dictionary) and names already in it: a new name goes into
+ *  the hash, which can grow its table and name store as it takes it.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if tree is not valid and closed, or @nnodes or
+ *                     @nbytes is too big (or @nnodes negative)
+ *              ENOMEM if out of memory
+ */
+
+int ltjson_reserve(ltjson_node_t *tree, int nnodes, size_t nbytes)
+{
+    ltjson_info_t *jsoninfo;
+
+    if (!is_closed_tree(tree) || nnodes < 0 || nnodes == INT_MAX ||
+        nbytes > INT_MAX)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jsoninfo = (ltjson_info_t *)tree;
+
+    if (!reserve_nodes(jsoninfo, nnodes))
+        return 0;
+
+    return sstore_reserve(jsoninfo->alloc, &jsoninfo->sstore, (int)nbytes);
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,714 @@
+/*
+ *  ltclone.c (as include): Copying subtrees and compacting trees
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A copy is made in two walks of the subtree. The first counts the
+    nodes and the bytes of strings so they can be reserved (a new tree
+    then gets one node set and one string block that just fit) and the
+    second copies the nodes in document order. Strings and raw numbers
+    are copied into the string store, whatever the source tree keeps
+    them in (so a copy of an in situ or mapped tree stands alone).
+    Names go through nhash_insert as for a parse, so two trees with
+    the same dictionary share its names instead of copying them.
+
+    ltjson_compact is a copy of a tree over itself: the tree's storage
+    is swapped out for storage that just fits, everything under the
+    root is copied into it and what was swapped out is freed.
+*/
+
+
+
+
+/*
+ *  clone_src(node) - The tree of a node to copy from
+ *
+ *  Returns the tree, or NULL (errno to EINVAL) if it isn't closed
+ */
+
+static ltjson_node_t *clone_src(ltjson_node_t *node)
+{
+    ltjson_node_t *tree;
+
+    if (!node)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (tree = node; tree->ancnode; tree = tree->ancnode)
+        ;
+
+    if (!is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return tree;
+}
+
+
+
+
+/*
+ *  clone_count(src, nnodesp, nbytesp, nnamesp) - Size up a copy of src
+ *
+ *  The bytes of the names are counted apart (in *nnamesp) since they
+ *  only take string store space in a tree without a hash.
+ *
+ *  Returns 1 if it fits the counts (which are ints), 0 (errno EINVAL)
+ *  if it doesn't
+ */
+
+static int clone_count(ltjson_node_t *src, int *nnodesp, int *nbytesp,
+                       int *nnamesp)
+{
+    ltjson_node_t *node = src;
+    size_t nnodes = 0, nbytes = 0, nnames = 0;
+
+    while (node)
+    {
+        nnodes++;
+
+        if (node->name && *node->name)
+            nnames += strlen(node->name) + 1;
+
+        if (node->ntype == LTJSON_NTYPE_STRING && *node->val.s)
+            nbytes += strlen(node->val.s) + 1;
+        else if (node->ntype == LTJSON_NTYPE_NUMRAW)
+            nbytes += RAWNUM_CACHE + strlen(node->val.s) + 1;
+
+        if (node->ntype != LTJSON_NTYPE_ARRAY &&
+            node->ntype != LTJSON_NTYPE_OBJECT)
+        {
+            if (node == src)
+                break;      /* traverse_tree_nodes would go past it */
+        }
+
+        node = traverse_tree_nodes(node, src);
+    }
+
+    if (nnodes >= INT_MAX || nbytes + nnames > INT_MAX)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    *nnodesp = (int)nnodes;
+    *nbytesp = (int)nbytes;
+    *nnamesp = (int)nnames;
+    return 1;
+}
+
+
+
+
+/*
+ *  clone_node(jsoninfo, src, copy, name) - Copy src's name and value
+ *
+ *  copy is a node of jsoninfo's tree, given name (or none if NULL). An
+ *  object or array is copied empty.
+ *
+ *  Returns 1 on success, 0 if out of memory (errno to ENOMEM)
+ */
+
+static int clone_node(ltjson_info_t *jsoninfo, const ltjson_node_t *src,
+                      ltjson_node_t *copy, const char *name)
+{
+    char *raw;
+    int len;
+
+    copy->ntype = src->ntype;
+    copy->nflags = src->nflags & (JSONNODE_NFLAGS_RAWLL |
+                                  JSONNODE_NFLAGS_RAWD);
+
+    if (name)
+    {
+        copy->name = nhash_insert(jsoninfo, name, &copy->namehash);
+        if (!copy->name)
+            return 0;
+    }
+
+    switch (src->ntype)
+    {
+        case LTJSON_NTYPE_ARRAY:
+        case LTJSON_NTYPE_OBJECT:
+            copy->val.subnode = NULL;
+        break;
+
+        case LTJSON_NTYPE_STRING:
+            if (!*src->val.s)
+                copy->val.s = ltjson_empty_name;
+            else if ((copy->val.s = sstore_add(jsoninfo->alloc,
+                                               &jsoninfo->sstore,
+                                               src->val.s)) == NULL)
+                return 0;
+        break;
+
+        case LTJSON_NTYPE_NUMRAW:
+        {
+            /* With the cached value in front of it */
+
+            len = strlen(src->val.s);
+            raw = sstore_space(jsoninfo->alloc, &jsoninfo->sstore,
+                               (int)RAWNUM_CACHE + len);
+            if (!raw)
+                return 0;
+
+            memcpy(raw, src->val.s - RAWNUM_CACHE, RAWNUM_CACHE + len + 1);
+            copy->val.s = raw + RAWNUM_CACHE;
+        }
+        break;
+
+        default:
+            copy->val = src->val;
+        break;
+    }
+
+    return 1;
+}
+
+
+
+
+/*
+ *  clone_under(jsoninfo, src, copy) - Copy what's under src to copy
+ *
+ *  copy is the copy of src (by clone_node) in jsoninfo's tree. Nodes
+ *  are copied in document order, down, along and back up as
+ *  traverse_tree_nodes goes, with the copy followed along in step. src
+ *  and copy can be the same node (a tree copied over itself) as the
+ *  value of src is read before that of copy is set.
+ *
+ *  Returns 1 on success, 0 if out of memory (errno to ENOMEM) with the
+ *  copy part done
+ */
+
+static int clone_under(ltjson_info_t *jsoninfo, const ltjson_node_t *src,
+                       ltjson_node_t *copy)
+{
+    const ltjson_node_t *snode;
+    ltjson_node_t *cnode, *newnode;
+
+    if ((src->ntype != LTJSON_NTYPE_ARRAY &&
+         src->ntype != LTJSON_NTYPE_OBJECT) || !src->val.subnode)
+        return 1;
+
+    if ((newnode = get_new_node(jsoninfo)) == NULL)
+        return 0;
+
+    snode = src->val.subnode;
+    copy->val.subnode = newnode;
+    newnode->ancnode = copy;
+    cnode = newnode;
+
+    for (;;)
+    {
+        if (!clone_node(jsoninfo, snode, cnode, snode->name))
+            return 0;
+
+        if ((snode->ntype == LTJSON_NTYPE_ARRAY ||
+             snode->ntype == LTJSON_NTYPE_OBJECT) && snode->val.subnode)
+        {
+            /* Down */
+
+            if ((newnode = get_new_node(jsoninfo)) == NULL)
+                return 0;
+
+            snode = snode->val.subnode;
+            cnode->val.subnode = newnode;
+            newnode->ancnode = cnode;
+            cnode = newnode;
+            continue;
+        }
+
+        while (!snode->next)
+        {
+            /* Up */
+
+            snode = snode->ancnode;
+            cnode = cnode->ancnode;
+
+            if (snode == src)
+                return 1;
+        }
+
+        /* Along */
+
+        if ((newnode = get_new_node(jsoninfo)) == NULL)
+            return 0;
+
+        snode = snode->next;
+        cnode->next = newnode;
+        newnode->ancnode = cnode->ancnode;
+        cnode = newnode;
+    }
+}
+
+
+
+
+/**
+ *  ltjson_clone(treeptr, src, flags) - Copy a subtree into a tree of its own
+ *      @treeptr:   Pointer to json tree root
+ *      @src:       Object or array node of a closed tree
+ *      @flags:     LTJSON_PARSE_* flags for a new or recycled tree
+ *
+ *  As if the text of @src was parsed into @*treeptr: if NULL a new tree
+ *  is created, otherwise it must not be open and it's recycled. @src
+ *  is the root of the copy (without its name, if it had one). Nothing
+ *  of the copy refers back to the tree of @src.
+ *
+ *  A new tree has the nodes in one node set, in document order, and
+ *  the strings in one block.
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if invalid tree, or @src is not in a closed tree
+ *                     (or is in @*treeptr itself)
+ *              EPERM  if @src is not an object or array
+ *              EBUSY  if the tree is open
+ *              ENOMEM if out of memory
+ *            On ENOMEM, all storage will be freed and *treeptr is set
+ *            to NULL
+ */
+
+int ltjson_clone(ltjson_node_t **treeptr, ltjson_node_t *src, int flags)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *srctree;
+    int nnodes, nbytes, nnames;
+
+    if (!treeptr || (*treeptr && !is_valid_tree(*treeptr)))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if ((srctree = clone_src(src)) == NULL)
+        return 0;
+
+    if (srctree == *treeptr)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (src->ntype != LTJSON_NTYPE_ARRAY && src->ntype != LTJSON_NTYPE_OBJECT)
+    {
+        errno = EPERM;
+        return 0;
+    }
+
+    if (*treeptr && ((ltjson_info_t *)(*treeptr))->open)
+    {
+        errno = EBUSY;
+        return 0;
+    }
+
+    if (!clone_count(src, &nnodes, &nbytes, &nnames))
+        return 0;
+
+    if ((jsoninfo = start_tree(treeptr, flags)) == NULL)
+        return 0;
+
+    if (!nhash_ishashed(jsoninfo))
+        nbytes += nnames;
+
+    if (!reserve_nodes(jsoninfo, nnodes - 1) ||
+        !sstore_reserve(jsoninfo->alloc, &jsoninfo->sstore, nbytes) ||
+        !clone_node(jsoninfo, src, jsoninfo->root, NULL) ||
+        !clone_under(jsoninfo, src, jsoninfo->root))
+    {
+        destroy_tree(jsoninfo);
+        *treeptr = NULL;
+        errno = ENOMEM;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_graft(tree, under, src, name) - Copy a subtree into a tree
+ *      @tree:   Valid closed tree
+ *      @under:  Object or array node of @tree to add the copy to
+ *      @src:    Node of a closed tree (which may be @tree) to copy
+ *      @name:   Name of the copy in an object, NULL for the name of @src
+ *
+ *  Add a copy of @src and everything under it to the end of @under.
+ *  All the room for the copy is reserved first. The copy is only added
+ *  once it's complete, so @under may be within @src.
+ *
+ *  Returns: Pointer to the copy on success
+ *           NULL on failure with errno is set to:
+ *              EINVAL if passed incorrect parameters (a copy added to an
+ *                     object needs a name) or either tree isn't closed
+ *              EPERM  if @under is not an object or array
+ *              ENOMEM if out of memory (tree remains, without the copy)
+ */
+
+ltjson_node_t *ltjson_graft(ltjson_node_t *tree, ltjson_node_t *under,
+                            ltjson_node_t *src, const char *name)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *node, *copy;
+    int nnodes, nbytes, nnames;
+
+    if (!is_closed_tree(tree) || !under || !clone_src(src))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (node = under; node->ancnode; node = node->ancnode)
+        ;
+
+    if (node != tree)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (under->ntype != LTJSON_NTYPE_OBJECT &&
+        under->ntype != LTJSON_NTYPE_ARRAY)
+    {
+        errno = EPERM;
+        return NULL;
+    }
+
+    if (under->ntype == LTJSON_NTYPE_ARRAY)
+        name = NULL;
+    else if (!name && !(name = src->name))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    jsoninfo = (ltjson_info_t *)tree;
+
+    if (!clone_count(src, &nnodes, &nbytes, &nnames))
+        return NULL;
+
+    if (!nhash_ishashed(jsoninfo))
+        nbytes += nnames;
+
+    if (!reserve_nodes(jsoninfo, nnodes) ||
+        !sstore_reserve(jsoninfo->alloc, &jsoninfo->sstore, nbytes) ||
+        (copy = get_new_node(jsoninfo)) == NULL ||
+        !clone_node(jsoninfo, src, copy, name) ||
+        !clone_under(jsoninfo, src, copy))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Complete. Link it in at the end */
+
+    copy->ancnode = under;
+
+    if ((node = under->val.subnode) == NULL)
+        under->val.subnode = copy;
+    else
+    {
+        while (node->next)
+            node = node->next;
+
+        node->next = copy;
+    }
+
+    if (under->ntype == LTJSON_NTYPE_OBJECT)
+        mindex_added(jsoninfo, under, copy);
+
+    nindex_free(jsoninfo);
+    return copy;
+}
+
+
+
+
+/**
+ *  ltjson_detach(tree, node) - Take a node out of a tree
+ *      @tree:   Valid closed tree
+ *      @node:   Node of @tree (not the root) to take out
+ *
+ *  Unlink @node (and everything under it) from the object or array it
+ *  is in. Its storage stays with the tree until it's recycled or freed
+ *  and, until then, @node can still be a @src for ltjson_clone or
+ *  ltjson_graft as it still refers up to where it was.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if passed incorrect parameters, tree isn't closed
+ *                     or @node is not in it
+ */
+
+int ltjson_detach(ltjson_node_t *tree, ltjson_node_t *node)
+{
+    ltjson_node_t *parent, *prev, *root;
+
+    if (!node || !is_closed_tree(tree) || !node->ancnode)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (root = node; root->ancnode; root = root->ancnode)
+        ;
+
+    if (root != tree)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    parent = node->ancnode;
+    prev = NULL;
+
+    if (parent->val.subnode != node)
+    {
+        for (prev = parent->val.subnode; prev; prev = prev->next)
+        {
+            if (prev->next == node)
+                break;
+        }
+
+        if (!prev)
+        {
+            errno = EINVAL;     /* Detached already */
+            return 0;
+        }
+    }
+
+    /* Drop the index while node is still a member, so its entry goes */
+
+    if (parent->ntype == LTJSON_NTYPE_OBJECT)
+        mindex_drop((ltjson_info_t *)tree, parent);
+
+    if (prev)
+        prev->next = node->next;
+    else
+        parent->val.subnode = node->next;
+
+    node->next = NULL;
+
+    nindex_free((ltjson_info_t *)tree);
+    return 1;
+}
+
+
+
+
+/*
+ *  compact_index(jsoninfo) - Index every wide object of a tree
+ *
+ *  For a LTJSON_PARSE_MEMBERINDEX tree just compacted (so it has no
+ *  member index), with the table sized once for all the entries. On
+ *  running out of memory objects are left unindexed.
+ */
+
+static void compact_index(ltjson_info_t *jsoninfo)
+{
+    ltjson_node_t *root = jsoninfo->root, *node, *member;
+    int pass, nmembers, nlive = 0;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (node = root; node; node = nindex_next(node, root))
+        {
+            if (node->ntype != LTJSON_NTYPE_OBJECT)
+                continue;
+
+            nmembers = 0;
+
+            for (member = node->val.subnode; member; member = member->next)
+                nmembers++;
+
+            if (nmembers < MINDEX_MIN_MEMBERS)
+                continue;
+
+            if (!pass)
+                nlive += nmembers;
+            else if (!mindex_build(jsoninfo, node))
+                return;
+        }
+
+        if (!pass && (!nlive || !mindex_rebuild(jsoninfo, nlive)))
+            return;
+    }
+}
+
+
+
+
+/**
+ *  ltjson_compact(tree) - Repack a tree into storage that just fits it
+ *      @tree:   Valid closed tree
+ *
+ *  Copy every node of @tree, in document order, into one node set and
+ *  every string into one block, then free all the storage it had
+ *  before (with what a parse leaves over for a next one). A hash table
+ *  is rebuilt with only the names the tree has. Strings of an in situ
+ *  parse are copied so the text (or a mapped file) is no longer used.
+ *
+ *  The root stays where it is but every other node of @tree moves, so
+ *  no node pointer got before is good after. A name index is built
+ *  again, as is a member index (for every object wide enough to have
+ *  one, not only those looked up) if the tree was parsed with
+ *  LTJSON_PARSE_MEMBERINDEX. Memory from an arena can't be used again,
+ *  so a tree in one is left as it is.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if tree isn't valid and closed
+ *              ENOMEM if out of memory (the tree is left as it was)
+ */
+
+int ltjson_compact(ltjson_node_t *tree)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *root, *cbasenode, *subnode;
+    struct nhash nhash;
+    void *sstore;
+    int nnodes, nbytes, nnames, nhits, nmisses, used, hadnindex, i;
+
+    if (!is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jsoninfo = (ltjson_info_t *)tree;
+    root = jsoninfo->root;
+
+    if (!mem_canfree(jsoninfo->alloc))
+        return 1;
+
+    if (!clone_count(root, &nnodes, &nbytes, &nnames))
+        return 0;
+
+    /* Swap the storage out for new */
+
+    cbasenode = jsoninfo->cbasenode;
+    sstore = jsoninfo->sstore;
+    nhash = jsoninfo->nhash;
+    nhits = jsoninfo->nh_nhits;
+    nmisses = jsoninfo->nh_nmisses;
+    subnode = root->val.subnode;
+
+    jsoninfo->cbasenode = 0;
+    jsoninfo->sstore = sstore_new();
+
+    if (nhash.tab)
+    {
+        /* The names in the old table are all (if not only) those of
+           the tree that aren't in a dictionary */
+
+        sstore_stats(&nhash.sstore, 0, 0, &used);
+        if (used < nnames)
+            nnames = used;
+
+        jsoninfo->nhash.tab = 0;
+        jsoninfo->nhash.sstore = 0;
+
+        if (!nhash_init(&jsoninfo->nhash))
+            goto nomem;
+
+        if (!sstore_fit(jsoninfo->alloc, &jsoninfo->nhash.sstore, nnames))
+            goto nomem;
+    }
+    else if (!jsoninfo->dict)
+    {
+        nbytes += nnames;
+    }
+
+    if (!reserve_nodes(jsoninfo, nnodes - 1) ||
+        !sstore_fit(jsoninfo->alloc, &jsoninfo->sstore, nbytes) ||
+        !clone_under(jsoninfo, root, root))
+        goto nomem;
+
+    jsoninfo->nh_nhits = nhits;
+    jsoninfo->nh_nmisses = nmisses;
+
+    /* Free the old, and all that's only there for a next parse */
+
+    free_nodes(jsoninfo->alloc, cbasenode);
+    sstore_free(jsoninfo->alloc, &sstore);
+
+    if (nhash.tab)
+        nhash_release(&nhash);
+
+    mem_free(jsoninfo->alloc, jsoninfo->workstr);
+    jsoninfo->workstr = NULL;
+    jsoninfo->workalloc = 0;
+    jsoninfo->freenodes = 0;
+
+    file_unmap(jsoninfo->map, jsoninfo->mapsize);
+    jsoninfo->map = 0;
+    jsoninfo->mapsize = 0;
+
+    if (jsoninfo->parts)
+    {
+        for (i = 0; i < LTJSON_BATCH_MAXTHREADS; i++)
+            destroy_tree((ltjson_info_t *)jsoninfo->parts[i]);
+
+        mem_free(jsoninfo->alloc, jsoninfo->parts);
+        jsoninfo->parts = 0;
+    }
+
+    /* Then the indexes of the nodes that were */
+
+    hadnindex = jsoninfo->nindex != NULL;
+
+    nindex_free(jsoninfo);
+    mindex_free(jsoninfo);
+    root->nflags &= ~JSONNODE_NFLAGS_INDEXED;
+
+    if (jsoninfo->pflags & LTJSON_PARSE_MEMBERINDEX)
+        compact_index(jsoninfo);
+
+    if (hadnindex)
+        nindex_build(jsoninfo);         /* Fine if it fails */
+
+    return 1;
+
+nomem:
+    free_nodes(jsoninfo->alloc, jsoninfo->cbasenode);
+    sstore_free(jsoninfo->alloc, &jsoninfo->sstore);
+
+    /* The new table, or one the copy started (a frozen dictionary's
+       miss) for a tree that had none */
+
+    if (jsoninfo->nhash.tab != nhash.tab)
+        nhash_release(&jsoninfo->nhash);
+
+    jsoninfo->cbasenode = cbasenode;
+    jsoninfo->sstore = sstore;
+    jsoninfo->nhash = nhash;
+    jsoninfo->nh_nhits = nhits;
+    jsoninfo->nh_nmisses = nmisses;
+    root->val.subnode = subnode;
+
+    errno = ENOMEM;
+    return 0;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,146 @@
+/*
+ *  ltcount.c (as include): Counting the work done on a tree
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  Built with LTJSON_COUNTERS, each tree has an ltjson_counters_t (in
+    .counters) that parsing and searching add to, which is copied out
+    by ltjson_getcounters. The counters last as long as the tree does,
+    recycling doesn't clear them. Without LTJSON_COUNTERS, COUNT_ADD
+    is nothing at all and neither is .counters.
+
+    Times are from a monotonic clock where there is one (clock_gettime
+    with CLOCK_MONOTONIC where the headers declare it, or the
+    performance counter under Windows) and from clock() otherwise.
+*/
+
+#ifdef LTJSON_COUNTERS
+
+#if defined(_WIN32)
+  #include <windows.h>
+  #define COUNT_QPC
+#else
+  #include <time.h>
+#endif
+
+#define COUNT_ADD(jsoninfo, counter, n)  ((jsoninfo)->counters.counter += (n))
+
+
+
+
+/*
+ *  count_now() - Get the time in ns since some start
+ */
+
+static unsigned long long count_now(void)
+{
+#if defined(COUNT_QPC)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+
+    return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000000ULL
+         + (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000000ULL
+         / (unsigned long long)freq.QuadPart;
+
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL +
+           (unsigned long long)ts.tv_nsec;
+
+#else
+    return (unsigned long long)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+
+
+
+/*
+ *  count_call(ncalls, ns, start) - Count a call that started at start
+ *
+ *  errno is left as it was.
+ */
+
+static void count_call(unsigned long long *ncalls, unsigned long long *ns,
+                       unsigned long long start)
+{
+    int saved = errno;
+
+    (*ncalls)++;
+    *ns += count_now() - start;
+
+    errno = saved;
+}
+
+
+
+
+/*
+ *  count_tree(node) - Get the jsoninfo of the tree a node is in
+ *
+ *  Returns: jsoninfo or NULL if node is not in a valid tree
+ */
+
+static ltjson_info_t *count_tree(ltjson_node_t *node)
+{
+    if (!node)
+        return NULL;
+
+    while (node->ancnode)
+        node = node->ancnode;
+
+    if (node->name || (node->ntype != LTJSON_NTYPE_OBJECT &&
+                       node->ntype != LTJSON_NTYPE_ARRAY))
+        return NULL;
+
+    return (ltjson_info_t *)node;
+}
+
+
+
+
+/*
+ *  count_merge(jsoninfo, from) - Move the counters of from to jsoninfo
+ *
+ *  For the part trees of a parallel parse, which can be freed at any
+ *  parse, to keep the tree's counters from going backwards.
+ */
+
+static void count_merge(ltjson_info_t *jsoninfo, ltjson_info_t *from)
+{
+    ltjson_counters_t *to = &jsoninfo->counters, *c = &from->counters;
+
+    to->nodes += c->nodes;
+    to->nodesets += c->nodesets;
+    to->nodereuses += c->nodereuses;
+    to->workgrows += c->workgrows;
+    to->resumes += c->resumes;
+
+    memset(c, 0, sizeof(ltjson_counters_t));
+}
+
+#else
+
+#define COUNT_ADD(jsoninfo, counter, n)  ((void)0)
+
+#endif  /* LTJSON_COUNTERS */
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
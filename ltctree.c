@@ -0,0 +1,1224 @@
+/*
+ *  ltctree.c (as include): Compact read-only trees
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A compact tree (ltjson_ctree_new) is a copy of a closed tree, or of
+    a subtree, in one allocation: the info structure, an array of
+    struct ctnode in document order and the strings. Nodes link to each
+    other by 32-bit index and to their names and strings by offset, so
+    a node is 24 bytes rather than the 40 of an ltjson_node_t (on LP64).
+
+    Being in document order, the first member or element of an object
+    or array is the node after it and .end, the index following all of
+    the node's subtree, is its next sibling unless that is past the end
+    of its parent. There is no need for a next or subnode link.
+
+    Member names that repeat (arrays of records) are only stored once
+    while there is room for them in a small table used while copying
+    (see ctree_addname in lttape.c).
+*/
+
+
+/*
+ *  ctree_node(ctree, index) - Get node index of ctree, if it's valid
+ *
+ *  Returns the node or NULL (errno to EINVAL)
+ */
+
+static const struct ctnode *ctree_node(const ltjson_ctree_t *ctree,
+                                       int index)
+{
+    if (!ctree || index < 0 || (unsigned int)index >= ctree->nnodes)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &ctree->nodes[index];
+}
+
+
+
+
+/*
+ *  ctree_next(ctree, index) - Index of the node after index's subtree
+ *  in the same object or array, CTREE_NONE if it was the last
+ */
+
+static unsigned int ctree_next(const ltjson_ctree_t *ctree,
+                               unsigned int index)
+{
+    const struct ctnode *ctnode = &ctree->nodes[index];
+
+    if (ctnode->up == CTREE_NONE ||
+        ctnode->end >= ctree->nodes[ctnode->up].end)
+        return CTREE_NONE;
+
+    return ctnode->end;
+}
+
+
+
+
+/*
+ *  ctree_rawnumber(ctree, ctnode, num) - Convert a raw number into num
+ *
+ *  A compact tree is read-only, so the value isn't kept
+ *
+ *  Returns 1 on success, 0 if out of range for a double (errno to ERANGE)
+ */
+
+static int ctree_rawnumber(const ltjson_ctree_t *ctree,
+                           const struct ctnode *ctnode, ltjson_node_t *num)
+{
+    const char *raw = ctree->strs + ctnode->val.s;
+
+    if (!convert_to_number(raw, strlen(raw), num))
+    {
+        errno = ERANGE;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+
+
+/*
+ *  ctree_measure(rnode, nnodes, nbytes) - Count rnode's nodes and the
+ *  bytes needed for their names and strings
+ *
+ *  Returns 1 on success, 0 if too big for 32 bits (errno to ERANGE)
+ */
+
+static int ctree_measure(ltjson_node_t *rnode, unsigned int *nnodes,
+                         size_t *nbytes)
+{
+    ltjson_node_t *node;
+    size_t count, bytes;
+
+    count = bytes = 0;
+    node = rnode;
+
+    for (;;)
+    {
+        count++;
+
+        if (node->name)
+            bytes += strlen(node->name) + 1;
+
+        if (node->ntype == LTJSON_NTYPE_STRING ||
+            node->ntype == LTJSON_NTYPE_NUMRAW)
+            bytes += strlen(node->val.s) + 1;
+
+        if ((node->ntype == LTJSON_NTYPE_OBJECT ||
+             node->ntype == LTJSON_NTYPE_ARRAY) && node->val.subnode)
+        {
+            node = node->val.subnode;
+            continue;
+        }
+
+        while (node != rnode && !node->next)
+            node = node->ancnode;
+
+        if (node == rnode)
+            break;
+
+        node = node->next;
+    }
+
+    if (count > INT_MAX || bytes >= CTREE_NONE)
+    {
+        errno = ERANGE;
+        return 0;
+    }
+
+    *nnodes = (unsigned int)count;
+    *nbytes = bytes;
+    return 1;
+}
+
+
+
+
+/*
+ *  ctree_copy(ctree, rnode) - Copy rnode and its subtree into ctree
+ *
+ *  ctree has room for the nodes and strings (see ctree_measure)
+ */
+
+static void ctree_copy(ltjson_ctree_t *ctree, ltjson_node_t *rnode)
+{
+    unsigned int names[CTREE_NAMESLOTS];
+    unsigned int index, up;
+    struct ctnode *ctnode;
+    ltjson_node_t *node;
+    int nnames = 0;
+
+    memset(names, 0, sizeof(names));
+
+    node = rnode;
+    up = CTREE_NONE;
+    index = 0;
+
+    for (;;)
+    {
+        ctnode = &ctree->nodes[index];
+
+        ctnode->name = node->name ? ctree_addname(ctree, names, &nnames,
+                                                  node->name)
+                                  : CTREE_NONE;
+        ctnode->up = up;
+        ctnode->end = index + 1;
+        ctnode->ntype = node->ntype;
+        ctnode->nflags = 0;
+
+        switch (node->ntype)
+        {
+            case LTJSON_NTYPE_STRING:
+            case LTJSON_NTYPE_NUMRAW:
+                ctnode->val.s = ctree_addstr(ctree, node->val.s);
+            break;
+
+            case LTJSON_NTYPE_FLOAT:
+                ctnode->val.d = node->val.d;
+            break;
+
+            case LTJSON_NTYPE_BOOL:
+            case LTJSON_NTYPE_INTEGER:
+                ctnode->val.ll = node->val.ll;
+            break;
+
+            case LTJSON_NTYPE_OBJECT:
+            case LTJSON_NTYPE_ARRAY:
+                ctnode->val.ll = 0;       /* .count of 0 */
+            break;
+
+            default:
+                ctnode->ntype = LTJSON_NTYPE_NULL;
+                ctnode->val.ll = 0;
+        }
+
+        if (up != CTREE_NONE)
+            ctree->nodes[up].val.count++;
+
+        index++;
+
+        if ((node->ntype == LTJSON_NTYPE_OBJECT ||
+             node->ntype == LTJSON_NTYPE_ARRAY) && node->val.subnode)
+        {
+            up = index - 1;
+            node = node->val.subnode;
+            continue;
+        }
+
+        /* Close every object or array that node was the last of */
+
+        while (node != rnode && !node->next)
+        {
+            node = node->ancnode;
+            ctree->nodes[up].end = index;
+            up = ctree->nodes[up].up;
+        }
+
+        if (node == rnode)
+            break;
+
+        node = node->next;
+    }
+
+    ctree->nnodes = index;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_new(rnode) - Make a compact read-only copy of a subtree
+ *      @rnode:     Node to copy (the tree root or any node in it)
+ *
+ *  @rnode and everything under it is copied into a single allocation
+ *  with nodes of 24 bytes (on LP64) that link by 32-bit index. The
+ *  tree must be valid and closed but can be freed or recycled once
+ *  the copy is made.
+ *
+ *  The nodes are numbered in document order from 0, the copy of
+ *  @rnode, and are read with the ltjson_ctree_*() functions. Member
+ *  names are kept, so a copy of the "b" member of an object is an
+ *  index 0 node named "b".
+ *
+ *  Returns: Pointer to the compact tree on success
+ *           NULL on failure with errno set to:
+ *              EINVAL if the tree is not valid/closed
+ *              ERANGE if it has too many nodes or strings for 32 bits
+ *              ENOMEM if out of memory
+ */
+
+ltjson_ctree_t *ltjson_ctree_new(ltjson_node_t *rnode)
+{
+    ltjson_ctree_t *ctree, *shrunk;
+    unsigned int nnodes;
+    size_t nbytes, size;
+
+    if (!write_checknode(rnode))
+        return NULL;
+
+    if (!ctree_measure(rnode, &nnodes, &nbytes))
+        return NULL;
+
+    size = sizeof(ltjson_ctree_t) + nnodes * sizeof(struct ctnode) + nbytes;
+
+    if ((ctree = malloc(size)) == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ctree->nodes = (struct ctnode *)(ctree + 1);
+    ctree->strs = (char *)(ctree->nodes + nnodes);
+    ctree->strsize = 0;
+
+    ctree_copy(ctree, rnode);
+
+    /* Give back what the shared names saved */
+
+    if (ctree->strsize < nbytes)
+    {
+        size -= nbytes - ctree->strsize;
+
+        if ((shrunk = realloc(ctree, size)) != NULL)
+        {
+            ctree = shrunk;
+            ctree->nodes = (struct ctnode *)(ctree + 1);
+            ctree->strs = (char *)(ctree->nodes + nnodes);
+        }
+    }
+
+    return ctree;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_free(ctreep) - Free a compact tree
+ *      @ctreep:    Pointer to valid compact tree
+ *
+ *  Returns:    1 on success, writing NULL to *ctreep
+ *              0 and errno set to EINVAL if compact tree is not valid
+ */
+
+int ltjson_ctree_free(ltjson_ctree_t **ctreep)
+{
+    if (!ctreep || !*ctreep)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    free(*ctreep);
+
+    *ctreep = NULL;
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_ntype(ctree, index) - Get the type of a compact node
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index (0 for the root)
+ *
+ *  Returns: The node's LTJSON_NTYPE_*
+ *           -1 if the tree or index is not valid (errno to EINVAL)
+ */
+
+int ltjson_ctree_ntype(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return -1;
+
+    return ctnode->ntype;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_name(ctree, index) - Get the member name of a node
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  Returns: The name or NULL if the node isn't an object member
+ *           NULL if the tree or index is not valid (errno to EINVAL)
+ */
+
+const char *ltjson_ctree_name(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return NULL;
+
+    if (ctnode->name == CTREE_NONE)
+        return NULL;
+
+    return ctree->strs + ctnode->name;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_next(ctree, index) - Get the next member or element
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  As node->next for an ltjson_node_t
+ *
+ *  Returns: Index of the node after @index in its object or array
+ *           -1 if it's the last (or the root) or errno to EINVAL if the
+ *           tree or index is not valid
+ */
+
+int ltjson_ctree_next(const ltjson_ctree_t *ctree, int index)
+{
+    unsigned int next;
+
+    if (!ctree_node(ctree, index))
+        return -1;
+
+    next = ctree_next(ctree, index);
+
+    return next == CTREE_NONE ? -1 : (int)next;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_subnode(ctree, index) - Get the first member or element
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index of an object or array
+ *
+ *  As node->val.subnode for an ltjson_node_t
+ *
+ *  Returns: Index of the first node in the object or array
+ *           -1 if it's empty or not an object or array, or errno to
+ *           EINVAL if the tree or index is not valid
+ */
+
+int ltjson_ctree_subnode(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return -1;
+
+    if (ctnode->end == (unsigned int)index + 1)
+        return -1;
+
+    return index + 1;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_ancnode(ctree, index) - Get the object or array of a node
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  As node->ancnode for an ltjson_node_t
+ *
+ *  Returns: Index of the object or array that @index is in
+ *           -1 for the root or errno to EINVAL if the tree or index is
+ *           not valid
+ */
+
+int ltjson_ctree_ancnode(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return -1;
+
+    return ctnode->up == CTREE_NONE ? -1 : (int)ctnode->up;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_count(ctree, index) - Number of members or elements
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  Returns: The number of members (object) or elements (array) of
+ *           @index, 0 for any other node
+ *           -1 if the tree or index is not valid (errno to EINVAL)
+ */
+
+int ltjson_ctree_count(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return -1;
+
+    if (ctnode->ntype != LTJSON_NTYPE_OBJECT &&
+        ctnode->ntype != LTJSON_NTYPE_ARRAY)
+        return 0;
+
+    return (int)ctnode->val.count;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_ll(ctree, index) - Get an integer or boolean value
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  A raw number (LTJSON_NTYPE_NUMRAW) is converted on each call.
+ *
+ *  Returns: The value of an integer node (or a raw number that is an
+ *           integer), 1 or 0 for a boolean and 0 for any other node or
+ *           if @ctree or @index is not valid (errno to EINVAL)
+ */
+
+long long ltjson_ctree_ll(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+    ltjson_node_t num;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return 0;
+
+    if (ctnode->ntype == LTJSON_NTYPE_NUMRAW)
+    {
+        if (!ctree_rawnumber(ctree, ctnode, &num) ||
+            num.ntype != LTJSON_NTYPE_INTEGER)
+            return 0;
+
+        return num.val.ll;
+    }
+
+    if (ctnode->ntype != LTJSON_NTYPE_INTEGER &&
+        ctnode->ntype != LTJSON_NTYPE_BOOL)
+        return 0;
+
+    return ctnode->val.ll;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_d(ctree, index) - Get a number as a double
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  A raw number (LTJSON_NTYPE_NUMRAW) is converted on each call.
+ *
+ *  Returns: The value of a float node, an integer node's value as a
+ *           double (either of them raw numbers or not) and 0 for any
+ *           other node or if @ctree or @index is not valid (errno to
+ *           EINVAL)
+ */
+
+double ltjson_ctree_d(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+    ltjson_node_t num;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return 0;
+
+    if (ctnode->ntype == LTJSON_NTYPE_NUMRAW)
+    {
+        if (!ctree_rawnumber(ctree, ctnode, &num))
+            return 0;
+
+        if (num.ntype == LTJSON_NTYPE_INTEGER)
+            return (double)num.val.ll;
+
+        return num.val.d;
+    }
+
+    if (ctnode->ntype == LTJSON_NTYPE_FLOAT)
+        return ctnode->val.d;
+
+    if (ctnode->ntype == LTJSON_NTYPE_INTEGER)
+        return (double)ctnode->val.ll;
+
+    return 0;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_s(ctree, index) - Get a string value
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  Returns: The string of a string node or NULL for any other node or
+ *           if @ctree or @index is not valid (errno to EINVAL)
+ */
+
+const char *ltjson_ctree_s(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return NULL;
+
+    if (ctnode->ntype != LTJSON_NTYPE_STRING)
+        return NULL;
+
+    return ctree->strs + ctnode->val.s;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_member(ctree, index, name) - Retrieve object member
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index of an object
+ *      @name:      Member name
+ *
+ *  As ltjson_get_member() without the flags: the members are checked
+ *  in order, stepping over each one's subtree in one go.
+ *
+ *  Returns: Index of the first member called @name
+ *           -1 if there is none or errno to EINVAL if an argument is not
+ *           valid
+ */
+
+int ltjson_ctree_member(const ltjson_ctree_t *ctree, int index,
+                        const char *name)
+{
+    const struct ctnode *ctnode;
+    unsigned int member;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return -1;
+
+    if (!name || ctnode->ntype != LTJSON_NTYPE_OBJECT)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (member = index + 1; member < ctnode->end;
+         member = ctree->nodes[member].end)
+    {
+        if (ctree->nodes[member].name != CTREE_NONE &&
+            strcmp(ctree->strs + ctree->nodes[member].name, name) == 0)
+            return (int)member;
+    }
+
+    return -1;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_search(ctree, name, from) - Search compact tree for name
+ *      @ctree:     Valid compact tree
+ *      @name:      Member name to look for
+ *      @from:      Index to search after or -1 to start at the root
+ *
+ *  As ltjson_search() over the whole compact tree. The nodes are in
+ *  document order, so this is a scan along the node array.
+ *
+ *  Returns: Index of the next node called @name after @from
+ *           -1 if there is none or errno to EINVAL if an argument is not
+ *           valid
+ */
+
+int ltjson_ctree_search(const ltjson_ctree_t *ctree, const char *name,
+                        int from)
+{
+    unsigned int index;
+
+    if (!ctree || !name || from < -1 ||
+        (from >= 0 && (unsigned int)from >= ctree->nnodes))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (index = from + 1; index < ctree->nnodes; index++)
+    {
+        if (ctree->nodes[index].name != CTREE_NONE &&
+            strcmp(ctree->strs + ctree->nodes[index].name, name) == 0)
+            return (int)index;
+    }
+
+    return -1;
+}
+
+
+
+/**
+ *  ltjson_gettape(tree) - Get the compact tree a parse built
+ *      @tree:      Valid closed tree with a tape (see ltjson_settape)
+ *
+ *  The compact tree belongs to @tree. It is valid until @tree is next
+ *  parsed, changed by a ltjson_set*() call or freed.
+ *
+ *  Returns: Pointer to the compact tree on success
+ *           NULL if tree is not valid/closed or has no tape (errno to
+ *           EINVAL)
+ */
+
+const ltjson_ctree_t *ltjson_gettape(ltjson_node_t *tree)
+{
+    ltjson_info_t *jsoninfo;
+
+    if (!is_closed_tree(tree) || !((ltjson_info_t *)tree)->tape)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    jsoninfo = (ltjson_info_t *)tree;
+    return &jsoninfo->tape->ctree;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_size(ctree) - Number of nodes in a compact tree
+ *      @ctree:     Valid compact tree
+ *
+ *  The nodes are numbered 0 to the size less one in document order, so
+ *  the whole tree can be read with a plain loop over the indexes.
+ *
+ *  Returns: The number of nodes
+ *           -1 if the tree is not valid (errno to EINVAL)
+ */
+
+int ltjson_ctree_size(const ltjson_ctree_t *ctree)
+{
+    if (!ctree)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return (int)ctree->nnodes;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_end(ctree, index) - Get the index after a subtree
+ *      @ctree:     Valid compact tree
+ *      @index:     Node index
+ *
+ *  The nodes from @index up to (not including) this index are @index
+ *  and everything under it. Jumping to it skips the subtree in one go.
+ *
+ *  Returns: Index following the subtree of @index (which can be the
+ *           size of the tree)
+ *           -1 if the tree or index is not valid (errno to EINVAL)
+ */
+
+int ltjson_ctree_end(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *ctnode;
+
+    if ((ctnode = ctree_node(ctree, index)) == NULL)
+        return -1;
+
+    return (int)ctnode->end;
+}
+
+
+
+
+/*
+ *  ctree_nodeinfo(ctree, index, spaces) - Print node information
+ *
+ *  As print_nodeinfo for a compact node
+ */
+
+static void ctree_nodeinfo(const ltjson_ctree_t *ctree, unsigned int index,
+                           int spaces)
+{
+    const struct ctnode *ctnode = &ctree->nodes[index];
+    int empty = ctnode->end == index + 1;
+
+    printf("%*s", spaces, "");
+
+    if (ctnode->name != CTREE_NONE)
+    {
+        if (ctree->strs[ctnode->name] == '\0')
+            printf("(no name) : ");
+        else
+            printf("%s : ", ctree->strs + ctnode->name);
+    }
+
+    switch (ctnode->ntype)
+    {
+        case LTJSON_NTYPE_NULL:
+            printf("null\n");
+        break;
+
+        case LTJSON_NTYPE_BOOL:
+            if (ctnode->val.ll)
+                printf("true\n");
+            else
+                printf("false\n");
+        break;
+
+        case LTJSON_NTYPE_ARRAY:
+            printf(empty ? "[]\n" : "[\n");
+        break;
+
+        case LTJSON_NTYPE_OBJECT:
+            printf(empty ? "{}\n" : "{\n");
+        break;
+
+        case LTJSON_NTYPE_FLOAT:
+            printf("%g\n", ctnode->val.d);
+        break;
+
+        case LTJSON_NTYPE_INTEGER:
+#ifdef _WIN32
+            printf("%I64d\n", ctnode->val.ll);
+#else
+            printf("%lld\n", ctnode->val.ll);
+#endif
+        break;
+
+        case LTJSON_NTYPE_STRING:
+            printf("\"%s\"\n", ctree->strs + ctnode->val.s);
+        break;
+
+        case LTJSON_NTYPE_NUMRAW:
+            printf("%s\n", ctree->strs + ctnode->val.s);
+        break;
+
+        default:
+            printf("!!Node does not look valid!!\n");
+    }
+}
+
+
+
+
+/**
+ *  ltjson_ctree_display(ctree, index) - Display a compact subtree
+ *      @ctree:     Valid compact tree
+ *      @index:     Node to act as display root (0 for all of it)
+ *
+ *  As ltjson_display(), with the same output
+ *
+ *  Returns: 1 on success
+ *           0 if the tree or index is not valid and sets errno (EINVAL)
+ */
+
+int ltjson_ctree_display(const ltjson_ctree_t *ctree, int index)
+{
+    const struct ctnode *nodes;
+    unsigned int i, n;
+    int depth = 0;
+
+    if (!ctree_node(ctree, index))
+        return 0;
+
+    nodes = ctree->nodes;
+
+    printf("JSON tree:\n");
+
+    for (i = index; i < nodes[index].end; i++)
+    {
+        ctree_nodeinfo(ctree, i, 4 + 4 * depth);
+
+        if (nodes[i].end != i + 1)
+        {
+            depth++;            /* Into a non-empty object or array */
+            continue;
+        }
+
+        /* Close every object or array that node i was the last of */
+
+        for (n = i; n != (unsigned int)index &&
+                    nodes[nodes[n].up].end == i + 1; n = nodes[n].up)
+        {
+            depth--;
+
+            printf("%*s", 4 + 4*depth, "");
+
+            if (nodes[nodes[n].up].ntype == LTJSON_NTYPE_ARRAY)
+                printf("]\n");
+            else
+                printf("}\n");
+        }
+    }
+
+    return 1;
+}
+
+
+
+
+/*
+ *  write_ctree(jw, ctree, index, flags) - Output index and its subtree
+ *
+ *  As write_tree. The node after each one in the text is the next in
+ *  the array, so there is only the closing of objects/arrays to see to.
+ */
+
+static void write_ctree(struct jwrite *jw, const ltjson_ctree_t *ctree,
+                        unsigned int index, int flags)
+{
+    const struct ctnode *nodes = ctree->nodes, *ctnode;
+    int pretty = flags & LTJSON_PRINT_PRETTY;
+    unsigned int i, n;
+    int depth = 0;
+
+    for (i = index; ; i++)
+    {
+        ctnode = &nodes[i];
+
+        if (i != index && nodes[ctnode->up].ntype == LTJSON_NTYPE_OBJECT)
+        {
+            write_string(jw, ctree->strs + ctnode->name);
+            write_char(jw, ':');
+            if (pretty)
+                write_char(jw, ' ');
+        }
+
+        switch (ctnode->ntype)
+        {
+            case LTJSON_NTYPE_ARRAY:
+            case LTJSON_NTYPE_OBJECT:
+                write_char(jw, ctnode->ntype == LTJSON_NTYPE_ARRAY ? '['
+                                                                   : '{');
+                if (ctnode->end != i + 1)
+                {
+                    depth++;
+                    if (pretty)
+                        write_newline(jw, depth);
+                    continue;
+                }
+
+                write_char(jw, ctnode->ntype == LTJSON_NTYPE_ARRAY ? ']'
+                                                                   : '}');
+            break;
+
+            case LTJSON_NTYPE_BOOL:
+                if (ctnode->val.ll)
+                    write_out(jw, "true", 4);
+                else
+                    write_out(jw, "false", 5);
+            break;
+
+            case LTJSON_NTYPE_FLOAT:
+                write_float(jw, ctnode->val.d);
+            break;
+
+            case LTJSON_NTYPE_INTEGER:
+                write_integer(jw, ctnode->val.ll);
+            break;
+
+            case LTJSON_NTYPE_STRING:
+                write_string(jw, ctree->strs + ctnode->val.s);
+            break;
+
+            case LTJSON_NTYPE_NUMRAW:
+                write_out(jw, ctree->strs + ctnode->val.s,
+                          (int)strlen(ctree->strs + ctnode->val.s));
+            break;
+
+            default:
+                write_out(jw, "null", 4);
+        }
+
+        /* Close every object or array that node i was the last of */
+
+        for (n = i; n != index && nodes[nodes[n].up].end == i + 1;
+             n = nodes[n].up)
+        {
+            depth--;
+
+            if (pretty)
+                write_newline(jw, depth);
+
+            write_char(jw, nodes[nodes[n].up].ntype == LTJSON_NTYPE_ARRAY
+                           ? ']' : '}');
+        }
+
+        if (n == index)
+            break;
+
+        write_char(jw, ',');
+        if (pretty)
+            write_newline(jw, depth);
+    }
+}
+
+
+
+
+/**
+ *  ltjson_ctree_print(ctree, index, buf, size, flags) - Write as text
+ *      @ctree:     Valid compact tree
+ *      @index:     Node to write out (0 for all of it)
+ *      @buf:       Buffer for the text or NULL if @size is 0
+ *      @size:      Size of @buf in bytes
+ *      @flags:     LTJSON_PRINT_PRETTY for indented output or 0
+ *
+ *  As ltjson_print(), with the same text
+ *
+ *  Returns: The length of the text (without the terminator) on success
+ *           0 if the tree or index is not valid or a bad argument
+ *           (errno to EINVAL)
+ */
+
+int ltjson_ctree_print(const ltjson_ctree_t *ctree, int index, char *buf,
+                       int size, int flags)
+{
+    struct jwrite jw;
+
+    if (size < 0 || (size && !buf) || !ctree_node(ctree, index))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jw.buf = buf;
+    jw.size = size ? size - 1 : 0;
+    jw.used = 0;
+    jw.total = 0;
+    jw.writer = NULL;
+    jw.ctx = NULL;
+    jw.stopped = 0;
+
+    write_ctree(&jw, ctree, index, flags);
+
+    if (size)
+        buf[jw.used] = '\0';
+
+    return jw.total;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_write(ctree, index, writer, ctx, flags) - To a writer
+ *      @ctree:     Valid compact tree
+ *      @index:     Node to write out (0 for all of it)
+ *      @writer:    Function called with successive pieces of the text
+ *      @ctx:       Context argument passed to @writer
+ *      @flags:     LTJSON_PRINT_PRETTY for indented output or 0
+ *
+ *  As ltjson_write()
+ *
+ *  Returns: The length of the text on success
+ *           0 on failure with errno set to one of
+ *              EINVAL if the tree or index is not valid or a bad argument
+ *              ECANCELED if the writer returned 0
+ */
+
+int ltjson_ctree_write(const ltjson_ctree_t *ctree, int index,
+                       int (*writer)(void *ctx, const char *s, int len),
+                       void *ctx, int flags)
+{
+    char stage[WRITE_STAGE_SIZE];
+    struct jwrite jw;
+
+    if (!writer || !ctree_node(ctree, index))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jw.buf = stage;
+    jw.size = sizeof(stage);
+    jw.used = 0;
+    jw.total = 0;
+    jw.writer = writer;
+    jw.ctx = ctx;
+    jw.stopped = 0;
+
+    write_ctree(&jw, ctree, index, flags);
+    write_flush(&jw);
+
+    if (jw.stopped)
+    {
+        errno = ECANCELED;
+        return 0;
+    }
+
+    return jw.total;
+}
+
+
+
+
+/*
+ *  ctree_finditem(ctree, at, refpath, storep, storeavail) - get item
+ *
+ *  As path_finditem for compact node at, with the names compared as
+ *  in a filter (the refpath is not hashed). The members or elements
+ *  are stepped over a subtree at a time.
+ *
+ *  Returns the number of matches found (whether stored or not)
+ */
+
+static int ctree_finditem(const ltjson_ctree_t *ctree, unsigned int at,
+                          const ltjson_rpath_t *refpath, int **storep,
+                          int *storeavail)
+{
+    const struct ctnode *nodes = ctree->nodes;
+    unsigned int index;
+    int thisindex, nfound;
+
+    if (refpath->name == NULL)
+    {
+        if (*storeavail)
+        {
+            *(*storep) = (int)at;
+            (*storep)++;
+            (*storeavail)--;
+        }
+        return 1;
+    }
+
+    switch (nodes[at].ntype)
+    {
+        case LTJSON_NTYPE_OBJECT:
+            if (!refpath->namelen)      /* No name given */
+                return 0;
+        break;
+
+        case LTJSON_NTYPE_ARRAY:
+            if (refpath->namelen)       /* Name given */
+                return 0;
+        break;
+
+        default:
+            return 0;
+    }
+
+    if (nodes[at].ntype == LTJSON_NTYPE_OBJECT)
+    {
+        for (index = at + 1; index < nodes[at].end; index = nodes[index].end)
+        {
+            if (filter_namematch(refpath, ctree->strs + nodes[index].name))
+                break;
+        }
+
+        if (index >= nodes[at].end)
+            return 0;
+
+        at = index;
+
+        if (nodes[at].ntype != LTJSON_NTYPE_ARRAY)
+        {
+            if (refpath->hasindex)
+                return 0;
+
+            return ctree_finditem(ctree, at, refpath + 1, storep, storeavail);
+        }
+
+        if (!refpath->hasindex && refpath[1].name == NULL)
+            return ctree_finditem(ctree, at, refpath + 1, storep, storeavail);
+    }
+
+    thisindex = 0;
+    nfound = 0;
+
+    for (index = at + 1; index < nodes[at].end; index = nodes[index].end)
+    {
+        if (refpath->aindex >= 0 && refpath->aindex != thisindex++)
+            continue;
+
+        nfound += ctree_finditem(ctree, index, refpath + 1, storep,
+                                 storeavail);
+    }
+
+    return nfound;
+}
+
+
+
+
+/**
+ *  ltjson_ctree_pathrefer(ctree, path, indexes, nindexes) - Search path
+ *      @ctree:     Valid compact tree
+ *      @path:      Reference path expression (as ltjson_pathrefer)
+ *      @indexes:   Array for the indexes of the matches
+ *      @nindexes:  Number of available entries in @indexes
+ *
+ *  As ltjson_pathrefer() from node 0 of @ctree, giving node indexes.
+ *
+ *  Returns: Number of matches found (not stored) on success or
+ *           0 on failure and, if an error, sets errno to one of
+ *              EINVAL if the tree or an argument is not valid
+ *              EILSEQ if path expression is not understood
+ *              ERANGE if path is too long
+ */
+
+int ltjson_ctree_pathrefer(const ltjson_ctree_t *ctree, const char *path,
+                           int *indexes, int nindexes)
+{
+    ltjson_rpath_t refpaths[8];
+    int ret;
+
+    if (!path || !indexes || nindexes <= 0 || !ctree_node(ctree, 0))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    ret = path_tokenise(path, refpaths, sizeof(refpaths)/sizeof(refpaths[0]));
+    if (ret < 0)
+        return 0;
+
+    if (ret == 0)
+    {
+        indexes[0] = 0;
+        return 1;
+    }
+
+    ret = ctree_finditem(ctree, 0, refpaths, &indexes, &nindexes);
+    if (!ret)
+        errno = 0;
+
+    return ret;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,270 @@
+/*
+ *  ltdict.c (as include): Shared name dictionaries
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A dictionary is a name hash (see lthash.c) that belongs to no tree.
+    Any number of trees can have the same dictionary attached and their
+    member names then come from it, so the same name has the same
+    pointer in all of them and LTJSON_SEARCH_NAMEISHASH searches made
+    with a dictionary string work on any of those trees.
+
+    While a dictionary is not frozen, names missing from it are added
+    to it as trees are parsed. Once frozen it is never written to again
+    and missing names go into the tree's own table instead. Only a
+    frozen dictionary may be shared by trees in several threads.
+*/
+
+
+
+
+/**
+ *  ltjson_dict_new() - Create a new, empty name dictionary
+ *
+ *  Returns: Pointer to the dictionary on success
+ *           NULL if out of memory (errno to ENOMEM)
+ */
+
+ltjson_dict_t *ltjson_dict_new(void)
+{
+    ltjson_dict_t *dict;
+
+    dict = malloc(sizeof(ltjson_dict_t));
+    if (!dict)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    dict->nhash.alloc = NULL;       /* Dictionaries belong to no tree */
+
+    if (!nhash_init(&dict->nhash))
+    {
+        free(dict);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    dict->frozen = 0;
+
+    return dict;
+}
+
+
+
+
+/**
+ *  ltjson_dict_add(dict, name) - Add a name to a dictionary
+ *      @dict:  Dictionary that is not frozen
+ *      @name:  An object member name
+ *
+ *  Returns: Pointer to the dictionary's copy of @name on success
+ *           NULL on failure with errno is set to:
+ *              EINVAL if passed null parameters
+ *              EPERM  if the dictionary is frozen
+ *              ENOMEM if out of memory
+ */
+
+const char *ltjson_dict_add(ltjson_dict_t *dict, const char *name)
+{
+    struct nhashcell *nhcp;
+    unsigned int hash;
+    int slen;
+
+    if (!dict || !name)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (dict->frozen)
+    {
+        errno = EPERM;
+        return NULL;
+    }
+
+    if (!(slen = strlen(name)))
+        return ltjson_empty_name;
+
+    hash = name_hash(name, slen);
+
+    nhcp = nhash_find(&dict->nhash, name, slen, hash, NULL);
+    if (nhcp->s)
+        return nhcp->s;
+
+    return nhash_store(&dict->nhash, name, slen, hash);
+}
+
+
+
+
+/**
+ *  ltjson_dict_lookup(dict, name) - Lookup a name in a dictionary
+ *      @dict:  Valid dictionary
+ *      @name:  An object member name
+ *
+ *  The string returned can be used with LTJSON_SEARCH_NAMEISHASH on
+ *  any tree the dictionary is attached to.
+ *
+ *  Returns: Pointer to constant string on success
+ *           NULL on failure with errno is set to:
+ *              EINVAL if passed null parameters
+ *              0      if entry not found (not really an error)
+ */
+
+const char *ltjson_dict_lookup(ltjson_dict_t *dict, const char *name)
+{
+    struct nhashcell *nhcp;
+    int slen;
+
+    if (!dict || !name)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(slen = strlen(name)))
+        return ltjson_empty_name;
+
+    nhcp = nhash_find(&dict->nhash, name, slen, name_hash(name, slen), NULL);
+    if (nhcp->s)
+        return nhcp->s;
+
+    errno = 0;
+    return NULL;
+}
+
+
+
+
+/**
+ *  ltjson_dict_freeze(dict) - Stop a dictionary from changing
+ *      @dict:  Valid dictionary
+ *
+ *  After this the dictionary is only ever read, by ltjson_dict_lookup
+ *  and by the trees it is attached to, so it is safe to share between
+ *  threads. There is no thawing it.
+ *
+ *  Returns: 1 on success
+ *           0 if dict is NULL (errno to EINVAL)
+ */
+
+int ltjson_dict_freeze(ltjson_dict_t *dict)
+{
+    if (!dict)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    dict->frozen = 1;
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_dict_free(dictptr) - Free up all memory of a dictionary
+ *      @dictptr:   Pointer to valid dictionary
+ *
+ *  Any tree the dictionary is attached to must be freed (or given
+ *  another dictionary) first as its names are gone with it.
+ *
+ *  Returns:    1 on success, writing NULL to *dictptr
+ *              0 and errno set to EINVAL if dictionary is not valid
+ */
+
+int ltjson_dict_free(ltjson_dict_t **dictptr)
+{
+    if (!dictptr || !*dictptr)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    nhash_release(&(*dictptr)->nhash);
+    free(*dictptr);
+
+    *dictptr = NULL;
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_setdict(treeptr, dict) - Attach a dictionary to a tree
+ *      @treeptr:   Pointer to json tree root
+ *      @dict:      Dictionary to attach or NULL to detach
+ *
+ *  If @*treeptr is NULL then a new (empty) tree is created for it.
+ *  Otherwise the tree must not be open and it is emptied, as are
+ *  any names in its own hash, since they are from the old dictionary.
+ *  The dictionary stays attached as the tree is recycled by each
+ *  following ltjson_parse().
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if invalid tree
+ *              EBUSY  if the tree is open
+ *              ENOMEM if out of memory
+ */
+
+int ltjson_setdict(ltjson_node_t **treeptr, ltjson_dict_t *dict)
+{
+    ltjson_info_t *jsoninfo = 0;
+
+    if (!treeptr)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (*treeptr)
+    {
+        if (!is_valid_tree(*treeptr))
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+
+        if (jsoninfo->open)
+        {
+            errno = EBUSY;
+            return 0;
+        }
+    }
+
+    if ((jsoninfo = create_tree(jsoninfo, NULL)) == NULL)
+    {
+        *treeptr = NULL;
+        return 0;
+    }
+
+    *treeptr = (ltjson_node_t *)jsoninfo;
+
+    nhash_reset(jsoninfo);
+    jsoninfo->dict = dict;
+
+    return 1;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
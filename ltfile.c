@@ -0,0 +1,220 @@
+/*
+ *  ltfile.c (as include): Mapping files into memory
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  ltjson_parse_file maps the whole file into memory and parses it as
+    one text, so nothing is read into buffers and no string or number
+    is ever split between two of them. The mapping is private: with
+    LTJSON_PARSE_INSITU the terminators and unescaped strings are
+    written to pages of the tree's own and the file is not changed.
+    A tree parsed in situ keeps the mapping (in .map) since its strings
+    are in it, and it's unmapped when the tree is recycled or freed.
+    Otherwise the file is unmapped as soon as the parse is done.
+
+    POSIX systems use mmap, with the pages advised to be read in
+    sequence (madvise or posix_madvise, where declared). Windows uses
+    a file mapping, with the file opened for a sequential scan, which
+    is the nearest it has.
+*/
+
+#if defined(_WIN32)
+  #include <windows.h>
+  #define FILE_WIN32
+#else
+  #include <sys/types.h>
+  #include <sys/stat.h>
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #define FILE_MMAP
+#endif
+
+
+
+
+#if defined(FILE_WIN32)
+/*
+ *  file_winerr(err) - Get the errno nearest a Windows error code
+ */
+
+static int file_winerr(DWORD err)
+{
+    switch (err)
+    {
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+    case ERROR_INVALID_NAME:
+        return ENOENT;
+
+    case ERROR_ACCESS_DENIED:
+    case ERROR_SHARING_VIOLATION:
+    case ERROR_LOCK_VIOLATION:
+        return EACCES;
+
+    case ERROR_NOT_ENOUGH_MEMORY:
+    case ERROR_OUTOFMEMORY:
+    case ERROR_COMMITMENT_LIMIT:
+        return ENOMEM;
+    }
+
+    return EIO;
+}
+#endif
+
+
+
+
+/*
+ *  file_map(path, writable, sizep) - Map a whole file into memory
+ *
+ *  The mapping is private. If writable, it can be written to without
+ *  the file being changed.
+ *
+ *  Returns: The start of the mapping (size in *sizep) on success
+ *           NULL on failure with errno set to:
+ *              EAGAIN if the file is empty
+ *              EINVAL if the file is not a regular file
+ *              ENOMEM if it's too big to map
+ *              or as set by the system if it can't be opened or mapped
+ */
+
+static char *file_map(const char *path, int writable, size_t *sizep)
+{
+#if defined(FILE_WIN32)
+    HANDLE fh, mh;
+    LARGE_INTEGER fsize;
+    char *addr;
+    DWORD err;
+
+    fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fh == INVALID_HANDLE_VALUE)
+    {
+        errno = file_winerr(GetLastError());
+        return NULL;
+    }
+
+    if (!GetFileSizeEx(fh, &fsize) || GetFileType(fh) != FILE_TYPE_DISK)
+    {
+        CloseHandle(fh);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (fsize.QuadPart == 0 || (ULONGLONG)fsize.QuadPart > (size_t)-1)
+    {
+        CloseHandle(fh);
+        errno = fsize.QuadPart ? ENOMEM : EAGAIN;
+        return NULL;
+    }
+
+    /* The view stays valid after the handles are closed */
+
+    mh = CreateFileMappingA(fh, NULL, writable ? PAGE_WRITECOPY :
+                            PAGE_READONLY, 0, 0, NULL);
+    addr = NULL;
+    err = GetLastError();
+
+    if (mh)
+    {
+        addr = MapViewOfFile(mh, writable ? FILE_MAP_COPY : FILE_MAP_READ,
+                             0, 0, 0);
+        err = GetLastError();
+        CloseHandle(mh);
+    }
+
+    CloseHandle(fh);
+
+    if (!addr)
+    {
+        errno = file_winerr(err);
+        return NULL;
+    }
+
+    *sizep = (size_t)fsize.QuadPart;
+    return addr;
+
+#else
+    struct stat st;
+    void *addr;
+    int fd, err;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (st.st_size == 0 || (off_t)(size_t)st.st_size != st.st_size)
+    {
+        close(fd);
+        errno = st.st_size ? ENOMEM : EAGAIN;
+        return NULL;
+    }
+
+    /* The mapping stays valid after the file is closed */
+
+    addr = mmap(NULL, (size_t)st.st_size, writable ?
+                PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+
+    if (addr == MAP_FAILED)
+    {
+        errno = err;
+        return NULL;
+    }
+
+#if defined(MADV_SEQUENTIAL)
+    madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+#elif defined(POSIX_MADV_SEQUENTIAL)
+    posix_madvise(addr, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+    *sizep = (size_t)st.st_size;
+    return addr;
+#endif
+}
+
+
+
+
+/*
+ *  file_unmap(addr, size) - Unmap a file mapped by file_map
+ *
+ *  addr can be NULL, when nothing is done.
+ */
+
+static void file_unmap(char *addr, size_t size)
+{
+    if (!addr)
+        return;
+
+#if defined(FILE_WIN32)
+    (void)size;
+    UnmapViewOfFile(addr);
+#else
+    munmap(addr, size);
+#endif
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,490 @@
+/*
+ *  ltfilter.c (as include): Selective parsing with a path filter
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A tree with a filter (ltjson_setfilter) only keeps the nodes that
+    the filter paths go through and everything under a node that a
+    path matches in full. The paths are followed as the text is parsed,
+    with the same rules as path_findmulti, one filterlevel for each
+    object or array that is being kept.
+
+    Whether a value is wanted is known from its first character: an
+    unwanted one is skipped with scan_nesting and scan_strbody, only
+    checking that its strings end and that its brackets balance. A
+    skipped value's node is reused for the next sibling, or unlinked
+    and put on the .freenodes list if it was the last one. Member
+    names no path wants are not stored or hashed.
+
+    Array elements a path picks by index have to stay at their index.
+    Skipped elements up to and including the last such index are left
+    in the tree as null nodes to hold the places.
+
+    The paths are compared with the names as they are in the text, so
+    the plain (non-dictionary) refpaths of the compiled paths are used.
+*/
+
+
+
+
+/*
+ *  filter_free(jsoninfo) - Remove the filter, if any
+ */
+
+static void filter_free(ltjson_info_t *jsoninfo)
+{
+    if (!jsoninfo->filter)
+        return;
+
+    mem_free(jsoninfo->alloc, jsoninfo->filter->levels);
+    mem_free(jsoninfo->alloc, jsoninfo->filter);
+    jsoninfo->filter = 0;
+}
+
+
+
+
+/*
+ *  filter_namematch(refpath, name) - Is name the refpath's name?
+ *
+ *  As path_namematch but for a null terminated name from the text
+ */
+
+static int filter_namematch(const ltjson_rpath_t *refpath, const char *name)
+{
+    if ((unsigned char)*refpath->name == 0xFF)
+        return *name == '\0';
+
+    return strncmp(name, refpath->name, refpath->namelen) == 0 &&
+           name[refpath->namelen] == '\0';
+}
+
+
+
+
+/*
+ *  filter_enter(filter, lev, cand, firstch) - Start a level for a value
+ *
+ *  The paths in cand have arrived at the value starting with firstch
+ *  at the states in lev->state. Those that finish here or can't go on
+ *  from here drop out (as at the top of path_findmulti). If the value
+ *  is an object or array, lev is set up for its members or elements.
+ *
+ *  Returns 1 if the value is wanted, 0 if not
+ */
+
+static int filter_enter(struct filter *filter, struct filterlevel *lev,
+                        unsigned long long cand, int firstch)
+{
+    const ltjson_rpath_t *refpath;
+    unsigned long long bit;
+    int i;
+
+    lev->mask = 0;
+    lev->pending = 0;
+    lev->seen = 0;
+    lev->all = 0;
+    lev->index = 0;
+    lev->hold = -1;
+
+    for (i = 0, bit = 1; i < filter->npaths; i++, bit <<= 1)
+    {
+        if (!(cand & bit))
+            continue;
+
+        refpath = &filter->rpaths[i][lev->state[i] >> 1];
+
+        if (!(lev->state[i] & 1))
+        {
+            if (refpath->name == NULL)
+            {
+                lev->all = 1;
+                return 1;
+            }
+
+            if (firstch == '{')
+            {
+                if (!refpath->namelen)
+                    continue;
+            }
+            else if (firstch == '[')
+            {
+                if (refpath->namelen)
+                    continue;
+            }
+            else
+            {
+                continue;
+            }
+        }
+
+        if (refpath->aindex > lev->hold)
+            lev->hold = refpath->aindex;
+
+        lev->mask |= bit;
+    }
+
+    return lev->mask != 0;
+}
+
+
+
+
+/*
+ *  filter_reserve(jsoninfo, filter, nlevels) - Have at least nlevels
+ *
+ *  Returns 1 on success, 0 if out of memory (errno to ENOMEM)
+ */
+
+static int filter_reserve(ltjson_info_t *jsoninfo, struct filter *filter,
+                          int nlevels)
+{
+    struct filterlevel *levels;
+    int newlevels;
+
+    if (nlevels <= filter->nlevels)
+        return 1;
+
+    newlevels = filter->nlevels ? filter->nlevels * 2 : FILTER_INIT_LEVELS;
+    while (newlevels < nlevels)
+        newlevels *= 2;
+
+    levels = mem_realloc(jsoninfo->alloc, filter->levels,
+                         newlevels * sizeof(struct filterlevel));
+    if (!levels)
+        return 0;
+
+    filter->levels = levels;
+    filter->nlevels = newlevels;
+    return 1;
+}
+
+
+
+
+/*
+ *  filter_root(jsoninfo, firstch) - Start the filter at the tree root
+ */
+
+static void filter_root(ltjson_info_t *jsoninfo, int firstch)
+{
+    struct filter *filter = jsoninfo->filter;
+    int i;
+
+    assert(filter->nlevels >= 2);
+
+    filter->depth = 0;
+    filter->skipping = 0;
+
+    for (i = 0; i < filter->npaths; i++)
+        filter->levels[0].state[i] = 0;
+
+    filter_enter(filter, &filter->levels[0], ~0ULL, firstch);
+}
+
+
+
+
+/*
+ *  filter_name(jsoninfo, name) - Check a member name against the filter
+ *
+ *  The name of a member of the current (open) object has been parsed.
+ *  Note which paths it matches, each only for the first member with
+ *  the name, for its value.
+ *
+ *  Returns 1 if the member may be wanted, 0 if its value will be skipped
+ */
+
+static int filter_name(ltjson_info_t *jsoninfo, const char *name)
+{
+    struct filter *filter = jsoninfo->filter;
+    struct filterlevel *lev = &filter->levels[filter->depth];
+    unsigned long long bit;
+    int i;
+
+    if (lev->all)
+        return 1;
+
+    lev->pending = 0;
+
+    for (i = 0, bit = 1; i < filter->npaths; i++, bit <<= 1)
+    {
+        if (!(lev->mask & bit) || (lev->seen & bit))
+            continue;
+
+        if (filter_namematch(&filter->rpaths[i][lev->state[i] >> 1], name))
+            lev->pending |= bit;
+    }
+
+    lev->seen |= lev->pending;
+
+    return lev->pending != 0;
+}
+
+
+
+
+/*
+ *  filter_atvalue(node, ch) - Is node about to get its value from ch?
+ */
+
+static int filter_atvalue(const ltjson_node_t *node, int ch)
+{
+    if (node->ntype != LTJSON_NTYPE_EMPTY || node->nflags)
+        return 0;
+
+    if (!node->name && node->ancnode->ntype != LTJSON_NTYPE_ARRAY)
+        return 0;
+
+    return ch == '{' || ch == '[' || ch == '"' || ch == '-' || c_isalnum(ch);
+}
+
+
+
+
+/*
+ *  filter_value(jsoninfo, node, firstch) - Is the value of node wanted?
+ *
+ *  node is a member of the current object (with its name already seen
+ *  by filter_name) or an element of the current array and its value
+ *  starts with firstch. If the value is a wanted object or array, its
+ *  level is started and becomes the current one.
+ *
+ *  Returns: FILTER_KEEP if the value is to be parsed as usual
+ *           FILTER_SKIP if it is to be skipped and the node dropped
+ *           FILTER_HOLD if skipped but the node kept as a placeholder
+ *           -1 if out of memory (errno to ENOMEM)
+ */
+
+static int filter_value(ltjson_info_t *jsoninfo, ltjson_node_t *node,
+                        int firstch)
+{
+    struct filter *filter = jsoninfo->filter;
+    struct filterlevel *lev, *sub;
+    const ltjson_rpath_t *refpath;
+    unsigned long long cand, bit;
+    int i, index, wanted;
+
+    if (!filter_reserve(jsoninfo, filter, filter->depth + 2))
+        return -1;
+
+    lev = &filter->levels[filter->depth];
+    sub = lev + 1;
+
+    if (lev->all)
+    {
+        wanted = 1;
+        sub->all = 1;
+    }
+    else
+    {
+        cand = 0;
+        index = -1;
+
+        if (node->ancnode->ntype == LTJSON_NTYPE_ARRAY)
+            index = lev->index++;
+
+        for (i = 0, bit = 1; i < filter->npaths; i++, bit <<= 1)
+        {
+            if (index < 0)
+            {
+                if (!(lev->pending & bit))
+                    continue;
+            }
+            else if (!(lev->mask & bit))
+            {
+                continue;
+            }
+
+            refpath = &filter->rpaths[i][lev->state[i] >> 1];
+
+            if (index >= 0)
+            {
+                /* Array: the element must have the section's index */
+
+                if (refpath->aindex >= 0 && refpath->aindex != index)
+                    continue;
+
+                sub->state[i] = (lev->state[i] & ~1) + 2;
+            }
+            else if (firstch != '[')
+            {
+                if (refpath->hasindex)
+                    continue;
+
+                sub->state[i] = lev->state[i] + 2;
+            }
+            else if (!refpath->hasindex && refpath[1].name == NULL)
+            {
+                sub->state[i] = lev->state[i] + 2;  /* The array itself */
+            }
+            else
+            {
+                sub->state[i] = lev->state[i] | 1;  /* Its elements */
+            }
+
+            cand |= bit;
+        }
+
+        lev->pending = 0;
+        wanted = filter_enter(filter, sub, cand, firstch);
+
+        if (!wanted)
+            return (index >= 0 && index <= lev->hold) ? FILTER_HOLD
+                                                     : FILTER_SKIP;
+    }
+
+    if (firstch == '{' || firstch == '[')
+        filter->depth++;
+
+    return FILTER_KEEP;
+}
+
+
+
+
+/*
+ *  filter_skip(jsoninfo, textp) - Skip over an unwanted value
+ *
+ *  Starts skipping the value at *textp or, if part way through one,
+ *  carries on where the last text left off. *textp is moved along.
+ *
+ *  Returns: 1 if at the end of the value
+ *           0 if out of input (errno to EAGAIN)
+ */
+
+static int filter_skip(ltjson_info_t *jsoninfo, const char **textp)
+{
+    struct filter *filter = jsoninfo->filter;
+    const char *s, *end;
+
+    s = *textp;
+    end = jsoninfo->textend;
+
+    if (!filter->skipping)
+    {
+        filter->skipping = 1;
+        filter->skipnest = 0;
+        filter->skipstr = 0;
+        filter->skipscalar = 0;
+
+        if (*s == '{' || *s == '[')
+        {
+            filter->skipnest = 1;
+            s++;
+        }
+        else if (*s == '"')
+        {
+            filter->skipstr = 1;
+            s++;
+        }
+        else
+        {
+            filter->skipscalar = 1;
+        }
+    }
+
+    while (s < end)
+    {
+        if (filter->skipscalar)
+        {
+            while (s < end &&
+                   !(scan_class(*s) & (SCAN_SPACE | SCAN_STRUCT | SCAN_QUOTE)))
+                s++;
+
+            if (s == end)
+                break;
+
+            filter->skipscalar = 0;
+        }
+        else if (filter->skipstr == 2)
+        {
+            filter->skipstr = 1;        /* Escaped character */
+            s++;
+            continue;
+        }
+        else if (filter->skipstr)
+        {
+            if ((s = scan_strbody(s, end)) == end)
+                break;
+
+            filter->skipstr = (*s++ == '\\') ? 2 : 0;
+
+            if (filter->skipstr || filter->skipnest)
+                continue;
+        }
+        else
+        {
+            if ((s = scan_nesting(s, end)) == end)
+                break;
+
+            if (*s == '"')
+                filter->skipstr = 1;
+            else if (*s == '{' || *s == '[')
+                filter->skipnest++;
+            else
+                filter->skipnest--;
+
+            s++;
+
+            if (filter->skipstr || filter->skipnest)
+                continue;
+        }
+
+        filter->skipping = 0;
+        *textp = s;
+        return 1;
+    }
+
+    *textp = s;
+    errno = EAGAIN;
+    return 0;
+}
+
+
+
+
+/*
+ *  filter_unlink(jsoninfo, node) - Drop a skipped last member or element
+ *
+ *  node is taken off the end of its object or array and put on the free
+ *  list. Only kept nodes are walked to find the one before it.
+ */
+
+static void filter_unlink(ltjson_info_t *jsoninfo, ltjson_node_t *node)
+{
+    ltjson_node_t *prev;
+
+    prev = node->ancnode->val.subnode;
+
+    if (prev == node)
+    {
+        node->ancnode->val.subnode = NULL;
+    }
+    else
+    {
+        while (prev->next != node)
+            prev = prev->next;
+
+        prev->next = NULL;
+    }
+
+    node->next = jsoninfo->freenodes;
+    jsoninfo->freenodes = node;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -13,91 +13,196 @@
 #ifdef _LTJSON_INLINE_INCLUDE_
 
 
-/* The hash table is implemented as a classic "bucket" table of
-   pointers to table entries. Each entry is a linked list of strings
-   that match any particular hash. The bucket table itself is only
-   an array of pointers, not an array of cells.
-
-   The table entries are allocated in blocks of size NHASH_CELL_ALLOC
-   plus 2; the last two entries in the block used for table maintenance.
-   table[NHASH_CELL_LINKCUR].next points to the next available empty
-   cell while table[NHASH_CELL_LINKNEXT].next points to the head of the
-   next table allocation. Any next pointer will point to a completely
-   filled table (so new tables are inserted before, not after).
+/* The hash table is an open addressed table of cells with linear
+   probing. Each cell holds the string, its length and its full hash
+   (as cached in the nodes) so that a probe only looks at the bytes of
+   a string when the hashes match, and growing the table never needs
+   to rehash the strings themselves.
+
+   The table starts at NHASH_INIT_SLOTS (a power of two) and doubles
+   whenever it gets more than NHASH_LOAD_PCT percent full.
+
+   The hashed names live in their own string store (.sstore of the
+   struct nhash) rather than the tree's. Thus a LTJSON_PARSE_KEEPHASH
+   tree can clear its string store when it is recycled but keep the
+   (warm) table as is.
+
+   A dictionary (ltdict.c) is the same table standing on its own. A
+   tree with one attached looks names up there first, so trees that
+   share a dictionary share the name pointers too.
 */
 
 
 
 
 /*
- *  djbhash(s) - Hash string s
+ *  name_hash(s, n) - Hash of a name as cached in node .namehash
  *
- *  Hashing algorithm from Dan Berntein, public domain, comp.lang.c
- *  I continually comment on how truly appalling the K&R C hash is
- *  so that noone will ever use it. It's just terrible!
+ *  The full hash of the name (not yet reduced to a slot). If n is
+ *  negative, s is null terminated. Comparing these first means names
+ *  are only compared byte by byte when they very probably match.
+ *
+ *  The name is taken eight bytes at a time with a multiply and rotate
+ *  per word and the result is run through the MurmurHash3 finaliser,
+ *  so the low bits (that pick the slot) depend on every byte.
  */
 
-static unsigned long djbhash(const char *s)
+static unsigned int name_hash(const char *s, int n)
 {
-    unsigned long hash = 5381;
-    int c;
+    unsigned long long hash, word;
+
+    if (n < 0)
+        n = strlen(s);
+
+    hash = 0x9E3779B97F4A7C15ULL ^ (unsigned long long)n;
+
+    while (n >= 8)
+    {
+        memcpy(&word, s, 8);
+
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash = (hash << 31) | (hash >> 33);
+
+        s += 8;
+        n -= 8;
+    }
+
+    if (n > 0)
+    {
+        word = 0;
+        memcpy(&word, s, n);
+
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash = (hash << 31) | (hash >> 33);
+    }
 
-    while ((c = (const unsigned char)*s++) != '\0')
-        hash = ((hash << 5) + hash) + c;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
 
-    return hash;
+    return (unsigned int)hash;
 }
 
 
 
 
 /*
- *  djbnhash(s, n) - Hash string s for length n
+ *  nhash_alloctab(nhash, nslots) - Allocate an empty table of nslots cells
+ *
+ *  Returns the table on success, NULL on failure with errno set to ENOMEM
+ */
+
+static struct nhashcell *nhash_alloctab(struct nhash *nhash, int nslots)
+{
+    return mem_zalloc(nhash->alloc, nslots * sizeof(struct nhashcell));
+}
+
+
+
+
+/*
+ *  nhash_init(nhash) - Set up an empty table and name store
+ *
+ *  nhash->alloc must already be set to the allocator to use.
  *
- *  As above except like strncmp - takes n as a size_t
+ *  Returns 1 on success, 0 on failure with errno set to ENOMEM
+ */
+
+static int nhash_init(struct nhash *nhash)
+{
+    if ((nhash->tab = nhash_alloctab(nhash, NHASH_INIT_SLOTS)) == NULL)
+        return 0;
+
+    nhash->sstore  = sstore_new();
+    nhash->nslots  = NHASH_INIT_SLOTS;
+    nhash->nfilled = 0;
+
+    return 1;
+}
+
+
+
+
+/*
+ *  nhash_release(nhash) - Free the table and name store
+ *
+ *  Safe to call on a table that was never set up (all zero).
+ */
+
+static void nhash_release(struct nhash *nhash)
+{
+    mem_free(nhash->alloc, nhash->tab);
+    sstore_free(nhash->alloc, &nhash->sstore);
+
+    nhash->tab = 0;
+    nhash->nslots = 0;
+    nhash->nfilled = 0;
+}
+
+
+
+
+/*
+ *  nhash_empty(nhash) - Empty the table (which keeps its size) and set
+ *  the name store to be reused
  */
 
-static unsigned long djbnhash(const char *s, size_t n)
+static void nhash_empty(struct nhash *nhash)
 {
-    unsigned long hash = 5381;
-    int c;
+    if (!nhash->tab)
+        return;
 
-    while (n-- && (c = (const unsigned char)*s++) != '\0')
-        hash = ((hash << 5) + hash) + c;
+    memset(nhash->tab, 0, nhash->nslots * sizeof(struct nhashcell));
+    sstore_clear(nhash->alloc, &nhash->sstore);
 
-    return hash;
+    nhash->nfilled = 0;
 }
 
 
 
 
 /*
- *  nhash_addstore(jsoninfo) - Allocate memory for new cell store
+ *  nhash_grow(nhash) - Double the size of the hash table
  *
- *  Adds a new cell store block by chaining the new allocation in
- *  between jsoninfo->nhstore and the old store (if it exists).
- *  Initialises relevant parts of the new store block.
+ *  Every filled cell is moved to its slot in the new table using the
+ *  hash cached in the cell. The strings are not looked at.
  *
  *  Returns 1 on success, 0 on failure with errno set to ENOMEM
  */
 
-static int nhash_addstore(ltjson_info_t *jsoninfo)
+static int nhash_grow(struct nhash *nhash)
 {
-    struct nhashcell *nhcp;
+    struct nhashcell *newtab, *nhcp;
+    unsigned int mask;
+    int i, nslots;
 
-    assert(jsoninfo);
+    nslots = nhash->nslots * 2;
 
-    nhcp = malloc(sizeof(struct nhashcell) * (NHASH_CELL_ALLOC + 2));
-    if (nhcp == NULL)
-    {
-        errno = ENOMEM;
+    if ((newtab = nhash_alloctab(nhash, nslots)) == NULL)
         return 0;
+
+    mask = nslots - 1;
+
+    for (i = 0; i < nhash->nslots; i++)
+    {
+        if (!nhash->tab[i].s)
+            continue;
+
+        nhcp = &newtab[nhash->tab[i].hash & mask];
+
+        while (nhcp->s)
+        {
+            if (++nhcp == newtab + nslots)
+                nhcp = newtab;
+        }
+
+        *nhcp = nhash->tab[i];
     }
 
-    nhcp[NHASH_CELL_LINKCUR].next = &nhcp[0];             /* First free */
-    nhcp[NHASH_CELL_LINKNEXT].next = jsoninfo->nhstore;   /* Previous store */
+    mem_free(nhash->alloc, nhash->tab);
 
-    jsoninfo->nhstore = nhcp;
+    nhash->tab = newtab;
+    nhash->nslots = nslots;
     return 1;
 }
 
@@ -105,37 +210,101 @@ static int nhash_addstore(ltjson_info_t *jsoninfo)
 
 
 /*
- *  nhash_free(jsoninfo) - Free all data associated with the hash
+ *  nhash_find(nhash, s, n, hash, missp) - Find the cell for string s
+ *
+ *  Probe the table for the string s of length n with name_hash() hash.
+ *  s need not be null terminated. The table must exist. If missp is
+ *  not NULL, it is incremented for every other string probed past.
+ *  The table is only read so a frozen dictionary can be searched by
+ *  any number of threads at once.
  *
- *  If jsoninfo contains a hash table and/or a hash store, free them.
- *  The table is one allocation but the store is a chained list of
- *  blocks.
- *  Sets the jsoninfo entries to NULL when finished.
+ *  Returns the cell holding s or, if s is not there, the empty cell
+ *  where s would be inserted.
  */
 
-static void nhash_free(ltjson_info_t *jsoninfo)
+static struct nhashcell *nhash_find(const struct nhash *nhash,
+                                    const char *s, int n, unsigned int hash,
+                                    int *missp)
 {
-    struct nhashcell *nhcp, *nhstore;
+    struct nhashcell *nhcp, *nhend;
 
-    if (!jsoninfo)
-        return;
+    assert(nhash->tab);
+
+    nhend = nhash->tab + nhash->nslots;
+    nhcp = nhash->tab + (hash & (nhash->nslots - 1));
 
-    if (jsoninfo->nhtab)
+    while (nhcp->s)
     {
-        free(jsoninfo->nhtab);
-        jsoninfo->nhtab = 0;
+        if (nhcp->hash == hash && nhcp->len == n &&
+                memcmp(nhcp->s, s, n) == 0)
+            return nhcp;
+
+        if (missp)
+            (*missp)++;
+
+        if (++nhcp == nhend)
+            nhcp = nhash->tab;
     }
 
-    nhstore = jsoninfo->nhstore;
+    return nhcp;
+}
+
+
+
+
+/*
+ *  nhash_store(nhash, s, n, hash) - Add a string not yet in the table
+ *
+ *  Grows the table first if it's getting full, then copies s (of
+ *  length n, with name_hash() hash) into the name store.
+ *
+ *  Returns: Pointer to the new string on success
+ *           NULL on error and sets errno (ENOMEM)
+ */
+
+static const char *nhash_store(struct nhash *nhash,
+                               const char *s, int n, unsigned int hash)
+{
+    struct nhashcell *nhcp;
 
-    while (nhstore)
+    if ((nhash->nfilled + 1) * 100 > nhash->nslots * NHASH_LOAD_PCT)
     {
-        nhcp = nhstore[NHASH_CELL_LINKNEXT].next;
-        free(nhstore);
-        nhstore = nhcp;
+        if (!nhash_grow(nhash))
+            return NULL;
     }
 
-    jsoninfo->nhstore = 0;
+    nhcp = nhash_find(nhash, s, n, hash, NULL);
+    assert(!nhcp->s);
+
+    nhcp->s = sstore_nadd(nhash->alloc, &nhash->sstore, s, n);
+    if (!nhcp->s)
+        return NULL;
+
+    nhcp->hash = hash;
+    nhcp->len  = n;
+
+    nhash->nfilled++;
+
+    return nhcp->s;
+}
+
+
+
+
+/*
+ *  nhash_free(jsoninfo) - Free all data associated with the hash
+ *
+ *  If jsoninfo contains a hash table and/or a name store, free them.
+ *  Sets the jsoninfo entries to NULL when finished. An attached
+ *  dictionary is not the tree's to free and is left alone.
+ */
+
+static void nhash_free(ltjson_info_t *jsoninfo)
+{
+    if (!jsoninfo)
+        return;
+
+    nhash_release(&jsoninfo->nhash);
 }
 
 
@@ -144,9 +313,8 @@ static void nhash_free(ltjson_info_t *jsoninfo)
 /*
  *  nhash_new(jsoninfo) - Set info structure up with new hash
  *
- *  If jsoninfo contains an old hash table and hash store, free
- *  those first. Then allocate memory for the table and initialise
- *  the pointers. And create a store using nhash_newstore().
+ *  If jsoninfo contains an old hash table and name store, free
+ *  those first. Then allocate an empty table of NHASH_INIT_SLOTS.
  *  Finally, reset the hit/miss statistic counters to 0.
  *
  *  Returns 1 on success, 0 on failure with errno set to ENOMEM
@@ -154,28 +322,12 @@ static void nhash_free(ltjson_info_t *jsoninfo)
 
 static int nhash_new(ltjson_info_t *jsoninfo)
 {
-    int i;
-
     assert(jsoninfo);
 
     nhash_free(jsoninfo);
 
-    jsoninfo->nhtab = malloc(sizeof(struct nhashcell *) * NHASH_NBUCKETS);
-    if (!jsoninfo->nhtab)
-    {
-        errno = ENOMEM;
+    if (!nhash_init(&jsoninfo->nhash))
         return 0;
-    }
-
-    for (i = 0; i < NHASH_NBUCKETS; i++)
-        jsoninfo->nhtab[i] = NULL;
-
-    if (!nhash_addstore(jsoninfo))
-    {
-        free(jsoninfo->nhtab);
-        errno = ENOMEM;
-        return 0;
-    }
 
     jsoninfo->nh_nhits   = 0;
     jsoninfo->nh_nmisses = 0;
@@ -189,28 +341,16 @@ static int nhash_new(ltjson_info_t *jsoninfo)
 /*
  *  nhash_reset(jsoninfo) - Reset the hash system up for reuse
  *
- *  Wipe the bucket pointers, clear out the cells and reset the
- *  hit/miss counters.
+ *  Empty the table (which keeps its size), set the name store to be
+ *  reused and reset the hit/miss counters.
  */
 
 static void nhash_reset(ltjson_info_t *jsoninfo)
 {
-    struct nhashcell *nhcp;
-    int i;
-
-    if (!jsoninfo || !jsoninfo->nhtab)
+    if (!jsoninfo)
         return;
 
-    for (i = 0; i < NHASH_NBUCKETS; i++)
-        jsoninfo->nhtab[i] = NULL;
-
-    nhcp = jsoninfo->nhstore;
-
-    while (nhcp)
-    {
-        nhcp[NHASH_CELL_LINKCUR].next = &nhcp[0];
-        nhcp = nhcp[NHASH_CELL_LINKNEXT].next;
-    }
+    nhash_empty(&jsoninfo->nhash);
 
     jsoninfo->nh_nhits   = 0;
     jsoninfo->nh_nmisses = 0;
@@ -220,56 +360,48 @@ static void nhash_reset(ltjson_info_t *jsoninfo)
 
 
 /*
- *  nhash_stats(jsoninfo) - Get hash system statistics
+ *  nhash_ishashed(jsoninfo) - Are the tree's names all interned?
  *
- *  Returns total memory usage
+ *  True if the tree has its own hash table or a dictionary attached.
+ *  Every name in such a tree is then in one or the other.
  */
 
-static int nhash_stats(ltjson_info_t *jsoninfo,
-                       int *bfillp, int *callocp, int *cfillp)
+static int nhash_ishashed(ltjson_info_t *jsoninfo)
 {
-    struct nhashcell *nhcp;
-    int i, bfcnt, cacnt, cfcnt, tmem;
-
-    if (!jsoninfo || !jsoninfo->nhtab)
-    {
-        if (bfillp)
-            *bfillp = 0;
-        if (callocp)
-            *callocp = 0;
-        if (cfillp)
-            *cfillp = 0;
+    return jsoninfo->nhash.tab || jsoninfo->dict;
+}
 
-        return 0;
-    }
 
-    bfcnt = cacnt = cfcnt = tmem = 0;
 
-    tmem = sizeof(struct nhashcell *) * NHASH_NBUCKETS;
 
-    for (i = 0; i < NHASH_NBUCKETS; i++)
-    {
-        if (jsoninfo->nhtab[i] != NULL)
-            bfcnt++;
-    }
+/*
+ *  nhash_stats(jsoninfo) - Get hash system statistics
+ *
+ *  Returns total memory usage
+ */
 
-    nhcp = jsoninfo->nhstore;
+static int nhash_stats(ltjson_info_t *jsoninfo,
+                       int *sfillp, int *nallocp, int *nfillp)
+{
+    int tmem;
 
-    while (nhcp)
+    if (!jsoninfo || !jsoninfo->nhash.tab)
     {
-        cacnt += NHASH_CELL_ALLOC;
-        tmem += sizeof(struct nhashcell) * (NHASH_CELL_ALLOC + 2);
-        cfcnt += nhcp[NHASH_CELL_LINKCUR].next - &nhcp[0];
+        if (sfillp)
+            *sfillp = 0;
+        if (nallocp)
+            *nallocp = 0;
+        if (nfillp)
+            *nfillp = 0;
 
-        nhcp = nhcp[NHASH_CELL_LINKNEXT].next;
+        return 0;
     }
 
-    if (bfillp)
-        *bfillp = bfcnt;
-    if (callocp)
-        *callocp = cacnt;
-    if (cfillp)
-        *cfillp = cfcnt;
+    tmem = sizeof(struct nhashcell) * jsoninfo->nhash.nslots;
+    tmem += sstore_stats(&jsoninfo->nhash.sstore, 0, nallocp, nfillp);
+
+    if (sfillp)
+        *sfillp = jsoninfo->nhash.nfilled;
 
     return tmem;
 }
@@ -278,113 +410,120 @@ static int nhash_stats(ltjson_info_t *jsoninfo,
 
 
 /*
- *  nhash_insert(jsoninfo, s) - Insert string into sstore if required
+ *  nhash_insert(jsoninfo, s, hashp) - Insert string into sstore if required
  *
- *  Lookup the hash of s in jsoninfo's hashtable, if there is one, and
- *  if a string exists already, return that one, otherwise add it to
- *  sstore and to the hash table and return the new string.
+ *  Lookup s in the attached dictionary and then jsoninfo's hashtable,
+ *  if there are any, and if a string exists already, return that one.
+ *  Otherwise add it to the dictionary if that isn't frozen, or else to
+ *  the tree's own table (which is created on the first such miss), and
+ *  return the new string.
  *
  *  Safe to call if no hashtable exists as it just adds the string to the
  *  string store. Adding a blank string ("") just returns a static pointer.
+ *  The name_hash() of s is written to *hashp either way.
  *
  *  Returns: Pointer to new or existing string on success
  *           NULL on error and sets errno (ENOMEM)
  */
 
-static const char *nhash_insert(ltjson_info_t *jsoninfo, const char *s)
+static const char *nhash_insert(ltjson_info_t *jsoninfo, const char *s,
+                                unsigned int *hashp)
 {
     struct nhashcell *nhcp;
-    unsigned long hashval;
+    ltjson_dict_t *dict;
+    int slen;
 
-    assert(jsoninfo && s);
+    assert(jsoninfo && s && hashp);
+
+    slen = strlen(s);
+    *hashp = name_hash(s, slen);
 
-    if (!*s)
+    if (!slen)
         return ltjson_empty_name;
 
-    if (!jsoninfo->nhtab || !jsoninfo->nhstore)
+    if (!nhash_ishashed(jsoninfo))
     {
         /* No hash. Improvise... */
         const char *nvstr;
 
-        nvstr = sstore_add(&jsoninfo->sstore, s);
+        nvstr = sstore_nadd(jsoninfo->alloc, &jsoninfo->sstore, s, slen);
         if (!nvstr)
             return NULL;
 
         return nvstr;
     }
 
-    hashval = djbhash(s) % NHASH_NBUCKETS;
-
-    for (nhcp = jsoninfo->nhtab[hashval]; nhcp != NULL; nhcp = nhcp->next)
+    if ((dict = jsoninfo->dict) != NULL)
     {
-        if (strcmp(s, nhcp->s) == 0)
+        nhcp = nhash_find(&dict->nhash, s, slen, *hashp,
+                          &jsoninfo->nh_nmisses);
+        if (nhcp->s)
         {
             jsoninfo->nh_nhits++;
-            return nhcp->s;             /* Found */
+            return nhcp->s;             /* Found in dictionary */
         }
-    }
-
-    if (jsoninfo->nhtab[hashval])
-        jsoninfo->nh_nmisses++;
-
-
-    /* No match. Get an empty cell and store new string... */
 
-    if (jsoninfo->nhstore[NHASH_CELL_LINKCUR].next ==
-            &jsoninfo->nhstore[NHASH_CELL_LINKCUR])
-    {
-        /* "Next available" cell pointer points to its own storage
-           cell. This means we're out of cells in the current block */
+        if (!dict->frozen)
+            return nhash_store(&dict->nhash, s, slen, *hashp);
 
-        if (!nhash_addstore(jsoninfo))
+        if (!jsoninfo->nhash.tab && !nhash_init(&jsoninfo->nhash))
             return NULL;
     }
 
-    nhcp = jsoninfo->nhstore[NHASH_CELL_LINKCUR].next++;
-
-
-    nhcp->s = sstore_add(&jsoninfo->sstore, s);
-    if (!nhcp->s)
-        return NULL;
+    nhcp = nhash_find(&jsoninfo->nhash, s, slen, *hashp,
+                      &jsoninfo->nh_nmisses);
+    if (nhcp->s)
+    {
+        jsoninfo->nh_nhits++;
+        return nhcp->s;                 /* Found */
+    }
 
-    nhcp->next = jsoninfo->nhtab[hashval];
-    jsoninfo->nhtab[hashval] = nhcp;
+    /* No match. Store new string... */
 
-    return nhcp->s;
+    return nhash_store(&jsoninfo->nhash, s, slen, *hashp);
 }
 
 
 
 
 /*
- *  nhash_lookup(jsoninfo, s) - Lookup string in hash table
+ *  nhash_nlookup(jsoninfo, s, n, hash) - Lookup string in hash table
+ *
+ *  As nhash_lookup below except s is of length n (and need not be null
+ *  terminated) and hash is its name_hash().
  *
  *  Returns: Pointer to constant string on success
  *           NULL if not found with errno set to 0
  *           NULL if no hash table with errno set to ENOENT
  */
 
-static const char *nhash_lookup(ltjson_info_t *jsoninfo, const char *s)
+static const char *nhash_nlookup(ltjson_info_t *jsoninfo, const char *s,
+                                 int n, unsigned int hash)
 {
     struct nhashcell *nhcp;
-    unsigned long hashval;
 
     assert(jsoninfo && s);
 
-    if (!*s)
+    if (!n)
         return ltjson_empty_name;
 
-    if (!jsoninfo->nhtab)
+    if (!nhash_ishashed(jsoninfo))
     {
         errno = ENOENT;
         return NULL;
     }
 
-    hashval = djbhash(s) % NHASH_NBUCKETS;
+    if (jsoninfo->dict)
+    {
+        nhcp = nhash_find(&jsoninfo->dict->nhash, s, n, hash, NULL);
+        if (nhcp->s)
+            return nhcp->s;
+    }
 
-    for (nhcp = jsoninfo->nhtab[hashval]; nhcp != NULL; nhcp = nhcp->next)
+    if (jsoninfo->nhash.tab)
     {
-        if (strcmp(s, nhcp->s) == 0)
+        nhcp = nhash_find(&jsoninfo->nhash, s, n, hash, NULL);
+        if (nhcp->s)
             return nhcp->s;
     }
 
@@ -393,6 +532,28 @@ static const char *nhash_lookup(ltjson_info_t *jsoninfo, const char *s)
 }
 
 
+
+
+/*
+ *  nhash_lookup(jsoninfo, s) - Lookup string in hash table
+ *
+ *  Returns: Pointer to constant string on success
+ *           NULL if not found with errno set to 0
+ *           NULL if no hash table with errno set to ENOENT
+ */
+
+static const char *nhash_lookup(ltjson_info_t *jsoninfo, const char *s)
+{
+    int slen;
+
+    assert(jsoninfo && s);
+
+    slen = strlen(s);
+
+    return nhash_nlookup(jsoninfo, s, slen, name_hash(s, slen));
+}
+
+
 #endif  /* _LTJSON_INLINE_INCLUDE_ */
 
 
@@ -0,0 +1,342 @@
+/*
+ *  ltindex.c (as include): Object member index
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A tree parsed with LTJSON_PARSE_MEMBERINDEX has one open addressed
+    table (.mitab) for the members of all of its wide objects. A cell
+    is keyed on the object node and the member's name hash, so the
+    lookup of a member doesn't have to walk the object at all.
+
+    An object is only indexed once a ltjson_get_member() walk of it
+    has gone MINDEX_MIN_MEMBERS nodes. Then every member is entered,
+    except later duplicates of a name as get_member finds the first,
+    and the object is flagged with JSONNODE_NFLAGS_INDEXED.
+
+    Anything that changes which member is first to have a name must
+    update or drop the index of that object. Dropped entries are left
+    as tombstones until the table is next rebuilt. Recycling the tree
+    simply empties the table.
+*/
+
+
+static ltjson_node_t mindex_tombstone;      /* .obj of a dropped entry */
+
+
+
+
+/*
+ *  mindex_slot(obj, hash) - Starting slot (unreduced) for a member
+ */
+
+static unsigned int mindex_slot(const ltjson_node_t *obj, unsigned int hash)
+{
+    size_t ptrval = (size_t)obj;
+
+    return hash ^ ((unsigned int)(ptrval >> 4) * 0x9E3779B1U);
+}
+
+
+
+
+/*
+ *  mindex_free(jsoninfo) - Free the member index, if any
+ */
+
+static void mindex_free(ltjson_info_t *jsoninfo)
+{
+    mem_free(jsoninfo->alloc, jsoninfo->mitab);
+
+    jsoninfo->mitab = 0;
+    jsoninfo->mi_nslots = 0;
+    jsoninfo->mi_nused = 0;
+}
+
+
+
+
+/*
+ *  mindex_reset(jsoninfo) - Empty the member index for a recycled tree
+ */
+
+static void mindex_reset(ltjson_info_t *jsoninfo)
+{
+    if (!jsoninfo->mitab)
+        return;
+
+    memset(jsoninfo->mitab, 0, jsoninfo->mi_nslots * sizeof(struct mindexcell));
+    jsoninfo->mi_nused = 0;
+}
+
+
+
+
+/*
+ *  mindex_rebuild(jsoninfo, nlive) - Reallocate the table for more entries
+ *
+ *  The new table has room for twice the nlive entries in use (so it may
+ *  not grow at all if it is full of tombstones). Tombstones are dropped.
+ *
+ *  Returns 1 on success, 0 on failure with errno set to ENOMEM
+ */
+
+static int mindex_rebuild(ltjson_info_t *jsoninfo, int nlive)
+{
+    struct mindexcell *newtab, *micp;
+    unsigned int mask;
+    int i, nslots;
+
+    nslots = MINDEX_INIT_SLOTS;
+
+    while ((nlive + 1) * 200 > nslots * MINDEX_LOAD_PCT)
+        nslots *= 2;
+
+    newtab = mem_zalloc(jsoninfo->alloc, nslots * sizeof(struct mindexcell));
+    if (!newtab)
+        return 0;
+
+    mask = nslots - 1;
+    nlive = 0;
+
+    for (i = 0; i < jsoninfo->mi_nslots; i++)
+    {
+        micp = &jsoninfo->mitab[i];
+
+        if (!micp->obj || micp->obj == &mindex_tombstone)
+            continue;
+
+        nlive++;
+
+        micp = &newtab[mindex_slot(micp->obj, micp->hash) & mask];
+
+        while (micp->obj)
+        {
+            if (++micp == newtab + nslots)
+                micp = newtab;
+        }
+
+        *micp = jsoninfo->mitab[i];
+    }
+
+    mem_free(jsoninfo->alloc, jsoninfo->mitab);
+
+    jsoninfo->mitab = newtab;
+    jsoninfo->mi_nslots = nslots;
+    jsoninfo->mi_nused = nlive;
+    return 1;
+}
+
+
+
+
+/*
+ *  mindex_find(jsoninfo, obj, name, hash, nameishash) - Find a member
+ *
+ *  Look up the member of indexed object obj called name, where hash is
+ *  the name_hash() of name. If nameishash, name is a hash string and
+ *  is compared by pointer.
+ *
+ *  Returns the member node or NULL if obj has no such member
+ */
+
+static ltjson_node_t *mindex_find(ltjson_info_t *jsoninfo,
+                                  const ltjson_node_t *obj, const char *name,
+                                  unsigned int hash, int nameishash)
+{
+    struct mindexcell *micp, *miend;
+
+    assert(jsoninfo->mitab && (obj->nflags & JSONNODE_NFLAGS_INDEXED));
+
+    miend = jsoninfo->mitab + jsoninfo->mi_nslots;
+    micp = jsoninfo->mitab + (mindex_slot(obj, hash) &
+                             (jsoninfo->mi_nslots - 1));
+
+    while (micp->obj)
+    {
+        if (micp->obj == obj && micp->hash == hash)
+        {
+            if (nameishash)
+            {
+                if (micp->member->name == name)
+                    return micp->member;
+            }
+            else
+            {
+                if (strcmp(micp->member->name, name) == 0)
+                    return micp->member;
+            }
+        }
+
+        if (++micp == miend)
+            micp = jsoninfo->mitab;
+    }
+
+    return NULL;
+}
+
+
+
+
+/*
+ *  mindex_enter(jsoninfo, obj, member) - Enter a member into the table
+ *
+ *  The member (of obj) must not be in there already under its name.
+ *
+ *  Returns 1 on success, 0 on failure with errno set to ENOMEM
+ */
+
+static int mindex_enter(ltjson_info_t *jsoninfo, ltjson_node_t *obj,
+                        ltjson_node_t *member)
+{
+    struct mindexcell *micp, *miend;
+
+    if ((jsoninfo->mi_nused + 1) * 100 > jsoninfo->mi_nslots * MINDEX_LOAD_PCT)
+    {
+        int i, nlive = 0;
+
+        for (i = 0; i < jsoninfo->mi_nslots; i++)
+        {
+            if (jsoninfo->mitab[i].obj &&
+                    jsoninfo->mitab[i].obj != &mindex_tombstone)
+                nlive++;
+        }
+
+        if (!mindex_rebuild(jsoninfo, nlive))
+            return 0;
+    }
+
+    miend = jsoninfo->mitab + jsoninfo->mi_nslots;
+    micp = jsoninfo->mitab + (mindex_slot(obj, member->namehash) &
+                             (jsoninfo->mi_nslots - 1));
+
+    while (micp->obj)
+    {
+        if (++micp == miend)
+            micp = jsoninfo->mitab;
+    }
+
+    micp->obj    = obj;
+    micp->member = member;
+    micp->hash   = member->namehash;
+
+    jsoninfo->mi_nused++;
+    return 1;
+}
+
+
+
+
+/*
+ *  mindex_drop(jsoninfo, obj) - Drop the index of an object
+ *
+ *  Each member's entry becomes a tombstone and obj is no longer flagged
+ *  as indexed. It will be indexed again if it is walked again.
+ */
+
+static void mindex_drop(ltjson_info_t *jsoninfo, ltjson_node_t *obj)
+{
+    struct mindexcell *micp, *miend;
+    ltjson_node_t *member;
+
+    if (!(obj->nflags & JSONNODE_NFLAGS_INDEXED))
+        return;
+
+    obj->nflags &= ~JSONNODE_NFLAGS_INDEXED;
+
+    miend = jsoninfo->mitab + jsoninfo->mi_nslots;
+
+    for (member = obj->val.subnode; member; member = member->next)
+    {
+        micp = jsoninfo->mitab + (mindex_slot(obj, member->namehash) &
+                                 (jsoninfo->mi_nslots - 1));
+
+        while (micp->obj)
+        {
+            if (micp->obj == obj && micp->member == member)
+            {
+                micp->obj = &mindex_tombstone;
+                break;
+            }
+
+            if (++micp == miend)
+                micp = jsoninfo->mitab;
+        }
+    }
+}
+
+
+
+
+/*
+ *  mindex_build(jsoninfo, obj) - Index all members of an object
+ *
+ *  Only the first member with each name is entered. On running out of
+ *  memory the object is left unindexed (so lookups still work).
+ *
+ *  Returns 1 on success, 0 on failure with errno set to ENOMEM
+ */
+
+static int mindex_build(ltjson_info_t *jsoninfo, ltjson_node_t *obj)
+{
+    ltjson_node_t *member;
+
+    assert(obj->ntype == LTJSON_NTYPE_OBJECT && obj->nflags == 0);
+
+    if (!jsoninfo->mitab && !mindex_rebuild(jsoninfo, 0))
+        return 0;
+
+    obj->nflags |= JSONNODE_NFLAGS_INDEXED;
+
+    for (member = obj->val.subnode; member; member = member->next)
+    {
+        if (mindex_find(jsoninfo, obj, member->name, member->namehash, 0))
+            continue;
+
+        if (!mindex_enter(jsoninfo, obj, member))
+        {
+            mindex_drop(jsoninfo, obj);
+            errno = ENOMEM;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+
+/*
+ *  mindex_added(jsoninfo, obj, member) - Update index for a new member
+ *
+ *  A member just added to obj is entered into its index if obj has one.
+ *  If there is already a member by that name, which one comes first
+ *  isn't known here so the whole index is dropped instead.
+ */
+
+static void mindex_added(ltjson_info_t *jsoninfo, ltjson_node_t *obj,
+                         ltjson_node_t *member)
+{
+    if (!(obj->nflags & JSONNODE_NFLAGS_INDEXED))
+        return;
+
+    if (mindex_find(jsoninfo, obj, member->name, member->namehash, 0) ||
+            !mindex_enter(jsoninfo, obj, member))
+        mindex_drop(jsoninfo, obj);
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -17,6 +17,8 @@
 #include <strings.h>
 #include <ctype.h>
 #include <assert.h>
+#include <limits.h>
+#include <float.h>
 
 #include "ltjson.h"
 
@@ -25,12 +27,24 @@
 
 #include "ltlocal.h"
 
-#include "lttext.c"     /* code inline include */
+#include "ltscan.c"     /* code inline include */
+#include "ltnumber.c"
+#include "ltalloc.c"
+#include "lttext.c"
 #include "lthash.c"
+#include "ltindex.c"
+#include "ltnindex.c"
+#include "ltfilter.c"
+#include "lttape.c"
+#include "ltfile.c"
+#include "ltcount.c"
 
 
-/* This extern can be set by the caller to change the number of
-   basenodes allocated every time we run out */
+/* This extern can be set by the caller to fix the number of nodes
+   allocated every time we run out. Left at 0, each set of nodes is
+   twice the size of the last (up to JSONNODE_MAX_ALLOC) and a tree
+   that needed more than one set is given a single set to fit when it
+   is recycled (see recycle_nodes) */
 
 int ltjson_allocsize_nodes;
 
@@ -40,10 +54,11 @@ int ltjson_allocsize_nodes;
 /*  Memory layout
     -------------
 
-    The storage for the json nodes is allocated in sets (set by
+    The storage for the json nodes is allocated in sets (the next of
     jsoninfo->nodeasize) with the first node in the set denoted the
     "basenode". This node uses the same structure as a normal node
-    so it overlays node usage information into that structure:
+    so it overlays node usage information into that structure (.nused
+    and the size of the set in .namehash):
 
         [bn] -> [bn] -> [bn] -> [bn] -+
          ^----------------------------+
@@ -72,34 +87,151 @@ int ltjson_allocsize_nodes;
 
 
 /*
- *  create_tree(jsoninfo) - Creates info structures for the json tree
+ *  free_nodes(alloc, cbasenode) - Free the ring of node sets
+ */
+
+static void free_nodes(const ltjson_alloc_t *alloc, ltjson_node_t *cbasenode)
+{
+    ltjson_node_t *basenode, *node;
+
+    if (!cbasenode)
+        return;
+
+    /* basenodes are in a ring linked by .next. Break the
+       ring first and then traverse from head to tail */
+
+    node = cbasenode->next;   /* can be itself! */
+    cbasenode->next = NULL;
+
+    do {
+        basenode = node;
+        node = basenode->next;
+        mem_free(alloc, basenode);
+    } while (node != NULL);
+}
+
+
+
+
+/*
+ *  recycle_nodes(jsoninfo) - Set the node sets up to be reused
+ *
+ *  If the last tree filled more than one set, they are freed instead
+ *  and the next set allocated is sized to hold all of that tree (plus
+ *  an eighth), unless the set size is fixed or the memory can't be
+ *  used again (an arena).
+ */
+
+static void recycle_nodes(ltjson_info_t *jsoninfo)
+{
+    ltjson_node_t *basenode;
+    int nused, nsets;
+
+    if (!jsoninfo->cbasenode)
+        return;
+
+    basenode = jsoninfo->cbasenode->ancnode;    /* First basenode */
+    nused = nsets = 0;
+
+    for (;;)
+    {
+        nused += basenode->val.nused - 1;
+        nsets++;
+
+        if (basenode == jsoninfo->cbasenode)
+            break;
+
+        basenode = basenode->next;
+    }
+
+    if (nsets > 1 && !ltjson_allocsize_nodes && mem_canfree(jsoninfo->alloc))
+    {
+        free_nodes(jsoninfo->alloc, jsoninfo->cbasenode);
+
+        jsoninfo->cbasenode = 0;
+        jsoninfo->nodeasize = nused + nused / 8 + 1;
+        return;
+    }
+
+    /* Mark each one to be reused */
+
+    basenode = jsoninfo->cbasenode->ancnode;
+
+    do {
+        basenode->val.nused = 1;
+        basenode = basenode->next;
+    } while (basenode != basenode->ancnode);
+
+    /* Set current basenode to be the first basenode: */
+
+    jsoninfo->cbasenode = basenode;
+}
+
+
+
+
+/*
+ *  create_tree(jsoninfo, alloc) - Creates info structures for the json tree
  *
  *  The JSON info root is default created with no base node allocations
+ *  and all its memory is got from alloc (NULL for the C library).
  *
  *  If jsoninfo is passed as non-NULL, the tree is simply recycled and
- *  all memories (including sstore and hashes) are set to be reused.
+ *  all memories (sstore and nodes) are set to be reused. The hash is
+ *  left alone: ltjson_parse() decides whether to reset, keep or free it.
  *
  *  Returns: pointer to jsoninfo on success
  *           NULL if out of memory (errno to ENOMEM)
  */
 
-static ltjson_info_t *create_tree(ltjson_info_t *jsoninfo)
+static ltjson_info_t *create_tree(ltjson_info_t *jsoninfo,
+                                  const ltjson_alloc_t *alloc)
 {
+    int i;
+
     if (jsoninfo == NULL)
     {
-        jsoninfo = malloc(sizeof(ltjson_info_t));
+        jsoninfo = mem_alloc(alloc, sizeof(ltjson_info_t));
         if (!jsoninfo)
-        {
-            errno = ENOMEM;
             return NULL;
+
+        if (alloc)
+        {
+            jsoninfo->allocator = *alloc;
+            jsoninfo->alloc = &jsoninfo->allocator;
+        }
+        else
+        {
+            jsoninfo->alloc = NULL;
         }
 
         jsoninfo->sstore    = sstore_new();
         jsoninfo->workstr   = NULL;
         jsoninfo->workalloc = 0;
         jsoninfo->cbasenode = 0;
-        jsoninfo->nhtab     = 0;
-        jsoninfo->nhstore   = 0;
+        jsoninfo->nhash.tab     = 0;
+        jsoninfo->nhash.sstore  = 0;
+        jsoninfo->nhash.nslots  = 0;
+        jsoninfo->nhash.nfilled = 0;
+        jsoninfo->nhash.alloc   = jsoninfo->alloc;
+        jsoninfo->dict          = 0;
+        jsoninfo->nh_nhits      = 0;
+        jsoninfo->nh_nmisses    = 0;
+        jsoninfo->sax           = 0;
+        jsoninfo->saxctx        = 0;
+        jsoninfo->filter        = 0;
+        jsoninfo->tape          = 0;
+        jsoninfo->parts         = 0;
+        jsoninfo->map           = 0;
+        jsoninfo->mapsize       = 0;
+        jsoninfo->mitab         = 0;
+        jsoninfo->mi_nslots     = 0;
+        jsoninfo->mi_nused      = 0;
+        jsoninfo->nindex        = 0;
+
+#ifdef LTJSON_COUNTERS
+        memset(&jsoninfo->counters, 0, sizeof(ltjson_counters_t));
+#endif
 
         /* And set the node allocation size once, right here */
 
@@ -123,46 +255,51 @@ static ltjson_info_t *create_tree(ltjson_info_t *jsoninfo)
        initialised as per get_new_node(). Then use the root entry
        to point to that node_t (more consistent pointer usage).
 
-       .cbasenode, .sstore, .workstr, .workalloc, .nhtab, .nhstore
-       will already be valid or are set in the above code.
+       .cbasenode, .sstore, .workstr, .workalloc, .nhash, .dict, .mitab,
+       .sax, .saxctx, .filter, .tape and .parts will already be valid or are
+       set in the above code. The strings in a mapped file go with the
+       nodes that point at them (.map).
        Init everything else:
     */
 
-    jsoninfo->rootnode.name    = NULL;
-    jsoninfo->rootnode.ntype   = LTJSON_NTYPE_EMPTY;
-    jsoninfo->rootnode.nflags  = 0;
-    jsoninfo->rootnode.next    = NULL;
-    jsoninfo->rootnode.ancnode = NULL;
+    jsoninfo->rootnode.name     = NULL;
+    jsoninfo->rootnode.ntype    = LTJSON_NTYPE_EMPTY;
+    jsoninfo->rootnode.nflags   = 0;
+    jsoninfo->rootnode.namehash = 0;
+    jsoninfo->rootnode.next     = NULL;
+    jsoninfo->rootnode.ancnode  = NULL;
 
     jsoninfo->root = &jsoninfo->rootnode;
     jsoninfo->open = 0;
+    jsoninfo->pflags = 0;
 
+    jsoninfo->freenodes  = 0;
+    jsoninfo->textend    = 0;
+    jsoninfo->textdone   = 0;
     jsoninfo->lasterr    = 0;
     jsoninfo->incomplete = 0;
+    jsoninfo->worklen    = 0;
+    jsoninfo->workescape = 0;
 
 
-    if (jsoninfo->nhtab)
-        nhash_reset(jsoninfo);
-
     if (jsoninfo->sstore)
-        sstore_clear(&jsoninfo->sstore);
-
-    if (jsoninfo->cbasenode)
-    {
-        /* Existing basenodes. Mark each one to be reused */
+        sstore_clear(jsoninfo->alloc, &jsoninfo->sstore);
 
-        ltjson_node_t *basenode;
+    mindex_reset(jsoninfo);
+    nindex_free(jsoninfo);
+    recycle_nodes(jsoninfo);
 
-        basenode = jsoninfo->cbasenode->ancnode;    /* First basenode */
+    file_unmap(jsoninfo->map, jsoninfo->mapsize);
+    jsoninfo->map = 0;
+    jsoninfo->mapsize = 0;
 
-        do {
-            basenode->val.nused = 1;
-            basenode = basenode->next;
-        } while (basenode != basenode->ancnode);
-
-        /* Set current basenode to be the first basenode: */
-
-        jsoninfo->cbasenode = basenode;
+    if (jsoninfo->parts)
+    {
+        for (i = 0; i < LTJSON_BATCH_MAXTHREADS; i++)
+        {
+            if (jsoninfo->parts[i])
+                create_tree((ltjson_info_t *)jsoninfo->parts[i], NULL);
+        }
     }
 
     return jsoninfo;
@@ -176,40 +313,47 @@ static ltjson_info_t *create_tree(ltjson_info_t *jsoninfo)
  *
  *  This uses the information in jsoninfo to free all memory associated
  *  with the tree. It then frees jsoninfo (the pointer is thus invalid).
- *  The minimum to free is that created by create_tree(0) above.
+ *  The minimum to free is that created by create_tree(0, alloc) above.
  */
 
 static void destroy_tree(ltjson_info_t *jsoninfo)
 {
-    ltjson_node_t *basenode, *node;
+    ltjson_alloc_t allocator, *alloc = NULL;
+    int i;
 
     if (!jsoninfo)
         return;
 
-    nhash_free(jsoninfo);
-    sstore_free(&jsoninfo->sstore);
-    free(jsoninfo->workstr);
+    /* The allocator lives in jsoninfo, which goes last */
 
-    if (jsoninfo->cbasenode)
+    if (jsoninfo->alloc)
     {
-        basenode = jsoninfo->cbasenode;
+        allocator = jsoninfo->allocator;
+        alloc = &allocator;
+    }
 
-        /* basenodes are in a ring linked by .next. Break the
-           ring first and then traverse from head to tail */
+    nhash_free(jsoninfo);
+    mindex_free(jsoninfo);
+    nindex_free(jsoninfo);
+    filter_free(jsoninfo);
+    tape_free(jsoninfo);
 
-        node = basenode->next;    /* can be itself! */
-        basenode->next = NULL;
+    if (jsoninfo->parts)
+    {
+        for (i = 0; i < LTJSON_BATCH_MAXTHREADS; i++)
+            destroy_tree((ltjson_info_t *)jsoninfo->parts[i]);
 
-        do {
-            basenode = node;
-            node = basenode->next;
-            free(basenode);
-        } while (node != NULL);
+        mem_free(alloc, jsoninfo->parts);
     }
 
+    sstore_free(alloc, &jsoninfo->sstore);
+    mem_free(alloc, jsoninfo->workstr);
+    free_nodes(alloc, jsoninfo->cbasenode);
+    file_unmap(jsoninfo->map, jsoninfo->mapsize);
+
     /* finally, free the info structure itself */
 
-    free(jsoninfo);
+    mem_free(alloc, jsoninfo);
 }
 
 
@@ -232,9 +376,12 @@ static ltjson_node_t *get_new_node(ltjson_info_t *jsoninfo)
 
     basenode = jsoninfo->cbasenode;
 
-    if (basenode && basenode->val.nused < jsoninfo->nodeasize)
+    if (basenode && basenode->val.nused < (int)basenode->namehash)
     {
         newnode = basenode + basenode->val.nused;
+
+        if (basenode->val.nused == 1)
+            COUNT_ADD(jsoninfo, nodereuses, 1);     /* Recycled set */
     }
     else
     {
@@ -249,18 +396,29 @@ static ltjson_node_t *get_new_node(ltjson_info_t *jsoninfo)
         {
             /* Out of available buffers */
 
-            newnode = malloc(jsoninfo->nodeasize * sizeof(ltjson_node_t));
+            newnode = mem_alloc(jsoninfo->alloc,
+                                jsoninfo->nodeasize * sizeof(ltjson_node_t));
             if (newnode == NULL)
-            {
-                errno = ENOMEM;
                 return NULL;
-            }
+
+            COUNT_ADD(jsoninfo, nodesets, 1);
 
             newnode->name      = NULL;
             newnode->ntype     = LTJSON_NTYPE_BASENODE;
             newnode->nflags    = 0;
+            newnode->namehash  = jsoninfo->nodeasize;
             newnode->val.nused = 1;
 
+            /* Double the next set (the basenode aside) */
+
+            if (!ltjson_allocsize_nodes &&
+                jsoninfo->nodeasize <= JSONNODE_MAX_ALLOC)
+            {
+                jsoninfo->nodeasize = 2 * (jsoninfo->nodeasize - 1) + 1;
+                if (jsoninfo->nodeasize > JSONNODE_MAX_ALLOC + 1)
+                    jsoninfo->nodeasize = JSONNODE_MAX_ALLOC + 1;
+            }
+
             if (basenode)
             {
                 /* Insert into ring */
@@ -280,18 +438,22 @@ static ltjson_node_t *get_new_node(ltjson_info_t *jsoninfo)
             /* Reuse existing buffer */
             newnode = basenode->next;
             assert(newnode->val.nused == 1);
+
+            COUNT_ADD(jsoninfo, nodereuses, 1);
         }
 
         jsoninfo->cbasenode = newnode++;
     }
 
     jsoninfo->cbasenode->val.nused++;
+    COUNT_ADD(jsoninfo, nodes, 1);
 
-    newnode->name    = NULL;
-    newnode->ntype   = LTJSON_NTYPE_EMPTY;
-    newnode->nflags  = 0;
-    newnode->next    = NULL;
-    newnode->ancnode = NULL;
+    newnode->name     = NULL;
+    newnode->ntype    = LTJSON_NTYPE_EMPTY;
+    newnode->nflags   = 0;
+    newnode->namehash = 0;
+    newnode->next     = NULL;
+    newnode->ancnode  = NULL;
 
     return newnode;
 }
@@ -299,6 +461,73 @@ static ltjson_node_t *get_new_node(ltjson_info_t *jsoninfo)
 
 
 
+/*
+ *  reserve_nodes(jsoninfo, nnodes) - Make sure nnodes nodes are to hand
+ *
+ *  Counting what's left of the current set and the sets after it in
+ *  the ring (a recycled tree's), if that's short of nnodes then one set
+ *  just big enough is added to the end of the ring. get_new_node then
+ *  needs no allocation for the next nnodes nodes.
+ *
+ *  Returns: 1 on success
+ *           0 if out of memory (errno to ENOMEM)
+ */
+
+static int reserve_nodes(ltjson_info_t *jsoninfo, int nnodes)
+{
+    ltjson_node_t *basenode, *newnode;
+    int avail;
+
+    basenode = jsoninfo->cbasenode;
+    avail = 0;
+
+    if (basenode)
+    {
+        avail = (int)basenode->namehash - basenode->val.nused;
+
+        while (avail < nnodes && basenode->next != basenode->ancnode)
+        {
+            basenode = basenode->next;
+            avail += (int)basenode->namehash - 1;
+        }
+    }
+
+    if (avail >= nnodes)
+        return 1;
+
+    newnode = mem_alloc(jsoninfo->alloc,
+                        (nnodes - avail + 1) * sizeof(ltjson_node_t));
+    if (newnode == NULL)
+        return 0;
+
+    COUNT_ADD(jsoninfo, nodesets, 1);
+
+    newnode->name      = NULL;
+    newnode->ntype     = LTJSON_NTYPE_BASENODE;
+    newnode->nflags    = 0;
+    newnode->namehash  = nnodes - avail + 1;
+    newnode->val.nused = 1;
+
+    if (basenode)
+    {
+        /* basenode is the last in the ring */
+        newnode->next    = basenode->ancnode;
+        newnode->ancnode = basenode->ancnode;
+        basenode->next   = newnode;
+    }
+    else
+    {
+        newnode->next    = newnode;
+        newnode->ancnode = newnode;
+        jsoninfo->cbasenode = newnode;
+    }
+
+    return 1;
+}
+
+
+
+
 /*
  *  begin_tree(jsoninfo, firstch, curnodep) - Begin json tree with the root
  *
@@ -386,6 +615,44 @@ static ltjson_node_t *traverse_tree_nodes(ltjson_node_t *node,
 
 
 
+/*
+ *  workstr_reserve(jsoninfo, need) - Make room in .workstr
+ *
+ *  Grow .workstr (by doubling) until at least need bytes are allocated.
+ *
+ *  Warning: This routine may move the .workstr pointer.
+ *
+ *  Returns: 1 on success
+ *           0 if out of memory (errno to ENOMEM)
+ */
+
+static int workstr_reserve(ltjson_info_t *jsoninfo, int need)
+{
+    char *newstore;
+    int newalloc;
+
+    if (need <= jsoninfo->workalloc)
+        return 1;
+
+    newalloc = jsoninfo->workalloc ? jsoninfo->workalloc : WORKSTR_INIT_ALLOC;
+
+    while (newalloc < need)
+        newalloc *= 2;
+
+    newstore = mem_realloc(jsoninfo->alloc, jsoninfo->workstr, newalloc);
+    if (!newstore)
+        return 0;
+
+    jsoninfo->workstr = newstore;
+    jsoninfo->workalloc = newalloc;
+
+    COUNT_ADD(jsoninfo, workgrows, 1);
+    return 1;
+}
+
+
+
+
 /*
  *  store_strnum(jsoninfo, textp) - Store text representations
  *
@@ -394,7 +661,14 @@ static ltjson_node_t *traverse_tree_nodes(ltjson_node_t *node,
  *  partially updated on each call), the first character is used as a type:
  *  string: ", logic: ! and number: none.
  *
- *  Characters are taken from textp whose pointer is moved along.
+ *  Characters are taken from textp, up to .textend, whose pointer is
+ *  moved along. String bodies are copied a run at a time between quotes
+ *  and backslashes (see scan_strbody).
+ *
+ *  The length stored is kept in .worklen. When out of input, that and
+ *  whether a backslash is waiting for its character (.workescape) are
+ *  all a continuation needs to carry on appending, so each text of a
+ *  long string split across many only costs its own length.
  *
  *  Warning: This routine may move the .workstr pointer.
  *
@@ -406,148 +680,143 @@ static ltjson_node_t *traverse_tree_nodes(ltjson_node_t *node,
 
 static char *store_strnum(ltjson_info_t *jsoninfo, const char **textp)
 {
-    const char *s;
-    char *d;
-    int dlen, prev, isnum, islogic;
+    const char *s, *end, *run;
+    int dlen, kind, escape;
 
-    assert(jsoninfo && textp && *textp && **textp);
+    assert(jsoninfo && textp && *textp);
 
     s = *textp;                         /* Source */
-    d = jsoninfo->workstr;              /* Dest, can be 0 */
-    dlen = prev = isnum = islogic = 0;
+    end = jsoninfo->textend;
+    dlen = escape = 0;
+
+    assert(s < end);
 
 
     if (jsoninfo->incomplete)
     {
-        /* Incomplete input. d is guaranteed to have at least
-           one character and to be null terminated */
+        /* Incomplete input. workstr is guaranteed to have at least
+           one character (the type, or a digit) */
 
-        assert(d && *d);
+        assert(jsoninfo->workstr && jsoninfo->worklen > 0);
 
         jsoninfo->incomplete = 0;
 
-        if (*d == '!')
-            islogic = 1;
-        else if (*d != '"')
-            isnum = 1;
-
-        while (*d)                  /* Point at '\0' */
-        {
-            dlen++;
-            d++;
-        }
-
-        prev = *(d - 1);
+        kind = *jsoninfo->workstr;
+        dlen = jsoninfo->worklen;
+        escape = jsoninfo->workescape;
     }
     else
     {
-        /* New string - initalise state */
+        /* New string - initalise state and store any type marker */
+
+        if (!workstr_reserve(jsoninfo, 2))
+            return NULL;
 
         if (*s == '"')
         {
-            prev = '\\';    /* hack! */
+            kind = '"';
+            jsoninfo->workstr[dlen++] = *s++;
         }
         else if (*s == '-' || c_isdigit(*s))
         {
-            isnum = 1;
+            kind = '0';
         }
         else if (c_isalpha(*s))
         {
-            islogic = 1;
-            prev = '!';     /* Flag! */
+            kind = '!';
+            jsoninfo->workstr[dlen++] = '!';
         }
         else
         {
             assert(0);  /* Shouldn't get here */
+            kind = 0;
         }
     }
 
 
-    /* There will always be at least one character
-       in the stream and, if a number, that character
-       is always in the set [0-9-] */
-
-    while (*s)
+    if (kind == '"')
     {
-        /* Need enough space for one char and one terminator */
-
-        if (dlen + 2 > jsoninfo->workalloc)
+        while (s < end)
         {
-            /* Out of storage space */
-
-            char *newstore;
+            if (escape)
+            {
+                /* Character after a backslash is copied as is and
+                   left for unescape_string() to decode */
 
-            if (!jsoninfo->workalloc)
-                jsoninfo->workalloc = WORKSTR_INIT_ALLOC;
+                run = s + 1;
+                escape = 0;
+            }
             else
-                jsoninfo->workalloc *= 2;
-
-            newstore = realloc(jsoninfo->workstr, jsoninfo->workalloc);
-            if (!newstore)
             {
-                errno = ENOMEM;
-                return NULL;
+                run = scan_strbody(s, end);
+
+                if (run == s)
+                {
+                    if (*s == '"')
+                    {
+                        jsoninfo->workstr[dlen] = '\0';
+                        jsoninfo->worklen = dlen;
+                        *textp = ++s;
+                        return jsoninfo->workstr;
+                    }
+
+                    /* Backslash */
+                    run = s + 1;
+                    escape = 1;
+                }
             }
 
-            jsoninfo->workstr = newstore;
-            d = newstore + dlen;
-        }
+            /* Copy s up to run plus room for a terminator */
 
-        /* We're good for two chars! */
+            if (!workstr_reserve(jsoninfo, dlen + (int)(run - s) + 1))
+                return NULL;
 
-        if (islogic)
+            memcpy(jsoninfo->workstr + dlen, s, run - s);
+            dlen += run - s;
+            s = run;
+        }
+    }
+    else
+    {
+        /* Number or logic. Numbers allow + - . 0-9 e E and let
+           convert_to_number figure out validity */
+
+        for (run = s; run < end; run++)
         {
-            if (prev == '!')
+            if (kind == '!')
             {
-                /* Have to store the ! to mark a logic representation but
-                   wasn't sure space available until this point. Store and
-                   loop around without incrementing the s pointer */
-
-                prev = 0;
-                *d++ = '!';
-                dlen++;
-                continue;
+                if (!c_isalpha(*run))
+                    break;
             }
-
-            if (!c_isalpha(*s))
+            else if (!c_isdigit(*run) && *run != '-' && *run != '+' &&
+                     *run != 'e' && *run != 'E' && *run != '.')
             {
-                *d = '\0';
-                *textp = s;
-                return jsoninfo->workstr;
+                break;
             }
         }
 
-        else if (!isnum)    /* string */
-        {
-            if (*s == '"' && prev != '\\')
-            {
-                *d = '\0';
-                *textp = ++s;
-                return jsoninfo->workstr;
-            }
-        }
+        if (!workstr_reserve(jsoninfo, dlen + (int)(run - s) + 1))
+            return NULL;
 
-        else    /* number */
-        {
-            /* Allow + - . 0-9 e E and let strtod figure out validity */
+        memcpy(jsoninfo->workstr + dlen, s, run - s);
+        dlen += run - s;
+        s = run;
 
-            if (!c_isdigit(*s) && *s != '-' && *s != '+' &&
-                                  *s != 'e' && *s != 'E' && *s != '.')
-            {
-                *d = '\0';
-                *textp = s;
-                return jsoninfo->workstr;
-            }
+        if (s < end)
+        {
+            jsoninfo->workstr[dlen] = '\0';
+            jsoninfo->worklen = dlen;
+            *textp = s;
+            return jsoninfo->workstr;
         }
-
-        prev = *s;
-        *d++ = *s++;
-        dlen++;
     }
 
+
     /* We've run out of input */
 
-    *d = '\0';
+    jsoninfo->workstr[dlen] = '\0';
+    jsoninfo->worklen = dlen;
+    jsoninfo->workescape = escape;
     jsoninfo->incomplete = 1;
     *textp = s;
 
@@ -559,48 +828,70 @@ static char *store_strnum(ltjson_info_t *jsoninfo, const char **textp)
 
 
 /*
- *  convert_to_number(numstr, node) - Convert string to number and store
+ *  convert_to_number(numstr, len, node) - Convert number and store
  *
- *  Convert the string numstr to an integer or float and store the result
- *  in the appropriate section in node.
+ *  Convert the len characters at numstr (which need not be null
+ *  terminated) to an integer or float and store the result in the
+ *  appropriate section in node. An integer too big for a long long is
+ *  stored as a float. See ltnumber.c.
  *
  *  Returns 1 on success or 0 on conversion error
  */
 
-static int convert_to_number(const char *numstr, ltjson_node_t *node)
+static int convert_to_number(const char *numstr, int len, ltjson_node_t *node)
 {
-    char *endptr;
-    double dval;
+    struct numparts np;
     long long llval;
+    double dval;
 
-    assert(c_isdigit(*numstr) || *numstr == '-');
-
-    /* Check for leading zeros which aren't strictly valid */
-
-    if (numstr[0] == '-' && numstr[1] == '0' && numstr[2] != '.')
-        return 0;
-    if (numstr[0] == '0' && numstr[1] != '.' && numstr[1] != '\0')
+    if (!num_scan(numstr, len, &np))
         return 0;
 
-    if (strpbrk(numstr, "eE."))
+    if (num_toint(&np, &llval))
     {
-        errno = 0;
-        dval = strtod(numstr, &endptr);
-        if (errno || *endptr)
-            return 0;
-        node->ntype = LTJSON_NTYPE_FLOAT;
-        node->val.d = dval;
-    }
-    else
-    {
-        errno = 0;
-        llval = strtoll(numstr, &endptr, 10);
-        if (errno || *endptr)
-            return 0;
         node->ntype = LTJSON_NTYPE_INTEGER;
         node->val.ll = llval;
+        return 1;
     }
 
+    if (!num_tofloat_exact(&np, &dval) &&
+        !num_tofloat_strtod(numstr, len, &dval))
+        return 0;
+
+    node->ntype = LTJSON_NTYPE_FLOAT;
+    node->val.d = dval;
+    return 1;
+}
+
+
+
+
+/*
+ *  store_rawnumber(jsoninfo, numstr, len, node) - Keep a number as text
+ *
+ *  For LTJSON_PARSE_RAWNUM: the len characters at numstr (a valid
+ *  number) are put in the string store, after RAWNUM_CACHE bytes for
+ *  the value once it has been converted (see ltjson_get_ll).
+ *
+ *  Returns 1 on success, 0 if out of memory (errno to ENOMEM)
+ */
+
+static int store_rawnumber(ltjson_info_t *jsoninfo, const char *numstr,
+                           int len, ltjson_node_t *node)
+{
+    char *raw;
+
+    raw = sstore_space(jsoninfo->alloc, &jsoninfo->sstore,
+                       (int)RAWNUM_CACHE + len);
+    if (!raw)
+        return 0;
+
+    raw += RAWNUM_CACHE;
+    memcpy(raw, numstr, len);
+    raw[len] = '\0';
+
+    node->ntype = LTJSON_NTYPE_NUMRAW;
+    node->val.s = raw;
     return 1;
 }
 
@@ -647,6 +938,69 @@ static int convert_to_logic(const char *logstr, ltjson_node_t *node)
 
 
 
+/*
+ *  insitu_string(jsoninfo, textp) - Terminate and unescape string in text
+ *
+ *  For LTJSON_PARSE_INSITU trees. If the string starting at *textp is
+ *  complete in the current text, overwrite the closing quote with a
+ *  terminator, unescape the contents in place and move *textp past it.
+ *  If the string runs past .textend nothing is changed.
+ *
+ *  Returns: A pointer to the string (in the caller's text) on success
+ *           NULL on failure with errno set to:
+ *                  EAGAIN if the string doesn't end in this text
+ *                  EILSEQ if an escape can't be decoded (sets lasterr)
+ */
+
+static char *insitu_string(ltjson_info_t *jsoninfo, const char **textp)
+{
+    const char *s, *end;
+    char *str;
+    int hasescape = 0;
+
+    assert(**textp == '"');
+
+    s = *textp + 1;
+    end = jsoninfo->textend;
+
+    while ((s = scan_strbody(s, end)) < end && *s != '"')
+    {
+        /* Backslash. Hop over it and the escaped character */
+
+        hasescape = 1;
+
+        if (end - s <= 2)
+        {
+            s = end;
+            break;
+        }
+
+        s += 2;
+    }
+
+    if (s >= end)
+    {
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    str = (char *)*textp + 1;       /* Caller gave us writable text */
+    *(char *)s = '\0';
+
+    if (hasescape && !unescape_string(str))
+    {
+        jsoninfo->lasterr = ERR_SEQ_BADESCAPE;
+        errno = EILSEQ;
+        return NULL;
+    }
+
+    *textp = s + 1;
+    return str;
+}
+
+
+
+
 /*
  *  process_json_alnum(jsoninfo, textp, node)
  *
@@ -685,6 +1039,53 @@ static int process_json_alnum(ltjson_info_t *jsoninfo, const char **textp,
             return 0;
         }
 
+        if ((jsoninfo->pflags & LTJSON_PARSE_INSITU) && !jsoninfo->incomplete)
+        {
+            /* Use the string where it is if it's all there */
+
+            char *str;
+
+            if ((str = insitu_string(jsoninfo, textp)) != NULL)
+            {
+                if (node->name || node->ancnode->ntype == LTJSON_NTYPE_ARRAY)
+                {
+                    node->ntype = LTJSON_NTYPE_STRING;
+                    node->val.s = str;
+                    return 1;
+                }
+
+                if (jsoninfo->sax)
+                {
+                    nvstr = str;        /* Only needed for the event */
+                }
+                else if (jsoninfo->filter && !filter_name(jsoninfo, str))
+                {
+                    nvstr = ltjson_empty_name;  /* Value to be skipped */
+                }
+                else if (nhash_ishashed(jsoninfo) || !*str)
+                {
+                    nvstr = nhash_insert(jsoninfo, str, &node->namehash);
+                }
+                else
+                {
+                    nvstr = str;
+                    node->namehash = name_hash(str, -1);
+                }
+
+                if (!nvstr)
+                    return 0;
+
+                node->name = nvstr;
+                node->nflags = JSONNODE_NFLAGS_COLON;
+                return 1;
+            }
+
+            if (errno != EAGAIN)
+                return 0;
+
+            /* Split across texts. Fall through to copy it */
+        }
+
         if (!store_strnum(jsoninfo, textp))     /* Sets errno */
             return 0;
 
@@ -701,7 +1102,12 @@ static int process_json_alnum(ltjson_info_t *jsoninfo, const char **textp,
             /* Name already set (if object member) or no name (if
                array element). Store the string, don't hash it */
 
-            nvstr = sstore_add(&jsoninfo->sstore, jsoninfo->workstr + 1);
+            if (jsoninfo->sax)
+                nvstr = jsoninfo->workstr + 1;  /* Only for the event */
+            else
+                nvstr = sstore_add(jsoninfo->alloc, &jsoninfo->sstore,
+                                   jsoninfo->workstr + 1);
+
             if (!nvstr)
                 return 0;
 
@@ -713,7 +1119,14 @@ static int process_json_alnum(ltjson_info_t *jsoninfo, const char **textp,
         /* Set the name part of an object member. Hashing available for
            this. Mark the node as looking for the colon (name : value) */
 
-        nvstr = nhash_insert(jsoninfo, jsoninfo->workstr + 1);
+        if (jsoninfo->sax)
+            nvstr = jsoninfo->workstr + 1;      /* Only for the event */
+        else if (jsoninfo->filter &&
+                 !filter_name(jsoninfo, jsoninfo->workstr + 1))
+            nvstr = ltjson_empty_name;          /* Value to be skipped */
+        else
+            nvstr = nhash_insert(jsoninfo, jsoninfo->workstr + 1,
+                                 &node->namehash);
         if (!nvstr)
             return 0;
 
@@ -726,6 +1139,10 @@ static int process_json_alnum(ltjson_info_t *jsoninfo, const char **textp,
 
     else if (firstch == '-' || c_isdigit(firstch))    /* Number */
     {
+        struct numparts np;
+        const char *numstr;
+        int len, rawnum;
+
         if (node->ntype != LTJSON_NTYPE_EMPTY)
         {
             jsoninfo->lasterr = ERR_SEQ_UNEXPNUM;
@@ -740,16 +1157,40 @@ static int process_json_alnum(ltjson_info_t *jsoninfo, const char **textp,
             return 0;
         }
 
-        if (!store_strnum(jsoninfo, textp))
-            return 0;
+        /* Convert a number that is all there from the text itself,
+           otherwise put it together in the working store */
 
-        if (!convert_to_number(jsoninfo->workstr, node))
+        if (!jsoninfo->incomplete &&
+            (len = num_span(*textp, jsoninfo->textend)) > 0)
+        {
+            numstr = *textp;
+            *textp += len;
+        }
+        else
+        {
+            if (!store_strnum(jsoninfo, textp))
+                return 0;
+
+            numstr = jsoninfo->workstr;
+            len = jsoninfo->worklen;
+        }
+
+        /* Events always get the value */
+
+        rawnum = (jsoninfo->pflags & LTJSON_PARSE_RAWNUM) && !jsoninfo->sax;
+
+        if (rawnum ? !num_scan(numstr, len, &np) ||
+                     !num_inrange(numstr, len, &np)
+                   : !convert_to_number(numstr, len, node))
         {
             jsoninfo->lasterr = ERR_SEQ_BADNUMBER;
             errno = EILSEQ;
             return 0;
         }
 
+        if (rawnum)
+            return store_rawnumber(jsoninfo, numstr, len, node);
+
         return 1;
     }
 
@@ -791,14 +1232,213 @@ static int process_json_alnum(ltjson_info_t *jsoninfo, const char **textp,
 
 
 
+/*  Event callbacks
+    ---------------
+
+    A tree with callbacks (ltjson_setsax) is parsed just the same but
+    doesn't keep what it has parsed. Each node is handed to the events
+    as soon as it is filled and is then reused for its next sibling, so
+    there is only ever one node per level of nesting (those under a
+    closed object or array go on the .freenodes list). Strings are given
+    to the events from the working store (or the text for INSITU) and
+    aren't stored or hashed.
+*/
+
+
+/*
+ *  sax_result(jsoninfo, ret) - Check the return of an event callback
+ *
+ *  Returns 1 to carry on, 0 if the callback asked to stop (sets
+ *  errno to ECANCELED and lasterr) or if the tape ran out of memory
+ *  (errno to ENOMEM)
+ */
+
+static int sax_result(ltjson_info_t *jsoninfo, int ret)
+{
+    if (ret)
+        return 1;
+
+    if (jsoninfo->tape && jsoninfo->tape->nomem)
+    {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    jsoninfo->lasterr = ERR_SEQ_SAXSTOP;
+    errno = ECANCELED;
+    return 0;
+}
+
+
+
+
+/*
+ *  sax_node(jsoninfo, node) - Send the event for a filled in node
+ *
+ *  Node has just been given either its name (and waits on the colon)
+ *  or its value by process_json_alnum.
+ *
+ *  Returns as sax_result
+ */
+
+static int sax_node(ltjson_info_t *jsoninfo, ltjson_node_t *node)
+{
+    const ltjson_sax_t *sax = jsoninfo->sax;
+    void *ctx = jsoninfo->saxctx;
+    int ret = 1;
+
+    if (node->nflags == JSONNODE_NFLAGS_COLON)
+    {
+        if (sax->key)
+            ret = sax->key(ctx, node->name);
+
+        node->name = ltjson_empty_name;     /* The string is not kept */
+        return sax_result(jsoninfo, ret);
+    }
+
+    switch (node->ntype)
+    {
+        case LTJSON_NTYPE_STRING:
+            if (sax->string)
+                ret = sax->string(ctx, node->val.s);
+        break;
+
+        case LTJSON_NTYPE_INTEGER:
+            if (sax->integer)
+                ret = sax->integer(ctx, node->val.ll);
+        break;
+
+        case LTJSON_NTYPE_FLOAT:
+            if (sax->floating)
+                ret = sax->floating(ctx, node->val.d);
+        break;
+
+        case LTJSON_NTYPE_BOOL:
+            if (sax->boolean)
+                ret = sax->boolean(ctx, (int)node->val.ll);
+        break;
+
+        case LTJSON_NTYPE_NULL:
+            if (sax->null)
+                ret = sax->null(ctx);
+        break;
+    }
+
+    return sax_result(jsoninfo, ret);
+}
+
+
+
+
+/*
+ *  sax_container(jsoninfo, node, isbegin) - Begin or end object or array
+ *
+ *  Send the event for node (an object or array) being opened or closed.
+ *  On a close, the node under it is put on the free list for reuse.
+ *
+ *  Returns as sax_result
+ */
+
+static int sax_container(ltjson_info_t *jsoninfo, ltjson_node_t *node,
+                         int isbegin)
+{
+    const ltjson_sax_t *sax = jsoninfo->sax;
+    void *ctx = jsoninfo->saxctx;
+    int (*event)(void *);
+
+    if (!isbegin && node->val.subnode)
+    {
+        node->val.subnode->next = jsoninfo->freenodes;
+        jsoninfo->freenodes = node->val.subnode;
+        node->val.subnode = NULL;
+    }
+
+    if (node->ntype == LTJSON_NTYPE_OBJECT)
+        event = isbegin ? sax->begin_object : sax->end_object;
+    else
+        event = isbegin ? sax->begin_array : sax->end_array;
+
+    return sax_result(jsoninfo, event ? event(ctx) : 1);
+}
+
+
+
+
+/*
+ *  sax_stopped(jsoninfo, treeptr) - The parse stops after an event
+ *
+ *  As elsewhere in ltjson_parse, a tree out of memory (here the tape)
+ *  is freed and *treeptr set to NULL.
+ *
+ *  Returns 0
+ */
+
+static int sax_stopped(ltjson_info_t *jsoninfo, ltjson_node_t **treeptr)
+{
+    if (errno == ENOMEM)
+    {
+        destroy_tree(jsoninfo);
+        *treeptr = NULL;
+        errno = ENOMEM;
+    }
+
+    return 0;
+}
+
+
+
+
+/*
+ *  reuse_node(jsoninfo, node) - Get a node for the events to fill
+ *
+ *  If node is given (a sibling that has had its events, or was skipped
+ *  by a filter) it is emptied for reuse. Otherwise a node comes off the
+ *  free list or is allocated.
+ *
+ *  Returns: a pointer to an initialised empty node on success
+ *           NULL if out of memory (errno to ENOMEM)
+ */
+
+static ltjson_node_t *reuse_node(ltjson_info_t *jsoninfo,
+                                 ltjson_node_t *node)
+{
+    if (!node)
+    {
+        if (!jsoninfo->freenodes)
+            return get_new_node(jsoninfo);
+
+        node = jsoninfo->freenodes;
+        jsoninfo->freenodes = node->next;
+        node->ancnode = NULL;
+    }
+
+    node->name     = NULL;
+    node->ntype    = LTJSON_NTYPE_EMPTY;
+    node->nflags   = 0;
+    node->namehash = 0;
+    node->next     = NULL;
+
+    return node;
+}
+
+
+
+
 /*
  *  Inline include of remaining parsing and utility code
  */
 
 #include "ltparse.c"
 #include "ltutils.c"
+#include "ltbuild.c"
+#include "ltclone.c"
 #include "ltpath.c"
 #include "ltsort.c"
+#include "ltdict.c"
+#include "ltwrite.c"
+#include "ltctree.c"
+#include "ltbatch.c"
+#include "ltpool.c"
 
 
 /* vi:set expandtab ts=4 sw=4: */
@@ -11,6 +11,8 @@
 #ifndef _LTJSON_H_
 #define _LTJSON_H_
 
+#include <stddef.h>
+
 
 #define LTJSON_NTYPE_EMPTY      0x00
 #define LTJSON_NTYPE_BASENODE   0x01
@@ -21,12 +23,25 @@
 #define LTJSON_NTYPE_FLOAT      0x06
 #define LTJSON_NTYPE_INTEGER    0x07
 #define LTJSON_NTYPE_STRING     0x08
+#define LTJSON_NTYPE_NUMRAW     0x09
 
 #define LTJSON_MEMSTATS           13
+#define LTJSON_POOLSTATS          18
 
 #define LTJSON_PARSE_USEHASH       1
 #define LTJSON_PARSE_KEEPHASH      2
+#define LTJSON_PARSE_INSITU        4
+#define LTJSON_PARSE_MEMBERINDEX   8
+#define LTJSON_PARSE_RAWNUM       16
 #define LTJSON_SEARCH_NAMEISHASH   1
+#define LTJSON_SEARCH_SKIPMATCHED  2
+#define LTJSON_SORT_DESCENDING     1
+#define LTJSON_CURSOR_NOCOPY       1
+#define LTJSON_PRINT_PRETTY        1
+
+#define LTJSON_PATH_MAXMULTI      64
+#define LTJSON_SEARCH_MAXNAMES    64
+#define LTJSON_BATCH_MAXTHREADS   64
 
 
 typedef struct ltjson_node
@@ -35,6 +50,7 @@ typedef struct ltjson_node
 
     short int ntype;
     short int nflags;
+    unsigned int namehash;      /* Cached hash of name, if named */
 
     union {
         int nused;
@@ -50,11 +66,113 @@ typedef struct ltjson_node
 } ltjson_node_t;
 
 
-extern int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash);
+/* Event callbacks for ltjson_setsax. Any may be NULL. Returning 0 from
+   one stops the parse. Strings are only valid during the callback. */
+
+typedef struct ltjson_sax
+{
+    int (*begin_object)(void *ctx);
+    int (*end_object)(void *ctx);
+    int (*begin_array)(void *ctx);
+    int (*end_array)(void *ctx);
+    int (*key)(void *ctx, const char *name);
+    int (*string)(void *ctx, const char *s);
+    int (*integer)(void *ctx, long long ll);
+    int (*floating)(void *ctx, double d);
+    int (*boolean)(void *ctx, int b);
+    int (*null)(void *ctx);
+
+} ltjson_sax_t;
+
+
+/* Allocator for all of a tree's memory (ltjson_setalloc). Each
+   function is called with ctx as its first argument. */
+
+typedef struct ltjson_alloc
+{
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*resize)(void *ctx, void *mem, size_t size);
+    void (*release)(void *ctx, void *mem);
+    void *ctx;
+
+} ltjson_alloc_t;
+
+
+/* A buffer of text for ltjson_parsev, not null terminated */
+
+typedef struct ltjson_iovec
+{
+    const char *base;
+    size_t len;
+
+} ltjson_iovec_t;
+
+
+/* Where ltjson_cursor_* calls add nodes. Set up by ltjson_cursor_init */
+
+typedef struct ltjson_cursor
+{
+    ltjson_node_t *tree;        /* Tree being added to */
+    ltjson_node_t *parent;      /* Object or array being added to */
+    ltjson_node_t *last;        /* Last node of parent or NULL */
+    int depth;                  /* Number of ltjson_cursor_open calls */
+    int flags;
+
+} ltjson_cursor_t;
+
+
+/* Counters of the work done on a tree (ltjson_getcounters). The tree
+   only keeps them if the library is built with LTJSON_COUNTERS. */
+
+typedef struct ltjson_counters
+{
+    unsigned long long nparses;     /* Parse calls, continuations too  */
+    unsigned long long bytes;       /* Text given to them              */
+    unsigned long long parse_ns;    /* Time spent in them              */
+    unsigned long long nodes;       /* Nodes filled                    */
+    unsigned long long nodesets;    /* Sets of nodes allocated         */
+    unsigned long long nodereuses;  /* Sets of nodes reused (recycled) */
+    unsigned long long workgrows;   /* Working store reallocations     */
+    unsigned long long resumes;     /* Strings etc. split across texts */
+    unsigned long long sstorechain; /* String store blocks, right now  */
+    unsigned long long nsearches;   /* ltjson_search(m) calls          */
+    unsigned long long search_ns;
+    unsigned long long npathrefers; /* ltjson_pathrefer calls          */
+    unsigned long long pathrefer_ns;
+
+} ltjson_counters_t;
+
+
+typedef struct ltjson_dict ltjson_dict_t;   /* Opaque name dictionary */
+typedef struct ltjson_cpath ltjson_cpath_t; /* Opaque compiled path */
+typedef struct ltjson_ctree ltjson_ctree_t; /* Opaque compact tree */
+typedef struct ltjson_pool ltjson_pool_t;   /* Opaque pool of trees */
+
+
+extern int ltjson_parse(ltjson_node_t **treeptr, const char *text, int flags);
+extern int ltjson_parsen(ltjson_node_t **treeptr, const char *text,
+                         size_t len, int flags);
+extern int ltjson_parse_file(ltjson_node_t **treeptr, const char *path,
+                             int flags);
+extern int ltjson_parse_stream(ltjson_node_t **treeptr, const char *text,
+                               size_t len, int flags, size_t *usedp);
+extern int ltjson_parsev(ltjson_node_t **treeptr, const ltjson_iovec_t *iov,
+                         int niov, int flags);
 extern int ltjson_free(ltjson_node_t **treeptr);
+extern int ltjson_setsax(ltjson_node_t **treeptr, const ltjson_sax_t *sax,
+                         void *ctx);
+extern int ltjson_setfilter(ltjson_node_t **treeptr,
+                            const ltjson_cpath_t **cpaths, int npaths);
+extern int ltjson_setalloc(ltjson_node_t **treeptr,
+                           const ltjson_alloc_t *alloc);
+extern int ltjson_setarena(ltjson_node_t **treeptr, void *buf, size_t size);
 
 extern const char *ltjson_lasterror(ltjson_node_t *tree);
 extern int ltjson_display(ltjson_node_t *rnode);
+extern int ltjson_print(ltjson_node_t *rnode, char *buf, int size, int flags);
+extern int ltjson_write(ltjson_node_t *rnode,
+                        int (*writer)(void *ctx, const char *s, int len),
+                        void *ctx, int flags);
 
 extern int ltjson_memstat(ltjson_node_t *tree, int *stats, int nents);
 extern const char *ltjson_statstring(int index);
@@ -67,6 +185,8 @@ extern const char *ltjson_mksearch(ltjson_node_t *tree, const char *name,
 
 extern ltjson_node_t *ltjson_get_member(ltjson_node_t *objnode,
                                         const char *name, int flags);
+extern long long ltjson_get_ll(ltjson_node_t *node);
+extern double ltjson_get_double(ltjson_node_t *node);
 
 extern ltjson_node_t *ltjson_addnode_after(ltjson_node_t *tree,
                                            ltjson_node_t *anode,
@@ -78,19 +198,119 @@ extern ltjson_node_t *ltjson_addnode_under(ltjson_node_t *tree,
                                            short int ntype, const char *name,
                                            const char *sval);
 
+extern int ltjson_cursor_init(ltjson_cursor_t *cur, ltjson_node_t *tree,
+                              ltjson_node_t *parent, int flags);
+extern ltjson_node_t *ltjson_cursor_add(ltjson_cursor_t *cur, short int ntype,
+                                        const char *name);
+extern ltjson_node_t *ltjson_cursor_addll(ltjson_cursor_t *cur,
+                                          const char *name, long long value);
+extern ltjson_node_t *ltjson_cursor_adddouble(ltjson_cursor_t *cur,
+                                              const char *name, double value);
+extern ltjson_node_t *ltjson_cursor_addbool(ltjson_cursor_t *cur,
+                                            const char *name, int value);
+extern ltjson_node_t *ltjson_cursor_addstring(ltjson_cursor_t *cur,
+                                              const char *name,
+                                              const char *s);
+extern ltjson_node_t *ltjson_cursor_open(ltjson_cursor_t *cur,
+                                         short int ntype, const char *name);
+extern int ltjson_cursor_close(ltjson_cursor_t *cur);
+extern int ltjson_cursor_addlls(ltjson_cursor_t *cur, const long long *values,
+                                int n);
+extern int ltjson_cursor_adddoubles(ltjson_cursor_t *cur,
+                                    const double *values, int n);
+extern int ltjson_cursor_addstrings(ltjson_cursor_t *cur, const char **strs,
+                                    int n);
+extern int ltjson_reserve(ltjson_node_t *tree, int nnodes, size_t nbytes);
+
+extern int ltjson_clone(ltjson_node_t **treeptr, ltjson_node_t *src,
+                        int flags);
+extern ltjson_node_t *ltjson_graft(ltjson_node_t *tree, ltjson_node_t *under,
+                                   ltjson_node_t *src, const char *name);
+extern int ltjson_detach(ltjson_node_t *tree, ltjson_node_t *node);
+extern int ltjson_compact(ltjson_node_t *tree);
+
 extern int ltjson_sort(ltjson_node_t *snode,
                        int (*compar)(ltjson_node_t *, ltjson_node_t *,
                                      ltjson_node_t *, void *),
                        void *extrap);
+extern int ltjson_sortby(ltjson_node_t *snode, const ltjson_cpath_t *cpath,
+                         const char *name, int flags);
 
 extern ltjson_node_t *ltjson_search(ltjson_node_t *rnode, const char *name,
                                     ltjson_node_t *fromnode, int flags);
 
+extern int ltjson_searchm(ltjson_node_t *rnode, const char **names,
+                          int nnames, ltjson_node_t **nodeptr, int nnodes,
+                          int flags);
+extern int ltjson_nameindex(ltjson_node_t *tree);
+
 extern int ltjson_promote(ltjson_node_t *rnode, const char *name);
 
 extern int ltjson_pathrefer(ltjson_node_t *tree, const char *path,
                             ltjson_node_t **nodeptr, int nnodes);
 
+extern ltjson_cpath_t *ltjson_pathcompile(const char *path,
+                                          ltjson_dict_t *dict);
+extern int ltjson_pathfree(ltjson_cpath_t **cpathp);
+
+extern int ltjson_pathexec(ltjson_node_t *tree, const ltjson_cpath_t *cpath,
+                           ltjson_node_t **nodeptr, int nnodes);
+extern int ltjson_pathexecm(ltjson_node_t *tree, const ltjson_cpath_t **cpaths,
+                            int npaths, ltjson_node_t **nodeptr, int *nfound);
+
+extern ltjson_dict_t *ltjson_dict_new(void);
+extern const char *ltjson_dict_add(ltjson_dict_t *dict, const char *name);
+extern const char *ltjson_dict_lookup(ltjson_dict_t *dict, const char *name);
+extern int ltjson_dict_freeze(ltjson_dict_t *dict);
+extern int ltjson_dict_free(ltjson_dict_t **dictptr);
+extern int ltjson_setdict(ltjson_node_t **treeptr, ltjson_dict_t *dict);
+
+extern ltjson_ctree_t *ltjson_ctree_new(ltjson_node_t *rnode);
+extern int ltjson_ctree_free(ltjson_ctree_t **ctreep);
+extern int ltjson_ctree_ntype(const ltjson_ctree_t *ctree, int index);
+extern const char *ltjson_ctree_name(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_next(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_subnode(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_ancnode(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_count(const ltjson_ctree_t *ctree, int index);
+extern long long ltjson_ctree_ll(const ltjson_ctree_t *ctree, int index);
+extern double ltjson_ctree_d(const ltjson_ctree_t *ctree, int index);
+extern const char *ltjson_ctree_s(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_member(const ltjson_ctree_t *ctree, int index,
+                               const char *name);
+extern int ltjson_ctree_search(const ltjson_ctree_t *ctree, const char *name,
+                               int from);
+extern int ltjson_ctree_size(const ltjson_ctree_t *ctree);
+extern int ltjson_ctree_end(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_display(const ltjson_ctree_t *ctree, int index);
+extern int ltjson_ctree_print(const ltjson_ctree_t *ctree, int index,
+                              char *buf, int size, int flags);
+extern int ltjson_ctree_write(const ltjson_ctree_t *ctree, int index,
+                              int (*writer)(void *ctx, const char *s,
+                                            int len),
+                              void *ctx, int flags);
+extern int ltjson_ctree_pathrefer(const ltjson_ctree_t *ctree,
+                                  const char *path, int *indexes,
+                                  int nindexes);
+
+extern int ltjson_settape(ltjson_node_t **treeptr, int on);
+extern const ltjson_ctree_t *ltjson_gettape(ltjson_node_t *tree);
+
+extern int ltjson_parse_batch(ltjson_node_t **trees, const char **texts,
+                              int *errs, int ntexts, int flags,
+                              ltjson_dict_t *dict, int nthreads);
+extern int ltjson_parse_parallel(ltjson_node_t **treeptr, const char *text,
+                                 int flags, int nthreads);
+
+extern ltjson_pool_t *ltjson_pool_new(int ntrees, size_t maxmem);
+extern int ltjson_pool_free(ltjson_pool_t **poolp);
+extern ltjson_node_t *ltjson_pool_acquire(ltjson_pool_t *pool);
+extern int ltjson_pool_release(ltjson_pool_t *pool, ltjson_node_t **treeptr);
+extern int ltjson_pool_memstat(ltjson_pool_t *pool, int *stats, int nents);
+
+extern int ltjson_getcounters(ltjson_node_t *tree,
+                              ltjson_counters_t *counters, int reset);
+
 #endif  /* _LTJSON_H_ */
 
 
@@ -42,24 +42,188 @@
 
 #define JSONNODE_MIN_ALLOC      8
 #define JSONNODE_DEF_ALLOC      32
+#define JSONNODE_MAX_ALLOC      16384       /* Largest doubled set    */
 
 #define JSONNODE_NFLAGS_OPENOA  0x01        /* nflags only used while */
 #define JSONNODE_NFLAGS_COLON   0x02        /* parsing incoming text  */
+#define JSONNODE_NFLAGS_INDEXED 0x04        /* or closed object index */
+#define JSONNODE_NFLAGS_SKIPPED 0x08        /* (or filtered out value) */
+#define JSONNODE_NFLAGS_RAWLL   0x10        /* Raw number's value is  */
+#define JSONNODE_NFLAGS_RAWD    0x20        /* cached as an ll or d   */
+
+union rawcache {                            /* Before a raw number's  */
+    long long ll;                           /* text in the sstore     */
+    double d;
+};
+
+#define RAWNUM_CACHE    sizeof(union rawcache)
 
 #define WORKSTR_INIT_ALLOC      32
 
-#define NHASH_NBUCKETS          512
-#define NHASH_CELL_ALLOC        64
-#define NHASH_CELL_LINKCUR      (NHASH_CELL_ALLOC + 0)
-#define NHASH_CELL_LINKNEXT     (NHASH_CELL_LINKCUR + 1)
+#define NHASH_INIT_SLOTS        64          /* Must be a power of 2   */
+#define NHASH_LOAD_PCT          75          /* Grow when this full    */
+
+#define MINDEX_MIN_MEMBERS      32          /* Index objects this big */
+#define MINDEX_INIT_SLOTS       64          /* Must be a power of 2   */
+#define MINDEX_LOAD_PCT         75          /* Rebuild when this full */
+
+#define NINDEX_INIT_SLOTS       64          /* Must be a power of 2   */
+#define NINDEX_LOAD_PCT         50          /* Grow when this full    */
+
+#define FILTER_INIT_LEVELS      8           /* Filter nesting levels  */
+
+#define FILTER_SKIP             0           /* filter_value() returns */
+#define FILTER_KEEP             1
+#define FILTER_HOLD             2
 
 #define SSTORE_MIN_ALLOC    64
 #define SSTORE_DEF_ALLOC    (2048 - sizeof(struct sstore))
+#define SSTORE_MAX_ALLOC    (262144 - sizeof(struct sstore))
 
 
 struct nhashcell {
-    const char *s;
-    struct nhashcell *next;
+    const char *s;              /* NULL if the cell is empty */
+    unsigned int hash;          /* name_hash() of s          */
+    int len;                    /* strlen(s)                 */
+};
+
+
+struct nhash {
+    struct nhashcell *tab;      /* Open addressed, NULL if no table  */
+    int nslots;                 /* Number of cells in tab            */
+    int nfilled;                /* Number of cells holding a name    */
+    void *sstore;               /* String store for the names        */
+    const ltjson_alloc_t *alloc; /* NULL for the C library           */
+};
+
+
+/* A shared name dictionary (ltdict.c). Once frozen it is only read */
+
+struct ltjson_dict {
+    struct nhash nhash;
+    int frozen;
+};
+
+
+struct mindexcell {
+    ltjson_node_t *obj;         /* Object, NULL if empty (see ltindex.c) */
+    ltjson_node_t *member;      /* First member of obj with the name     */
+    unsigned int hash;          /* member->namehash                      */
+};
+
+
+/* The name index (ltnindex.c) of a tree, which is built on demand */
+
+struct nindexcell {
+    const char *name;           /* Name, NULL if the cell is empty   */
+    unsigned int hash;          /* name_hash() of name               */
+    int first;                  /* Start of its run in .nodes        */
+    int count;                  /* Number of nodes with the name     */
+};
+
+struct nindexnode {
+    ltjson_node_t *node;        /* Named node                        */
+    int seq;                    /* Place among named nodes in order  */
+};
+
+struct nindex {
+    struct nindexcell *tab;     /* Open addressed cell for each name */
+    int nslots;                 /* Number of cells in tab            */
+    struct nindexnode *nodes;   /* Runs of nodes, a run to a name    */
+};
+
+
+typedef struct {
+    const char *name;   /* Pointer to name (not null terminated) */
+    int namelen;        /* Name length (can be zero) */
+    unsigned int hash;  /* name_hash() of the name */
+    int hasindex;       /* If this section specifies an index */
+    int aindex;         /* The index (0 based. -1 means "*") */
+} ltjson_rpath_t;
+
+
+/* A compiled path (see ltjson_pathcompile) is one allocation: this
+   structure, then the two refpath lists and then a copy of the path
+   text that the names in .plain point into. */
+
+struct ltjson_cpath {
+    ltjson_dict_t *dict;        /* Dictionary the names were looked up in */
+    int nsects;                 /* Number of sections (0 for "/")         */
+    ltjson_rpath_t *plain;      /* Sections with the names as given       */
+    ltjson_rpath_t *interned;   /* As plain with dict names as hashes     */
+};
+
+
+/* Filter state (ltfilter.c) for each open object or array kept in the
+   tree. Path i is still matching from here at state[i] (as in
+   path_findmulti) if bit i of mask is set. */
+
+struct filterlevel {
+    unsigned long long mask;    /* Paths matching at this level        */
+    unsigned long long pending; /* Paths the member name just matched  */
+    unsigned long long seen;    /* Paths whose member name has been    */
+    int state[LTJSON_PATH_MAXMULTI];
+    int all;                    /* Whole subtree is wanted             */
+    int index;                  /* Index of the next array element     */
+    int hold;                   /* Keep placeholders up to this index  */
+};
+
+
+struct filter {
+    int npaths;
+    const ltjson_rpath_t *rpaths[LTJSON_PATH_MAXMULTI];
+    struct filterlevel *levels; /* levels[depth] is the open container */
+    int nlevels;                /* Number allocated                    */
+    int depth;
+    int skipping;               /* Part way through skipping a value   */
+    int skipnest;               /* Objects and arrays still open       */
+    int skipstr;                /* In string, 2 if after a backslash   */
+    int skipscalar;             /* In a number or literal              */
+};
+
+
+/* A compact tree (ltctree.c) is one allocation: this structure, the
+   nodes and then the strings that .name and .val.s are offsets into */
+
+#define CTREE_NONE  0xFFFFFFFFU        /* No name, node or parent     */
+
+struct ctnode {
+    unsigned int name;          /* Offset of name or CTREE_NONE      */
+    unsigned int up;            /* Object/array node is in           */
+    unsigned int end;           /* Index after the node's subtree    */
+    short int ntype;
+    short int nflags;
+    union {
+        long long ll;
+        double d;
+        unsigned int s;         /* Offset of string                  */
+        unsigned int count;     /* Members or elements               */
+    } val;
+};
+
+
+struct ltjson_ctree {
+    struct ctnode *nodes;
+    unsigned int nnodes;
+    char *strs;
+    unsigned int strsize;       /* Bytes used at strs                */
+};
+
+
+/* A tape (lttape.c) is a compact tree built by the parse in separately
+   allocated arrays that are kept and reused as the tree is recycled */
+
+#define CTREE_NAMESLOTS 1024    /* Member names shared by offset     */
+
+struct tape {
+    ltjson_ctree_t ctree;
+    unsigned int nalloc;        /* Nodes allocated                   */
+    unsigned int salloc;        /* String bytes allocated            */
+    unsigned int up;            /* Open object/array or CTREE_NONE   */
+    unsigned int name;          /* Name for the next node            */
+    int nomem;                  /* Out of memory in an event         */
+    int nnames;                 /* Entries used in names             */
+    unsigned int names[CTREE_NAMESLOTS];
 };
 
 
@@ -85,20 +249,48 @@ typedef struct {
     ltjson_node_t *open;        /* Tree open? This is current node   */
     ltjson_node_t *cbasenode;   /* Current basenode                  */
 
-    int nodeasize;              /* node alloc size, set at startup   */
+    ltjson_alloc_t allocator;   /* Copy of ltjson_setalloc's         */
+    const ltjson_alloc_t *alloc; /* &.allocator or NULL (C lib)      */
+
+    int nodeasize;              /* Size of the next set of nodes     */
+    int pflags;                 /* LTJSON_PARSE_* flags for the tree */
 
     char *workstr;              /* Working string for partials       */
     int   workalloc;            /* Amount allocated to workstr       */
 
     void *sstore;               /* Context handle to string store    */
 
-    struct nhashcell **nhtab;   /* Name hash table, optional use     */
-    struct nhashcell *nhstore;  /* Hash cell storage blocks          */
+    struct nhash nhash;         /* Name hash table, optional use     */
+    ltjson_dict_t *dict;        /* Shared dictionary, optional use   */
     int nh_nhits;               /* Stats: Hash match finds entry and */
-    int nh_nmisses;             /*    hash match does not find entry */
+    int nh_nmisses;             /*    probes past a different name   */
+
+    struct mindexcell *mitab;   /* Member index, optional use        */
+    int mi_nslots;              /* Number of cells in mitab          */
+    int mi_nused;               /* Cells filled, including dropped   */
+
+    struct nindex *nindex;      /* Name index, optional use          */
+
+    const ltjson_sax_t *sax;    /* Event callbacks, optional use     */
+    void *saxctx;               /* Context argument for the events   */
+    struct filter *filter;      /* Selective parse paths, or NULL    */
+    struct tape *tape;          /* Compact tree being built, or NULL */
+    ltjson_node_t **parts;      /* Trees of a parallel parse or NULL */
+    char *map;                  /* File the in situ strings are in   */
+    size_t mapsize;             /*    (see ltjson_parse_file) or 0   */
+    ltjson_node_t *freenodes;   /* Nodes for reuse by events/filter  */
+
+    const char *textend;        /* End of the text being parsed      */
+    const char *textdone;       /* Just past the tree's close or 0   */
 
     const char *lasterr;        /* 0 or description of error         */
     int incomplete;             /* If !0, continue adding to string  */
+    int worklen;                /* Length of the string in .workstr  */
+    int workescape;             /* If !0, it ends in an open escape  */
+
+#ifdef LTJSON_COUNTERS
+    ltjson_counters_t counters; /* Work done over the tree's life    */
+#endif
 
 } ltjson_info_t;
 
@@ -127,6 +319,7 @@ typedef struct {
 #define ERR_SEQ_BADCLOSURE    ltjson_errordesc[17]
 #define ERR_SEQ_UNEXPCOLON    ltjson_errordesc[18]
 #define ERR_SEQ_BADTEXT       ltjson_errordesc[19]
+#define ERR_SEQ_SAXSTOP       ltjson_errordesc[20]
 
 
 static const char *ltjson_errordesc[] =
@@ -154,6 +347,7 @@ static const char *ltjson_errordesc[] =
     "Empty entry at object or array close",
     "Unexpected name-value separator (:)",
     "Random unquoted text in content",
+    "Parse stopped by an event callback",
 };
 
 
@@ -166,18 +360,28 @@ static const char *ltjson_errordesc[] =
 #define MSTAT_SSTORE_NBLOCKS    4
 #define MSTAT_SSTORE_ALLOC      5
 #define MSTAT_SSTORE_FILLED     6
-#define MSTAT_HASH_NBUCKETS     7
-#define MSTAT_HASH_BUCKETFILL   8
-#define MSTAT_HASHCELL_ALLOC    9
-#define MSTAT_HASHCELL_FILLED   10
+#define MSTAT_HASH_NSLOTS       7
+#define MSTAT_HASH_SLOTFILL     8
+#define MSTAT_HASH_SSTORE_ALLOC 9
+#define MSTAT_HASH_SSTORE_FILLED 10
 #define MSTAT_HASH_HITS         11
 #define MSTAT_HASH_MISSES       12
 #define MSTAT_NENTS             13
+#define MSTAT_POOL_IDLE         13      /* ltjson_pool_memstat only */
+#define MSTAT_POOL_REUSED       14
+#define MSTAT_POOL_MADE         15
+#define MSTAT_POOL_TRIMMED      16
+#define MSTAT_POOL_FREED        17
+#define MSTAT_POOL_NENTS        18
 
 #if MSTAT_NENTS != LTJSON_MEMSTATS
   #error LTJSON_MEMSTATS must be equal to MSTAT_NENTS
 #endif
 
+#if MSTAT_POOL_NENTS != LTJSON_POOLSTATS
+  #error LTJSON_POOLSTATS must be equal to MSTAT_POOL_NENTS
+#endif
+
 
 static const char *ltjson_memstatdesc[] =
 {
@@ -192,14 +396,20 @@ static const char *ltjson_memstatdesc[] =
     "string store total (bytes)",
     "string store used (bytes)",
 
-    "hash buckets created",
-    "hash buckets filled",
+    "hash slots created",
+    "hash slots filled",
 
-    "hash cells created",
-    "hash cells filled",
+    "hash name store total (bytes)",
+    "hash name store used (bytes)",
 
     "hash hits",
-    "hash misses"
+    "hash misses",
+
+    "pool trees idle",
+    "pool trees reused",
+    "pool trees created",
+    "pool trees trimmed",
+    "pool trees freed"
 };
 
 
@@ -0,0 +1,245 @@
+/*
+ *  ltnindex.c (as include): Name index for searches
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  ltjson_nameindex builds a tree an index (.nindex) of every named
+    node, so ltjson_searchm can go straight to the nodes with the names
+    it's after instead of walking the whole tree. An open addressed
+    table has a cell for each name, which gives the run of that name's
+    nodes in one array. Each run is in document order and every node
+    has its place in that order (.seq) so runs can be merged.
+
+    The index is only as good as the tree it was built on. Anything
+    that adds nodes or changes the order of them (sort, promote, add)
+    frees it, as does recycling the tree. It's never built by a parse.
+*/
+
+
+
+
+/*
+ *  nindex_free(jsoninfo) - Free the name index, if any
+ */
+
+static void nindex_free(ltjson_info_t *jsoninfo)
+{
+    struct nindex *nindex = jsoninfo->nindex;
+
+    if (!nindex)
+        return;
+
+    mem_free(jsoninfo->alloc, nindex->tab);
+    mem_free(jsoninfo->alloc, nindex->nodes);
+    mem_free(jsoninfo->alloc, nindex);
+
+    jsoninfo->nindex = 0;
+}
+
+
+
+
+/*
+ *  nindex_cell(nindex, name, hash) - Find the cell of a name
+ *
+ *  Returns the cell for name (hash is its name_hash), which is empty
+ *  (.name NULL) if the name is not in the table
+ */
+
+static struct nindexcell *nindex_cell(const struct nindex *nindex,
+                                      const char *name, unsigned int hash)
+{
+    struct nindexcell *nicp, *niend;
+
+    niend = nindex->tab + nindex->nslots;
+    nicp = nindex->tab + (hash & (nindex->nslots - 1));
+
+    while (nicp->name)
+    {
+        if (nicp->hash == hash &&
+            (nicp->name == name || strcmp(nicp->name, name) == 0))
+            break;
+
+        if (++nicp == niend)
+            nicp = nindex->tab;
+    }
+
+    return nicp;
+}
+
+
+
+
+/*
+ *  nindex_grow(jsoninfo, nindex) - Double the cells of the table
+ *
+ *  Returns 1 on success, 0 on failure with errno set to ENOMEM
+ */
+
+static int nindex_grow(ltjson_info_t *jsoninfo, struct nindex *nindex)
+{
+    struct nindexcell *oldtab = nindex->tab, *nicp;
+    int i, oldslots = nindex->nslots;
+
+    nindex->nslots = oldslots ? oldslots * 2 : NINDEX_INIT_SLOTS;
+    nindex->tab = mem_zalloc(jsoninfo->alloc,
+                             nindex->nslots * sizeof(struct nindexcell));
+    if (!nindex->tab)
+    {
+        nindex->tab = oldtab;
+        nindex->nslots = oldslots;
+        return 0;
+    }
+
+    for (i = 0; i < oldslots; i++)
+    {
+        if (!oldtab[i].name)
+            continue;
+
+        nicp = nindex_cell(nindex, oldtab[i].name, oldtab[i].hash);
+        *nicp = oldtab[i];
+    }
+
+    mem_free(jsoninfo->alloc, oldtab);
+    return 1;
+}
+
+
+
+
+/*
+ *  nindex_next(node, root) - The next node in document order
+ *
+ *  As traverse_tree_nodes over the whole tree at root.
+ */
+
+static ltjson_node_t *nindex_next(ltjson_node_t *node, ltjson_node_t *root)
+{
+    if ((node->ntype == LTJSON_NTYPE_ARRAY ||
+         node->ntype == LTJSON_NTYPE_OBJECT) && node->val.subnode)
+        return node->val.subnode;
+
+    for (; node != root; node = node->ancnode)
+    {
+        if (node->next)
+            return node->next;
+    }
+
+    return NULL;
+}
+
+
+
+
+/*
+ *  nindex_build(jsoninfo) - Build the name index of a closed tree
+ *
+ *  Any index there was is freed first. One walk counts the nodes of
+ *  each name and a second puts them in their runs.
+ *
+ *  Returns 1 on success, 0 on failure with errno set to ENOMEM (and
+ *  the tree left without an index)
+ */
+
+static int nindex_build(ltjson_info_t *jsoninfo)
+{
+    ltjson_node_t *root = jsoninfo->root, *node;
+    struct nindexcell *nicp;
+    struct nindex *nindex;
+    int i, nnamed, nnames, first;
+
+    nindex_free(jsoninfo);
+
+    if ((nindex = mem_zalloc(jsoninfo->alloc, sizeof(struct nindex))) == NULL)
+        return 0;
+
+    nnamed = nnames = 0;
+
+    if (!nindex_grow(jsoninfo, nindex))
+        goto nomem;
+
+    for (node = nindex_next(root, root); node; node = nindex_next(node, root))
+    {
+        if (!node->name)
+            continue;
+
+        nicp = nindex_cell(nindex, node->name, node->namehash);
+
+        if (!nicp->name)
+        {
+            if ((nnames + 1) * 100 > nindex->nslots * NINDEX_LOAD_PCT)
+            {
+                if (!nindex_grow(jsoninfo, nindex))
+                    goto nomem;
+
+                nicp = nindex_cell(nindex, node->name, node->namehash);
+            }
+
+            nicp->name = node->name;
+            nicp->hash = node->namehash;
+            nnames++;
+        }
+
+        nicp->count++;
+        nnamed++;
+    }
+
+    if (nnamed)
+    {
+        nindex->nodes = mem_alloc(jsoninfo->alloc,
+                                  nnamed * sizeof(struct nindexnode));
+        if (!nindex->nodes)
+            goto nomem;
+    }
+
+    /* Each name's run starts where the last one ended. Count again */
+
+    for (first = 0, i = 0; i < nindex->nslots; i++)
+    {
+        nicp = &nindex->tab[i];
+        nicp->first = first;
+        first += nicp->count;
+        nicp->count = 0;
+    }
+
+    nnamed = 0;
+
+    for (node = nindex_next(root, root); node; node = nindex_next(node, root))
+    {
+        struct nindexnode *ninp;
+
+        if (!node->name)
+            continue;
+
+        nicp = nindex_cell(nindex, node->name, node->namehash);
+
+        ninp = &nindex->nodes[nicp->first + nicp->count++];
+        ninp->node = node;
+        ninp->seq = nnamed++;
+    }
+
+    jsoninfo->nindex = nindex;
+    return 1;
+
+nomem:
+    mem_free(jsoninfo->alloc, nindex->tab);
+    mem_free(jsoninfo->alloc, nindex);
+    errno = ENOMEM;
+    return 0;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,388 @@
+/*
+ *  ltnumber.c (as include): Converting JSON numbers
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  Numbers are converted by hand rather than with strtoll and strtod,
+    which are slow for this and go by the locale's decimal point. The
+    text is checked against the JSON grammar as the digits are read:
+
+        -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+
+    Up to 19 significant digits are kept in a 64 bit integer, which is
+    the whole story for an integer that fits in a long long. Anything
+    else is a double. That is exact when the digits fit in the 53 bits
+    of a double and the power of ten is one of the exact ones up to
+    1e22 (W. D. Clinger, "How to Read Floating Point Numbers
+    Accurately", 1990), which covers most numbers in real documents.
+    The rest are given to strtod, rewritten as digits and an exponent
+    so the locale has no part in it.
+*/
+
+#define NUM_MAXDIGITS   19      /* Significant digits a mantissa holds */
+#define NUM_MAXEXP      99999   /* Exponents are capped here          */
+#define NUM_MAXSTRTOD   768     /* Digits that can decide a double    */
+
+struct numparts {
+    unsigned long long mant;    /* First NUM_MAXDIGITS digits          */
+    int ndigits;                /* Significant digits in all           */
+    int exp10;                  /* Value is mant * 10^exp10 if exact   */
+    int neg;
+    int isfloat;                /* Has a fraction or exponent          */
+};
+
+
+/* The doubles that are exact powers of ten */
+
+static const double num_pow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+    1e22
+};
+
+#define NUM_MAXPOW10    22
+#define NUM_MAXEXACT    (1ULL << 53)
+
+
+
+
+/*
+ *  num_span(s, end) - Find the end of the number starting at s
+ *
+ *  Numbers are taken to be + - . 0-9 e E (as in store_strnum) and
+ *  num_scan sorts out whether they are valid.
+ *
+ *  Returns the length of the number or 0 if it goes on to end
+ */
+
+static int num_span(const char *s, const char *end)
+{
+    const char *p;
+
+    for (p = s; p < end; p++)
+    {
+        if (!c_isdigit(*p) && *p != '-' && *p != '+' &&
+            *p != 'e' && *p != 'E' && *p != '.')
+            return (int)(p - s);
+    }
+
+    return 0;
+}
+
+
+
+
+/*
+ *  num_exponent(s, end, exp) - Read the digits of an exponent
+ *
+ *  Returns the position after the digits or NULL if there are none
+ */
+
+static const char *num_exponent(const char *s, const char *end, int *exp)
+{
+    int neg = 0, e = 0;
+
+    if (s < end && (*s == '-' || *s == '+'))
+        neg = (*s++ == '-');
+
+    if (s == end || !c_isdigit(*s))
+        return NULL;
+
+    for (; s < end && c_isdigit(*s); s++)
+    {
+        if (e < NUM_MAXEXP)
+            e = e * 10 + (*s - '0');
+    }
+
+    if (e > NUM_MAXEXP)
+        e = NUM_MAXEXP;
+
+    *exp = neg ? -e : e;
+    return s;
+}
+
+
+
+
+/*
+ *  num_scan(s, len, np) - Check and break up the len long number at s
+ *
+ *  Returns 1 if it's a valid JSON number (np filled in), 0 if not
+ */
+
+static int num_scan(const char *s, int len, struct numparts *np)
+{
+    const char *end = s + len;
+    int d, exp;
+
+    np->mant = 0;
+    np->ndigits = 0;
+    np->exp10 = 0;
+    np->neg = 0;
+    np->isfloat = 0;
+
+    if (s < end && *s == '-')
+    {
+        np->neg = 1;
+        s++;
+    }
+
+    if (s == end || !c_isdigit(*s))
+        return 0;
+
+    if (*s == '0')
+    {
+        s++;                    /* No more digits before a '.' */
+    }
+    else
+    {
+        for (; s < end && c_isdigit(*s); s++)
+        {
+            if (np->ndigits++ < NUM_MAXDIGITS)
+                np->mant = np->mant * 10 + (*s - '0');
+            else
+                np->exp10++;
+        }
+    }
+
+    if (s < end && *s == '.')
+    {
+        np->isfloat = 1;
+
+        if (++s == end || !c_isdigit(*s))
+            return 0;
+
+        for (; s < end && c_isdigit(*s); s++)
+        {
+            d = *s - '0';
+
+            if (!np->ndigits && !d)
+            {
+                np->exp10--;    /* Leading zero */
+            }
+            else if (np->ndigits++ < NUM_MAXDIGITS)
+            {
+                np->mant = np->mant * 10 + d;
+                np->exp10--;
+            }
+        }
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        np->isfloat = 1;
+
+        if ((s = num_exponent(s + 1, end, &exp)) == NULL)
+            return 0;
+
+        np->exp10 += exp;
+    }
+
+    return s == end;
+}
+
+
+
+
+/*
+ *  num_toint(np, llp) - Get an integer np as a long long, if it fits
+ *
+ *  Returns 1 on success, 0 if np is too big (or not an integer)
+ */
+
+static int num_toint(const struct numparts *np, long long *llp)
+{
+    const unsigned long long max = (unsigned long long)LLONG_MAX;
+
+    if (np->isfloat || np->ndigits > NUM_MAXDIGITS)
+        return 0;
+
+    if (!np->neg)
+    {
+        if (np->mant > max)
+            return 0;
+
+        *llp = (long long)np->mant;
+    }
+    else
+    {
+        if (np->mant > max + 1)
+            return 0;
+
+        *llp = (np->mant == max + 1) ? LLONG_MIN : -(long long)np->mant;
+    }
+
+    return 1;
+}
+
+
+
+
+/*
+ *  num_tofloat_exact(np, dp) - Convert np where the result is exact
+ *
+ *  Returns 1 on success, 0 if the double can't be got this way
+ */
+
+static int num_tofloat_exact(const struct numparts *np, double *dp)
+{
+    unsigned long long mant = np->mant;
+    int exp10 = np->exp10;
+    double d;
+
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD != 0
+    /* Wider intermediates (x87) could round twice */
+
+    if (mant)
+        return 0;
+#endif
+
+    if (!mant)
+    {
+        *dp = np->neg ? -0.0 : 0.0;
+        return 1;
+    }
+
+    if (np->ndigits > NUM_MAXDIGITS || mant > NUM_MAXEXACT)
+        return 0;
+
+    /* 1234e25 is 12340000e21 as long as the digits still fit */
+
+    while (exp10 > NUM_MAXPOW10 && mant * 10 <= NUM_MAXEXACT)
+    {
+        mant *= 10;
+        exp10--;
+    }
+
+    if (exp10 > NUM_MAXPOW10 || exp10 < -NUM_MAXPOW10)
+        return 0;
+
+    d = (double)mant;
+
+    if (exp10 >= 0)
+        d *= num_pow10[exp10];
+    else
+        d /= num_pow10[-exp10];
+
+    *dp = np->neg ? -d : d;
+    return 1;
+}
+
+
+
+
+/*
+ *  num_tofloat_strtod(s, len, dp) - Convert the number at s with strtod
+ *
+ *  The number is rewritten as [-]digits[1]e[-]exp, with no decimal
+ *  point for the locale to get wrong. Digits past NUM_MAXSTRTOD can't
+ *  change the result other than to break a tie, so they are replaced
+ *  by a 1 if any of them is not 0.
+ *
+ *  Returns 1 on success, 0 if out of range for a double (overflow)
+ */
+
+static int num_tofloat_strtod(const char *s, int len, double *dp)
+{
+    char buf[NUM_MAXSTRTOD + 32], *bp = buf;
+    const char *end = s + len;
+    int ndigits = 0, sticky = 0, infrac = 0, exp10 = 0, exp, saved;
+    double d;
+
+    if (*s == '-')
+        *bp++ = *s++;
+
+    for (; s < end && (c_isdigit(*s) || *s == '.'); s++)
+    {
+        if (*s == '.')
+        {
+            infrac = 1;
+        }
+        else if (*s == '0' && !ndigits)
+        {
+            if (infrac)
+                exp10--;        /* Leading zero */
+        }
+        else if (ndigits < NUM_MAXSTRTOD)
+        {
+            *bp++ = *s;
+            ndigits++;
+            if (infrac)
+                exp10--;
+        }
+        else
+        {
+            sticky |= (*s != '0');
+            if (!infrac)
+                exp10++;
+        }
+    }
+
+    if (sticky)
+    {
+        *bp++ = '1';
+        exp10--;
+    }
+
+    if (!ndigits)
+        *bp++ = '0';
+
+    if (s < end && num_exponent(s + 1, end, &exp))
+        exp10 += exp;
+
+    sprintf(bp, "e%d", exp10);
+
+    saved = errno;              /* Underflow (ERANGE) is not an error */
+    d = strtod(buf, NULL);
+    errno = saved;
+
+    if (!(d - d == 0))
+        return 0;               /* Infinity */
+
+    *dp = d;
+    return 1;
+}
+
+
+
+
+/*
+ *  num_inrange(s, len, np) - Does the number at s fit a double?
+ *
+ *  For a number kept raw (LTJSON_PARSE_RAWNUM) to fail the parse just
+ *  as converting it would. np is from num_scan. It's below 1e308, so
+ *  fits, if its digits and exponent say so; only a number about as
+ *  big as DBL_MAX or bigger has to be converted to find out.
+ *
+ *  Returns 1 if it fits, 0 if not (overflow)
+ */
+
+static int num_inrange(const char *s, int len, const struct numparts *np)
+{
+    int ndigits;
+    double d;
+
+    ndigits = np->ndigits < NUM_MAXDIGITS ? np->ndigits : NUM_MAXDIGITS;
+
+    if (!np->mant || ndigits + np->exp10 <= 308)
+        return 1;
+
+    return num_tofloat_exact(np, &d) || num_tofloat_strtod(s, len, &d);
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
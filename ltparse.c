@@ -76,147 +76,79 @@ static int is_closed_tree(ltjson_node_t *node)
 
 
 
-/**
- *  ltjson_parse(treeptr, text, usehash) - Parse text into JSON tree
- *      @treeptr:   Pointer to json tree root
- *      @text:      UTF-8 text
- *      @usehash:   Use a hash to find duplicate node names
- *
- *  Scan the JSON provided @text and parse it into the tree which is
- *  pointed to by treeptr. If @*treeptr is NULL then a new tree is created.
- *  If not NULL the memory storage is reused if the tree is closed or
- *  text continues to be added if the tree is open.
- *
- *  If @text is NULL, the tree is forced closed and into an error state.
- *
- *  If @usehash is true, a new or recycled tree will obtain a name
- *  lookup hash table. This is really only useful for large trees with
- *  many duplicate names. If false, a recycled tree will lose the hash.
+/*
+ *  start_tree(treeptr, flags) - Create or recycle a tree for a new text
  *
- *  Returns:  1 on success and the tree is parsed and closed
- *            0 on error or tree is incomplete and errno is set to:
- *              EAGAIN if tree incomplete and more text needed
- *              EINVAL if invalid argument
- *              EILSEQ if invalid JSON sequence (reason available)
- *              ENOMEM if out of memory
+ *  The tree at *treeptr (if any) must be valid and not open. It gets
+ *  the hash that flags ask for. The caller sets .textend.
  *
- *  On ENOMEM, all storage will be freed and *treeptr is set to NULL
+ *  Returns: jsoninfo on success (and in *treeptr)
+ *           NULL if out of memory (errno to ENOMEM and *treeptr NULL)
  */
 
-int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
+static ltjson_info_t *start_tree(ltjson_node_t **treeptr, int flags)
 {
-    ltjson_info_t *jsoninfo = 0;
-    ltjson_node_t *newnode, *curnode;
-
-    if (!treeptr)
-    {
-        errno = EINVAL;
-        return 0;
-    }
+    ltjson_info_t *jsoninfo = (ltjson_info_t *)(*treeptr);
+    int usehash;
 
-    if (*treeptr)
+    if ((jsoninfo = create_tree(jsoninfo, NULL)) == NULL)
     {
-        if (!is_valid_tree(*treeptr))
-        {
-            errno = EINVAL;
-            return 0;
-        }
-
-        jsoninfo = (ltjson_info_t *)(*treeptr);
+        *treeptr = NULL;
+        return NULL;
     }
 
-    if (!text)
-    {
-        /* Request to close a tree. The next call will recycle
-           the tree (if not NULL). Put tree into error state. */
+    *treeptr = (ltjson_node_t *)jsoninfo;
+    jsoninfo->pflags = flags;
 
-        if (jsoninfo)
-        {
-            jsoninfo->open = 0;
-            jsoninfo->lasterr = ERR_SEQ_TREEDUMP;
-        }
 
-        return 1;   /* Success! */
-    }
+    /* Add or remove the hash support from jsoninfo */
 
+    usehash = flags & (LTJSON_PARSE_USEHASH | LTJSON_PARSE_KEEPHASH);
 
-    if (jsoninfo && jsoninfo->open)
+    if (usehash && !jsoninfo->nhash.tab)
     {
-        /* Existing open tree */
-
-        curnode = jsoninfo->open;
-        jsoninfo->open = 0;
-
-        if (jsoninfo->incomplete)
+        if (!nhash_new(jsoninfo))
         {
-            /* Open tree with partial string stored in workstr
-               Finish it and get the name:value state right */
-
-            if (!process_json_alnum(jsoninfo, &text, curnode))
-            {
-                if (errno == ENOMEM)
-                {
-                    destroy_tree(jsoninfo);
-                    *treeptr = NULL;
-                    errno = ENOMEM;
-                }
-                else if (errno == EAGAIN)
-                {
-                    jsoninfo->open = curnode;
-                }
-                return 0;
-            }
+            destroy_tree(jsoninfo);
+            *treeptr = NULL;
+            errno = ENOMEM;
+            return NULL;
         }
     }
-    else
+    else if (!usehash && jsoninfo->nhash.tab && !jsoninfo->dict)
     {
-        /* Create (or recycle) tree and get a new (or the same) jsoninfo.
-           Check for blank text as it's a nuisance otherwise but it is
-           reasonable to allow leading spaces before the tree starts */
-
-        text = skip_space(text);
-        if (!*text)
-        {
-            errno = EAGAIN;
-            return 0;
-        }
-
-        if ((jsoninfo = create_tree(jsoninfo)) == NULL)
-        {
-            *treeptr = NULL;
-            return 0;
-        }
-
-        *treeptr = (ltjson_node_t *)jsoninfo;
+        nhash_free(jsoninfo);
+    }
+    else if (!(flags & LTJSON_PARSE_KEEPHASH))
+    {
+        nhash_reset(jsoninfo);
+    }
 
+    return jsoninfo;
+}
 
-        /* Add or remove the hash support from jsoninfo */
 
-        if (usehash && !jsoninfo->nhtab)
-        {
-            if (!nhash_new(jsoninfo))
-            {
-                destroy_tree(jsoninfo);
-                *treeptr = NULL;
-                errno = ENOMEM;
-                return 0;
-            }
-        }
-        else if (!usehash && jsoninfo->nhtab)
-        {
-            nhash_free(jsoninfo);
-        }
 
-        if ((curnode = begin_tree(jsoninfo, *text)) == NULL)
-            return 0;
 
-        text++;
-    }
+/*
+ *  parse_values(jsoninfo, treeptr, curnode, text) - The parse proper
+ *
+ *  Parse from text up to .textend, carrying on from curnode of the
+ *  tree at *treeptr (which is jsoninfo).
+ *
+ *  Returns: as ltjson_parse()
+ */
 
+static int parse_values(ltjson_info_t *jsoninfo, ltjson_node_t **treeptr,
+                        ltjson_node_t *curnode, const char *text)
+{
+    const char *end = jsoninfo->textend;
+    ltjson_node_t *newnode;
+    int filtered;
 
-    text = skip_space(text);
+    text = skip_space(text, end);
 
-    while(*text)
+    while (text < end)
     {
         if (  (curnode->nflags == JSONNODE_NFLAGS_OPENOA) &&
               (*text != '}' && *text != ']')  )
@@ -227,7 +159,12 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
 
             assert(curnode->val.subnode == NULL);
 
-            if ((newnode = get_new_node(jsoninfo)) == NULL)
+            if (jsoninfo->sax || jsoninfo->filter)
+                newnode = reuse_node(jsoninfo, NULL);
+            else
+                newnode = get_new_node(jsoninfo);
+
+            if (newnode == NULL)
             {
                 destroy_tree(jsoninfo);
                 *treeptr = NULL;
@@ -241,7 +178,33 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
         }
 
 
-        if (curnode->nflags == JSONNODE_NFLAGS_COLON)
+        if (jsoninfo->filter && filter_atvalue(curnode, *text) &&
+            (filtered = filter_value(jsoninfo, curnode, *text)) != FILTER_KEEP)
+        {
+            /* Value not wanted by the filter. Skip over it in the text */
+
+            if (filtered < 0)
+            {
+                destroy_tree(jsoninfo);
+                *treeptr = NULL;
+                errno = ENOMEM;
+                return 0;
+            }
+
+            curnode->ntype = LTJSON_NTYPE_NULL;
+
+            if (filtered == FILTER_SKIP)
+                curnode->nflags = JSONNODE_NFLAGS_SKIPPED;
+
+            if (!filter_skip(jsoninfo, &text))
+            {
+                jsoninfo->open = curnode;
+                return 0;
+            }
+        }
+
+
+        else if (curnode->nflags == JSONNODE_NFLAGS_COLON)
         {
             /* The current node expects the next character to be a colon */
 
@@ -278,20 +241,31 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
                 return 0;
             }
 
-            /* create a new empty node */
-
-            if ((newnode = get_new_node(jsoninfo)) == NULL)
+            if (jsoninfo->sax || curnode->nflags == JSONNODE_NFLAGS_SKIPPED)
             {
-                destroy_tree(jsoninfo);
-                *treeptr = NULL;
-                errno = ENOMEM;
-                return 0;
+                /* The events have had this node (or a filter skipped
+                   its value). Empty it for reuse */
+
+                reuse_node(jsoninfo, curnode);
             }
+            else
+            {
+                /* create a new empty node */
+
+                if ((newnode = get_new_node(jsoninfo)) == NULL)
+                {
+                    destroy_tree(jsoninfo);
+                    *treeptr = NULL;
+                    errno = ENOMEM;
+                    return 0;
+                }
 
-            curnode->next = newnode;
-            newnode->ancnode = curnode->ancnode;
+                curnode->next = newnode;
+                newnode->ancnode = curnode->ancnode;
+
+                curnode = newnode;
+            }
 
-            curnode = newnode;
             text++;
         }
 
@@ -323,6 +297,9 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
             curnode->nflags = JSONNODE_NFLAGS_OPENOA;
             curnode->val.subnode = NULL;
 
+            if (jsoninfo->sax && !sax_container(jsoninfo, curnode, 1))
+                return sax_stopped(jsoninfo, treeptr);
+
             text++;
         }
 
@@ -338,6 +315,13 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
                 return 0;
             }
 
+            if (curnode->nflags == JSONNODE_NFLAGS_SKIPPED)
+            {
+                /* Filter skipped the last value. Drop its node */
+                filter_unlink(jsoninfo, curnode);
+                curnode = curnode->ancnode;
+            }
+
             if (curnode->nflags != JSONNODE_NFLAGS_OPENOA)
             {
                 /* Not at the node that is a { or [ */
@@ -365,8 +349,17 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
 
             curnode->nflags = 0;    /* Mark object/array as closed */
 
+            if (jsoninfo->filter)
+                jsoninfo->filter->depth--;
+
+            if (jsoninfo->sax && !sax_container(jsoninfo, curnode, 0))
+                return sax_stopped(jsoninfo, treeptr);
+
             if (curnode->ancnode == NULL)       /* At top, tree closed */
+            {
+                jsoninfo->textdone = text + 1;
                 return 1;
+            }
 
             text++;
         }
@@ -388,6 +381,9 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
                 }
                 return 0;
             }
+
+            if (jsoninfo->sax && !sax_node(jsoninfo, curnode))
+                return sax_stopped(jsoninfo, treeptr);
         }
 
 
@@ -398,9 +394,9 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
             return 0;
         }
 
-        text = skip_space(text);
+        text = skip_space(text, end);
 
-    }   /* while(*text) */
+    }   /* while (text < end) */
 
 
     /* Ran out of text without closing the JSON tree.
@@ -414,6 +410,864 @@ int ltjson_parse(ltjson_node_t **treeptr, const char *text, int usehash)
 
 
 
+/*
+ *  parse_text(treeptr, text, end, flags) - Parse text up to end
+ *
+ *  ltjson_parse() of the text from text to end, which need not be null
+ *  terminated. The tree at *treeptr (if any) must be valid.
+ *
+ *  Returns: as ltjson_parse()
+ */
+
+static int parse_text(ltjson_node_t **treeptr, const char *text,
+                      const char *end, int flags)
+{
+    ltjson_info_t *jsoninfo = (ltjson_info_t *)(*treeptr);
+    ltjson_node_t *curnode;
+
+    if (jsoninfo && jsoninfo->open)
+    {
+        /* Existing open tree */
+
+        if (text == end)
+        {
+            errno = EAGAIN;
+            return 0;
+        }
+
+        curnode = jsoninfo->open;
+        jsoninfo->open = 0;
+        jsoninfo->textend = end;
+
+        if (jsoninfo->incomplete)
+        {
+            /* Open tree with partial string stored in workstr
+               Finish it and get the name:value state right */
+
+            COUNT_ADD(jsoninfo, resumes, 1);
+
+            if (!process_json_alnum(jsoninfo, &text, curnode))
+            {
+                if (errno == ENOMEM)
+                {
+                    destroy_tree(jsoninfo);
+                    *treeptr = NULL;
+                    errno = ENOMEM;
+                }
+                else if (errno == EAGAIN)
+                {
+                    jsoninfo->open = curnode;
+                }
+                return 0;
+            }
+
+            if (jsoninfo->sax && !sax_node(jsoninfo, curnode))
+                return sax_stopped(jsoninfo, treeptr);
+        }
+        else if (jsoninfo->filter && jsoninfo->filter->skipping)
+        {
+            /* Open tree part way through skipping a value */
+
+            if (!filter_skip(jsoninfo, &text))
+            {
+                jsoninfo->open = curnode;
+                return 0;
+            }
+        }
+    }
+    else
+    {
+        /* Create (or recycle) tree and get a new (or the same) jsoninfo.
+           Check for blank text as it's a nuisance otherwise but it is
+           reasonable to allow leading spaces before the tree starts */
+
+        text = skip_space(text, end);
+        if (text == end)
+        {
+            errno = EAGAIN;
+            return 0;
+        }
+
+        if ((jsoninfo = start_tree(treeptr, flags)) == NULL)
+            return 0;
+
+        jsoninfo->textend = end;
+
+        if ((curnode = begin_tree(jsoninfo, *text)) == NULL)
+            return 0;
+
+        if (jsoninfo->sax && !sax_container(jsoninfo, curnode, 1))
+            return sax_stopped(jsoninfo, treeptr);
+
+        if (jsoninfo->filter)
+            filter_root(jsoninfo, *text);
+
+        text++;
+    }
+
+    return parse_values(jsoninfo, treeptr, curnode, text);
+}
+
+
+
+
+#ifdef LTJSON_COUNTERS
+/*
+ *  count_parse(treeptr, text, end, flags) - parse_text, counted
+ */
+
+static int count_parse(ltjson_node_t **treeptr, const char *text,
+                       const char *end, int flags)
+{
+    unsigned long long start = count_now();
+    ltjson_info_t *jsoninfo;
+    int ret;
+
+    ret = parse_text(treeptr, text, end, flags);
+
+    if ((jsoninfo = (ltjson_info_t *)(*treeptr)) != NULL)
+    {
+        if (ret && jsoninfo->textdone)
+            end = jsoninfo->textdone;   /* What's after isn't parsed */
+
+        jsoninfo->counters.bytes += end - text;
+        count_call(&jsoninfo->counters.nparses,
+                   &jsoninfo->counters.parse_ns, start);
+    }
+
+    return ret;
+}
+#else
+  #define count_parse   parse_text
+#endif
+
+
+
+
+/**
+ *  ltjson_parse(treeptr, text, flags) - Parse text into JSON tree
+ *      @treeptr:   Pointer to json tree root
+ *      @text:      UTF-8 text
+ *      @flags:     LTJSON_PARSE_* flags for a new or recycled tree
+ *
+ *  Scan the JSON provided @text and parse it into the tree which is
+ *  pointed to by treeptr. If @*treeptr is NULL then a new tree is created.
+ *  If not NULL the memory storage is reused if the tree is closed or
+ *  text continues to be added if the tree is open.
+ *
+ *  If @text is NULL, the tree is forced closed and into an error state.
+ *
+ *  If @flags has LTJSON_PARSE_USEHASH, a new or recycled tree will obtain
+ *  a name lookup hash table. This is really only useful for large trees
+ *  with many duplicate names. If not, a recycled tree will lose the hash.
+ *  With LTJSON_PARSE_KEEPHASH instead, a recycled tree keeps the names
+ *  already in its hash, so a stream of similar trees doesn't have to
+ *  hash and store the same names over and over again.
+ *
+ *  A tree with a dictionary attached (see ltjson_setdict) is always
+ *  hashed: names are taken from the dictionary where they're in it.
+ *
+ *  If @flags has LTJSON_PARSE_INSITU, @text must be writable and must
+ *  outlive the tree (as must the text of any continuation). Strings are
+ *  then unescaped in place in @text and the tree points at them there
+ *  instead of copying them. Member names are still copied if the tree
+ *  is hashed. A string split across two continuations is copied as usual.
+ *
+ *  If @flags has LTJSON_PARSE_MEMBERINDEX, ltjson_get_member indexes any
+ *  object of the closed tree that it has to walk far into, so further
+ *  lookups in wide objects take the same time however many members
+ *  there are. Adding nodes and sorting keep the index right.
+ *
+ *  If @flags has LTJSON_PARSE_RAWNUM, numbers are checked but not
+ *  converted. They are LTJSON_NTYPE_NUMRAW nodes holding the text of
+ *  the number in .val.s, which ltjson_get_ll and ltjson_get_double
+ *  convert on first use, keeping the value in the node. Raw numbers
+ *  are written and displayed just as they were in the text, so big
+ *  integers and long decimals are not rounded. Events always get
+ *  converted numbers.
+ *
+ *  A tree with a filter (see ltjson_setfilter) only keeps the parts
+ *  of the text that its paths search.
+ *
+ *  The flags are taken when the tree is started and continuations
+ *  carry on in the same mode.
+ *
+ *  Strings are stored as null terminated UTF-8. A \u0000 escape is
+ *  stored as the bytes 0xC0 0x80 ("Modified UTF-8") so that it is kept.
+ *
+ *  Numbers without a fraction or exponent that fit in a long long are
+ *  stored as integers, all others as doubles. The locale is not used.
+ *
+ *  Returns:  1 on success and the tree is parsed and closed
+ *            0 on error or tree is incomplete and errno is set to:
+ *              EAGAIN if tree incomplete and more text needed
+ *              EINVAL if invalid argument
+ *              EILSEQ if invalid JSON sequence (reason available)
+ *              ENOMEM if out of memory
+ *              ECANCELED if an event callback stopped the parse
+ *
+ *  On ENOMEM, all storage will be freed and *treeptr is set to NULL
+ */
+
+int ltjson_parse(ltjson_node_t **treeptr, const char *text, int flags)
+{
+    ltjson_info_t *jsoninfo = 0;
+
+    if (!treeptr)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (*treeptr)
+    {
+        if (!is_valid_tree(*treeptr))
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+    }
+
+    if (!text)
+    {
+        /* Request to close a tree. The next call will recycle
+           the tree (if not NULL). Put tree into error state. */
+
+        if (jsoninfo)
+        {
+            jsoninfo->open = 0;
+            jsoninfo->lasterr = ERR_SEQ_TREEDUMP;
+        }
+
+        return 1;   /* Success! */
+    }
+
+    return count_parse(treeptr, text, text + strlen(text), flags);
+}
+
+
+
+
+/**
+ *  ltjson_parsen(treeptr, text, len, flags) - Parse len bytes of text
+ *      @treeptr:   Pointer to json tree root
+ *      @text:      UTF-8 text, not necessarily null terminated
+ *      @len:       Length of text in bytes
+ *      @flags:     LTJSON_PARSE_* flags for a new or recycled tree
+ *
+ *  As ltjson_parse() of the @len bytes at @text. Nothing at or past
+ *  @text + @len is read (or written with LTJSON_PARSE_INSITU). Coming
+ *  to the end of them with the tree still open is the same as coming
+ *  to the end of a text: 0 and EAGAIN, to be continued by the next
+ *  call. A null byte is text like any other, which is not valid JSON
+ *  outside a string and ends one it's in (strings are stored null
+ *  terminated).
+ *
+ *  If @text is NULL, the tree is forced closed and into an error state.
+ *
+ *  Returns:  As ltjson_parse()
+ */
+
+int ltjson_parsen(ltjson_node_t **treeptr, const char *text, size_t len,
+                  int flags)
+{
+    if (!text || !treeptr || (*treeptr && !is_valid_tree(*treeptr)))
+        return ltjson_parse(treeptr, text, flags);
+
+    return count_parse(treeptr, text, text + len, flags);
+}
+
+
+
+
+/**
+ *  ltjson_parse_file(treeptr, path, flags) - Parse a file into JSON tree
+ *      @treeptr:   Pointer to json tree root
+ *      @path:      Name of the file
+ *      @flags:     LTJSON_PARSE_* flags for a new or recycled tree
+ *
+ *  As ltjson_parse() of the whole file as one text, which is mapped
+ *  into memory rather than read. If @*treeptr is NULL then a new tree
+ *  is created, otherwise it must not be open and is recycled.
+ *
+ *  With LTJSON_PARSE_INSITU the strings are unescaped in place in a
+ *  private mapping of the file (the file itself is not changed) and
+ *  the tree keeps the mapping until it is recycled or freed. Otherwise
+ *  the file is unmapped before returning.
+ *
+ *  There is no continuing a file. If it ends before the tree does, the
+ *  tree is forced closed and into an error state, as ltjson_parse()
+ *  with a NULL text, and errno is EAGAIN.
+ *
+ *  Returns:  As ltjson_parse(), or 0 with errno set to:
+ *              EBUSY  if the tree is open
+ *              EAGAIN if the file is empty or all white space (the
+ *                     tree is unchanged) or incomplete (see above)
+ *              EINVAL if the file is not a regular file
+ *              or as set by the system if it can't be opened or mapped
+ */
+
+int ltjson_parse_file(ltjson_node_t **treeptr, const char *path, int flags)
+{
+    ltjson_info_t *jsoninfo;
+    char *text;
+    size_t size;
+    int ret, err;
+
+    if (!treeptr || !path || (*treeptr && !is_valid_tree(*treeptr)))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (*treeptr && ((ltjson_info_t *)(*treeptr))->open)
+    {
+        errno = EBUSY;
+        return 0;
+    }
+
+    if ((text = file_map(path, flags & LTJSON_PARSE_INSITU, &size)) == NULL)
+        return 0;
+
+    if (skip_space(text, text + size) == text + size)
+    {
+        file_unmap(text, size);
+        errno = EAGAIN;
+        return 0;
+    }
+
+    ret = count_parse(treeptr, text, text + size, flags);
+    err = errno;
+
+    /* The tree was started from this text, so any mapping it had
+       is gone. In situ strings need this one for as long as it lasts */
+
+    jsoninfo = (ltjson_info_t *)(*treeptr);
+
+    if (jsoninfo && (flags & LTJSON_PARSE_INSITU))
+    {
+        jsoninfo->map = text;
+        jsoninfo->mapsize = size;
+    }
+    else
+    {
+        file_unmap(text, size);
+    }
+
+    if (!ret && err == EAGAIN && jsoninfo && jsoninfo->open)
+        ltjson_parse(treeptr, NULL, 0);
+
+    errno = err;
+    return ret;
+}
+
+
+
+
+/**
+ *  ltjson_parsev(treeptr, iov, niov, flags) - Parse a run of buffers
+ *      @treeptr:   Pointer to json tree root
+ *      @iov:       Array of buffers of UTF-8 text
+ *      @niov:      Number of buffers in iov
+ *      @flags:     LTJSON_PARSE_* flags for a new or recycled tree
+ *
+ *  As ltjson_parse() of the buffers, one after another, as if they had
+ *  been put together into one text. They don't have to be null
+ *  terminated and may be empty. A string, number or logic split
+ *  between buffers (or between calls) is carried on from where it
+ *  left off, so buffers straight from a read need no copying.
+ *
+ *  Once the tree is closed the rest of the buffers are ignored. If
+ *  it's still open after the last one, this returns 0 and EAGAIN as
+ *  usual and the tree carries on with the next ltjson_parse() or
+ *  ltjson_parsev().
+ *
+ *  Returns:  As ltjson_parse(), with EINVAL also if @iov is NULL (and
+ *            @niov isn't 0), @niov is negative or a buffer other than
+ *            an empty one has a NULL .base
+ */
+
+int ltjson_parsev(ltjson_node_t **treeptr, const ltjson_iovec_t *iov,
+                  int niov, int flags)
+{
+    int i;
+
+    if (!treeptr || (*treeptr && !is_valid_tree(*treeptr)) || niov < 0 ||
+        (!iov && niov))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (i = 0; i < niov; i++)
+    {
+        if (!iov[i].base && iov[i].len)
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    for (i = 0; i < niov; i++)
+    {
+        if (!iov[i].len)
+            continue;
+
+        if (count_parse(treeptr, iov[i].base, iov[i].base + iov[i].len,
+                        flags))
+            return 1;
+
+        if (errno != EAGAIN)
+            return 0;
+    }
+
+    errno = EAGAIN;
+    return 0;
+}
+
+
+
+
+/**
+ *  ltjson_parse_stream(treeptr, text, len, flags, usedp) - Parse a stream
+ *      @treeptr:   Pointer to json tree root
+ *      @text:      UTF-8 text of one or more trees, not null terminated
+ *      @len:       Length of text in bytes
+ *      @flags:     LTJSON_PARSE_* flags for each new or recycled tree
+ *      @usedp:     Written with the number of bytes of @text parsed
+ *
+ *  As ltjson_parsen() for a stream of trees one after another, such as
+ *  newline delimited JSON (NDJSON) or trees simply run together. The
+ *  parse stops as soon as a tree is closed, returning 1 with *@usedp
+ *  the bytes up to and including its closing brace or bracket. The
+ *  next call (with @text + *@usedp) recycles the tree for the tree that
+ *  follows, so its storage is reused for every record in the stream
+ *  (use LTJSON_PARSE_KEEPHASH to keep hashed names too).
+ *
+ *  A tree split between texts is continued as usual: 0 and EAGAIN,
+ *  with all of @text used. So is text that is all white space, which
+ *  leaves a closed tree as it is until there's another to parse.
+ *
+ *  Returns:  As ltjson_parse(), with *@usedp written:
+ *              the bytes used when the tree is closed (1 returned)
+ *              @len for EAGAIN, 0 on any other error
+ */
+
+int ltjson_parse_stream(ltjson_node_t **treeptr, const char *text,
+                        size_t len, int flags, size_t *usedp)
+{
+    ltjson_info_t *jsoninfo;
+
+    if (!usedp)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    *usedp = 0;
+
+    if (!treeptr || !text || (*treeptr && !is_valid_tree(*treeptr)))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (count_parse(treeptr, text, text + len, flags))
+    {
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+        *usedp = jsoninfo->textdone - text;
+        return 1;
+    }
+
+    if (errno == EAGAIN)
+        *usedp = len;
+
+    return 0;
+}
+
+
+
+
+/**
+ *  ltjson_setsax(treeptr, sax, ctx) - Parse into event callbacks
+ *      @treeptr:   Pointer to json tree root
+ *      @sax:       Event callbacks or NULL to build trees again
+ *      @ctx:       Context argument passed to every callback
+ *
+ *  If @*treeptr is NULL then a new (empty) tree is created for it.
+ *  Otherwise the tree must not be open and it is emptied.
+ *
+ *  Each following ltjson_parse() of the tree (with continuations just
+ *  as usual) calls the callbacks in @sax, in document order, instead
+ *  of building the tree, which stays empty. Only one node per level of
+ *  nesting and the working store for the longest string or number are
+ *  used whatever the size of the text. Names are not hashed.
+ *
+ *  A callback returning 0 stops the parse: ltjson_parse() returns 0
+ *  with errno set to ECANCELED and the tree is in an error state.
+ *  Setting callbacks removes any filter (see ltjson_setfilter) and
+ *  any tape (see ltjson_settape).
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if invalid tree
+ *              EBUSY  if the tree is open
+ *              ENOMEM if out of memory
+ */
+
+int ltjson_setsax(ltjson_node_t **treeptr, const ltjson_sax_t *sax,
+                  void *ctx)
+{
+    ltjson_info_t *jsoninfo = 0;
+
+    if (!treeptr)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (*treeptr)
+    {
+        if (!is_valid_tree(*treeptr))
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+
+        if (jsoninfo->open)
+        {
+            errno = EBUSY;
+            return 0;
+        }
+    }
+
+    if ((jsoninfo = create_tree(jsoninfo, NULL)) == NULL)
+    {
+        *treeptr = NULL;
+        return 0;
+    }
+
+    *treeptr = (ltjson_node_t *)jsoninfo;
+
+    tape_free(jsoninfo);
+
+    jsoninfo->sax = sax;
+    jsoninfo->saxctx = ctx;
+
+    if (sax)
+        filter_free(jsoninfo);
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_setfilter(treeptr, cpaths, npaths) - Only parse what paths use
+ *      @treeptr:   Pointer to json tree root
+ *      @cpaths:    Array of compiled paths (see ltjson_pathcompile)
+ *      @npaths:    Number of paths (max LTJSON_PATH_MAXMULTI) or 0
+ *
+ *  If @*treeptr is NULL then a new (empty) tree is created for it.
+ *  Otherwise the tree must not be open and it is emptied.
+ *
+ *  Each following ltjson_parse() of the tree only builds the nodes on
+ *  the way to the matches of @cpaths and the whole of each match. All
+ *  else is skipped over in the text without storing or hashing any of
+ *  it, so only balanced brackets and strings are checked there.
+ *  Searching for the same paths then gives the same nodes as searching
+ *  the full tree: unwanted array elements up to a path's index are
+ *  kept as null placeholders. Any event callbacks or tape are removed.
+ *
+ *  The compiled paths must not be freed while the tree uses them. An
+ *  @npaths of 0 removes the filter.
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if invalid tree or path
+ *              EBUSY  if the tree is open
+ *              ERANGE if there are too many paths
+ *              ENOMEM if out of memory
+ */
+
+int ltjson_setfilter(ltjson_node_t **treeptr, const ltjson_cpath_t **cpaths,
+                     int npaths)
+{
+    ltjson_info_t *jsoninfo = 0;
+    struct filter *filter;
+    int i;
+
+    if (!treeptr || npaths < 0 || (npaths && !cpaths))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (npaths > LTJSON_PATH_MAXMULTI)
+    {
+        errno = ERANGE;
+        return 0;
+    }
+
+    for (i = 0; i < npaths; i++)
+    {
+        if (!cpaths[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+    }
+
+    if (*treeptr)
+    {
+        if (!is_valid_tree(*treeptr))
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+
+        if (jsoninfo->open)
+        {
+            errno = EBUSY;
+            return 0;
+        }
+    }
+
+    if ((jsoninfo = create_tree(jsoninfo, NULL)) == NULL)
+    {
+        *treeptr = NULL;
+        return 0;
+    }
+
+    *treeptr = (ltjson_node_t *)jsoninfo;
+
+    filter_free(jsoninfo);
+
+    if (!npaths)
+        return 1;
+
+    if ((filter = mem_alloc(jsoninfo->alloc, sizeof(struct filter))) == NULL)
+        return 0;
+
+    filter->npaths = npaths;
+    filter->levels = 0;
+    filter->nlevels = 0;
+    filter->depth = 0;
+    filter->skipping = 0;
+
+    for (i = 0; i < npaths; i++)
+        filter->rpaths[i] = cpaths[i]->plain;
+
+    if (!filter_reserve(jsoninfo, filter, FILTER_INIT_LEVELS))
+    {
+        mem_free(jsoninfo->alloc, filter);
+        return 0;
+    }
+
+    tape_free(jsoninfo);
+
+    jsoninfo->filter = filter;
+    jsoninfo->sax = 0;
+    jsoninfo->saxctx = 0;
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_settape(treeptr, on) - Parse into a compact tree
+ *      @treeptr:   Pointer to json tree root
+ *      @on:        1 to build a tape, 0 to build trees again
+ *
+ *  If @*treeptr is NULL then a new (empty) tree is created for it.
+ *  Otherwise the tree must not be open and it is emptied.
+ *
+ *  Each following ltjson_parse() of the tree (with continuations just
+ *  as usual) builds a compact tree (see ltjson_ctree_new) as the text
+ *  is read, rather than a tree of ltjson_node_t: a flat array of nodes
+ *  in document order, each object and array having the index after
+ *  its last member or element. This uses the event callbacks, so the
+ *  tree itself stays empty. Once the tree is closed, the tape is got
+ *  with ltjson_gettape() and read with the ltjson_ctree_*() functions.
+ *
+ *  The tape's memory is kept and reused for the next parse. It comes
+ *  from the tree's allocator. Any filter or event callbacks are removed.
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if invalid tree
+ *              EBUSY  if the tree is open
+ *              ENOMEM if out of memory
+ */
+
+int ltjson_settape(ltjson_node_t **treeptr, int on)
+{
+    ltjson_info_t *jsoninfo = 0;
+    struct tape *tape;
+
+    if (!treeptr)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (*treeptr)
+    {
+        if (!is_valid_tree(*treeptr))
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        jsoninfo = (ltjson_info_t *)(*treeptr);
+
+        if (jsoninfo->open)
+        {
+            errno = EBUSY;
+            return 0;
+        }
+    }
+
+    if ((jsoninfo = create_tree(jsoninfo, NULL)) == NULL)
+    {
+        *treeptr = NULL;
+        return 0;
+    }
+
+    *treeptr = (ltjson_node_t *)jsoninfo;
+
+    if (!on)
+    {
+        if (jsoninfo->tape)
+        {
+            tape_free(jsoninfo);
+            jsoninfo->sax = 0;
+            jsoninfo->saxctx = 0;
+        }
+        return 1;
+    }
+
+    if (!jsoninfo->tape)
+    {
+        if ((tape = mem_zalloc(jsoninfo->alloc, sizeof(struct tape))) == NULL)
+            return 0;
+
+        tape->ctree.nodes = 0;
+        tape->ctree.strs = 0;
+        jsoninfo->tape = tape;
+    }
+
+    filter_free(jsoninfo);
+
+    jsoninfo->sax = &tape_sax;
+    jsoninfo->saxctx = jsoninfo;
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_setalloc(treeptr, alloc) - Get a new tree's memory from alloc
+ *      @treeptr:   Pointer to json tree root, which must be NULL
+ *      @alloc:     Allocator functions and their context
+ *
+ *  A new (empty) tree is created for @*treeptr with its own copy of
+ *  @alloc. All of the tree's memory, including the tree itself, is got
+ *  from and given back to @alloc for as long as the tree lasts: alloc
+ *  returns NULL when out of memory, resize acts as realloc (with a
+ *  NULL mem too) and release is never given NULL. The context must
+ *  stay valid until the tree is freed.
+ *
+ *  Dictionaries and compiled paths are not part of a tree and always
+ *  use malloc. If a parse runs out of memory the tree is freed as
+ *  usual and *treeptr set to NULL, so the allocator must be set again
+ *  for the next tree.
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if @*treeptr is not NULL or @alloc is incomplete
+ *              ENOMEM if out of memory
+ */
+
+int ltjson_setalloc(ltjson_node_t **treeptr, const ltjson_alloc_t *alloc)
+{
+    ltjson_info_t *jsoninfo;
+
+    if (!treeptr || *treeptr || !alloc ||
+        !alloc->alloc || !alloc->resize || !alloc->release)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if ((jsoninfo = create_tree(NULL, alloc)) == NULL)
+        return 0;
+
+    *treeptr = (ltjson_node_t *)jsoninfo;
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_setarena(treeptr, buf, size) - Build a new tree in a buffer
+ *      @treeptr:   Pointer to json tree root, which must be NULL
+ *      @buf:       Memory for the tree
+ *      @size:      Bytes at @buf
+ *
+ *  As ltjson_setalloc() with an allocator that hands out @buf from the
+ *  start with no calls to malloc at all. Only the last block can be
+ *  given back, so a table or store that grows leaves its old copy
+ *  behind: the arena suits a tree that is parsed once or recycled for
+ *  texts of much the same size. Running out of @buf is ENOMEM, as for
+ *  malloc. ltjson_free() leaves @buf to the caller.
+ *
+ *  Returns:  1 on success
+ *            0 on error and errno is set to:
+ *              EINVAL if @*treeptr is not NULL or @buf is NULL
+ *              ENOMEM if @buf is too small for an empty tree
+ */
+
+int ltjson_setarena(ltjson_node_t **treeptr, void *buf, size_t size)
+{
+    ltjson_alloc_t alloc;
+    struct arena *arena;
+
+    if (!treeptr || *treeptr || !buf)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if ((arena = arena_init(buf, size)) == NULL)
+    {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    alloc.alloc   = arena_alloc;
+    alloc.resize  = arena_resize;
+    alloc.release = arena_release;
+    alloc.ctx     = arena;
+
+    return ltjson_setalloc(treeptr, &alloc);
+}
+
+
+
+
 /**
  *  ltjson_free(treeptr) - Free up all memory associate with tree
  *      @treeptr:   Pointer to valid tree
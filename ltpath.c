@@ -14,14 +14,6 @@
 #ifdef _LTJSON_INLINE_INCLUDE_
 
 
-typedef struct {
-    const char *name;   /* Pointer to name (not null terminated) */
-    int namelen;        /* Name length (can be zero) */
-    int hasindex;       /* If this section specifies an index */
-    int aindex;         /* The index (0 based. -1 means "*") */
-} ltjson_rpath_t;
-
-
 /*
  *  path_tokenise(path, rstore, rsize) - break path into sections
  *
@@ -81,6 +73,8 @@ static int path_tokenise(const char *path, ltjson_rpath_t *rstore, int rsize)
             rstore[rnum].namelen++;
         }
 
+        rstore[rnum].hash = name_hash(rstore[rnum].name, rstore[rnum].namelen);
+
         if (*curp == '\0')
             continue;
 
@@ -153,11 +147,9 @@ static int path_tokenise(const char *path, ltjson_rpath_t *rstore, int rsize)
 static int path_hashify_rpath(ltjson_info_t *jsoninfo,
                               ltjson_rpath_t *refpaths)
 {
-    struct nhashcell *nhcp;
-    unsigned long hashval;
     const char *hashname;
 
-    if (!jsoninfo->nhtab)
+    if (!nhash_ishashed(jsoninfo))
         return 1;
 
     while (refpaths->name != NULL)
@@ -177,20 +169,8 @@ static int path_hashify_rpath(ltjson_info_t *jsoninfo,
             continue;
         }
 
-        hashval =
-            djbnhash(refpaths->name, refpaths->namelen) % NHASH_NBUCKETS;
-
-        hashname = 0;
-
-        for (nhcp = jsoninfo->nhtab[hashval]; nhcp; nhcp = nhcp->next)
-        {
-            if (strncmp(refpaths->name, nhcp->s, refpaths->namelen) == 0)
-            {
-                hashname = nhcp->s;
-                break;
-            }
-        }
-
+        hashname = nhash_nlookup(jsoninfo, refpaths->name,
+                                 refpaths->namelen, refpaths->hash);
         if (!hashname)
             return 0;
 
@@ -205,6 +185,35 @@ static int path_hashify_rpath(ltjson_info_t *jsoninfo,
 
 
 
+/*
+ *  path_namematch(refpath, node) - Does node have the refpath's name?
+ *
+ *  Returns 1 if the object member node is named as in refpath, 0 if not
+ */
+
+static int path_namematch(const ltjson_rpath_t *refpath,
+                          const ltjson_node_t *node)
+{
+    if (refpath->namelen < 0)
+    {
+        /* Hash: Just compare pointers */
+        return refpath->name == node->name;
+    }
+
+    if ((unsigned char)*refpath->name == 0xFF)
+    {
+        /* Special handling for a "" search */
+        return *node->name == '\0';
+    }
+
+    return node->namehash == refpath->hash &&
+           strncmp(node->name, refpath->name, refpath->namelen) == 0 &&
+           node->name[refpath->namelen] == '\0';
+}
+
+
+
+
 /*
  *  path_finditem(atnode, refpath, nodestorep, storeavail) - get item
  *
@@ -219,7 +228,7 @@ static int path_hashify_rpath(ltjson_info_t *jsoninfo,
  *  Returns the number of matches found (whether stored or not)
  */
 
-static int path_finditem(ltjson_node_t *atnode, ltjson_rpath_t *refpath,
+static int path_finditem(ltjson_node_t *atnode, const ltjson_rpath_t *refpath,
                          ltjson_node_t ***nodestorep, int *storeavail)
 {
     int thisindex, nfound;
@@ -265,24 +274,8 @@ static int path_finditem(ltjson_node_t *atnode, ltjson_rpath_t *refpath,
             return 0;
 
         do {
-            if (refpath->namelen < 0)
-            {
-                /* Hash: Just compare pointers */
-                if (refpath->name == atnode->name)
-                    break;
-            }
-            else if ((unsigned char)*refpath->name == 0xFF)
-            {
-                /* Special handling for a "" search */
-                if (*atnode->name == '\0')
-                    break;
-            }
-            else if (strncmp(atnode->name, refpath->name,
-                                           refpath->namelen) == 0)
-            {
-                /* found */
+            if (path_namematch(refpath, atnode))
                 break;
-            }
 
         } while ((atnode = atnode->next) != NULL);
 
@@ -343,6 +336,54 @@ static int path_finditem(ltjson_node_t *atnode, ltjson_rpath_t *refpath,
 
 
 
+/*
+ *  path_refer(tree, path, nodeptr, nnodes) - ltjson_pathrefer, uncounted
+ */
+
+static int path_refer(ltjson_node_t *tree, const char *path,
+                      ltjson_node_t **nodeptr, int nnodes)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_rpath_t refpaths[8];
+    int ret;
+
+    if (!path || !nodeptr || nnodes <= 0 || !is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    ret = path_tokenise(path, refpaths, sizeof(refpaths)/sizeof(refpaths[0]));
+    if (ret < 0)
+        return 0;
+
+    if (ret == 0)
+    {
+        nodeptr[0] = tree;
+        return 1;
+    }
+
+    /* If hashes are available, use them */
+
+    jsoninfo = (ltjson_info_t *)tree;
+
+    if (!path_hashify_rpath(jsoninfo, refpaths))
+    {
+        /* Failure to hash a name means it can never be found! */
+        errno = 0;
+        return 0;
+    }
+
+    ret = path_finditem(tree, refpaths, &nodeptr, &nnodes);
+    if (!ret)
+        errno = 0;
+
+    return ret;
+}
+
+
+
+
 /**
  *  ltjson_pathrefer(tree, path, nodeptr, nnodes) - Search for nodes
  *      @tree:      Valid closed and finalised (no error state) tree
@@ -378,42 +419,445 @@ static int path_finditem(ltjson_node_t *atnode, ltjson_rpath_t *refpath,
 int ltjson_pathrefer(ltjson_node_t *tree, const char *path,
                      ltjson_node_t **nodeptr, int nnodes)
 {
-    ltjson_info_t *jsoninfo;
-    ltjson_rpath_t refpaths[8];
+#ifdef LTJSON_COUNTERS
+    unsigned long long start = count_now();
     int ret;
 
-    if (!path || !nodeptr || nnodes <= 0 || !is_closed_tree(tree))
+    ret = path_refer(tree, path, nodeptr, nnodes);
+
+    if (is_valid_tree(tree))
+        count_call(&((ltjson_info_t *)tree)->counters.npathrefers,
+                   &((ltjson_info_t *)tree)->counters.pathrefer_ns, start);
+
+    return ret;
+#else
+    return path_refer(tree, path, nodeptr, nnodes);
+#endif
+}
+
+
+/**
+ *  ltjson_pathcompile(path, dict) - Compile a path for repeated use
+ *      @path:  Reference path expression (as ltjson_pathrefer)
+ *      @dict:  Optional dictionary of the trees the path will search
+ *
+ *  The path is tokenised once and its names (with their hashes) kept
+ *  in the compiled path, which belongs to no tree. If @dict is given,
+ *  names in it are looked up now, so searching a tree attached to that
+ *  dictionary just compares name pointers.
+ *
+ *  A compiled path is only read by ltjson_pathexec and ltjson_pathexecm
+ *  so one can be used on any number of trees at once.
+ *
+ *  Returns: Pointer to the compiled path on success
+ *           NULL on failure with errno set to one of
+ *              EINVAL if path is NULL
+ *              EILSEQ if path expression is not understood
+ *              ENOMEM if out of memory
+ */
+
+ltjson_cpath_t *ltjson_pathcompile(const char *path, ltjson_dict_t *dict)
+{
+    ltjson_cpath_t *cpath;
+    ltjson_rpath_t *rpath;
+    const char *cp;
+    char *text;
+    int nslash;
+
+    if (!path)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (nslash = 0, cp = path; *cp; cp++)
+    {
+        if (*cp == '/')
+            nslash++;
+    }
+
+    /* There can't be more sections than slashes (plus the terminator) */
+
+    cpath = malloc(sizeof(ltjson_cpath_t) +
+                   2 * (nslash + 1) * sizeof(ltjson_rpath_t) +
+                   (cp - path) + 1);
+    if (!cpath)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    cpath->dict = dict;
+    cpath->plain = (ltjson_rpath_t *)(cpath + 1);
+    cpath->interned = cpath->plain + nslash + 1;
+
+    text = (char *)(cpath->interned + nslash + 1);
+    memcpy(text, path, (cp - path) + 1);
+
+    cpath->nsects = path_tokenise(text, cpath->plain, nslash + 1);
+    if (cpath->nsects < 0)
+    {
+        free(cpath);
+        return NULL;    /* errno from path_tokenise */
+    }
+
+    memcpy(cpath->interned, cpath->plain,
+           (cpath->nsects + 1) * sizeof(ltjson_rpath_t));
+
+    for (rpath = cpath->interned; rpath->name; rpath++)
+    {
+        struct nhashcell *nhcp;
+
+        if (rpath->namelen == 0)
+            continue;
+
+        if ((unsigned char)*rpath->name == 0xFF)
+        {
+            /* A "" name is the same pointer in every tree */
+            rpath->name = ltjson_empty_name;
+            rpath->namelen = -1;
+            continue;
+        }
+
+        if (!dict)
+            continue;
+
+        nhcp = nhash_find(&dict->nhash, rpath->name, rpath->namelen,
+                          rpath->hash, NULL);
+        if (nhcp->s)
+        {
+            rpath->name = nhcp->s;
+            rpath->namelen = -1;
+        }
+    }
+
+    return cpath;
+}
+
+
+
+
+/**
+ *  ltjson_pathfree(cpathp) - Free a compiled path
+ *      @cpathp:    Pointer to compiled path
+ *
+ *  Returns:    1 on success, writing NULL to *cpathp
+ *              0 and errno set to EINVAL if there is no compiled path
+ */
+
+int ltjson_pathfree(ltjson_cpath_t **cpathp)
+{
+    if (!cpathp || !*cpathp)
     {
         errno = EINVAL;
         return 0;
     }
 
-    ret = path_tokenise(path, refpaths, sizeof(refpaths)/sizeof(refpaths[0]));
-    if (ret < 0)
+    free(*cpathp);
+    *cpathp = NULL;
+    return 1;
+}
+
+
+
+
+/*
+ *  path_rpaths(jsoninfo, cpath) - The refpath list to use on a tree
+ *
+ *  Names from the dictionary can only be compared by pointer in trees
+ *  attached to the same dictionary.
+ */
+
+static const ltjson_rpath_t *path_rpaths(ltjson_info_t *jsoninfo,
+                                         const ltjson_cpath_t *cpath)
+{
+    if (cpath->dict && cpath->dict == jsoninfo->dict)
+        return cpath->interned;
+
+    return cpath->plain;
+}
+
+
+
+
+/**
+ *  ltjson_pathexec(tree, cpath, nodeptr, nnodes) - Search with compiled path
+ *      @tree:      Valid closed and finalised (no error state) tree
+ *      @cpath:     Compiled path
+ *      @nodeptr:   Pointer to nodestore for the answer
+ *      @nnodes:    Number of available nodes in @nodeptr
+ *
+ *  As ltjson_pathrefer but with a path from ltjson_pathcompile.
+ *
+ *  Returns: Number of matches found (not stored) on success or
+ *           0 on failure and, if an error, sets errno to
+ *              EINVAL if tree is not valid, closed or finalised
+ */
+
+int ltjson_pathexec(ltjson_node_t *tree, const ltjson_cpath_t *cpath,
+                    ltjson_node_t **nodeptr, int nnodes)
+{
+    int ret;
+
+    if (!cpath || !nodeptr || nnodes <= 0 || !is_closed_tree(tree))
+    {
+        errno = EINVAL;
         return 0;
+    }
 
-    if (ret == 0)
+    if (cpath->nsects == 0)
     {
         nodeptr[0] = tree;
         return 1;
     }
 
-    /* If hashes are available, use them */
+    ret = path_finditem(tree, path_rpaths((ltjson_info_t *)tree, cpath),
+                        &nodeptr, &nnodes);
+    if (!ret)
+        errno = 0;
 
-    jsoninfo = (ltjson_info_t *)tree;
+    return ret;
+}
 
-    if (!path_hashify_rpath(jsoninfo, refpaths))
+
+
+
+/* State of each path in the traversal of path_findmulti below. The
+   path has section (state >> 1) still to match and, if (state & 1),
+   the node is an array whose elements are to be picked by the index
+   of that section. */
+
+struct pathmulti {
+    const ltjson_rpath_t *rpaths[LTJSON_PATH_MAXMULTI];
+    ltjson_node_t **nodeptr;            /* First match of each path */
+    int *nfound;                        /* Matches of each path     */
+};
+
+
+
+
+/*
+ *  path_findmulti(atnode, pmulti, mask, state) - Find items of many paths
+ *
+ *  As path_finditem for every path i in pmulti with bit i set in mask,
+ *  each at its own state[i]. The members or elements of atnode are
+ *  visited once for all the paths together.
+ */
+
+static void path_findmulti(ltjson_node_t *atnode, struct pathmulti *pmulti,
+                           unsigned long long mask, const int *state)
+{
+    int substate[LTJSON_PATH_MAXMULTI];
+    unsigned long long submask, seen, bit;
+    const ltjson_rpath_t *refpath;
+    ltjson_node_t *node;
+    int i, thisindex, maxindex;
+
+    /* Paths that finish here, or can't go on from here, drop out */
+
+    for (i = 0, bit = 1; i < LTJSON_PATH_MAXMULTI; i++, bit <<= 1)
     {
-        /* Failure to hash a name means it can never be found! */
-        errno = 0;
+        if (!(mask & bit) || (state[i] & 1))
+            continue;
+
+        refpath = &pmulti->rpaths[i][state[i] >> 1];
+
+        if (refpath->name == NULL)
+        {
+            if (pmulti->nfound[i]++ == 0)
+                pmulti->nodeptr[i] = atnode;
+
+            mask &= ~bit;
+        }
+        else if (atnode->ntype == LTJSON_NTYPE_OBJECT)
+        {
+            if (!refpath->namelen)
+                mask &= ~bit;
+        }
+        else if (atnode->ntype == LTJSON_NTYPE_ARRAY)
+        {
+            if (refpath->namelen)
+                mask &= ~bit;
+        }
+        else
+        {
+            mask &= ~bit;
+        }
+    }
+
+    if (!mask || !atnode->val.subnode)
+        return;
+
+
+    if (atnode->ntype == LTJSON_NTYPE_OBJECT)
+    {
+        /* Each path matches the first member with its name only */
+
+        seen = 0;
+
+        for (node = atnode->val.subnode; node; node = node->next)
+        {
+            submask = 0;
+
+            for (i = 0, bit = 1; i < LTJSON_PATH_MAXMULTI; i++, bit <<= 1)
+            {
+                if (!(mask & bit) || (seen & bit))
+                    continue;
+
+                refpath = &pmulti->rpaths[i][state[i] >> 1];
+
+                if (!path_namematch(refpath, node))
+                    continue;
+
+                seen |= bit;
+
+                if (node->ntype != LTJSON_NTYPE_ARRAY)
+                {
+                    if (refpath->hasindex)
+                        continue;
+
+                    substate[i] = state[i] + 2;
+                }
+                else if (!refpath->hasindex && refpath[1].name == NULL)
+                {
+                    substate[i] = state[i] + 2;     /* The array itself */
+                }
+                else
+                {
+                    substate[i] = state[i] | 1;     /* Its elements */
+                }
+
+                submask |= bit;
+            }
+
+            if (submask)
+                path_findmulti(node, pmulti, submask, substate);
+
+            if (seen == mask)
+                break;
+        }
+
+        return;
+    }
+
+
+    /* Array: every path picks elements by the index of its section */
+
+    maxindex = 0;
+
+    for (i = 0, bit = 1; i < LTJSON_PATH_MAXMULTI; i++, bit <<= 1)
+    {
+        if (!(mask & bit))
+            continue;
+
+        refpath = &pmulti->rpaths[i][state[i] >> 1];
+
+        if (refpath->aindex < 0)
+            maxindex = -1;
+        else if (maxindex >= 0 && refpath->aindex > maxindex)
+            maxindex = refpath->aindex;
+    }
+
+    thisindex = 0;
+
+    for (node = atnode->val.subnode; node; node = node->next, thisindex++)
+    {
+        if (maxindex >= 0 && thisindex > maxindex)
+            break;
+
+        submask = 0;
+
+        for (i = 0, bit = 1; i < LTJSON_PATH_MAXMULTI; i++, bit <<= 1)
+        {
+            if (!(mask & bit))
+                continue;
+
+            refpath = &pmulti->rpaths[i][state[i] >> 1];
+
+            if (refpath->aindex >= 0 && refpath->aindex != thisindex)
+                continue;
+
+            substate[i] = (state[i] & ~1) + 2;
+            submask |= bit;
+        }
+
+        if (submask)
+            path_findmulti(node, pmulti, submask, substate);
+    }
+}
+
+
+
+
+/**
+ *  ltjson_pathexecm(tree, cpaths, npaths, nodeptr, nfound) - Many searches
+ *      @tree:      Valid closed and finalised (no error state) tree
+ *      @cpaths:    Array of compiled paths
+ *      @npaths:    Number of paths in @cpaths (max LTJSON_PATH_MAXMULTI)
+ *      @nodeptr:   Array of @npaths nodes for the answers
+ *      @nfound:    Optional array of @npaths match counts
+ *
+ *  Search the tree for all the compiled paths at once, walking each
+ *  part of the tree once however many paths go through it. The first
+ *  match of @cpaths[i] (the one ltjson_pathexec would store first) is
+ *  stored in @nodeptr[i], or NULL if there is none, and the number of
+ *  matches in @nfound[i].
+ *
+ *  Returns: Number of paths that matched on success or
+ *           0 on failure and, if an error, sets errno to one of
+ *              EINVAL if tree is not valid, closed or finalised
+ *              ERANGE if there are too many paths
+ */
+
+int ltjson_pathexecm(ltjson_node_t *tree, const ltjson_cpath_t **cpaths,
+                     int npaths, ltjson_node_t **nodeptr, int *nfound)
+{
+    int state[LTJSON_PATH_MAXMULTI], counts[LTJSON_PATH_MAXMULTI];
+    struct pathmulti pmulti;
+    int i, nmatched;
+
+    if (!cpaths || !nodeptr || npaths <= 0 || !is_closed_tree(tree))
+    {
+        errno = EINVAL;
         return 0;
     }
 
-    ret = path_finditem(tree, refpaths, &nodeptr, &nnodes);
-    if (!ret)
+    if (npaths > LTJSON_PATH_MAXMULTI)
+    {
+        errno = ERANGE;
+        return 0;
+    }
+
+    pmulti.nodeptr = nodeptr;
+    pmulti.nfound = nfound ? nfound : counts;
+
+    for (i = 0; i < npaths; i++)
+    {
+        if (!cpaths[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
+
+        pmulti.rpaths[i] = path_rpaths((ltjson_info_t *)tree, cpaths[i]);
+        pmulti.nfound[i] = 0;
+        nodeptr[i] = NULL;
+        state[i] = 0;
+    }
+
+    path_findmulti(tree, &pmulti,
+                   (npaths == 64) ? ~0ULL : (1ULL << npaths) - 1, state);
+
+    for (i = 0, nmatched = 0; i < npaths; i++)
+    {
+        if (pmulti.nfound[i])
+            nmatched++;
+    }
+
+    if (!nmatched)
         errno = 0;
 
-    return ret;
+    return nmatched;
 }
 
 
@@ -0,0 +1,563 @@
+/*
+ *  ltpool.c (as include): Pools of trees for reuse
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A pool holds trees that are not in use in an array of slots, each
+    NULL or an idle tree. Acquiring a tree takes one out of a slot and
+    releasing it puts it into an empty one, so a tree is only ever in
+    one place and recycling keeps working as it does for one caller.
+
+    Each slot is changed by a single atomic exchange or compare and
+    swap, so any number of threads can acquire and release at once
+    without a lock (and with no ABA problem, as nothing is linked).
+    That needs GCC style __atomic builtins or Windows Interlocked
+    calls. Otherwise, or with LTJSON_POOL_LOCKED defined, a mutex is
+    taken instead. With LTJSON_NO_THREADS it's neither.
+
+    A released tree is recycled and then trimmed: while what it keeps
+    comes to more than the pool's limit, the biggest of its node sets,
+    string store, working store, hash, member index and parallel parts
+    is freed. The tree gets more as it needs it, as a new tree would.
+*/
+
+#if defined(LTJSON_NO_THREADS)
+  #define POOL_PLAIN
+#elif !defined(LTJSON_POOL_LOCKED) && defined(_WIN32)
+  #define POOL_LOCKFREE
+  #define pool_take(p)      InterlockedExchangePointer((PVOID volatile *)(p), \
+                                                       NULL)
+  #define pool_put(p, t)    (InterlockedCompareExchangePointer( \
+                                (PVOID volatile *)(p), (t), NULL) == NULL)
+  #define pool_peek(p)      (*(ltjson_node_t * volatile *)(p))
+  #define pool_count(c)     InterlockedIncrement((LONG volatile *)(c))
+#elif !defined(LTJSON_POOL_LOCKED) && defined(__GNUC__)
+  #define POOL_LOCKFREE
+  #define pool_take(p)      __atomic_exchange_n((p), NULL, __ATOMIC_ACQ_REL)
+  #define pool_put(p, t)    pool_cas((p), (t))
+  #define pool_peek(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+  #define pool_count(c)     __atomic_fetch_add((c), 1, __ATOMIC_RELAXED)
+#elif defined(_WIN32)
+  #define POOL_WIN32
+#else
+  #define POOL_PTHREADS
+#endif
+
+#define POOL_REUSED     0       /* Counts, as from MSTAT_POOL_REUSED */
+#define POOL_MADE       1
+#define POOL_TRIMMED    2
+#define POOL_FREED      3
+#define POOL_NCOUNTS    4
+
+struct ltjson_pool {
+    ltjson_node_t **slots;      /* Idle trees, NULL for an empty slot */
+    int nslots;
+    size_t maxmem;              /* Most a tree keeps, 0 for no limit  */
+#if defined(POOL_LOCKFREE) && defined(_WIN32)
+    LONG counts[POOL_NCOUNTS];
+#else
+    int counts[POOL_NCOUNTS];
+#endif
+#if defined(POOL_WIN32)
+    CRITICAL_SECTION lock;
+#elif defined(POOL_PTHREADS)
+    pthread_mutex_t lock;
+#endif
+};
+
+
+#if defined(POOL_LOCKFREE) && !defined(_WIN32)
+
+/*
+ *  pool_cas(slot, tree) - Put tree in slot if the slot is empty
+ *
+ *  Returns 1 if it was put there, 0 if the slot is in use
+ */
+
+static int pool_cas(ltjson_node_t **slot, ltjson_node_t *tree)
+{
+    ltjson_node_t *expect = NULL;
+
+    return __atomic_compare_exchange_n(slot, &expect, tree, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+#elif !defined(POOL_LOCKFREE)
+
+/* Under a lock (or in one thread) the slots are used as they are */
+
+  #define pool_take(p)      pool_swap((p), NULL)
+  #define pool_put(p, t)    (*(p) ? 0 : (*(p) = (t), 1))
+  #define pool_peek(p)      (*(p))
+  #define pool_count(c)     ((*(c))++)
+
+static ltjson_node_t *pool_swap(ltjson_node_t **slot, ltjson_node_t *tree)
+{
+    ltjson_node_t *old = *slot;
+
+    *slot = tree;
+    return old;
+}
+
+#endif
+
+
+
+
+/*
+ *  pool_lock(pool), pool_unlock(pool) - Take and give back a pool lock
+ *
+ *  Only a locked pool has a lock, the others need none
+ */
+
+static void pool_lock(ltjson_pool_t *pool)
+{
+#if defined(POOL_WIN32)
+    EnterCriticalSection(&pool->lock);
+#elif defined(POOL_PTHREADS)
+    pthread_mutex_lock(&pool->lock);
+#else
+    (void)pool;
+#endif
+}
+
+
+static void pool_unlock(ltjson_pool_t *pool)
+{
+#if defined(POOL_WIN32)
+    LeaveCriticalSection(&pool->lock);
+#elif defined(POOL_PTHREADS)
+    pthread_mutex_unlock(&pool->lock);
+#else
+    (void)pool;
+#endif
+}
+
+
+
+
+/*
+ *  pool_nodemem(jsoninfo) - Bytes in the node sets of a tree
+ */
+
+static size_t pool_nodemem(ltjson_info_t *jsoninfo)
+{
+    ltjson_node_t *basenode;
+    size_t total = 0;
+
+    if (!jsoninfo->cbasenode)
+        return 0;
+
+    basenode = jsoninfo->cbasenode->ancnode;    /* First basenode */
+
+    do {
+        total += basenode->namehash * sizeof(ltjson_node_t);
+        basenode = basenode->next;
+    } while (basenode != basenode->ancnode);
+
+    return total;
+}
+
+
+
+
+/*
+ *  pool_trim(jsoninfo, maxmem) - Free what a recycled tree has over maxmem
+ *
+ *  Returns the number of things freed (node sets, string store, ...)
+ */
+
+#define TRIM_NODES      0
+#define TRIM_SSTORE     1
+#define TRIM_WORKSTR    2
+#define TRIM_HASH       3
+#define TRIM_MINDEX     4
+#define TRIM_PARTS      5
+#define TRIM_NKINDS     6
+
+static int pool_trim(ltjson_info_t *jsoninfo, size_t maxmem)
+{
+    size_t mem[TRIM_NKINDS], total;
+    int i, big, ntrimmed = 0;
+
+    mem[TRIM_NODES] = pool_nodemem(jsoninfo);
+    mem[TRIM_SSTORE] = sstore_stats(&jsoninfo->sstore, NULL, NULL, NULL);
+    mem[TRIM_WORKSTR] = jsoninfo->workalloc;
+    mem[TRIM_HASH] = nhash_stats(jsoninfo, NULL, NULL, NULL);
+    mem[TRIM_MINDEX] = jsoninfo->mi_nslots * sizeof(struct mindexcell);
+    mem[TRIM_PARTS] = 0;
+
+    if (jsoninfo->parts)
+    {
+        int stat;
+
+        for (i = 0; i < LTJSON_BATCH_MAXTHREADS; i++)
+        {
+            if (jsoninfo->parts[i] &&
+                ltjson_memstat(jsoninfo->parts[i], &stat, 1))
+                mem[TRIM_PARTS] += stat;
+        }
+    }
+
+    total = sizeof(ltjson_info_t);
+    for (i = 0; i < TRIM_NKINDS; i++)
+        total += mem[i];
+
+    while (total > maxmem)
+    {
+        for (big = 0, i = 1; i < TRIM_NKINDS; i++)
+        {
+            if (mem[i] > mem[big])
+                big = i;
+        }
+
+        if (!mem[big])
+            break;              /* Down to the info structure */
+
+        switch (big)
+        {
+            case TRIM_NODES:
+                free_nodes(jsoninfo->alloc, jsoninfo->cbasenode);
+                jsoninfo->cbasenode = 0;
+                if (!ltjson_allocsize_nodes)
+                    jsoninfo->nodeasize = JSONNODE_DEF_ALLOC + 1;
+                break;
+
+            case TRIM_SSTORE:
+                sstore_free(jsoninfo->alloc, &jsoninfo->sstore);
+                break;
+
+            case TRIM_WORKSTR:
+                mem_free(jsoninfo->alloc, jsoninfo->workstr);
+                jsoninfo->workstr = NULL;
+                jsoninfo->workalloc = 0;
+                break;
+
+            case TRIM_HASH:
+                nhash_free(jsoninfo);
+                break;
+
+            case TRIM_MINDEX:
+                mindex_free(jsoninfo);
+                break;
+
+            default:
+                for (i = 0; i < LTJSON_BATCH_MAXTHREADS; i++)
+                    destroy_tree((ltjson_info_t *)jsoninfo->parts[i]);
+
+                mem_free(jsoninfo->alloc, jsoninfo->parts);
+                jsoninfo->parts = 0;
+                break;
+        }
+
+        total -= mem[big];
+        mem[big] = 0;
+        ntrimmed++;
+    }
+
+    return ntrimmed;
+}
+
+
+
+
+/**
+ *  ltjson_pool_new(ntrees, maxmem) - Create a pool of trees
+ *      @ntrees:    Most idle trees the pool holds
+ *      @maxmem:    Most memory (bytes) an idle tree keeps, 0 for no limit
+ *
+ *  Returns: Pointer to the pool on success
+ *           NULL on failure with errno set to:
+ *              EINVAL if ntrees is less than 1
+ *              ENOMEM if out of memory
+ */
+
+ltjson_pool_t *ltjson_pool_new(int ntrees, size_t maxmem)
+{
+    ltjson_pool_t *pool;
+    int i;
+
+    if (ntrees < 1)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pool = malloc(sizeof(ltjson_pool_t));
+    if (!pool)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pool->slots = calloc(ntrees, sizeof(ltjson_node_t *));
+    if (!pool->slots)
+    {
+        free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+#if defined(POOL_WIN32)
+    InitializeCriticalSection(&pool->lock);
+#elif defined(POOL_PTHREADS)
+    if (pthread_mutex_init(&pool->lock, NULL) != 0)
+    {
+        free(pool->slots);
+        free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+#endif
+
+    pool->nslots = ntrees;
+    pool->maxmem = maxmem;
+
+    for (i = 0; i < POOL_NCOUNTS; i++)
+        pool->counts[i] = 0;
+
+    return pool;
+}
+
+
+
+
+/**
+ *  ltjson_pool_free(poolp) - Free a pool and the trees it holds
+ *      @poolp:     Pointer to valid pool
+ *
+ *  Trees acquired from the pool are not affected and must still be
+ *  released or freed. Nothing else may use the pool at the time.
+ *
+ *  Returns: 1 on success, writing NULL to *poolp
+ *           0 and errno set to EINVAL if pool is not valid
+ */
+
+int ltjson_pool_free(ltjson_pool_t **poolp)
+{
+    ltjson_pool_t *pool;
+    int i;
+
+    if (!poolp || !*poolp)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    pool = *poolp;
+
+    for (i = 0; i < pool->nslots; i++)
+        destroy_tree((ltjson_info_t *)pool->slots[i]);
+
+#if defined(POOL_WIN32)
+    DeleteCriticalSection(&pool->lock);
+#elif defined(POOL_PTHREADS)
+    pthread_mutex_destroy(&pool->lock);
+#endif
+
+    free(pool->slots);
+    free(pool);
+
+    *poolp = NULL;
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_pool_acquire(pool) - Get a tree from a pool
+ *      @pool:      Valid pool
+ *
+ *  The tree is an idle one from the pool if there is one, otherwise a
+ *  new one. Either way it's empty and closed, ready for ltjson_parse.
+ *
+ *  Returns: Pointer to the tree on success
+ *           NULL on failure with errno set to:
+ *              EINVAL if pool is not valid
+ *              ENOMEM if out of memory
+ */
+
+ltjson_node_t *ltjson_pool_acquire(ltjson_pool_t *pool)
+{
+    ltjson_node_t *tree = NULL;
+    ltjson_info_t *jsoninfo;
+    int i;
+
+    if (!pool)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pool_lock(pool);
+
+    for (i = 0; i < pool->nslots && !tree; i++)
+    {
+        if (pool_peek(&pool->slots[i]))
+            tree = pool_take(&pool->slots[i]);
+    }
+
+    pool_count(&pool->counts[tree ? POOL_REUSED : POOL_MADE]);
+    pool_unlock(pool);
+
+    if (tree)
+        return tree;
+
+    if ((jsoninfo = create_tree(NULL, NULL)) == NULL)
+        return NULL;
+
+    return (ltjson_node_t *)jsoninfo;
+}
+
+
+
+
+/**
+ *  ltjson_pool_release(pool, treeptr) - Give a tree back to a pool
+ *      @pool:      Valid pool
+ *      @treeptr:   Pointer to a valid tree (from the pool or not)
+ *
+ *  The tree is emptied (and closed if open), loses any events, filter,
+ *  tape or dictionary, is trimmed to the pool's limit and is kept for
+ *  the next ltjson_pool_acquire. It is freed instead if the pool is
+ *  full or the tree has its own allocator.
+ *
+ *  Returns: 1 on success, writing NULL to *treeptr
+ *           0 and errno set to EINVAL if pool or tree is not valid
+ */
+
+int ltjson_pool_release(ltjson_pool_t *pool, ltjson_node_t **treeptr)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *tree;
+    int i, trimmed = 0, kept = 0;
+
+    if (!pool || !treeptr || !is_valid_tree(*treeptr))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    tree = *treeptr;
+    jsoninfo = (ltjson_info_t *)tree;
+    *treeptr = NULL;
+
+    if (jsoninfo->alloc)
+    {
+        pool_lock(pool);
+        pool_count(&pool->counts[POOL_FREED]);
+        pool_unlock(pool);
+
+        destroy_tree(jsoninfo);
+        return 1;
+    }
+
+    create_tree(jsoninfo, NULL);        /* Recycles, can't fail */
+
+    jsoninfo->sax = 0;
+    jsoninfo->saxctx = 0;
+    filter_free(jsoninfo);
+    tape_free(jsoninfo);
+
+    if (jsoninfo->dict)
+    {
+        jsoninfo->dict = 0;
+        nhash_reset(jsoninfo);
+    }
+
+    if (pool->maxmem)
+        trimmed = pool_trim(jsoninfo, pool->maxmem);
+
+    pool_lock(pool);
+
+    if (trimmed)
+        pool_count(&pool->counts[POOL_TRIMMED]);
+
+    for (i = 0; i < pool->nslots && !kept; i++)
+    {
+        if (!pool_peek(&pool->slots[i]))
+            kept = pool_put(&pool->slots[i], tree);
+    }
+
+    if (!kept)
+        pool_count(&pool->counts[POOL_FREED]);
+
+    pool_unlock(pool);
+
+    if (!kept)
+        destroy_tree(jsoninfo);
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_pool_memstat(pool, stats, nents) - get pool statistics
+ *      @pool:  Valid pool
+ *      @stats: Pointer to an array of ints which is filled
+ *      @nents: Number of entries in stats (up to LTJSON_POOLSTATS)
+ *
+ *  The first LTJSON_MEMSTATS entries are those of ltjson_memstat added
+ *  up over the idle trees in the pool. The rest count the idle trees,
+ *  the trees acquired from and not from the pool and the trees trimmed
+ *  and freed on release. See ltjson_statstring. Trees must not be
+ *  acquired or released at the same time.
+ *
+ *  Returns: the number of stats placed in stats array
+ *           0 if pool/stats/nents not valid and sets errno (EINVAL)
+ */
+
+int ltjson_pool_memstat(ltjson_pool_t *pool, int *stats, int nents)
+{
+    int pstats[MSTAT_POOL_NENTS] = {0};
+    int tstats[MSTAT_NENTS];
+    int i, j, n;
+
+    if (!pool || !stats || nents <= 0)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if (nents > MSTAT_POOL_NENTS)
+        nents = MSTAT_POOL_NENTS;
+
+    for (i = 0; i < pool->nslots; i++)
+    {
+        if (!pool->slots[i])
+            continue;
+
+        pstats[MSTAT_POOL_IDLE]++;
+
+        n = ltjson_memstat(pool->slots[i], tstats, MSTAT_NENTS);
+        for (j = 0; j < n; j++)
+            pstats[j] += tstats[j];
+    }
+
+    for (i = 0; i < POOL_NCOUNTS; i++)
+        pstats[MSTAT_POOL_REUSED + i] = (int)pool->counts[i];
+
+    for (i = 0; i < nents; i++)
+        stats[i] = pstats[i];
+
+    return nents;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -0,0 +1,382 @@
+/*
+ *  ltscan.c (as include): Block scanning of input text
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  Most of the parse time is spent looking for the next interesting
+    character: the end of a run of whitespace or the next quote or
+    backslash inside a string. Where the compiler targets a vector unit
+    the text is classified a block at a time (32 bytes for AVX2 and 16
+    for SSE2 or NEON), giving a bitmask with bit n set if the nth
+    character of the block is in the class being looked for.
+
+    The scalar lookup table is the fallback. It is also used for the
+    tail of the text where there isn't a full block left to load, so
+    the scanners never read at or beyond the end pointer.
+
+    Define LTJSON_NO_SIMD to force the scalar path.
+*/
+
+#if !defined(LTJSON_NO_SIMD) && defined(__AVX2__)
+  #include <immintrin.h>
+  #define SCAN_SIMD_AVX2
+#elif !defined(LTJSON_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+  #include <emmintrin.h>
+  #define SCAN_SIMD_SSE2
+#elif !defined(LTJSON_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define SCAN_SIMD_NEON
+#endif
+
+
+#define SCAN_SPACE      0x01        /* JSON (and isspace) whitespace */
+#define SCAN_STRUCT     0x02        /* One of { } [ ] , :            */
+#define SCAN_QUOTE      0x04        /* Double quote                  */
+#define SCAN_BSLASH     0x08        /* Backslash                     */
+#define SCAN_NEST       0x10        /* One of { } [ ]                */
+
+
+static const unsigned char scan_ctab[256] =
+{
+    ['\t'] = SCAN_SPACE,  ['\n'] = SCAN_SPACE,  ['\v'] = SCAN_SPACE,
+    ['\f'] = SCAN_SPACE,  ['\r'] = SCAN_SPACE,  [' ']  = SCAN_SPACE,
+
+    ['{']  = SCAN_STRUCT | SCAN_NEST, ['}'] = SCAN_STRUCT | SCAN_NEST,
+    ['[']  = SCAN_STRUCT | SCAN_NEST, [']'] = SCAN_STRUCT | SCAN_NEST,
+    [',']  = SCAN_STRUCT, [':']  = SCAN_STRUCT,
+
+    ['"']  = SCAN_QUOTE,  ['\\'] = SCAN_BSLASH
+};
+
+#define scan_class(x)   scan_ctab[(unsigned char)(x)]
+
+
+/* Per architecture vector primitives. Only the handful of operations
+   needed to build the class masks are defined. */
+
+#if defined(SCAN_SIMD_AVX2)
+
+  #define SCAN_BLOCKSIZE    32
+  #define SCAN_ALLBITS      0xFFFFFFFFUL
+
+  typedef __m256i scanvec_t;
+
+  #define scanv_load(p)     _mm256_loadu_si256((const __m256i *)(p))
+  #define scanv_eq(v, c)    _mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))
+  #define scanv_or(a, b)    _mm256_or_si256((a), (b))
+  #define scanv_orc(v, c)   _mm256_or_si256((v), _mm256_set1_epi8(c))
+  #define scanv_ctrl(v)     _mm256_cmpeq_epi8((v), _mm256_min_epu8((v), \
+                                _mm256_set1_epi8(0x1F)))
+  #define scanv_mask(v)     ((unsigned long)(unsigned int) \
+                                    _mm256_movemask_epi8(v))
+
+  /* (v + 0x77) < 0x85 signed is true only for v in 0x09 - 0x0D.
+     For scanv_ctrl, min(v, 0x1F) == v (unsigned) only for v < 0x20 */
+  #define scanv_ctrlsp(v)   _mm256_cmpgt_epi8(_mm256_set1_epi8(-123), \
+                                _mm256_add_epi8((v), _mm256_set1_epi8(0x77)))
+
+#elif defined(SCAN_SIMD_SSE2)
+
+  #define SCAN_BLOCKSIZE    16
+  #define SCAN_ALLBITS      0xFFFFUL
+
+  typedef __m128i scanvec_t;
+
+  #define scanv_load(p)     _mm_loadu_si128((const __m128i *)(p))
+  #define scanv_eq(v, c)    _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+  #define scanv_or(a, b)    _mm_or_si128((a), (b))
+  #define scanv_orc(v, c)   _mm_or_si128((v), _mm_set1_epi8(c))
+  #define scanv_ctrl(v)     _mm_cmpeq_epi8((v), _mm_min_epu8((v), \
+                                _mm_set1_epi8(0x1F)))
+  #define scanv_mask(v)     ((unsigned long)(unsigned int) \
+                                    _mm_movemask_epi8(v))
+  #define scanv_ctrlsp(v)   _mm_cmplt_epi8( \
+                                _mm_add_epi8((v), _mm_set1_epi8(0x77)), \
+                                _mm_set1_epi8(-123))
+
+#elif defined(SCAN_SIMD_NEON)
+
+  #define SCAN_BLOCKSIZE    16
+  #define SCAN_ALLBITS      0xFFFFUL
+
+  typedef uint8x16_t scanvec_t;
+
+  #define scanv_load(p)     vld1q_u8((const uint8_t *)(p))
+  #define scanv_eq(v, c)    vceqq_u8((v), vdupq_n_u8(c))
+  #define scanv_or(a, b)    vorrq_u8((a), (b))
+  #define scanv_orc(v, c)   vorrq_u8((v), vdupq_n_u8(c))
+  #define scanv_ctrl(v)     vcltq_u8((v), vdupq_n_u8(0x20))
+  #define scanv_mask(v)     neon_movemask(v)
+  #define scanv_ctrlsp(v)   vcltq_u8(vsubq_u8((v), vdupq_n_u8(0x09)), \
+                                     vdupq_n_u8(5))
+
+/* NEON has no movemask. Weight each lane by its bit position and
+   add across each half of the vector instead. */
+
+static unsigned long neon_movemask(uint8x16_t v)
+{
+    static const uint8_t weights[16] =
+        { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t m;
+
+    m = vandq_u8(v, vld1q_u8(weights));
+
+    return (unsigned long)vaddv_u8(vget_low_u8(m)) |
+           ((unsigned long)vaddv_u8(vget_high_u8(m)) << 8);
+}
+
+#else
+
+  #define SCAN_BLOCKSIZE    16
+  #define SCAN_ALLBITS      0xFFFFUL
+
+#endif
+
+
+#if defined(SCAN_SIMD_AVX2) || defined(SCAN_SIMD_SSE2) || \
+    defined(SCAN_SIMD_NEON)
+  #define SCAN_SIMD
+#endif
+
+
+
+
+#ifdef SCAN_SIMD
+
+/*
+ *  scan_ctz(mask) - Index of the lowest set bit in a non-zero mask
+ */
+
+static int scan_ctz(unsigned long mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzl(mask);
+#else
+    int n = 0;
+
+    assert(mask);
+
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+#endif  /* SCAN_SIMD */
+
+
+
+
+/*
+ *  scan_space(s, end) - Skip a run of whitespace
+ *
+ *  Returns a pointer to the first non-space character in s up to end
+ *  or end itself if the text is all whitespace.
+ */
+
+static const char *scan_space(const char *s, const char *end)
+{
+    /* Short runs (a single space after a colon) are the most
+       common so don't bother with a block unless it looks long */
+
+    if (s < end && !(scan_class(*s) & SCAN_SPACE))
+        return s;
+
+#ifdef SCAN_SIMD
+    while (end - s >= SCAN_BLOCKSIZE)
+    {
+        scanvec_t v;
+        unsigned long mask;
+
+        v = scanv_load(s);
+        mask = ~scanv_mask(scanv_or(scanv_eq(v, ' '), scanv_ctrlsp(v)));
+        mask &= SCAN_ALLBITS;
+
+        if (mask)
+            return s + scan_ctz(mask);
+
+        s += SCAN_BLOCKSIZE;
+    }
+#endif
+
+    while (s < end && (scan_class(*s) & SCAN_SPACE))
+        s++;
+
+    return s;
+}
+
+
+
+
+/*
+ *  scan_strbody(s, end) - Skip over plain string characters
+ *
+ *  Returns a pointer to the first quote or backslash in s up to end
+ *  or end itself if there are none. Everything in between can be
+ *  copied as is.
+ */
+
+static const char *scan_strbody(const char *s, const char *end)
+{
+#ifdef SCAN_SIMD
+    while (end - s >= SCAN_BLOCKSIZE)
+    {
+        scanvec_t v;
+        unsigned long mask;
+
+        v = scanv_load(s);
+        mask = scanv_mask(scanv_or(scanv_eq(v, '"'), scanv_eq(v, '\\')));
+
+        if (mask)
+            return s + scan_ctz(mask);
+
+        s += SCAN_BLOCKSIZE;
+    }
+#endif
+
+    while (s < end && !(scan_class(*s) & (SCAN_QUOTE | SCAN_BSLASH)))
+        s++;
+
+    return s;
+}
+
+
+
+
+
+/*
+ *  scan_nesting(s, end) - Skip over everything but nesting and strings
+ *
+ *  Returns a pointer to the first quote or bracket ({ } [ ]) in s up to
+ *  end or end itself if there are none. Used to skip over values that
+ *  a filter doesn't want (see ltfilter.c).
+ */
+
+static const char *scan_nesting(const char *s, const char *end)
+{
+#ifdef SCAN_SIMD
+    while (end - s >= SCAN_BLOCKSIZE)
+    {
+        scanvec_t v, lc;
+        unsigned long mask;
+
+        /* [ and ] differ from { and } only by the 0x20 bit */
+
+        v = scanv_load(s);
+        lc = scanv_orc(v, 0x20);
+        mask = scanv_mask(scanv_or(scanv_or(scanv_eq(lc, '{'),
+                                            scanv_eq(lc, '}')),
+                                   scanv_eq(v, '"')));
+
+        if (mask)
+            return s + scan_ctz(mask);
+
+        s += SCAN_BLOCKSIZE;
+    }
+#endif
+
+    while (s < end && !(scan_class(*s) & (SCAN_QUOTE | SCAN_NEST)))
+        s++;
+
+    return s;
+}
+
+
+
+
+/*
+ *  scan_structure(s, end) - Skip to the next quote, bracket or comma
+ *
+ *  Returns a pointer to the first quote, bracket ({ } [ ]) or comma in
+ *  s up to end or end itself if there are none. Used to find where the
+ *  elements of a big array start (see ltbatch.c).
+ */
+
+static const char *scan_structure(const char *s, const char *end)
+{
+#ifdef SCAN_SIMD
+    while (end - s >= SCAN_BLOCKSIZE)
+    {
+        scanvec_t v, lc;
+        unsigned long mask;
+
+        v = scanv_load(s);
+        lc = scanv_orc(v, 0x20);
+        mask = scanv_mask(scanv_or(scanv_or(scanv_eq(lc, '{'),
+                                            scanv_eq(lc, '}')),
+                                   scanv_or(scanv_eq(v, '"'),
+                                            scanv_eq(v, ','))));
+
+        if (mask)
+            return s + scan_ctz(mask);
+
+        s += SCAN_BLOCKSIZE;
+    }
+#endif
+
+    while (s < end && !(scan_class(*s) & (SCAN_QUOTE | SCAN_NEST)) &&
+           *s != ',')
+        s++;
+
+    return s;
+}
+
+
+
+
+/*
+ *  scan_plain(s, end) - Skip over characters written without escapes
+ *
+ *  Returns a pointer to the first quote, backslash, control character
+ *  or 0xC0 (a Modified UTF-8 \u0000) in s up to end or end itself if
+ *  there are none. Used when writing strings out (see ltwrite.c).
+ */
+
+static const char *scan_plain(const char *s, const char *end)
+{
+#ifdef SCAN_SIMD
+    while (end - s >= SCAN_BLOCKSIZE)
+    {
+        scanvec_t v;
+        unsigned long mask;
+
+        v = scanv_load(s);
+        mask = scanv_mask(scanv_or(scanv_or(scanv_eq(v, '"'),
+                                            scanv_eq(v, '\\')),
+                                   scanv_or(scanv_eq(v, (char)0xC0),
+                                            scanv_ctrl(v))));
+
+        if (mask)
+            return s + scan_ctz(mask);
+
+        s += SCAN_BLOCKSIZE;
+    }
+#endif
+
+    while (s < end && !(scan_class(*s) & (SCAN_QUOTE | SCAN_BSLASH)) &&
+           (unsigned char)*s >= 0x20 && (unsigned char)*s != 0xC0)
+        s++;
+
+    return s;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
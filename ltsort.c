@@ -71,6 +71,11 @@ int ltjson_sort(ltjson_node_t *snode,
         return 1;
     }
 
+    /* The first member with a name may change. Drop any index */
+
+    mindex_drop((ltjson_info_t *)tree, snode);
+    nindex_free((ltjson_info_t *)tree);
+
     listhead = snode->val.subnode;
 
 
@@ -195,6 +200,481 @@ int ltjson_sort(ltjson_node_t *snode,
 
 
 
+/* ltjson_sortby gets each element's key once into an array of these,
+   sorts the array and then relinks the elements in its order. Numbers
+   and strings have a key that sorts as an unsigned integer (a string's
+   is its first 8 bytes) so both are radix sorted, strings that tie on
+   those 8 bytes being merge sorted on the rest. */
+
+struct sortkey {
+    unsigned long long key;     /* Key, ordered as unsigned */
+    ltjson_node_t *node;        /* Element being sorted */
+    ltjson_node_t *knode;       /* Node of its key or NULL */
+};
+
+#define SORT_SIGNBIT    0x8000000000000000ULL
+
+enum { SORT_NUMBER, SORT_STRING, SORT_OTHER };
+
+
+
+
+/*
+ *  sort_group(knode) - Which group a key sorts in
+ *
+ *  A raw number too big for a double goes with the other keys.
+ */
+
+static int sort_group(ltjson_node_t *knode)
+{
+    if (!knode)
+        return SORT_OTHER;
+
+    switch (knode->ntype)
+    {
+        case LTJSON_NTYPE_INTEGER:
+        case LTJSON_NTYPE_FLOAT:
+            return SORT_NUMBER;
+
+        case LTJSON_NTYPE_NUMRAW:
+            return raw_convert(knode) ? SORT_NUMBER : SORT_OTHER;
+
+        case LTJSON_NTYPE_STRING:
+            return SORT_STRING;
+    }
+
+    return SORT_OTHER;
+}
+
+
+
+
+/*
+ *  sort_isint(knode) - If a number key is an integer
+ */
+
+static int sort_isint(const ltjson_node_t *knode)
+{
+    return knode->ntype == LTJSON_NTYPE_INTEGER ||
+           (knode->ntype == LTJSON_NTYPE_NUMRAW &&
+            (knode->nflags & JSONNODE_NFLAGS_RAWLL));
+}
+
+
+
+
+/*
+ *  sort_numkey(knode, allint) - Key of a number
+ *
+ *  If allint, every key is an integer and is ordered as one. Otherwise
+ *  they are all ordered as doubles, whose bits order as unsigned once
+ *  the sign bit is flipped for positives and all bits for negatives.
+ *  -0.0 is taken as 0.0 first, as the two are equal.
+ */
+
+static unsigned long long sort_numkey(ltjson_node_t *knode, int allint)
+{
+    unsigned long long u;
+    double d;
+
+    if (allint)
+        return (unsigned long long)ltjson_get_ll(knode) ^ SORT_SIGNBIT;
+
+    d = ltjson_get_double(knode);
+    if (d == 0)
+        d = 0;
+
+    memcpy(&u, &d, sizeof(u));
+
+    return (u & SORT_SIGNBIT) ? ~u : u | SORT_SIGNBIT;
+}
+
+
+
+
+/*
+ *  sort_strkey(s) - Key of a string: its first 8 bytes, big endian
+ */
+
+static unsigned long long sort_strkey(const char *s)
+{
+    unsigned long long key = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        key <<= 8;
+        if (*s)
+            key |= (unsigned char)*s++;
+    }
+
+    return key;
+}
+
+
+
+
+/*
+ *  sort_radix(a, tmp, n) - Stable sort of a by key, tmp as big as a
+ *
+ *  One pass for the counts of all 8 bytes, then one for each byte that
+ *  isn't the same in every key.
+ */
+
+static void sort_radix(struct sortkey *a, struct sortkey *tmp, size_t n)
+{
+    size_t counts[8][256], *count, i, sum, c;
+    struct sortkey *from = a, *to = tmp, *swap;
+    int byte, shift;
+
+    memset(counts, 0, sizeof(counts));
+
+    for (i = 0; i < n; i++)
+    {
+        for (byte = 0; byte < 8; byte++)
+            counts[byte][(a[i].key >> (byte * 8)) & 0xFF]++;
+    }
+
+    for (byte = 0; byte < 8; byte++)
+    {
+        count = counts[byte];
+        shift = byte * 8;
+
+        if (count[(a[0].key >> shift) & 0xFF] == n)
+            continue;
+
+        for (sum = 0, i = 0; i < 256; i++)
+        {
+            c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+
+        for (i = 0; i < n; i++)
+            to[count[(from[i].key >> shift) & 0xFF]++] = from[i];
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != a)
+        memcpy(a, from, n * sizeof(struct sortkey));
+}
+
+
+
+
+/*
+ *  sort_strcmp(x, y, desc) - Order strings that tie on their first 8
+ */
+
+static int sort_strcmp(const struct sortkey *x, const struct sortkey *y,
+                       int desc)
+{
+    int cmp = strcmp(x->knode->val.s + 8, y->knode->val.s + 8);
+
+    return desc ? -cmp : cmp;
+}
+
+
+
+
+/*
+ *  sort_merge(a, tmp, n, desc) - Stable merge sort of tied strings
+ */
+
+static void sort_merge(struct sortkey *a, struct sortkey *tmp, size_t n,
+                       int desc)
+{
+    struct sortkey *p, *q, *pend, *qend, *out, kv;
+    size_t half, i, j;
+
+    if (n <= 8)
+    {
+        for (i = 1; i < n; i++)
+        {
+            kv = a[i];
+            for (j = i; j > 0 && sort_strcmp(&a[j - 1], &kv, desc) > 0; j--)
+                a[j] = a[j - 1];
+            a[j] = kv;
+        }
+        return;
+    }
+
+    half = n / 2;
+    sort_merge(a, tmp, half, desc);
+    sort_merge(a + half, tmp, n - half, desc);
+
+    if (sort_strcmp(&a[half - 1], &a[half], desc) <= 0)
+        return;
+
+    memcpy(tmp, a, half * sizeof(struct sortkey));
+
+    p = tmp, pend = tmp + half;
+    q = a + half, qend = a + n;
+    out = a;
+
+    while (p < pend && q < qend)
+        *out++ = (sort_strcmp(q, p, desc) < 0) ? *q++ : *p++;
+
+    while (p < pend)
+        *out++ = *p++;
+}
+
+
+
+
+/*
+ *  sort_strings(a, tmp, n, desc) - Sort string keys in a
+ */
+
+static void sort_strings(struct sortkey *a, struct sortkey *tmp, size_t n,
+                         int desc)
+{
+    size_t i, j;
+    int len;
+
+    sort_radix(a, tmp, n);
+
+    /* Runs of the same key are the same string, unless it's 8 bytes
+       or more when the rest of it has to be compared */
+
+    for (i = 0; i < n; i = j)
+    {
+        for (j = i + 1; j < n && a[j].key == a[i].key; j++)
+            ;
+
+        if (j - i < 2)
+            continue;
+
+        for (len = 0; len < 8 && a[i].knode->val.s[len]; len++)
+            ;
+
+        if (len == 8)
+            sort_merge(a + i, tmp, j - i, desc);
+    }
+}
+
+
+
+
+/**
+ *  ltjson_sortby(snode, cpath, name, flags) - Sort by a key of each entry
+ *      @snode:  Node whose contents to sort
+ *      @cpath:  Optional compiled path to the key, from each entry
+ *      @name:   Optional member name of the key, if no @cpath
+ *      @flags:  Optional sort flags
+ *
+ *  Sort the entries of @snode by a key found once for each. The key is
+ *  the first match of @cpath from the entry (as ltjson_pathexec on a
+ *  tree that is the entry) or, without @cpath, the entry's member
+ *  @name or, without either, the entry itself.
+ *
+ *  Numbers sort by value, before strings which sort by byte. For UTF-8
+ *  that's by code point, except that U+0000 (kept as 0xC0 0x80) comes
+ *  between U+007F and U+0080. Entries whose key is anything else or is
+ *  missing go last, as they were. The sort is stable.
+ *
+ *  Flags supported are: LTJSON_SORT_DESCENDING to sort numbers and
+ *  strings largest first (numbers still before strings).
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno (EINVAL or ENOMEM)
+ */
+
+int ltjson_sortby(ltjson_node_t *snode, const ltjson_cpath_t *cpath,
+                  const char *name, int flags)
+{
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *tree, *node, **store;
+    ltjson_rpath_t mpath[2];
+    const ltjson_rpath_t *rpaths;
+    struct sortkey *keys, *tmp;
+    size_t n, i, ngroup[3], at[3];
+    int avail, allint, desc;
+
+    if (!snode || (snode->ntype != LTJSON_NTYPE_ARRAY &&
+                   snode->ntype != LTJSON_NTYPE_OBJECT))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (tree = snode; tree->ancnode != NULL; tree = tree->ancnode)
+        ;
+
+    if (!is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jsoninfo = (ltjson_info_t *)tree;
+
+    for (n = 0, node = snode->val.subnode; node; node = node->next)
+        n++;
+
+    if (n < 2)
+        return 1;
+
+    rpaths = NULL;
+
+    if (cpath)
+    {
+        if (cpath->nsects)
+            rpaths = path_rpaths(jsoninfo, cpath);
+    }
+    else if (name)
+    {
+        /* A path of the one member, "" as path_tokenise has it */
+
+        mpath[0].name = *name ? name : "\xFF";
+        mpath[0].namelen = *name ? (int)strlen(name) : 1;
+        mpath[0].hash = name_hash(mpath[0].name, mpath[0].namelen);
+        mpath[0].hasindex = 0;
+        mpath[0].aindex = -1;
+        mpath[1].name = NULL;
+        rpaths = mpath;
+    }
+
+    if ((keys = mem_alloc(jsoninfo->alloc,
+                          2 * n * sizeof(struct sortkey))) == NULL)
+        return 0;
+
+    tmp = keys + n;
+
+    /* Get the keys into tmp, in order, then put them into keys a group
+       at a time (numbers, strings, the rest) keeping them in order */
+
+    ngroup[SORT_NUMBER] = ngroup[SORT_STRING] = ngroup[SORT_OTHER] = 0;
+    allint = 1;
+
+    for (i = 0, node = snode->val.subnode; node; node = node->next, i++)
+    {
+        tmp[i].node = node;
+        tmp[i].knode = node;
+
+        if (rpaths)
+        {
+            store = &tmp[i].knode;
+            avail = 1;
+
+            if (!path_finditem(node, rpaths, &store, &avail))
+                tmp[i].knode = NULL;
+        }
+
+        tmp[i].key = sort_group(tmp[i].knode);
+        ngroup[tmp[i].key]++;
+
+        if (tmp[i].key == SORT_NUMBER && !sort_isint(tmp[i].knode))
+            allint = 0;
+    }
+
+    at[SORT_NUMBER] = 0;
+    at[SORT_STRING] = ngroup[SORT_NUMBER];
+    at[SORT_OTHER] = at[SORT_STRING] + ngroup[SORT_STRING];
+
+    desc = (flags & LTJSON_SORT_DESCENDING) != 0;
+
+    for (i = 0; i < n; i++)
+    {
+        struct sortkey *kp = &keys[at[tmp[i].key]++];
+
+        *kp = tmp[i];
+
+        if (kp->key == SORT_NUMBER)
+            kp->key = sort_numkey(kp->knode, allint);
+        else if (kp->key == SORT_STRING)
+            kp->key = sort_strkey(kp->knode->val.s);
+
+        if (desc)
+            kp->key = ~kp->key;
+    }
+
+    if (ngroup[SORT_NUMBER] > 1)
+        sort_radix(keys, tmp, ngroup[SORT_NUMBER]);
+
+    if (ngroup[SORT_STRING] > 1)
+        sort_strings(keys + ngroup[SORT_NUMBER], tmp,
+                     ngroup[SORT_STRING], desc);
+
+    /* The first member with a name may change. Drop any index */
+
+    mindex_drop(jsoninfo, snode);
+    nindex_free(jsoninfo);
+
+    snode->val.subnode = keys[0].node;
+
+    for (i = 1; i < n; i++)
+        keys[i - 1].node->next = keys[i].node;
+
+    keys[n - 1].node->next = NULL;
+
+    mem_free(jsoninfo->alloc, keys);
+    return 1;
+}
+
+
+
+
+/*
+ *  search_tree(rnode, name, fromnode, flags) - ltjson_search, uncounted
+ */
+
+static ltjson_node_t *search_tree(ltjson_node_t *rnode, const char *name,
+                                  ltjson_node_t *fromnode, int flags)
+{
+    ltjson_node_t *curnode;
+    unsigned int hashval;
+
+    if (!rnode || !name)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (rnode->ntype != LTJSON_NTYPE_OBJECT &&
+        rnode->ntype != LTJSON_NTYPE_ARRAY)
+    {
+        errno = EPERM;
+        return NULL;
+    }
+
+    if (!fromnode)
+        fromnode = rnode;
+
+    hashval = name_hash(name, -1);
+
+    curnode = traverse_tree_nodes(fromnode, rnode);
+
+    while (curnode)
+    {
+        if (curnode->name)
+        {
+            if (flags & LTJSON_SEARCH_NAMEISHASH)
+            {
+                if (curnode->name == name)
+                    return curnode;
+            }
+            else
+            {
+                if (curnode->namehash == hashval &&
+                        strcmp(curnode->name, name) == 0)
+                    return curnode;
+            }
+        }
+
+        curnode = traverse_tree_nodes(curnode, rnode);
+    }
+
+    errno = 0;
+    return NULL;
+}
+
+
+
+
 /**
  *  ltjson_search(rnode, name, fromnode, flags) - Search tree for name
  *      @rnode:     Subtree within which to search
@@ -222,48 +702,347 @@ int ltjson_sort(ltjson_node_t *snode,
 ltjson_node_t *ltjson_search(ltjson_node_t *rnode, const char *name,
                              ltjson_node_t *fromnode, int flags)
 {
+#ifdef LTJSON_COUNTERS
+    unsigned long long start = count_now();
+    ltjson_info_t *jsoninfo;
+    ltjson_node_t *node;
+
+    node = search_tree(rnode, name, fromnode, flags);
+
+    if ((jsoninfo = count_tree(rnode)) != NULL)
+        count_call(&jsoninfo->counters.nsearches,
+                   &jsoninfo->counters.search_ns, start);
+
+    return node;
+#else
+    return search_tree(rnode, name, fromnode, flags);
+#endif
+}
+
+
+
+
+/* The names of a ltjson_searchm, with their hashes. A bit is set in
+   the mask for each name's hash (mod 64) so most other names are
+   passed over without comparing any. */
+
+struct searchnames {
+    const char *names[LTJSON_SEARCH_MAXNAMES];
+    unsigned int hashes[LTJSON_SEARCH_MAXNAMES];
+    unsigned long long mask;
+    int nnames;
+    int nameishash;
+};
+
+
+
+
+/*
+ *  search_named(snames, node) - If node has one of the names
+ */
+
+static int search_named(const struct searchnames *snames,
+                        const ltjson_node_t *node)
+{
+    int i;
+
+    if (!node->name || !(snames->mask & (1ULL << (node->namehash & 63))))
+        return 0;
+
+    for (i = 0; i < snames->nnames; i++)
+    {
+        if (snames->nameishash)
+        {
+            if (node->name == snames->names[i])
+                return 1;
+        }
+        else if (node->namehash == snames->hashes[i] &&
+                 strcmp(node->name, snames->names[i]) == 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+/*
+ *  search_past(node, rnode) - The next node in rnode after node's value
+ *
+ *  As traverse_tree_nodes, without going into node.
+ */
+
+static ltjson_node_t *search_past(ltjson_node_t *node, ltjson_node_t *rnode)
+{
+    for (; node != rnode; node = node->ancnode)
+    {
+        if (node->next)
+            return node->next;
+    }
+
+    return NULL;
+}
+
+
+
+
+/*
+ *  search_store(node, nodeptr, nnodes, nfound) - Count a match, store it
+ */
+
+static void search_store(ltjson_node_t *node, ltjson_node_t **nodeptr,
+                         int nnodes, int *nfound)
+{
+    if (*nfound < nnodes)
+        nodeptr[*nfound] = node;
+
+    (*nfound)++;
+}
+
+
+
+
+/*
+ *  search_indexed(jsoninfo, rnode, snames, nodeptr, nnodes, flags)
+ *
+ *  ltjson_searchm with the tree's name index. The runs of the names are
+ *  merged by .seq, keeping to nodes under rnode (and, if skipping, not
+ *  under another match) by a walk up from each.
+ *
+ *  Returns the number of matches found
+ */
+
+static int search_indexed(ltjson_info_t *jsoninfo, ltjson_node_t *rnode,
+                          const struct searchnames *snames,
+                          ltjson_node_t **nodeptr, int nnodes, int flags)
+{
+    const struct nindexnode *runs[LTJSON_SEARCH_MAXNAMES];
+    const struct nindexnode *ends[LTJSON_SEARCH_MAXNAMES];
+    const struct nindexcell *nicp;
+    ltjson_node_t *node, *up;
+    int i, j, nruns, best, nfound;
+
+    for (nruns = 0, i = 0; i < snames->nnames; i++)
+    {
+        nicp = nindex_cell(jsoninfo->nindex, snames->names[i],
+                           snames->hashes[i]);
+        if (!nicp->name || !nicp->count)
+            continue;
+
+        for (j = 0; j < nruns; j++)
+        {
+            if (runs[j] == jsoninfo->nindex->nodes + nicp->first)
+                break;      /* A name given twice */
+        }
+
+        if (j < nruns)
+            continue;
+
+        runs[nruns] = jsoninfo->nindex->nodes + nicp->first;
+        ends[nruns] = runs[nruns] + nicp->count;
+        nruns++;
+    }
+
+    nfound = 0;
+
+    while (nruns)
+    {
+        for (best = 0, i = 1; i < nruns; i++)
+        {
+            if (runs[i]->seq < runs[best]->seq)
+                best = i;
+        }
+
+        node = runs[best]->node;
+
+        if (++runs[best] == ends[best])
+        {
+            nruns--;
+            runs[best] = runs[nruns];
+            ends[best] = ends[nruns];
+        }
+
+        for (up = node->ancnode; up && up != rnode; up = up->ancnode)
+        {
+            if ((flags & LTJSON_SEARCH_SKIPMATCHED) &&
+                search_named(snames, up))
+                break;
+        }
+
+        if (up == rnode)
+            search_store(node, nodeptr, nnodes, &nfound);
+    }
+
+    return nfound;
+}
+
+
+
+
+/*
+ *  search_multi(rnode, names, nnames, nodeptr, nnodes, flags)
+ *
+ *  ltjson_searchm, uncounted
+ */
+
+static int search_multi(ltjson_node_t *rnode, const char **names, int nnames,
+                        ltjson_node_t **nodeptr, int nnodes, int flags)
+{
+    struct searchnames snames;
+    ltjson_info_t *jsoninfo;
     ltjson_node_t *curnode;
+    int i, nfound;
 
-    if (!rnode || !name)
+    if (!rnode || !names || nnames <= 0 || !nodeptr || nnodes < 0)
     {
         errno = EINVAL;
-        return NULL;
+        return 0;
+    }
+
+    if (nnames > LTJSON_SEARCH_MAXNAMES)
+    {
+        errno = ERANGE;
+        return 0;
     }
 
     if (rnode->ntype != LTJSON_NTYPE_OBJECT &&
         rnode->ntype != LTJSON_NTYPE_ARRAY)
     {
         errno = EPERM;
-        return NULL;
+        return 0;
     }
 
-    if (!fromnode)
-        fromnode = rnode;
+    snames.mask = 0;
+    snames.nnames = nnames;
+    snames.nameishash = (flags & LTJSON_SEARCH_NAMEISHASH) != 0;
 
-    curnode = traverse_tree_nodes(fromnode, rnode);
+    for (i = 0; i < nnames; i++)
+    {
+        if (!names[i])
+        {
+            errno = EINVAL;
+            return 0;
+        }
 
-    while (curnode)
+        snames.names[i] = names[i];
+        snames.hashes[i] = name_hash(names[i], -1);
+        snames.mask |= 1ULL << (snames.hashes[i] & 63);
+    }
+
+    jsoninfo = node_jsoninfo(rnode);
+
+    if (jsoninfo->nindex)
+        nfound = search_indexed(jsoninfo, rnode, &snames, nodeptr, nnodes,
+                                flags);
+    else
     {
-        if (curnode->name)
+        nfound = 0;
+        curnode = traverse_tree_nodes(rnode, rnode);
+
+        while (curnode)
         {
-            if (flags & LTJSON_SEARCH_NAMEISHASH)
+            if (!search_named(&snames, curnode))
             {
-                if (curnode->name == name)
-                    return curnode;
+                curnode = traverse_tree_nodes(curnode, rnode);
+                continue;
             }
+
+            search_store(curnode, nodeptr, nnodes, &nfound);
+
+            if (flags & LTJSON_SEARCH_SKIPMATCHED)
+                curnode = search_past(curnode, rnode);
             else
-            {
-                if (*curnode->name == *name &&
-                        strcmp(curnode->name, name) == 0)
-                    return curnode;
-            }
+                curnode = traverse_tree_nodes(curnode, rnode);
         }
+    }
 
-        curnode = traverse_tree_nodes(curnode, rnode);
+    if (!nfound)
+        errno = 0;
+
+    return nfound;
+}
+
+
+
+
+/**
+ *  ltjson_searchm(rnode, names, nnames, nodeptr, nnodes, flags)
+ *      @rnode:     Subtree within which to search
+ *      @names:     Array of object member names
+ *      @nnames:    Number of names (to a max of LTJSON_SEARCH_MAXNAMES)
+ *      @nodeptr:   Pointer to nodestore for the answer
+ *      @nnodes:    Number of available nodes in @nodeptr
+ *      @flags:     Optional search flags
+ *
+ *  Search through the JSON tree rooted at @rnode for members with any
+ *  of the @names, all in one go. Matches are stored in document order
+ *  into the @nodeptr node array up to a max of @nnodes. If the tree
+ *  has a name index (ltjson_nameindex) it's used instead of a walk.
+ *
+ *  Flags supported are: LTJSON_SEARCH_NAMEISHASH to denote that the
+ *  names are ones retrieved using ltjson_get_hashstring, and
+ *  LTJSON_SEARCH_SKIPMATCHED to not search within a match's value.
+ *
+ *  This routine does not check if @rnode is part of a closed tree.
+ *
+ *  Returns: Number of matches found (not stored) on success or
+ *           0 on failure and sets errno to:
+ *              EINVAL if passed null parameters
+ *              ERANGE if there are too many names
+ *              EPERM  if rnode is not an object/array
+ *              0      if no entry found (not really an error)
+ */
+
+int ltjson_searchm(ltjson_node_t *rnode, const char **names, int nnames,
+                   ltjson_node_t **nodeptr, int nnodes, int flags)
+{
+#ifdef LTJSON_COUNTERS
+    unsigned long long start = count_now();
+    ltjson_info_t *jsoninfo;
+    int nfound;
+
+    nfound = search_multi(rnode, names, nnames, nodeptr, nnodes, flags);
+
+    if ((jsoninfo = count_tree(rnode)) != NULL)
+        count_call(&jsoninfo->counters.nsearches,
+                   &jsoninfo->counters.search_ns, start);
+
+    return nfound;
+#else
+    return search_multi(rnode, names, nnames, nodeptr, nnodes, flags);
+#endif
+}
+
+
+
+
+/**
+ *  ltjson_nameindex(tree) - Index a tree by member name
+ *      @tree:   Valid closed tree
+ *
+ *  Build an index of the tree's nodes by name that ltjson_searchm uses
+ *  from then on, for a tree to be searched many times. An index there
+ *  was is rebuilt. Adding nodes, ltjson_sort, ltjson_sortby and
+ *  ltjson_promote drop the index, as does recycling the tree.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno:
+ *              EINVAL if tree is not valid and closed
+ *              ENOMEM if out of memory (the tree has no index)
+ */
+
+int ltjson_nameindex(ltjson_node_t *tree)
+{
+    if (!is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return 0;
     }
 
-    errno = 0;
-    return NULL;
+    return nindex_build((ltjson_info_t *)tree);
 }
 
 
@@ -289,6 +1068,7 @@ int ltjson_promote(ltjson_node_t *rnode, const char *name)
 {
     ltjson_node_t *tree, *curnode;
     const char *hname;
+    unsigned int hashval;
     int matches;
 
     if (!rnode || !name)
@@ -327,6 +1107,8 @@ int ltjson_promote(ltjson_node_t *rnode, const char *name)
     }
 
 
+    hashval = name_hash(name, -1);
+
     curnode = rnode;
     matches = 0;
 
@@ -348,7 +1130,7 @@ int ltjson_promote(ltjson_node_t *rnode, const char *name)
                 }
                 else
                 {
-                    if (*promnode->name == *name &&
+                    if (promnode->namehash == hashval &&
                             strcmp(promnode->name, name) == 0)
                         break;
                 }
@@ -360,7 +1142,8 @@ int ltjson_promote(ltjson_node_t *rnode, const char *name)
             if (promnode && prevnode)
             {
                 /* Node to promote is found and is not first already.
-                   Break out promnode and place it first: */
+                   Break out promnode and place it first. It was the
+                   first by that name anyway, so any index is good: */
 
                 prevnode->next = promnode->next;    /* Hop over promnode   */
                 prevnode = curnode->val.subnode;    /* Save old topnode    */
@@ -379,6 +1162,7 @@ int ltjson_promote(ltjson_node_t *rnode, const char *name)
         return 0;
     }
 
+    nindex_free((ltjson_info_t *)tree);
     return 1;
 }
 
@@ -0,0 +1,339 @@
+/*
+ *  lttape.c (as include): Parsing straight into a compact tree
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  A tree with a tape (ltjson_settape) is parsed with the event
+    callbacks in tape_sax, so it only ever holds one node per level of
+    nesting, and the events append each value to a compact tree (see
+    ltctree.c) in the order they arrive, which is document order. An
+    object or array gets its .end when it is closed.
+
+    The tape's node and string arrays are grown by doubling with the
+    tree's allocator and are kept as the tree is recycled, so a tree
+    that is parsed over and over soon stops allocating at all.
+
+    The events have no way to report ENOMEM, so on running out of
+    memory one sets .nomem and stops the parse (see sax_result).
+*/
+
+
+#define TAPE_INIT_NODES     64
+#define TAPE_INIT_BYTES     1024
+
+
+
+
+/*
+ *  ctree_addstr(ctree, s) - Copy s to the end of ctree's strings
+ *
+ *  Returns the offset of the copy
+ */
+
+static unsigned int ctree_addstr(ltjson_ctree_t *ctree, const char *s)
+{
+    unsigned int offset = ctree->strsize;
+    unsigned int len = strlen(s) + 1;
+
+    memcpy(ctree->strs + offset, s, len);
+    ctree->strsize += len;
+
+    return offset;
+}
+
+
+
+
+/*
+ *  ctree_addname(ctree, names, nnames, name) - Offset for member name
+ *
+ *  names (CTREE_NAMESLOTS entries of offset + 1, 0 for empty) finds a
+ *  copy already in the strings. Once it's three quarters full, names
+ *  not in it are copied every time.
+ */
+
+static unsigned int ctree_addname(ltjson_ctree_t *ctree, unsigned int *names,
+                                  int *nnames, const char *name)
+{
+    unsigned int slot, offset;
+    int len;
+
+    len = strlen(name);
+    slot = name_hash(name, len) & (CTREE_NAMESLOTS - 1);
+
+    while (names[slot])
+    {
+        if (strcmp(ctree->strs + names[slot] - 1, name) == 0)
+            return names[slot] - 1;
+
+        slot = (slot + 1) & (CTREE_NAMESLOTS - 1);
+    }
+
+    offset = ctree_addstr(ctree, name);
+
+    if (*nnames < CTREE_NAMESLOTS * 3 / 4)
+    {
+        names[slot] = offset + 1;
+        (*nnames)++;
+    }
+
+    return offset;
+}
+
+
+
+
+/*
+ *  tape_free(jsoninfo) - Remove the tape, if any
+ */
+
+static void tape_free(ltjson_info_t *jsoninfo)
+{
+    if (!jsoninfo->tape)
+        return;
+
+    mem_free(jsoninfo->alloc, jsoninfo->tape->ctree.nodes);
+    mem_free(jsoninfo->alloc, jsoninfo->tape->ctree.strs);
+    mem_free(jsoninfo->alloc, jsoninfo->tape);
+    jsoninfo->tape = 0;
+}
+
+
+
+
+/*
+ *  tape_reserve(jsoninfo, nbytes) - Make room for a node and nbytes
+ *
+ *  Returns 1 on success, 0 if out of memory (sets .nomem)
+ */
+
+static int tape_reserve(ltjson_info_t *jsoninfo, size_t nbytes)
+{
+    struct tape *tape = jsoninfo->tape;
+    ltjson_ctree_t *ctree = &tape->ctree;
+    struct ctnode *nodes;
+    unsigned int nalloc;
+    char *strs;
+    size_t salloc;
+
+    if (ctree->nnodes == tape->nalloc)
+    {
+        nalloc = tape->nalloc ? tape->nalloc * 2 : TAPE_INIT_NODES;
+
+        if (nalloc > INT_MAX ||
+            (nodes = mem_realloc(jsoninfo->alloc, ctree->nodes,
+                                 nalloc * sizeof(struct ctnode))) == NULL)
+        {
+            tape->nomem = 1;
+            return 0;
+        }
+
+        ctree->nodes = nodes;
+        tape->nalloc = nalloc;
+    }
+
+    if (ctree->strsize + nbytes > tape->salloc)
+    {
+        salloc = tape->salloc ? tape->salloc : TAPE_INIT_BYTES;
+        while (salloc < ctree->strsize + nbytes)
+            salloc *= 2;
+
+        if (salloc >= CTREE_NONE ||
+            (strs = mem_realloc(jsoninfo->alloc, ctree->strs, salloc)) == NULL)
+        {
+            tape->nomem = 1;
+            return 0;
+        }
+
+        ctree->strs = strs;
+        tape->salloc = salloc;
+    }
+
+    return 1;
+}
+
+
+
+
+/*
+ *  tape_add(jsoninfo, ntype) - Append a node to the tape
+ *
+ *  Room must have been made with tape_reserve. The node gets the name
+ *  from the last key event, if any, and its value is zeroed.
+ *
+ *  Returns the new node
+ */
+
+static struct ctnode *tape_add(ltjson_info_t *jsoninfo, int ntype)
+{
+    struct tape *tape = jsoninfo->tape;
+    ltjson_ctree_t *ctree = &tape->ctree;
+    struct ctnode *ctnode;
+
+    ctnode = &ctree->nodes[ctree->nnodes];
+
+    ctnode->name = tape->name;
+    ctnode->up = tape->up;
+    ctnode->end = ++ctree->nnodes;
+    ctnode->ntype = ntype;
+    ctnode->nflags = 0;
+    ctnode->val.ll = 0;
+
+    if (tape->up != CTREE_NONE)
+        ctree->nodes[tape->up].val.count++;
+
+    tape->name = CTREE_NONE;
+    return ctnode;
+}
+
+
+
+
+/*
+ *  tape_open(jsoninfo, ntype) - Event for the start of an object/array
+ *
+ *  The root starts a new tape.
+ */
+
+static int tape_open(ltjson_info_t *jsoninfo, int ntype)
+{
+    struct tape *tape = jsoninfo->tape;
+
+    if (!jsoninfo->root->val.subnode)
+    {
+        tape->ctree.nnodes = 0;
+        tape->ctree.strsize = 0;
+        tape->up = CTREE_NONE;
+        tape->name = CTREE_NONE;
+        tape->nnames = 0;
+        memset(tape->names, 0, sizeof(tape->names));
+    }
+
+    if (!tape_reserve(jsoninfo, 0))
+        return 0;
+
+    tape_add(jsoninfo, ntype);
+    tape->up = tape->ctree.nnodes - 1;
+    return 1;
+}
+
+
+
+
+/*
+ *  tape_close(jsoninfo) - Event for the end of an object/array
+ */
+
+static int tape_close(ltjson_info_t *jsoninfo)
+{
+    struct tape *tape = jsoninfo->tape;
+    struct ctnode *ctnode = &tape->ctree.nodes[tape->up];
+
+    ctnode->end = tape->ctree.nnodes;
+    tape->up = ctnode->up;
+    return 1;
+}
+
+
+
+
+/* The tape's event callbacks (ctx is the jsoninfo) */
+
+static int tape_begin_object(void *ctx)
+{
+    return tape_open(ctx, LTJSON_NTYPE_OBJECT);
+}
+
+static int tape_begin_array(void *ctx)
+{
+    return tape_open(ctx, LTJSON_NTYPE_ARRAY);
+}
+
+static int tape_end(void *ctx)
+{
+    return tape_close(ctx);
+}
+
+static int tape_key(void *ctx, const char *name)
+{
+    ltjson_info_t *jsoninfo = ctx;
+    struct tape *tape = jsoninfo->tape;
+
+    if (!tape_reserve(jsoninfo, strlen(name) + 1))
+        return 0;
+
+    tape->name = ctree_addname(&tape->ctree, tape->names, &tape->nnames,
+                               name);
+    return 1;
+}
+
+static int tape_string(void *ctx, const char *s)
+{
+    ltjson_info_t *jsoninfo = ctx;
+
+    if (!tape_reserve(jsoninfo, strlen(s) + 1))
+        return 0;
+
+    tape_add(jsoninfo, LTJSON_NTYPE_STRING)->val.s =
+        ctree_addstr(&jsoninfo->tape->ctree, s);
+    return 1;
+}
+
+static int tape_integer(void *ctx, long long ll)
+{
+    if (!tape_reserve(ctx, 0))
+        return 0;
+
+    tape_add(ctx, LTJSON_NTYPE_INTEGER)->val.ll = ll;
+    return 1;
+}
+
+static int tape_floating(void *ctx, double d)
+{
+    if (!tape_reserve(ctx, 0))
+        return 0;
+
+    tape_add(ctx, LTJSON_NTYPE_FLOAT)->val.d = d;
+    return 1;
+}
+
+static int tape_boolean(void *ctx, int b)
+{
+    if (!tape_reserve(ctx, 0))
+        return 0;
+
+    tape_add(ctx, LTJSON_NTYPE_BOOL)->val.ll = b;
+    return 1;
+}
+
+static int tape_null(void *ctx)
+{
+    if (!tape_reserve(ctx, 0))
+        return 0;
+
+    tape_add(ctx, LTJSON_NTYPE_NULL);
+    return 1;
+}
+
+
+static const ltjson_sax_t tape_sax =
+{
+    tape_begin_object, tape_end, tape_begin_array, tape_end, tape_key,
+    tape_string, tape_integer, tape_floating, tape_boolean, tape_null
+};
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -14,9 +14,12 @@
 #ifdef _LTJSON_INLINE_INCLUDE_
 
 
-/* This extern can be set by the caller to change the total (so
+/* This extern can be set by the caller to fix the total (so
    includes the header) allocated block size for string stores.
-   A good rule of thumb is to set it to 2048 or 4096 (a page) */
+   A good rule of thumb is to set it to 2048 or 4096 (a page).
+   Left at 0, blocks start at 2048 and double up to SSTORE_MAX_ALLOC
+   and a store that needed more than one is given a single block to
+   fit when it is cleared. */
 
 int ltjson_allocsize_sstore;
 
@@ -48,25 +51,21 @@ static void *sstore_new(void)
 
 
 /*
- *  sstore_nadd() - Add string of length n to sstore
+ *  sstore_block() - Get a block of sstore with sneeds bytes free
  *
- *  Returns: pointer to string on success
+ *  Returns: pointer to the block on success
  *           NULL if out of memory (errno to ENOMEM)
  */
 
-static char *sstore_nadd(void **ctxp, const char *str, int n)
+static struct sstore *sstore_block(const ltjson_alloc_t *alloc, void **ctxp,
+                                   int sneeds)
 {
     struct sstore *sstore, *curstore;
-    int allocsize, sneeds;
-    char *newstr;
-
-    assert(ctxp && str);
+    int allocsize;
 
-    if (n <= 0)
-        n = strlen(str);
+    assert(ctxp && sneeds > 0);
 
     sstore = (struct sstore *)*ctxp;
-    sneeds = n + 1;
 
 
     for (curstore = sstore; curstore != NULL; curstore = curstore->next)
@@ -105,6 +104,16 @@ static char *sstore_nadd(void **ctxp, const char *str, int n)
         if (!ltjson_allocsize_sstore)
         {
             allocsize = SSTORE_DEF_ALLOC;       /* Default */
+
+            /* Or double the total of the newest block (the head) */
+
+            if (sstore)
+            {
+                if (sstore->balloc < (int)SSTORE_MAX_ALLOC / 2)
+                    allocsize = 2 * sstore->balloc + sizeof(struct sstore);
+                else
+                    allocsize = SSTORE_MAX_ALLOC;
+            }
         }
         else
         {
@@ -120,12 +129,9 @@ static char *sstore_nadd(void **ctxp, const char *str, int n)
         if (sneeds > allocsize)
             allocsize = sneeds;
 
-        curstore = malloc(allocsize + sizeof(struct sstore));
+        curstore = mem_alloc(alloc, allocsize + sizeof(struct sstore));
         if (!curstore)
-        {
-            errno = ENOMEM;
             return NULL;
-        }
 
         /* Initialise entry and chain it into list (if one) */
 
@@ -142,45 +148,127 @@ static char *sstore_nadd(void **ctxp, const char *str, int n)
         *ctxp = (void *)sstore;
     }
 
+    return curstore;
+}
+
+
+
+
+/*
+ *  sstore_space() - Get n + 1 bytes (a string of length n) from sstore
+ *
+ *  Returns: pointer to the space on success
+ *           NULL if out of memory (errno to ENOMEM)
+ */
+
+static char *sstore_space(const ltjson_alloc_t *alloc, void **ctxp, int n)
+{
+    struct sstore *curstore;
+    char *newstr;
+
+    assert(ctxp && n >= 0);
+
+    if ((curstore = sstore_block(alloc, ctxp, n + 1)) == NULL)
+        return NULL;
+
     newstr = (char *)curstore + sizeof(struct sstore)
                               + (curstore->balloc - curstore->bavail);
 
-    strncpy(newstr, str, n);
-    newstr[n] = 0;
-
-    curstore->bavail -= sneeds;
+    curstore->bavail -= n + 1;
     return newstr;
 }
 
 
-static char *sstore_add(void **ctxp, const char *str)
+
+
+/*
+ *  sstore_reserve() - Make room for strings totalling n bytes
+ *
+ *  n counts the terminators. Once a block has n bytes free, strings
+ *  that add up to that much fit without another block: any that don't
+ *  fit elsewhere go in that one.
+ *
+ *  Returns: 1 on success
+ *           0 if out of memory (errno to ENOMEM)
+ */
+
+static int sstore_reserve(const ltjson_alloc_t *alloc, void **ctxp, int n)
 {
-    return sstore_nadd(ctxp, str, 0);
+    if (n <= 0)
+        return 1;
+
+    return sstore_block(alloc, ctxp, n) != NULL;
 }
 
 
 
 
 /*
- *  sstore_clear() - Set string blocklist to be reused
+ *  sstore_fit() - Give an empty store one block of exactly n bytes
+ *
+ *  For a store about to be filled with strings totalling n bytes (with
+ *  the terminators), so none of the block is left over.
+ *
+ *  Returns: 1 on success
+ *           0 if out of memory (errno to ENOMEM)
  */
 
-static void sstore_clear(void **ctxp)
+static int sstore_fit(const ltjson_alloc_t *alloc, void **ctxp, int n)
 {
-    struct sstore *sstore;
+    struct sstore *curstore;
 
-    if (!ctxp || !*ctxp)
-        return;
+    assert(ctxp && !*ctxp);
 
-    sstore = (struct sstore *)*ctxp;
+    if (n <= 0)
+        return 1;
 
-    /* Just move to the end of the list and clear that block */
+    curstore = mem_alloc(alloc, n + sizeof(struct sstore));
+    if (!curstore)
+        return 0;
 
-    while (sstore->next)
-        sstore = sstore->next;
+    curstore->balloc = n;
+    curstore->bavail = n;
+    curstore->prev = NULL;
+    curstore->next = NULL;
 
-    sstore->bavail = sstore->balloc;
-    *ctxp = (void *)sstore;
+    *ctxp = (void *)curstore;
+    return 1;
+}
+
+
+
+
+/*
+ *  sstore_nadd() - Add string of length n to sstore
+ *
+ *  Returns: pointer to string on success
+ *           NULL if out of memory (errno to ENOMEM)
+ */
+
+static char *sstore_nadd(const ltjson_alloc_t *alloc, void **ctxp,
+                         const char *str, int n)
+{
+    char *newstr;
+
+    assert(ctxp && str);
+
+    if (n <= 0)
+        n = strlen(str);
+
+    if ((newstr = sstore_space(alloc, ctxp, n)) == NULL)
+        return NULL;
+
+    strncpy(newstr, str, n);
+    newstr[n] = 0;
+
+    return newstr;
+}
+
+
+static char *sstore_add(const ltjson_alloc_t *alloc, void **ctxp,
+                        const char *str)
+{
+    return sstore_nadd(alloc, ctxp, str, 0);
 }
 
 
@@ -243,7 +331,7 @@ static int sstore_stats(void **ctxp,
  *  sstore_free() - Free the entire block list
  */
 
-static void sstore_free(void **ctxp)
+static void sstore_free(const ltjson_alloc_t *alloc, void **ctxp)
 {
     struct sstore *sstore, *nextstore;
 
@@ -260,7 +348,7 @@ static void sstore_free(void **ctxp)
     while (sstore)
     {
         nextstore = sstore->next;
-        free(sstore);
+        mem_free(alloc, sstore);
         sstore = nextstore;
     }
 
@@ -271,18 +359,69 @@ static void sstore_free(void **ctxp)
 
 
 /*
- *  skip_space(s) - Move s to first nonspace and return s
+ *  sstore_clear() - Set string blocklist to be reused
+ *
+ *  If the strings took more than one block, a single block to hold
+ *  them all (plus an eighth) replaces the list, unless the block size
+ *  is fixed or the memory can't be used again (an arena). The list is
+ *  just reused if that block can't be had.
  */
 
-static const char *skip_space(const char *s)
+static void sstore_clear(const ltjson_alloc_t *alloc, void **ctxp)
+{
+    struct sstore *sstore, *newstore;
+    int filled;
+
+    if (!ctxp || !*ctxp)
+        return;
+
+    sstore = (struct sstore *)*ctxp;
+
+    if (!ltjson_allocsize_sstore && (sstore->prev || sstore->next) &&
+        mem_canfree(alloc))
+    {
+        sstore_stats(ctxp, NULL, NULL, &filled);
+        filled += filled / 8;
+        if (filled < (int)SSTORE_DEF_ALLOC)
+            filled = SSTORE_DEF_ALLOC;
+
+        newstore = mem_alloc(alloc, filled + sizeof(struct sstore));
+        if (newstore)
+        {
+            sstore_free(alloc, ctxp);
+
+            newstore->balloc = filled;
+            newstore->bavail = filled;
+            newstore->prev = NULL;
+            newstore->next = NULL;
+
+            *ctxp = (void *)newstore;
+            return;
+        }
+    }
+
+    /* Just move to the end of the list and clear that block */
+
+    while (sstore->next)
+        sstore = sstore->next;
+
+    sstore->bavail = sstore->balloc;
+    *ctxp = (void *)sstore;
+}
+
+
+
+
+/*
+ *  skip_space(s, end) - Move s to first nonspace before end and return s
+ */
+
+static const char *skip_space(const char *s, const char *end)
 {
     if (!s)
         return 0;
 
-    while (*s && c_isspace(*s))
-        s++;
-
-    return s;
+    return scan_space(s, end);
 }
 
 
@@ -369,6 +508,10 @@ static struct
  *  Take a codepoint up to 0xFFFF and convert into a maximum of a 3 byte
  *  UTF-8 sequence in *dest. (dest is a char *, probably signed).
  *
+ *  U+0000 is written as the two byte (overlong) sequence 0xC0 0x80 as
+ *  is done in "Modified UTF-8". This keeps the string null terminated
+ *  for C while the \u0000 from the JSON text can still be recovered.
+ *
  *  Warning: No buffer length checks. No terminator written.
  *
  *  Returns the number of bytes written or 0 on error
@@ -378,9 +521,16 @@ static int codepoint_to_utf8(int codept, char *dest)
 {
     int nchars, bitshift;
 
-    if (codept <= 0 || !dest)
+    if (codept < 0 || !dest)
         return 0;
 
+    if (codept == 0)
+    {
+        *dest++ = (char)0xC0;
+        *dest = (char)0x80;
+        return 2;
+    }
+
     for (nchars = 1; utf8tab[nchars].cntmask; nchars++)
     {
         /* The resmask gives the maximum unicode value for a
@@ -468,6 +618,10 @@ static int unescape_string(char *s)
                 *d++ = '\t';
             break;
 
+            case 'b':
+                *d++ = '\b';
+            break;
+
             case 'f':
                 *d++ = '\f';
             break;
@@ -487,7 +641,7 @@ static int unescape_string(char *s)
 
                 s++;
                 codepoint = string_to_codepoint(s);
-                if (codepoint <= 0)
+                if (codepoint < 0)
                     return 0;
                 s += 3;
 
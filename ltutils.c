@@ -104,6 +104,10 @@ static void print_nodeinfo(ltjson_node_t *node, int spaces)
             printf("\"%s\"\n", node->val.s);
         break;
 
+        case LTJSON_NTYPE_NUMRAW:
+            printf("%s\n", node->val.s);
+        break;
+
         default:
             printf("!!Node does not look valid!!\n");
     }
@@ -257,9 +261,9 @@ int ltjson_memstat(ltjson_node_t *tree, int *stats, int nents)
         basenode = jsoninfo->cbasenode->ancnode;    /* First basenode */
 
         do {
-            jmstats[MSTAT_NODES_ALLOC] += jsoninfo->nodeasize - 1;
+            jmstats[MSTAT_NODES_ALLOC] += (int)basenode->namehash - 1;
             jmstats[MSTAT_NODES_USED] += basenode->val.nused - 1;
-            jmstats[MSTAT_TOTAL] += jsoninfo->nodeasize *
+            jmstats[MSTAT_TOTAL] += (int)basenode->namehash *
                                     sizeof(ltjson_node_t);
 
             basenode = basenode->next;
@@ -269,22 +273,49 @@ int ltjson_memstat(ltjson_node_t *tree, int *stats, int nents)
 
     jmstats[MSTAT_WORKSTR_ALLOC] = jsoninfo->workalloc;
     jmstats[MSTAT_TOTAL] += jsoninfo->workalloc;
+    jmstats[MSTAT_TOTAL] += jsoninfo->mi_nslots * sizeof(struct mindexcell);
+
+    if (jsoninfo->filter)
+        jmstats[MSTAT_TOTAL] += sizeof(struct filter) +
+                                jsoninfo->filter->nlevels *
+                                sizeof(struct filterlevel);
 
     jmstats[MSTAT_TOTAL] += sstore_stats(&jsoninfo->sstore,
                                          &jmstats[MSTAT_SSTORE_NBLOCKS],
                                          &jmstats[MSTAT_SSTORE_ALLOC],
                                          &jmstats[MSTAT_SSTORE_FILLED]);
 
-    if (jsoninfo->nhtab)
+    /* A parallel parse leaves nodes and strings in its part trees */
+
+    if (jsoninfo->parts)
+    {
+        int pstats[MSTAT_SSTORE_FILLED + 1], p;
+
+        jmstats[MSTAT_TOTAL] += LTJSON_BATCH_MAXTHREADS *
+                                sizeof(ltjson_node_t *);
+
+        for (p = 0; p < LTJSON_BATCH_MAXTHREADS; p++)
+        {
+            if (jsoninfo->parts[p] &&
+                ltjson_memstat(jsoninfo->parts[p], pstats,
+                               MSTAT_SSTORE_FILLED + 1))
+            {
+                for (i = 0; i <= MSTAT_SSTORE_FILLED; i++)
+                    jmstats[i] += pstats[i];
+            }
+        }
+    }
+
+    if (nhash_ishashed(jsoninfo))
     {
-        jmstats[MSTAT_HASH_NBUCKETS] = NHASH_NBUCKETS;
+        jmstats[MSTAT_HASH_NSLOTS] = jsoninfo->nhash.nslots;
         jmstats[MSTAT_HASH_HITS] = jsoninfo->nh_nhits;
         jmstats[MSTAT_HASH_MISSES] = jsoninfo->nh_nmisses;
 
         jmstats[MSTAT_TOTAL] += nhash_stats(jsoninfo,
-                                            &jmstats[MSTAT_HASH_BUCKETFILL],
-                                            &jmstats[MSTAT_HASHCELL_ALLOC],
-                                            &jmstats[MSTAT_HASHCELL_FILLED]);
+                                            &jmstats[MSTAT_HASH_SLOTFILL],
+                                            &jmstats[MSTAT_HASH_SSTORE_ALLOC],
+                                            &jmstats[MSTAT_HASH_SSTORE_FILLED]);
     }
     else
     {
@@ -311,7 +342,7 @@ int ltjson_memstat(ltjson_node_t *tree, int *stats, int nents)
 
 const char *ltjson_statstring(int index)
 {
-    if (index < 0 || index >= MSTAT_NENTS)
+    if (index < 0 || index >= MSTAT_POOL_NENTS)
         return NULL;
 
     return ltjson_memstatdesc[index];
@@ -354,6 +385,71 @@ void ltjson_statdump(ltjson_node_t *tree)
 
 
 
+/**
+ *  ltjson_getcounters(tree, counters, reset) - get work done counters
+ *      @tree:      Valid tree
+ *      @counters:  Filled with the counters of the tree
+ *      @reset:     If !0, the tree's counters are zeroed after copying
+ *
+ *  The counters are kept only if the library is built with
+ *  LTJSON_COUNTERS. They add up the work done on the tree since it
+ *  was created (or last reset), through any number of recycles, apart
+ *  from .sstorechain, which is the length of its string store now.
+ *  Times are in ns. Tree does not have to be closed.
+ *
+ *  Returns: 1 on success
+ *           0 on error and sets errno (@counters zeroed if given):
+ *              EINVAL if tree or counters is not valid
+ *              ENOSYS if the library is built without the counters
+ */
+
+int ltjson_getcounters(ltjson_node_t *tree, ltjson_counters_t *counters,
+                       int reset)
+{
+#ifdef LTJSON_COUNTERS
+    ltjson_info_t *jsoninfo = (ltjson_info_t *)tree, *part;
+    int nblocks, i;
+#endif
+
+    if (counters)
+        memset(counters, 0, sizeof(ltjson_counters_t));
+
+    if (!is_valid_tree(tree) || !counters)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+#ifdef LTJSON_COUNTERS
+    *counters = jsoninfo->counters;
+
+    if (reset)
+        memset(&jsoninfo->counters, 0, sizeof(ltjson_counters_t));
+
+    sstore_stats(&jsoninfo->sstore, &nblocks, NULL, NULL);
+    counters->sstorechain = nblocks;
+
+    for (i = 0; jsoninfo->parts && i < LTJSON_BATCH_MAXTHREADS; i++)
+    {
+        if ((part = (ltjson_info_t *)jsoninfo->parts[i]) != NULL)
+        {
+            sstore_stats(&part->sstore, &nblocks, NULL, NULL);
+            counters->sstorechain += nblocks;
+        }
+    }
+
+    return 1;
+#else
+    (void)reset;
+
+    errno = ENOSYS;
+    return 0;
+#endif
+}
+
+
+
+
 /**
  *  ltjson_get_hashstring(tree, name) - Lookup a name in the hash table
  *      @tree:  Valid closed tree
@@ -362,7 +458,7 @@ void ltjson_statdump(ltjson_node_t *tree)
  *  Returns: Pointer to constant string on success
  *           NULL on failure with errno is set to:
  *              EINVAL if tree is not valid/closed etc
- *              ENOENT if tree has no hash table
+ *              ENOENT if tree has no hash table or dictionary
  *              0      if entry not found (not really an error)
  */
 
@@ -442,6 +538,23 @@ const char *ltjson_mksearch(ltjson_node_t *tree, const char *name, int *flagsp)
 
 
 
+/*
+ *  node_jsoninfo(node) - Get the info structure of the node's tree
+ *
+ *  Walks back to the root via the ancnode links.
+ */
+
+static ltjson_info_t *node_jsoninfo(ltjson_node_t *node)
+{
+    while (node->ancnode != NULL)
+        node = node->ancnode;
+
+    return (ltjson_info_t *)node;
+}
+
+
+
+
 /**
  *  ltjson_get_member(objnode, name, flags) - Retrieve object member
  *      @objnode: A pointer to an object node
@@ -453,6 +566,9 @@ const char *ltjson_mksearch(ltjson_node_t *tree, const char *name, int *flagsp)
  *  name is one retrieved using ltjson_get_hashstring. This function does
  *  not recurse down a tree, just hops from node to node within the object.
  *
+ *  If the tree was parsed with LTJSON_PARSE_MEMBERINDEX, an object that
+ *  takes a long walk is indexed so the next lookups of it don't walk.
+ *
  *  This routine does not check if @objnode is part of a closed tree.
  *
  *  Returns: Pointer to the matched node on success
@@ -466,6 +582,10 @@ const char *ltjson_mksearch(ltjson_node_t *tree, const char *name, int *flagsp)
 ltjson_node_t *ltjson_get_member(ltjson_node_t *objnode,
                                  const char *name, int flags)
 {
+    ltjson_node_t *member;
+    unsigned int hashval = 0;
+    int nsteps = 0;
+
     if (!objnode || !name)
     {
         errno = EINVAL;
@@ -478,30 +598,206 @@ ltjson_node_t *ltjson_get_member(ltjson_node_t *objnode,
         return NULL;
     }
 
-    objnode = objnode->val.subnode;
+    if (objnode->nflags & JSONNODE_NFLAGS_INDEXED)
+    {
+        member = mindex_find(node_jsoninfo(objnode), objnode, name,
+                             name_hash(name, -1),
+                             flags & LTJSON_SEARCH_NAMEISHASH);
+        if (!member)
+            errno = 0;
+
+        return member;
+    }
+
+    member = objnode->val.subnode;
 
-    if (!objnode)
+    if (!member)
     {
         errno = 0;
         return NULL;
     }
 
+    if (!(flags & LTJSON_SEARCH_NAMEISHASH))
+        hashval = name_hash(name, -1);
+
     do {
+        nsteps++;
+
         if (flags & LTJSON_SEARCH_NAMEISHASH)
         {
-            if (objnode->name == name)
-                return objnode;
+            if (member->name == name)
+                break;
         }
         else
         {
-            if (*objnode->name == *name && strcmp(objnode->name, name) == 0)
-                return objnode;
+            if (member->namehash == hashval &&
+                    strcmp(member->name, name) == 0)
+                break;
         }
 
-    } while ((objnode = objnode->next) != NULL);
+    } while ((member = member->next) != NULL);
 
-    errno = 0;
-    return NULL;
+    if (nsteps >= MINDEX_MIN_MEMBERS && objnode->nflags == 0)
+    {
+        /* A long walk. Index the object if the tree wants that
+           (and is closed, so the object won't change under it) */
+
+        ltjson_info_t *jsoninfo = node_jsoninfo(objnode);
+        int saved = errno;
+
+        if ((jsoninfo->pflags & LTJSON_PARSE_MEMBERINDEX) &&
+                is_closed_tree(jsoninfo->root) &&
+                !mindex_build(jsoninfo, objnode))
+            errno = saved;                      /* Fine if it fails */
+    }
+
+    if (!member)
+        errno = 0;
+
+    return member;
+}
+
+
+
+
+/*
+ *  raw_convert(node) - Convert a raw number node's text, once
+ *
+ *  The value is cached in front of the text (see store_rawnumber) and
+ *  the node's nflags say whether it is an integer or a float.
+ *
+ *  Returns 1 on success, 0 if out of range for a double (errno to ERANGE)
+ */
+
+static int raw_convert(ltjson_node_t *node)
+{
+    union rawcache cache;
+    ltjson_node_t num;
+
+    if (node->nflags & (JSONNODE_NFLAGS_RAWLL | JSONNODE_NFLAGS_RAWD))
+        return 1;
+
+    if (!convert_to_number(node->val.s, strlen(node->val.s), &num))
+    {
+        errno = ERANGE;
+        return 0;
+    }
+
+    if (num.ntype == LTJSON_NTYPE_INTEGER)
+    {
+        cache.ll = num.val.ll;
+        node->nflags |= JSONNODE_NFLAGS_RAWLL;
+    }
+    else
+    {
+        cache.d = num.val.d;
+        node->nflags |= JSONNODE_NFLAGS_RAWD;
+    }
+
+    memcpy((char *)node->val.s - RAWNUM_CACHE, &cache, RAWNUM_CACHE);
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_get_ll(node) - Get an integer or boolean value
+ *      @node:    A pointer to a node
+ *
+ *  A number parsed with LTJSON_PARSE_RAWNUM (an LTJSON_NTYPE_NUMRAW
+ *  node) is converted the first time and the value kept in the node.
+ *
+ *  Returns: The value of an integer node (or a raw number that is an
+ *           integer), 1 or 0 for a boolean and 0 for any other node
+ *           0 on failure with errno set to:
+ *              EINVAL if passed a null node
+ *              EDOM   if a raw number is not an integer (a float, or
+ *                     too big for a long long)
+ */
+
+long long ltjson_get_ll(ltjson_node_t *node)
+{
+    union rawcache cache;
+
+    if (!node)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    switch (node->ntype)
+    {
+        case LTJSON_NTYPE_INTEGER:
+        case LTJSON_NTYPE_BOOL:
+            return node->val.ll;
+
+        case LTJSON_NTYPE_NUMRAW:
+            if (!raw_convert(node))
+                return 0;
+
+            if (!(node->nflags & JSONNODE_NFLAGS_RAWLL))
+            {
+                errno = EDOM;
+                return 0;
+            }
+
+            memcpy(&cache, node->val.s - RAWNUM_CACHE, RAWNUM_CACHE);
+            return cache.ll;
+    }
+
+    return 0;
+}
+
+
+
+
+/**
+ *  ltjson_get_double(node) - Get a number as a double
+ *      @node:    A pointer to a node
+ *
+ *  As ltjson_get_ll, a raw number is converted once and kept.
+ *
+ *  Returns: The value of a float node, an integer node's value as a
+ *           double (either of them raw numbers or not) and 0 for any
+ *           other node
+ *           0 on failure with errno set to:
+ *              EINVAL if passed a null node
+ *              ERANGE if a raw number is too big for a double (which
+ *                     the parse doesn't let through)
+ */
+
+double ltjson_get_double(ltjson_node_t *node)
+{
+    union rawcache cache;
+
+    if (!node)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    switch (node->ntype)
+    {
+        case LTJSON_NTYPE_FLOAT:
+            return node->val.d;
+
+        case LTJSON_NTYPE_INTEGER:
+            return (double)node->val.ll;
+
+        case LTJSON_NTYPE_NUMRAW:
+            if (!raw_convert(node))
+                return 0;
+
+            memcpy(&cache, node->val.s - RAWNUM_CACHE, RAWNUM_CACHE);
+
+            if (node->nflags & JSONNODE_NFLAGS_RAWLL)
+                return (double)cache.ll;
+
+            return cache.d;
+    }
+
+    return 0;
 }
 
 
@@ -523,6 +819,7 @@ static ltjson_node_t *add_new_node(ltjson_info_t *jsoninfo,
 {
     ltjson_node_t *newnode, *oanode;
     const char *nvstr;
+    unsigned int hashval;
 
     assert(jsoninfo);
 
@@ -566,17 +863,19 @@ static ltjson_node_t *add_new_node(ltjson_info_t *jsoninfo,
 
     if (oanode->ntype == LTJSON_NTYPE_OBJECT)
     {
-        if ((nvstr = nhash_insert(jsoninfo, name)) == NULL)
+        if ((nvstr = nhash_insert(jsoninfo, name, &hashval)) == NULL)
             return NULL;
     }
     else
     {
         nvstr = NULL;
+        hashval = 0;
     }
 
-    newnode->name   = nvstr;
-    newnode->ntype  = ntype;
-    newnode->nflags = 0;
+    newnode->name     = nvstr;
+    newnode->ntype    = ntype;
+    newnode->nflags   = 0;
+    newnode->namehash = hashval;
 
 
     switch (ntype)
@@ -604,7 +903,7 @@ static ltjson_node_t *add_new_node(ltjson_info_t *jsoninfo,
             }
             else
             {
-                nvstr = sstore_add(&jsoninfo->sstore, sval);
+                nvstr = sstore_add(jsoninfo->alloc, &jsoninfo->sstore, sval);
                 if (!nvstr)
                     return NULL;
             }
@@ -632,6 +931,10 @@ static ltjson_node_t *add_new_node(ltjson_info_t *jsoninfo,
         refnode->val.subnode = newnode;
     }
 
+    if (oanode->ntype == LTJSON_NTYPE_OBJECT)
+        mindex_added(jsoninfo, oanode, newnode);
+
+    nindex_free(jsoninfo);
     return newnode;
 }
 
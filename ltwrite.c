@@ -0,0 +1,850 @@
+/*
+ *  ltwrite.c (as include): Writing trees out as JSON text
+ *
+ *  This code is supposed to be #included into the main ltjson.c file
+ *  which makes the codebase less unwieldy but keep static namespace.
+ *
+ *  Distribution and use of this software are as per the terms of the
+ *  Simplified BSD License (also known as the "2-Clause License")
+ *
+ *  Copyright 2016 Conor F. O'Rourke. All rights reserved.
+ */
+
+#ifdef _LTJSON_INLINE_INCLUDE_
+
+
+/*  The text is put together in a buffer: the caller's for ltjson_print
+    or a staging buffer for ltjson_write, which hands the buffer to the
+    writer each time it fills. Everything goes through write_out, which
+    just counts what doesn't fit in a caller's buffer so the size needed
+    can be returned.
+
+    Strings are copied a run at a time between the characters that need
+    an escape (see scan_plain). Modified UTF-8 (0xC0 0x80) is written
+    back as \u0000. Doubles are written to read back as the same value
+    and always look like a float. Infinities and NaNs, which JSON can't
+    represent, are written as null. Raw numbers (LTJSON_PARSE_RAWNUM)
+    are written just as they were in the text.
+*/
+
+#define WRITE_STAGE_SIZE    4096        /* ltjson_write staging buffer */
+#define WRITE_INDENT        4           /* Spaces per level if pretty  */
+
+struct jwrite {
+    char *buf;          /* Output or staging buffer                  */
+    int size;           /* Bytes buf can take (less the terminator)  */
+    int used;           /* Bytes in buf                              */
+    int total;          /* Bytes of text in all (written or not)     */
+    int (*writer)(void *ctx, const char *s, int len);
+    void *ctx;
+    int stopped;        /* The writer returned 0                     */
+};
+
+
+static const char write_digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+static const char write_spaces[] = "                                ";
+
+
+
+
+/*
+ *  write_flush(jw) - Hand the staged text to the writer
+ */
+
+static void write_flush(struct jwrite *jw)
+{
+    if (!jw->writer)
+        return;
+
+    if (jw->used && !jw->stopped && !jw->writer(jw->ctx, jw->buf, jw->used))
+        jw->stopped = 1;
+
+    jw->used = 0;
+}
+
+
+
+
+/*
+ *  write_out(jw, s, n) - Output n characters from s
+ */
+
+static void write_out(struct jwrite *jw, const char *s, int n)
+{
+    int room;
+
+    jw->total += n;
+
+    if (jw->writer && n >= jw->size)
+    {
+        /* Too big to stage: write it straight out */
+
+        write_flush(jw);
+
+        if (!jw->stopped && !jw->writer(jw->ctx, s, n))
+            jw->stopped = 1;
+
+        return;
+    }
+
+    while (n > 0)
+    {
+        if ((room = jw->size - jw->used) == 0)
+        {
+            if (!jw->writer)
+                return;         /* Caller's buffer full. Just count */
+
+            write_flush(jw);
+            room = jw->size;
+        }
+
+        if (room > n)
+            room = n;
+
+        memcpy(jw->buf + jw->used, s, room);
+        jw->used += room;
+        s += room;
+        n -= room;
+    }
+}
+
+
+
+
+/*
+ *  write_char(jw, c) - Output one character
+ */
+
+static void write_char(struct jwrite *jw, char c)
+{
+    if (jw->used < jw->size)
+    {
+        jw->buf[jw->used++] = c;
+        jw->total++;
+    }
+    else
+    {
+        write_out(jw, &c, 1);
+    }
+}
+
+
+
+
+/*
+ *  write_newline(jw, depth) - Start a new line indented for depth
+ */
+
+static void write_newline(struct jwrite *jw, int depth)
+{
+    int nspaces = depth * WRITE_INDENT, n;
+
+    write_char(jw, '\n');
+
+    while (nspaces > 0)
+    {
+        n = nspaces;
+        if (n > (int)sizeof(write_spaces) - 1)
+            n = sizeof(write_spaces) - 1;
+
+        write_out(jw, write_spaces, n);
+        nspaces -= n;
+    }
+}
+
+
+
+
+/*
+ *  write_string(jw, s) - Output s as a quoted and escaped string
+ */
+
+static void write_string(struct jwrite *jw, const char *s)
+{
+    const char *end, *run;
+    char esc[8];
+
+    end = s + strlen(s);
+
+    write_char(jw, '"');
+
+    while ((run = scan_plain(s, end)) < end)
+    {
+        write_out(jw, s, (int)(run - s));
+        s = run;
+
+        switch (*s)
+        {
+            case '"':   write_out(jw, "\\\"", 2);   break;
+            case '\\':  write_out(jw, "\\\\", 2);   break;
+            case '\b':  write_out(jw, "\\b", 2);    break;
+            case '\f':  write_out(jw, "\\f", 2);    break;
+            case '\n':  write_out(jw, "\\n", 2);    break;
+            case '\r':  write_out(jw, "\\r", 2);    break;
+            case '\t':  write_out(jw, "\\t", 2);    break;
+
+            default:
+                if ((unsigned char)*s == 0xC0)
+                {
+                    if ((unsigned char)s[1] == 0x80)
+                    {
+                        write_out(jw, "\\u0000", 6);
+                        s++;
+                    }
+                    else
+                    {
+                        write_char(jw, *s);
+                    }
+                }
+                else
+                {
+                    sprintf(esc, "\\u%04x", (unsigned char)*s);
+                    write_out(jw, esc, 6);
+                }
+        }
+
+        s++;
+    }
+
+    write_out(jw, s, (int)(end - s));
+    write_char(jw, '"');
+}
+
+
+
+
+/*
+ *  write_integer(jw, ll) - Output an integer
+ *
+ *  Two digits at a time from the least significant end
+ */
+
+static void write_integer(struct jwrite *jw, long long ll)
+{
+    char num[24], *p;
+    unsigned long long u;
+    int i;
+
+    p = num + sizeof(num);
+    u = (ll < 0) ? 0ULL - (unsigned long long)ll : (unsigned long long)ll;
+
+    while (u >= 100)
+    {
+        i = (int)(u % 100) * 2;
+        u /= 100;
+        *--p = write_digits[i + 1];
+        *--p = write_digits[i];
+    }
+
+    if (u >= 10)
+    {
+        i = (int)u * 2;
+        *--p = write_digits[i + 1];
+        *--p = write_digits[i];
+    }
+    else
+    {
+        *--p = (char)('0' + u);
+    }
+
+    if (ll < 0)
+        *--p = '-';
+
+    write_out(jw, p, (int)(num + sizeof(num) - p));
+}
+
+
+
+
+/*  Doubles are turned into digits with Grisu2 (F. Loitsch, "Printing
+    Floating-Point Numbers Quickly and Accurately with Integers", 2010).
+    The double and the halfway points to its neighbours are scaled by a
+    cached power of ten, using 64 bit integers, so that the digits can
+    be generated as for an integer. They always read back as the same
+    double and are the fewest digits that do for nearly all doubles.
+*/
+
+struct diyfp {
+    unsigned long long f;       /* Significand */
+    int e;                      /* Binary exponent: value is f * 2^e */
+};
+
+
+/* Normalised 10^k for k = -348, -340, ... 340 */
+
+static const struct diyfp dtoa_powers[] =
+{
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193},
+    {0x8b16fb203055ac76ULL, -1166}, {0xcf42894a5dce35eaULL, -1140},
+    {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034},
+    {0xbe5691ef416bd60cULL, -1007}, {0x8dd01fad907ffc3cULL, -980},
+    {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874},
+    {0x823c12795db6ce57ULL, -847}, {0xc21094364dfb5637ULL, -821},
+    {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715},
+    {0xb23867fb2a35b28eULL, -688}, {0x84c8d4dfd2c63f3bULL, -661},
+    {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555},
+    {0xf3e2f893dec3f126ULL, -529}, {0xb5b5ada8aaff80b8ULL, -502},
+    {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396},
+    {0xa6dfbd9fb8e5b88fULL, -369}, {0xf8a95fcf88747d94ULL, -343},
+    {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236},
+    {0xe45c10c42a2b3b06ULL, -210}, {0xaa242499697392d3ULL, -183},
+    {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77},
+    {0x9c40000000000000ULL, -50}, {0xe8d4a51000000000ULL, -24},
+    {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83},
+    {0xd5d238a4abe98068ULL, 109}, {0x9f4f2726179a2245ULL, 136},
+    {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242},
+    {0x924d692ca61be758ULL, 269}, {0xda01ee641a708deaULL, 295},
+    {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402},
+    {0xc83553c5c8965d3dULL, 428}, {0x952ab45cfa97a0b3ULL, 455},
+    {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561},
+    {0x88fcf317f22241e2ULL, 588}, {0xcc20ce9bd35c78a5ULL, 614},
+    {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720},
+    {0xbb764c4ca7a44410ULL, 747}, {0x8bab8eefb6409c1aULL, 774},
+    {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880},
+    {0x80444b5e7aa7cf85ULL, 907}, {0xbf21e44003acdd2dULL, 933},
+    {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039},
+    {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static const unsigned long long dtoa_pow10[] =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL
+};
+
+#define DTOA_HIDDENBIT  0x0010000000000000ULL
+#define DTOA_SIGMASK    0x000FFFFFFFFFFFFFULL
+
+
+
+
+/*
+ *  dtoa_multiply(x, y) - Upper 64 bits of the product of x and y, rounded
+ */
+
+static struct diyfp dtoa_multiply(struct diyfp x, struct diyfp y)
+{
+    const unsigned long long m32 = 0xFFFFFFFFULL;
+    unsigned long long a, b, c, d, ac, bc, ad, bd, tmp;
+    struct diyfp r;
+
+    a = x.f >> 32;
+    b = x.f & m32;
+    c = y.f >> 32;
+    d = y.f & m32;
+
+    ac = a * c;
+    bc = b * c;
+    ad = a * d;
+    bd = b * d;
+
+    tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1ULL << 31;
+
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+
+
+
+/*
+ *  dtoa_normalise(x) - Shift x up until the top bit of f is set
+ */
+
+static struct diyfp dtoa_normalise(struct diyfp x)
+{
+    while (!(x.f & (1ULL << 63)))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+
+    return x;
+}
+
+
+
+
+/*
+ *  dtoa_grisu2(d, digits, decexp) - Digits of a positive finite double
+ *
+ *  Stores the digits in digits (at least 18 characters, not null
+ *  terminated) with d being digits * 10^*decexp.
+ *
+ *  Returns the number of digits
+ */
+
+static int dtoa_grisu2(double d, char *digits, int *decexp)
+{
+    struct diyfp v, w, wp, wm, cpow, one;
+    unsigned long long bits, delta, rest, tenkappa, wpw;
+    unsigned int p1;
+    int k, index, kappa, len, digit;
+    double dk;
+
+    memcpy(&bits, &d, sizeof(bits));
+
+    if (bits >> 52)
+    {
+        v.f = (bits & DTOA_SIGMASK) | DTOA_HIDDENBIT;
+        v.e = (int)(bits >> 52) - 1075;
+    }
+    else
+    {
+        v.f = bits & DTOA_SIGMASK;      /* Subnormal */
+        v.e = -1074;
+    }
+
+    /* Boundaries: the halfway points to the neighbouring doubles,
+       with the lower one closer if d is a power of two */
+
+    wp.f = (v.f << 1) + 1;
+    wp.e = v.e - 1;
+
+    while (!(wp.f & (DTOA_HIDDENBIT << 1)))
+    {
+        wp.f <<= 1;
+        wp.e--;
+    }
+
+    wp.f <<= 10;
+    wp.e -= 10;
+
+    if (v.f == DTOA_HIDDENBIT)
+    {
+        wm.f = (v.f << 2) - 1;
+        wm.e = v.e - 2;
+    }
+    else
+    {
+        wm.f = (v.f << 1) - 1;
+        wm.e = v.e - 1;
+    }
+
+    wm.f <<= wm.e - wp.e;
+    wm.e = wp.e;
+
+    /* Cached power of ten bringing wp's exponent into -60 to -32 */
+
+    dk = (-61 - wp.e) * 0.30102999566398114 + 347;
+    k = (int)dk;
+    if (dk - k > 0.0)
+        k++;
+
+    index = (k >> 3) + 1;
+    *decexp = -(-348 + index * 8);
+    cpow = dtoa_powers[index];
+
+    w = dtoa_multiply(dtoa_normalise(v), cpow);
+    wp = dtoa_multiply(wp, cpow);
+    wm = dtoa_multiply(wm, cpow);
+    wm.f++;
+    wp.f--;
+
+    /* Generate digits of wp until they are within delta of it */
+
+    delta = wp.f - wm.f;
+    wpw = wp.f - w.f;
+    one.e = wp.e;
+    one.f = 1ULL << -one.e;
+
+    p1 = (unsigned int)(wp.f >> -one.e);
+    rest = wp.f & (one.f - 1);
+
+    for (kappa = 0; kappa < 10 && p1 >= dtoa_pow10[kappa]; kappa++)
+        ;
+
+    len = 0;
+
+    while (kappa > 0)
+    {
+        kappa--;
+        digit = (int)(p1 / dtoa_pow10[kappa]);
+        p1 %= dtoa_pow10[kappa];
+
+        if (digit || len)
+            digits[len++] = (char)('0' + digit);
+
+        if ((((unsigned long long)p1 << -one.e) + rest) <= delta)
+        {
+            rest += (unsigned long long)p1 << -one.e;
+            tenkappa = dtoa_pow10[kappa] << -one.e;
+            *decexp += kappa;
+            goto round;
+        }
+    }
+
+    for (;;)
+    {
+        rest *= 10;
+        delta *= 10;
+        digit = (int)(rest >> -one.e);
+
+        if (digit || len)
+            digits[len++] = (char)('0' + digit);
+
+        rest &= one.f - 1;
+        kappa--;
+
+        if (rest < delta)
+        {
+            *decexp += kappa;
+            tenkappa = one.f;
+            wpw *= (-kappa < 20) ? dtoa_pow10[-kappa] : 0;
+            break;
+        }
+    }
+
+round:
+    /* Move the last digit down towards w while still in range */
+
+    while (rest < wpw && delta - rest >= tenkappa &&
+           (rest + tenkappa < wpw || wpw - rest > rest + tenkappa - wpw))
+    {
+        digits[len - 1]--;
+        rest += tenkappa;
+    }
+
+    return len;
+}
+
+
+
+
+/*
+ *  write_float(jw, d) - Output a double so that it reads back the same
+ *
+ *  Plain notation is used from 1e-5 up to 1e17, otherwise it is
+ *  d.ddde[-]x. A whole number gets a ".0" to read back as a double.
+ */
+
+static void write_float(struct jwrite *jw, double d)
+{
+    char num[40], digits[20], *cp;
+    int len, decexp, point, i;
+
+    if (!(d - d == 0))
+    {
+        write_out(jw, "null", 4);       /* Infinity or NaN */
+        return;
+    }
+
+    cp = num;
+
+    if (d < 0 || (d == 0 && 1 / d < 0))
+    {
+        *cp++ = '-';
+        d = -d;
+    }
+
+    if (d == 0)
+    {
+        memcpy(cp, "0.0", 3);
+        write_out(jw, num, (int)(cp - num) + 3);
+        return;
+    }
+
+    len = dtoa_grisu2(d, digits, &decexp);
+    point = len + decexp;           /* Digits before the decimal point */
+
+    if (point > 0 && point <= 17)
+    {
+        if (decexp >= 0)
+        {
+            memcpy(cp, digits, len);
+            cp += len;
+            for (i = 0; i < decexp; i++)
+                *cp++ = '0';
+            *cp++ = '.';
+            *cp++ = '0';
+        }
+        else
+        {
+            memcpy(cp, digits, point);
+            cp += point;
+            *cp++ = '.';
+            memcpy(cp, digits + point, len - point);
+            cp += len - point;
+        }
+    }
+    else if (point <= 0 && point > -5)
+    {
+        *cp++ = '0';
+        *cp++ = '.';
+        for (i = point; i < 0; i++)
+            *cp++ = '0';
+        memcpy(cp, digits, len);
+        cp += len;
+    }
+    else
+    {
+        *cp++ = digits[0];
+        if (len > 1)
+        {
+            *cp++ = '.';
+            memcpy(cp, digits + 1, len - 1);
+            cp += len - 1;
+        }
+        cp += sprintf(cp, "e%d", point - 1);
+    }
+
+    write_out(jw, num, (int)(cp - num));
+}
+
+
+
+
+/*
+ *  write_tree(jw, rnode, flags) - Output rnode and everything under it
+ *
+ *  The tree is walked without recursion (as in ltjson_display). A name
+ *  is written for members of objects, except for rnode itself, so that
+ *  the text is a complete JSON value.
+ */
+
+static void write_tree(struct jwrite *jw, ltjson_node_t *rnode, int flags)
+{
+    ltjson_node_t *node = rnode;
+    int pretty = flags & LTJSON_PRINT_PRETTY;
+    int depth = 0;
+
+    for (;;)
+    {
+        if (node != rnode && node->ancnode->ntype == LTJSON_NTYPE_OBJECT)
+        {
+            write_string(jw, node->name);
+            write_char(jw, ':');
+            if (pretty)
+                write_char(jw, ' ');
+        }
+
+        switch (node->ntype)
+        {
+            case LTJSON_NTYPE_ARRAY:
+            case LTJSON_NTYPE_OBJECT:
+                write_char(jw, node->ntype == LTJSON_NTYPE_ARRAY ? '[' : '{');
+
+                if (node->val.subnode)
+                {
+                    node = node->val.subnode;
+                    depth++;
+                    if (pretty)
+                        write_newline(jw, depth);
+                    continue;
+                }
+
+                write_char(jw, node->ntype == LTJSON_NTYPE_ARRAY ? ']' : '}');
+            break;
+
+            case LTJSON_NTYPE_BOOL:
+                if (node->val.ll)
+                    write_out(jw, "true", 4);
+                else
+                    write_out(jw, "false", 5);
+            break;
+
+            case LTJSON_NTYPE_FLOAT:
+                write_float(jw, node->val.d);
+            break;
+
+            case LTJSON_NTYPE_INTEGER:
+                write_integer(jw, node->val.ll);
+            break;
+
+            case LTJSON_NTYPE_STRING:
+                write_string(jw, node->val.s);
+            break;
+
+            case LTJSON_NTYPE_NUMRAW:
+                write_out(jw, node->val.s, (int)strlen(node->val.s));
+            break;
+
+            default:
+                write_out(jw, "null", 4);
+        }
+
+        /* Close every object or array that node was the last of */
+
+        while (node != rnode && !node->next)
+        {
+            node = node->ancnode;
+            depth--;
+
+            if (pretty)
+                write_newline(jw, depth);
+
+            write_char(jw, node->ntype == LTJSON_NTYPE_ARRAY ? ']' : '}');
+        }
+
+        if (node == rnode)
+            break;
+
+        write_char(jw, ',');
+        if (pretty)
+            write_newline(jw, depth);
+
+        node = node->next;
+    }
+}
+
+
+
+
+/*
+ *  write_checknode(rnode) - Check rnode is in a valid closed tree
+ *
+ *  Returns 1 if so, 0 if not and sets errno (EINVAL)
+ */
+
+static int write_checknode(ltjson_node_t *rnode)
+{
+    ltjson_node_t *tree;
+
+    if (!rnode)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    for (tree = rnode; tree->ancnode != NULL; tree = tree->ancnode)
+        ;
+
+    if (!is_closed_tree(tree))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+
+
+/**
+ *  ltjson_print(rnode, buf, size, flags) - Write a subtree as JSON text
+ *      @rnode:     Node to write out (the tree root or any node in it)
+ *      @buf:       Buffer for the text or NULL if @size is 0
+ *      @size:      Size of @buf in bytes
+ *      @flags:     LTJSON_PRINT_PRETTY for indented output or 0
+ *
+ *  Write rnode, and everything under it, into @buf as JSON text with a
+ *  null terminator. The text is compact unless @flags asks for one
+ *  member or element per line. As with snprintf, the text is cut short
+ *  if @buf is too small and the full length is returned, so a call with
+ *  a @size of 0 measures the text. The tree must be valid and closed.
+ *
+ *  Returns: The length of the text (without the terminator) on success
+ *           0 if tree is not valid/closed or a bad argument (errno to
+ *           EINVAL)
+ */
+
+int ltjson_print(ltjson_node_t *rnode, char *buf, int size, int flags)
+{
+    struct jwrite jw;
+
+    if (size < 0 || (size && !buf) || !write_checknode(rnode))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jw.buf = buf;
+    jw.size = size ? size - 1 : 0;
+    jw.used = 0;
+    jw.total = 0;
+    jw.writer = NULL;
+    jw.ctx = NULL;
+    jw.stopped = 0;
+
+    write_tree(&jw, rnode, flags);
+
+    if (size)
+        buf[jw.used] = '\0';
+
+    return jw.total;
+}
+
+
+
+
+/**
+ *  ltjson_write(rnode, writer, ctx, flags) - Write a subtree to a writer
+ *      @rnode:     Node to write out (the tree root or any node in it)
+ *      @writer:    Function called with successive pieces of the text
+ *      @ctx:       Context argument passed to @writer
+ *      @flags:     LTJSON_PRINT_PRETTY for indented output or 0
+ *
+ *  As ltjson_print but the text is passed to @writer, a few KB at a
+ *  time, as it is put together (@s is not null terminated). The writer
+ *  returns 0 to stop. Use this to append to a growable buffer or to
+ *  write to a file or socket without holding all of the text.
+ *
+ *  Returns: The length of the text on success
+ *           0 on failure with errno set to one of
+ *              EINVAL if tree is not valid/closed or a bad argument
+ *              ECANCELED if the writer returned 0
+ */
+
+int ltjson_write(ltjson_node_t *rnode,
+                 int (*writer)(void *ctx, const char *s, int len),
+                 void *ctx, int flags)
+{
+    char stage[WRITE_STAGE_SIZE];
+    struct jwrite jw;
+
+    if (!writer || !write_checknode(rnode))
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    jw.buf = stage;
+    jw.size = sizeof(stage);
+    jw.used = 0;
+    jw.total = 0;
+    jw.writer = writer;
+    jw.ctx = ctx;
+    jw.stopped = 0;
+
+    write_tree(&jw, rnode, flags);
+    write_flush(&jw);
+
+    if (jw.stopped)
+    {
+        errno = ECANCELED;
+        return 0;
+    }
+
+    return jw.total;
+}
+
+
+#endif  /* _LTJSON_INLINE_INCLUDE_ */
+
+
+/* vi:set expandtab ts=4 sw=4: */
@@ -11,3 +11,9 @@ echo Compiling %gccexec%
 
 @echo on
 gcc %gccdefs% %gccopts% -o %gccexec% %gccinps% %gcclibs%
+@echo off
+
+echo Compiling bench.exe
+
+@echo on
+gcc %gccdefs% %gccopts% -O2 -o bench.exe bench.c ltjson.c %gcclibs%
@@ -96,6 +96,2445 @@ int dump_file(char *filename)
 }
 
 
+/* Behaviour checks of the features, run after the demo in main. The
+   shared helpers come first, then a check_*() per feature, in the order
+   the features were added */
+
+static int nchecks, nfailed;
+
+#define CHECK(cond)  check_that((cond), #cond, __LINE__)
+
+
+static void check_that(int ok, const char *what, int line)
+{
+    nchecks++;
+
+    if (!ok)
+    {
+        nfailed++;
+        printf("FAIL (test.c:%d): %s\n", line, what);
+    }
+}
+
+
+/* Object text {"k0":0,"k1":1,...} with n members (free it) */
+
+static char *wide_object(int n)
+{
+    char *text, *p;
+    int i;
+
+    text = p = malloc(16 * n + 8);
+    if (!text)
+        exit(1);
+
+    *p++ = '{';
+
+    for (i = 0; i < n; i++)
+        p += sprintf(p, "%s\"k%d\":%d", i ? "," : "", i, i);
+
+    strcpy(p, "}");
+    return text;
+}
+
+
+/* The text of a tree or subtree (free it) */
+
+static char *tree_text(ltjson_node_t *tree)
+{
+    int len = ltjson_print(tree, NULL, 0, 0);
+    char *text = malloc(len + 1);
+
+    if (!text)
+        exit(1);
+
+    ltjson_print(tree, text, len + 1, 0);
+    return text;
+}
+
+
+/* Array text of n records of assorted values (free it) */
+
+static char *record_text(int n)
+{
+    char *text, *p;
+    int i;
+
+    text = p = malloc(128 * n + 8);
+    if (!text)
+        exit(1);
+
+    *p++ = '[';
+
+    for (i = 0; i < n; i++)
+        p += sprintf(p, "%s{\"id\":%d,\"name\":\"n%d\",\"t\":[%d.5,"
+                     "\"a\\u00e9\\n\\\"%d\"],\"o\":{\"x\":[-%d,{\"y\":"
+                     "\"z\"}],\"e\":{}},\"w\":%s}", i ? ",\n " : "", i,
+                     i % 7, i, i, i, i % 3 ? "null" : "true");
+
+    strcpy(p, "]");
+    return text;
+}
+
+
+/* Do two trees print the same? */
+
+static int same_tree(ltjson_node_t *a, ltjson_node_t *b)
+{
+    static char abuf[65536], bbuf[65536];
+
+    if (!ltjson_print(a, abuf, sizeof(abuf), 0) ||
+        !ltjson_print(b, bbuf, sizeof(bbuf), 0))
+        return 0;
+
+    return strcmp(abuf, bbuf) == 0;
+}
+
+
+/* An allocator that fails once ctx (an int) counts down to 0. It
+   never fails while ctx is negative */
+
+static int fail_now(int *left)
+{
+    if (*left == 0)
+        return 1;
+
+    if (*left > 0)
+        (*left)--;
+
+    return 0;
+}
+
+
+static void *fail_alloc(void *ctx, size_t size)
+{
+    return fail_now(ctx) ? NULL : malloc(size);
+}
+
+
+static void *fail_resize(void *ctx, void *mem, size_t size)
+{
+    return fail_now(ctx) ? NULL : realloc(mem, size);
+}
+
+
+static void fail_release(void *ctx, void *mem)
+{
+    (void)ctx;
+    free(mem);
+}
+
+
+/* An allocator that counts its calls (ctx is the count) */
+
+static void *count_alloc(void *ctx, size_t size)
+{
+    (*(int *)ctx)++;
+    return malloc(size);
+}
+
+
+static void *count_resize(void *ctx, void *mem, size_t size)
+{
+    (*(int *)ctx)++;
+    return realloc(mem, size);
+}
+
+
+static void count_release(void *ctx, void *mem)
+{
+    (void)ctx;
+    free(mem);
+}
+
+
+/* Text {ws}["{body}"]{ws} with ws and body as in check_scan (free it) */
+
+static char *scan_text(int nws, const char *body)
+{
+    char *text, *p;
+    int i;
+
+    text = p = malloc(2 * nws + strlen(body) + 8);
+    if (!text)
+        exit(1);
+
+    for (i = 0; i < nws; i++)
+        *p++ = " \t\n\r"[i % 4];
+
+    p += sprintf(p, "[\"%s\"]", body);
+
+    for (i = 0; i < nws; i++)
+        *p++ = " \r\n\t"[i % 4];
+
+    *p = '\0';
+    return text;
+}
+
+
+static void check_scan(void)
+{
+    static const char *escs[][2] = {
+        {"\\\"", "\""}, {"\\\\", "\\"}, {"\\n", "\n"}, {"\\/", "/"},
+        {"\\u00e9", "\xc3\xa9"}, {"\\t\\u20ac", "\t\xe2\x82\xac"},
+        {"\xc3\xa9", "\xc3\xa9"}, {"", ""}
+    };
+    ltjson_node_t *tree = NULL;
+    char body[160], want[160], *text, *cut;
+    int n, pos, e, k, len, ok = 1, cutok = 1;
+
+    /* Runs of plain characters, white space and an escape of every
+       length and at every place either side of the block edges */
+
+    for (n = 0; n <= 70; n++)
+        for (pos = 0; pos <= n; pos++)
+            for (e = 0; e < 8; e++)
+            {
+                sprintf(body, "%.*s%s%.*s", pos, 
+                        "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz"
+                        "abcdefghijklmnopqrst", escs[e][0], n - pos,
+                        "ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                        "ABCDEFGHIJKLMNOPQRST");
+                sprintf(want, "%.*s%s%.*s", pos, body, escs[e][1],
+                        n - pos, body + pos + strlen(escs[e][0]));
+                text = scan_text(n, body);
+
+                if (ltjson_parse(&tree, text, 0) != 1 ||
+                    tree->ntype != LTJSON_NTYPE_ARRAY ||
+                    strcmp(tree->val.subnode->val.s, want) != 0)
+                    ok = 0;
+
+                /* The same text cut short anywhere in the string */
+
+                if (n == 40 && e == 5)
+                {
+                    len = (int)strlen(text);
+
+                    for (k = n + 2; k < len - n - 1; k++)
+                    {
+                        if ((cut = malloc(k + 1)) == NULL)
+                            exit(1);
+
+                        memcpy(cut, text, k);
+                        cut[k] = '\0';
+
+                        cutok &= !ltjson_parse(&tree, cut, 0) &&
+                                 errno == EAGAIN;
+                        cutok &= ltjson_parse(&tree, text + k, 0) == 1 &&
+                                 strcmp(tree->val.subnode->val.s,
+                                        want) == 0;
+                        free(cut);
+                    }
+                }
+
+                free(text);
+            }
+
+    CHECK(ok);
+    CHECK(cutok);
+
+    /* White space of every length with nothing else */
+
+    for (n = 0, ok = 1; n <= 70; n++)
+    {
+        text = scan_text(n, "");
+        text[n] = '\0';
+        ok &= !ltjson_parse(&tree, text, 0) && errno == EAGAIN;
+        free(text);
+    }
+
+    CHECK(ok);
+    CHECK(ltjson_parse(&tree, "[\"ab\"cd\"]", 0) == 0 && errno == EILSEQ);
+
+    ltjson_free(&tree);
+}
+
+
+/* Is s in the n bytes at buf? */
+
+static int in_buffer(const char *s, const char *buf, size_t n)
+{
+    return s && s >= buf && s < buf + n;
+}
+
+
+static void check_insitu(void)
+{
+    static const char doc[] = "{\"a\":\"plain\",\"b\":\"e\\u00e9\\n\\\"q\","
+                              "\"c\":[\"x\\\\y\",\"\"],\"d\":\"\\u0000z\"}";
+    ltjson_node_t *tree = NULL, *copy = NULL, *node;
+    char buf[sizeof(doc)], part[sizeof(doc)];
+    int hashed;
+
+    CHECK(ltjson_parse(&copy, doc, 0) == 1);
+
+    for (hashed = 0; hashed < 2; hashed++)
+    {
+        memcpy(buf, doc, sizeof(doc));
+        CHECK(ltjson_parse(&tree, buf, LTJSON_PARSE_INSITU |
+                           (hashed ? LTJSON_PARSE_USEHASH : 0)) == 1);
+        CHECK(same_tree(tree, copy));
+
+        node = ltjson_get_member(tree, "a", 0);
+        CHECK(in_buffer(node->val.s, buf, sizeof(buf)));
+        CHECK(strcmp(node->val.s, "plain") == 0);
+        CHECK(in_buffer(node->name, buf, sizeof(buf)) == !hashed);
+
+        node = ltjson_get_member(tree, "b", 0);
+        CHECK(in_buffer(node->val.s, buf, sizeof(buf)));
+        CHECK(strcmp(node->val.s, "e\xc3\xa9\n\"q") == 0);
+
+        node = ltjson_get_member(tree, "c", 0)->val.subnode;
+        CHECK(in_buffer(node->val.s, buf, sizeof(buf)));
+        CHECK(strcmp(node->val.s, "x\\y") == 0);
+        CHECK(in_buffer(node->next->val.s, buf, sizeof(buf)));
+        CHECK(node->next->val.s[0] == '\0');
+
+        /* \u0000 is kept as 0xC0 0x80 so the string goes on */
+
+        node = ltjson_get_member(tree, "d", 0);
+        CHECK(in_buffer(node->val.s, buf, sizeof(buf)));
+        CHECK(strcmp(node->val.s, "\xc0\x80z") == 0);
+    }
+
+    /* A string split between two texts is copied */
+
+    memcpy(buf, doc, sizeof(doc));
+    memcpy(part, doc, 21);
+    part[21] = '\0';
+
+    CHECK(ltjson_parse(&tree, part, LTJSON_PARSE_INSITU) == 0 &&
+          errno == EAGAIN);
+    CHECK(ltjson_parse(&tree, buf + 21, LTJSON_PARSE_INSITU) == 1);
+    CHECK(same_tree(tree, copy));
+
+    node = ltjson_get_member(tree, "a", 0);
+    CHECK(in_buffer(node->val.s, part, sizeof(part)));
+    node = ltjson_get_member(tree, "b", 0);
+    CHECK(!in_buffer(node->val.s, part, sizeof(part)) &&
+          !in_buffer(node->val.s, buf, sizeof(buf)));
+    CHECK(strcmp(node->val.s, "e\xc3\xa9\n\"q") == 0);
+    node = ltjson_get_member(tree, "d", 0);
+    CHECK(in_buffer(node->val.s, buf, sizeof(buf)));
+
+    ltjson_free(&copy);
+    ltjson_free(&tree);
+}
+
+
+static void check_dict(void)
+{
+    ltjson_node_t *tree = NULL, *trees[2] = {0}, *node;
+    ltjson_dict_t *dict = ltjson_dict_new();
+    const char *id, *extra, *texts[2] = {"{\"id\":1}", "{\"id\":2}"};
+    int i;
+
+    CHECK(dict != NULL);
+    CHECK((id = ltjson_dict_add(dict, "id")) != NULL);
+    CHECK(ltjson_dict_add(dict, "id") == id);
+    CHECK(ltjson_dict_lookup(dict, "id") == id);
+    errno = EINVAL;
+    CHECK(ltjson_dict_lookup(dict, "extra") == NULL && errno == 0);
+
+    /* A dictionary that isn't frozen takes the names it's missing */
+
+    CHECK(ltjson_setdict(&tree, dict) == 1);
+    CHECK(ltjson_parse(&tree, "{\"id\":1,\"extra\":2}", 0) == 1);
+    CHECK((extra = ltjson_dict_lookup(dict, "extra")) != NULL);
+    CHECK(ltjson_get_member(tree, "id", 0)->name == id);
+    CHECK(ltjson_get_member(tree, "extra", 0)->name == extra);
+
+    /* Not while the tree is open */
+
+    CHECK(ltjson_parse(&tree, "{\"id\":", 0) == 0 && errno == EAGAIN);
+    CHECK(ltjson_setdict(&tree, NULL) == 0 && errno == EBUSY);
+    ltjson_free(&tree);
+
+    /* A batch on threads needs a frozen dictionary */
+
+    CHECK(ltjson_parse_batch(trees, texts, NULL, 2, 0, dict, 2) == 0 &&
+          errno == EPERM);
+
+    CHECK(ltjson_dict_freeze(dict) == 1);
+    CHECK(ltjson_dict_freeze(NULL) == 0 && errno == EINVAL);
+    CHECK(ltjson_dict_add(dict, "more") == NULL && errno == EPERM);
+    CHECK(ltjson_dict_add(NULL, "more") == NULL && errno == EINVAL);
+    CHECK(ltjson_dict_lookup(dict, "more") == NULL);
+
+    /* Trees sharing the frozen dictionary keep new names to themselves */
+
+    texts[0] = "{\"id\":1,\"more\":[{\"extra\":3}]}";
+    texts[1] = "{\"more\":true,\"id\":2}";
+    CHECK(ltjson_parse_batch(trees, texts, NULL, 2, 0, dict, 2) == 2);
+
+    for (i = 0; i < 2; i++)
+    {
+        node = ltjson_search(trees[i], id, NULL, LTJSON_SEARCH_NAMEISHASH);
+        CHECK(node && node->name == id && ltjson_get_ll(node) == i + 1);
+        CHECK(ltjson_get_member(trees[i], id, LTJSON_SEARCH_NAMEISHASH) ==
+              node);
+        CHECK(ltjson_get_member(trees[i], "more", 0) != NULL);
+    }
+
+    CHECK(ltjson_get_member(trees[0], "more", 0)->name !=
+          ltjson_get_member(trees[1], "more", 0)->name);
+    CHECK(ltjson_search(trees[0], extra, NULL,
+                        LTJSON_SEARCH_NAMEISHASH) != NULL);
+    CHECK(ltjson_dict_lookup(dict, "more") == NULL);
+
+    /* Detached, a tree hashes its own names again */
+
+    CHECK(ltjson_setdict(&trees[1], NULL) == 1);
+    CHECK(ltjson_parse(&trees[1], texts[1], 0) == 1);
+    CHECK(ltjson_get_member(trees[1], "id", 0)->name != id);
+
+    ltjson_free(&trees[0]);
+    ltjson_free(&trees[1]);
+    CHECK(ltjson_dict_free(&dict) == 1 && dict == NULL);
+}
+
+
+static void check_memberindex(void)
+{
+    ltjson_node_t *tree = NULL;
+    ltjson_alloc_t alloc;
+    char *text = wide_object(40);
+    int failing = -1;
+
+    alloc.alloc = fail_alloc;
+    alloc.resize = fail_resize;
+    alloc.release = fail_release;
+    alloc.ctx = &failing;
+
+    CHECK(ltjson_setalloc(&tree, &alloc) == 1);
+    CHECK(ltjson_parse(&tree, text, LTJSON_PARSE_MEMBERINDEX) == 1);
+
+    /* The index can't be built, but the lookups don't fail */
+
+    failing = 0;
+
+    errno = 0;
+    CHECK(ltjson_get_ll(ltjson_get_member(tree, "k39", 0)) == 39);
+    CHECK(errno == 0);
+    CHECK(ltjson_get_member(tree, "k40", 0) == NULL && errno == 0);
+
+    failing = -1;
+
+    CHECK(ltjson_get_ll(ltjson_get_member(tree, "k39", 0)) == 39);
+    CHECK(ltjson_get_ll(ltjson_get_member(tree, "k7", 0)) == 7);
+
+    ltjson_free(&tree);
+    free(text);
+}
+
+
+/* A log of events as text, from callbacks or from a walk of a tree */
+
+struct evlog
+{
+    char text[65536];
+    int len;
+    int stopat;                 /* Event number to cancel at, or -1 */
+    int nevents;
+};
+
+
+static int ev_put(void *ctx, const char *fmt, const char *s,
+                  long long ll, double d)
+{
+    struct evlog *log = ctx;
+    int room = (int)sizeof(log->text) - log->len;
+
+    if (s)
+        log->len += snprintf(log->text + log->len, room, fmt, s);
+    else if (strchr(fmt, 'g'))
+        log->len += snprintf(log->text + log->len, room, fmt, d);
+    else
+        log->len += snprintf(log->text + log->len, room, fmt, ll);
+
+    if (log->len >= (int)sizeof(log->text))
+        exit(1);
+
+    return log->nevents++ != log->stopat;
+}
+
+
+static int ev_bobj(void *ctx)    { return ev_put(ctx, "{ ", "", 0, 0); }
+static int ev_eobj(void *ctx)    { return ev_put(ctx, "} ", "", 0, 0); }
+static int ev_barr(void *ctx)    { return ev_put(ctx, "[ ", "", 0, 0); }
+static int ev_earr(void *ctx)    { return ev_put(ctx, "] ", "", 0, 0); }
+static int ev_null(void *ctx)    { return ev_put(ctx, "n ", "", 0, 0); }
+
+static int ev_key(void *ctx, const char *name)
+{
+    return ev_put(ctx, "k'%s' ", name, 0, 0);
+}
+
+static int ev_string(void *ctx, const char *s)
+{
+    return ev_put(ctx, "s'%s' ", s, 0, 0);
+}
+
+static int ev_integer(void *ctx, long long ll)
+{
+    return ev_put(ctx, "i%lld ", NULL, ll, 0);
+}
+
+static int ev_floating(void *ctx, double d)
+{
+    return ev_put(ctx, "f%.17g ", NULL, 0, d);
+}
+
+static int ev_boolean(void *ctx, int b)
+{
+    return ev_put(ctx, "b%lld ", NULL, b, 0);
+}
+
+
+static void ev_walk(struct evlog *log, ltjson_node_t *node)
+{
+    ltjson_node_t *sub;
+
+    if (node->name)
+        ev_key(log, node->name);
+
+    switch (node->ntype)
+    {
+        case LTJSON_NTYPE_OBJECT:
+        case LTJSON_NTYPE_ARRAY:
+            if (node->ntype == LTJSON_NTYPE_OBJECT)
+                ev_bobj(log);
+            else
+                ev_barr(log);
+
+            for (sub = node->val.subnode; sub; sub = sub->next)
+                ev_walk(log, sub);
+
+            if (node->ntype == LTJSON_NTYPE_OBJECT)
+                ev_eobj(log);
+            else
+                ev_earr(log);
+        break;
+
+        case LTJSON_NTYPE_STRING:   ev_string(log, node->val.s);    break;
+        case LTJSON_NTYPE_INTEGER:  ev_integer(log, node->val.ll);  break;
+        case LTJSON_NTYPE_FLOAT:    ev_floating(log, node->val.d);  break;
+        case LTJSON_NTYPE_BOOL:     ev_boolean(log, (int)node->val.ll);
+                                    break;
+        default:                    ev_null(log);                   break;
+    }
+}
+
+
+static void check_sax(void)
+{
+    static const ltjson_sax_t sax = {ev_bobj, ev_eobj, ev_barr, ev_earr,
+                                     ev_key, ev_string, ev_integer,
+                                     ev_floating, ev_boolean, ev_null};
+    static struct evlog want, got;
+    static const char doc[] = "{\"s\":\"a\\u00e9\\n\", \"\":{\"e\":[]},"
+                              "\"n\":[0,-1,12.5e-3,1E+2,-0.0,-9223372036854"
+                              "775808],\"l\":[true,false,null],\"o\":{}}";
+    ltjson_node_t *tree = NULL, *stree = NULL;
+    char *recs = record_text(20), part[sizeof(doc)];
+    size_t k;
+    int ok;
+
+    want.stopat = got.stopat = -1;
+
+    /* The events are those of a walk of the tree for the same text */
+
+    CHECK(ltjson_parse(&tree, recs, 0) == 1);
+    ev_walk(&want, tree);
+    CHECK(ltjson_setsax(&stree, &sax, &got) == 1);
+    CHECK(ltjson_parse(&stree, recs, 0) == 1);
+    CHECK(got.len == want.len && strcmp(got.text, want.text) == 0);
+
+    /* And the same for a text split at every byte */
+
+    CHECK(ltjson_parse(&tree, doc, 0) == 1);
+    want.len = 0;
+    ev_walk(&want, tree);
+
+    for (k = 1, ok = 1; k < sizeof(doc) - 1; k++)
+    {
+        memcpy(part, doc, k);
+        part[k] = '\0';
+        got.len = 0;
+
+        ok &= !ltjson_parse(&stree, part, 0) && errno == EAGAIN;
+        ok &= ltjson_parse(&stree, doc + k, 0) == 1;
+        ok &= strcmp(got.text, want.text) == 0;
+    }
+
+    CHECK(ok);
+
+    /* A callback returning 0 cancels the parse */
+
+    got.len = got.nevents = 0;
+    got.stopat = 5;
+    CHECK(!ltjson_parse(&stree, doc, 0) && errno == ECANCELED);
+    CHECK(got.nevents == 6);
+
+    /* Without callbacks the tree is built again */
+
+    CHECK(ltjson_setsax(&stree, NULL, NULL) == 1);
+    CHECK(ltjson_parse(&stree, doc, 0) == 1 && same_tree(stree, tree));
+
+    ltjson_free(&stree);
+    ltjson_free(&tree);
+    free(recs);
+}
+
+
+/* Do the paths find the same nodes with filters of them as on the full
+   tree? Each path is filtered on its own, with each other one and with
+   all of them. Returns the number of paths that match anything */
+
+static int filter_agrees(const char *text, const char **paths, int npaths)
+{
+    const ltjson_cpath_t *cpaths[16], *fpaths[16];
+    ltjson_node_t *tree = NULL, *ftree = NULL;
+    ltjson_node_t *want[64], *got[64];
+    char *a, *b;
+    int i, j, n, nwant, ngot, nmatched = 0;
+    unsigned int m, all = (1U << npaths) - 1;
+
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+
+    for (i = 0; i < npaths; i++)
+        CHECK((cpaths[i] = ltjson_pathcompile(paths[i], NULL)) != NULL);
+
+    for (m = 1; m <= all; m++)
+    {
+        for (i = n = 0; i < npaths; i++)
+            if (m & (1U << i))
+                fpaths[n++] = cpaths[i];
+
+        if (n > 2 && m != all)
+            continue;
+
+        CHECK(ltjson_setfilter(&ftree, fpaths, n) == 1);
+        CHECK(ltjson_parse(&ftree, text, 0) == 1);
+
+        for (i = 0; i < npaths; i++)
+        {
+            if (!(m & (1U << i)))
+                continue;
+
+            nwant = ltjson_pathrefer(tree, paths[i], want, 64);
+            ngot = ltjson_pathexec(ftree, cpaths[i], got, 64);
+            CHECK(ngot == nwant);
+
+            if (m == all && nwant)
+                nmatched++;
+
+            for (j = 0; j < nwant && j < ngot; j++)
+            {
+                a = tree_text(want[j]);
+                b = tree_text(got[j]);
+                CHECK(strcmp(a, b) == 0);
+                free(a);
+                free(b);
+            }
+        }
+    }
+
+    ltjson_free(&ftree);
+
+    for (i = 0; i < npaths; i++)
+        ltjson_pathfree((ltjson_cpath_t **)&cpaths[i]);
+
+    ltjson_free(&tree);
+    return nmatched;
+}
+
+
+static void check_filter(void)
+{
+    const char *rpaths[] = {"/[]/name", "/[7]/t", "/[]/o/x[1]/y",
+                            "/[3]", "/[]/t[1]", "/[40]/o/e"};
+    const char *apaths[] = {"/[]/[1]/name", "/[0]/[]", "/[1]/[0]", "/[5]",
+                            "/[]/name", "/[0]/b/name", "/[2]/x",
+                            "/[]/[]/name", "/[1]"};
+    const char *opaths[] = {"/a[]/b[1]/c", "/a[3]/[0]", "/a[1]", "/a[2]",
+                            "/b/a[0]", "/a[]/[1]", "/a[]/b", "/z",
+                            "/c/x", "/a[9]"};
+    ltjson_node_t *tree = NULL, *ftree = NULL;
+    const ltjson_cpath_t *cpath;
+    char *text = record_text(50), *a;
+
+    CHECK(filter_agrees(text, rpaths, 6) == 6);
+
+    /* Paths that match nothing, or where a wildcard path gets past an
+       element that an index path doesn't want */
+
+    CHECK(filter_agrees("[{\"a\":1,\"b\":{\"name\":3}},[0,{\"name\":5}]]",
+                        apaths, 9) == 5);
+    CHECK(filter_agrees("{\"a\":[[1,2],{\"b\":[3,{\"c\":4}]},\"s\",[5]],"
+                        "\"b\":{\"a\":[6]},\"c\":null}", opaths, 10) == 7);
+
+    /* The filter does leave things out */
+
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+    cpath = ltjson_pathcompile("/[3]", NULL);
+    CHECK(ltjson_setfilter(&ftree, &cpath, 1) == 1);
+    CHECK(ltjson_parse(&ftree, text, 0) == 1);
+    a = tree_text(ftree);
+    CHECK(strlen(a) < strlen(text));
+    free(a);
+
+    ltjson_free(&ftree);
+    ltjson_pathfree((ltjson_cpath_t **)&cpath);
+    ltjson_free(&tree);
+    free(text);
+}
+
+
+/* A writer appending to a buffer (ctx), stopping at ->stopat calls */
+
+struct wbuf
+{
+    char text[65536];
+    int len;
+    int stopat;
+};
+
+
+static int wbuf_writer(void *ctx, const char *s, int len)
+{
+    struct wbuf *wb = ctx;
+
+    if (wb->stopat-- == 0 || wb->len + len >= (int)sizeof(wb->text))
+        return 0;
+
+    memcpy(wb->text + wb->len, s, len);
+    wb->len += len;
+    wb->text[wb->len] = '\0';
+    return 1;
+}
+
+
+static void check_write(void)
+{
+    static const double fixed[] = {0.1, 1.0 / 3, 5e-324, 1e-7, 1e23,
+                                   2.2250738585072014e-308, 1.5, -0.0,
+                                   1.7976931348623157e308,
+                                   9007199254740993.0,
+                                   123456789012345678.0, 4.35, 0.3};
+    static struct wbuf wb;
+    ltjson_node_t *tree = NULL, *back = NULL, *a, *b;
+    char *text, *p, *again, str[64];
+    unsigned long long bits = 88172645463325252ULL;
+    double d;
+    int i, ok, len;
+
+    /* Doubles read back as the same value: some awkward ones, then
+       ones from random bit patterns */
+
+    text = p = malloc(32 * 2100);
+    if (!text)
+        exit(1);
+
+    *p++ = '[';
+
+    for (i = 0; i < 2013; i++)
+    {
+        if (i < 13)
+            d = fixed[i];
+        else
+        {
+            do {
+                bits ^= bits << 13;
+                bits ^= bits >> 7;
+                bits ^= bits << 17;
+                memcpy(&d, &bits, sizeof(d));
+            } while (d != d || d - d != 0);
+        }
+
+        p += sprintf(p, "%s%.17e", i ? "," : "", d);
+    }
+
+    strcpy(p, "]");
+
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+    again = tree_text(tree);
+    CHECK(ltjson_parse(&back, again, 0) == 1);
+
+    for (a = tree->val.subnode, b = back->val.subnode, ok = 1; a && b;
+         a = a->next, b = b->next)
+        ok &= b->ntype == LTJSON_NTYPE_FLOAT &&
+              memcmp(&a->val.d, &b->val.d, sizeof(d)) == 0;
+
+    CHECK(ok && !a && !b);
+    CHECK(strncmp(again, "[0.1,0.3333333333333333,5e-324,1e-7,", 36) == 0);
+    CHECK(strstr(again, ",1.5,-0.0,") != NULL);
+    free(again);
+    free(text);
+
+    /* Escapes, control characters and U+0000 */
+
+    text = "{\"\\u0000\":[\"\\u0001\\u001f\\t\\b\\f\\n\\r\\\"\\\\/\","
+           "\"a\\u0000b\", \"\\u00e9\\u20ac\\uffff\", \"\\u007f\"]}";
+
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+    again = tree_text(tree);
+    CHECK(strstr(again, "\"\\u0000\"") != NULL);
+    CHECK(strstr(again, "a\\u0000b") != NULL);
+    CHECK(ltjson_parse(&back, again, 0) == 1 && same_tree(tree, back));
+
+    a = ltjson_get_member(back, "\xc0\x80", 0);
+    CHECK(a && a->ntype == LTJSON_NTYPE_ARRAY);
+    CHECK(strcmp(a->val.subnode->val.s,
+                 "\x01\x1f\t\b\f\n\r\"\\/") == 0);
+    CHECK(strcmp(a->val.subnode->next->val.s, "a\xc0\x80" "b") == 0);
+
+    /* ltjson_write gives the text of ltjson_print, pretty or not */
+
+    for (i = 0; i < 2; i++)
+    {
+        len = ltjson_print(tree, NULL, 0, i);
+        wb.len = 0;
+        wb.stopat = -1;
+        CHECK(ltjson_write(tree, wbuf_writer, &wb, i) == len);
+        text = tree_text(tree);
+
+        if (i == 0)
+            CHECK(wb.len == len && strcmp(wb.text, text) == 0);
+        else
+            CHECK(ltjson_parse(&back, wb.text, 0) == 1 &&
+                  same_tree(tree, back));
+        free(text);
+    }
+
+    wb.stopat = 0;
+    CHECK(ltjson_write(tree, wbuf_writer, &wb, 0) == 0 &&
+          errno == ECANCELED);
+
+    /* A short buffer gets as much as fits and the whole length */
+
+    len = ltjson_print(tree, str, 10, 0);
+    CHECK(len == (int)strlen(again) && strlen(str) == 9);
+    CHECK(strncmp(str, again, 9) == 0);
+
+    free(again);
+    ltjson_free(&back);
+    ltjson_free(&tree);
+}
+
+
+/* An allocator that counts the blocks it has out (ctx is the count) */
+
+static void *live_alloc(void *ctx, size_t size)
+{
+    (*(int *)ctx)++;
+    return malloc(size);
+}
+
+
+static void *live_resize(void *ctx, void *mem, size_t size)
+{
+    if (!mem)
+        (*(int *)ctx)++;
+
+    return realloc(mem, size);
+}
+
+
+static void live_release(void *ctx, void *mem)
+{
+    (*(int *)ctx)--;
+    free(mem);
+}
+
+
+static void check_alloc(void)
+{
+    static char arena[1 << 16];
+    ltjson_node_t *tree = NULL, *copy = NULL, *node;
+    ltjson_alloc_t alloc = {live_alloc, live_resize, live_release, NULL};
+    char *text = record_text(20);
+    int live = 0, failing, i, size, ok, nomem;
+
+    CHECK(ltjson_parse(&copy, text, LTJSON_PARSE_USEHASH) == 1);
+
+    /* All of a tree's memory comes from and goes back to the hooks */
+
+    alloc.ctx = &live;
+    CHECK(ltjson_setalloc(&tree, &alloc) == 1 && live > 0);
+    CHECK(ltjson_setalloc(&tree, &alloc) == 0 && errno == EINVAL);
+    CHECK(ltjson_parse(&tree, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(same_tree(tree, copy));
+    CHECK(ltjson_free(&tree) == 1 && live == 0);
+
+    alloc.release = NULL;
+    CHECK(ltjson_setalloc(&tree, &alloc) == 0 && errno == EINVAL);
+
+    /* Running out at each allocation in turn is ENOMEM, freeing all */
+
+    alloc.alloc = fail_alloc;
+    alloc.resize = fail_resize;
+    alloc.release = fail_release;
+    alloc.ctx = &failing;
+
+    for (i = 0, ok = 1; ; i++)
+    {
+        failing = i;
+
+        if (!ltjson_setalloc(&tree, &alloc))
+        {
+            ok &= errno == ENOMEM && tree == NULL;
+            continue;
+        }
+
+        if (ltjson_parse(&tree, text, LTJSON_PARSE_USEHASH) == 1)
+            break;
+
+        ok &= errno == ENOMEM && tree == NULL;
+    }
+
+    CHECK(ok && i > 1);
+    CHECK(same_tree(tree, copy));
+    ltjson_free(&tree);
+
+    /* An arena holds all of the tree */
+
+    CHECK(ltjson_setarena(&tree, arena, sizeof(arena)) == 1);
+    CHECK(ltjson_parse(&tree, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(same_tree(tree, copy));
+
+    for (node = tree->val.subnode->val.subnode, ok = 1; node;
+         node = node->next)
+        ok &= (char *)node >= arena && (char *)node < arena + sizeof(arena) &&
+              node->name >= arena && node->name < arena + sizeof(arena);
+
+    CHECK(ok);
+    CHECK(ltjson_free(&tree) == 1);
+
+    /* An arena too small is ENOMEM, leaving what's past it alone */
+
+    CHECK(ltjson_setarena(&tree, arena, 8) == 0 && errno == ENOMEM);
+    CHECK(ltjson_setarena(&tree, NULL, 1024) == 0 && errno == EINVAL);
+
+    for (size = 64, ok = 1, nomem = 0; size < (int)sizeof(arena); size += 64)
+    {
+        memset(arena, 0xA5, sizeof(arena));
+
+        if (!ltjson_setarena(&tree, arena, size))
+        {
+            ok &= errno == ENOMEM && tree == NULL;
+            continue;
+        }
+
+        if (ltjson_parse(&tree, text, LTJSON_PARSE_USEHASH) != 1)
+        {
+            ok &= errno == ENOMEM && tree == NULL;
+            nomem++;
+        }
+        else
+        {
+            ok &= same_tree(tree, copy);
+            ltjson_free(&tree);
+        }
+
+        for (i = size; i < (int)sizeof(arena); i++)
+            ok &= (unsigned char)arena[i] == 0xA5;
+    }
+
+    CHECK(ok && nomem > 0);
+
+    ltjson_free(&copy);
+    free(text);
+}
+
+
+/* Compare ctree node index with node and all under it, as for its
+   ancestor anc. Returns the index after the subtree or -1 if any
+   part differs */
+
+static int ctree_agrees(const ltjson_ctree_t *ct, int index,
+                        ltjson_node_t *node, int anc)
+{
+    ltjson_node_t *sub;
+    const char *name = ltjson_ctree_name(ct, index);
+    int next, count, i, m;
+
+    if (ltjson_ctree_ntype(ct, index) != node->ntype ||
+        ltjson_ctree_ancnode(ct, index) != anc ||
+        (name ? !node->name || strcmp(name, node->name) != 0 : !!node->name))
+        return -1;
+
+    switch (node->ntype)
+    {
+        case LTJSON_NTYPE_OBJECT:
+        case LTJSON_NTYPE_ARRAY:
+            next = index + 1;
+            count = 0;
+
+            if (ltjson_ctree_subnode(ct, index) != (node->val.subnode ?
+                                                    next : -1))
+                return -1;
+
+            for (sub = node->val.subnode; sub; sub = sub->next, count++)
+            {
+                i = next;
+
+                if ((next = ctree_agrees(ct, i, sub, index)) < 0 ||
+                    ltjson_ctree_next(ct, i) != (sub->next ? next : -1))
+                    return -1;
+
+                /* The first member of the name is found */
+
+                if (sub->name)
+                {
+                    m = ltjson_ctree_member(ct, index, sub->name);
+                    if (m < 0 || (ltjson_get_member(node, sub->name, 0) ==
+                                  sub) != (m == i))
+                        return -1;
+                }
+            }
+
+            if (ltjson_ctree_count(ct, index) != count ||
+                ltjson_ctree_end(ct, index) != next)
+                return -1;
+
+            if (node->ntype == LTJSON_NTYPE_OBJECT &&
+                ltjson_ctree_member(ct, index, "no such name") != -1)
+                return -1;
+
+            return next;
+
+        case LTJSON_NTYPE_STRING:
+            if (strcmp(ltjson_ctree_s(ct, index), node->val.s) != 0)
+                return -1;
+        break;
+
+        case LTJSON_NTYPE_BOOL:
+        case LTJSON_NTYPE_INTEGER:
+        case LTJSON_NTYPE_FLOAT:
+        case LTJSON_NTYPE_NUMRAW:
+            if (ltjson_ctree_ll(ct, index) != ltjson_get_ll(node) ||
+                (node->ntype != LTJSON_NTYPE_BOOL &&
+                 ltjson_ctree_d(ct, index) != ltjson_get_double(node)))
+                return -1;
+        break;
+    }
+
+    return ltjson_ctree_end(ct, index) == index + 1 ? index + 1 : -1;
+}
+
+
+/* Does the ctree print as the tree does, compact and pretty? */
+
+static int ctree_prints_as(const ltjson_ctree_t *ct, ltjson_node_t *tree)
+{
+    char *a, *b;
+    int pretty, n, ok = 1;
+
+    for (pretty = 0; pretty < 2; pretty++)
+    {
+        n = ltjson_print(tree, NULL, 0, pretty);
+        a = malloc(n + 1);
+        b = malloc(n + 1);
+        if (!a || !b)
+            exit(1);
+
+        ltjson_print(tree, a, n + 1, pretty);
+        ok &= ltjson_ctree_print(ct, 0, b, n + 1, pretty) == n &&
+              strcmp(a, b) == 0;
+        free(a);
+        free(b);
+    }
+
+    return ok;
+}
+
+
+static void check_ctree(void)
+{
+    const char *paths[] = {"/recs/[]/name", "/a", "/b/a[3]", "/recs[4]/o",
+                           "/x"};
+    ltjson_node_t *tree = NULL, *node, *nodes[64];
+    ltjson_ctree_t *ct, *sub;
+    char *recs = record_text(30), *text, *a, buf[256];
+    int indexes[64], raw, i, j, n, ok;
+
+    text = malloc(strlen(recs) + 128);
+    if (!text)
+        exit(1);
+
+    sprintf(text, "{\"recs\":%s,\"a\":1,\"b\":{\"a\":[true,false,null,"
+            "-0.5,\"x\",12345678901234]},\"a\":2,\"\":{}}", recs);
+
+    for (raw = 0; raw < 2; raw++)
+    {
+        CHECK(ltjson_parse(&tree, text,
+                           raw ? LTJSON_PARSE_RAWNUM : 0) == 1);
+        CHECK((ct = ltjson_ctree_new(tree)) != NULL);
+
+        CHECK(ctree_agrees(ct, 0, tree, -1) == ltjson_ctree_size(ct));
+
+        /* Names are searched for in the same order */
+
+        for (node = NULL, i = -1, ok = 1;
+             (node = ltjson_search(tree, "name", node, 0)) != NULL; )
+        {
+            i = ltjson_ctree_search(ct, "name", i);
+            ok &= i >= 0 && strcmp(ltjson_ctree_s(ct, i), node->val.s) == 0;
+        }
+
+        CHECK(ok && ltjson_ctree_search(ct, "name", i) == -1);
+
+        /* The text and the path matches are the same */
+
+        CHECK(ctree_prints_as(ct, tree));
+
+        for (i = 0; i < 5; i++)
+        {
+            n = ltjson_pathrefer(tree, paths[i], nodes, 64);
+            CHECK(ltjson_ctree_pathrefer(ct, paths[i], indexes, 64) == n);
+
+            for (j = 0, ok = 1; j < n; j++)
+            {
+                a = tree_text(nodes[j]);
+                ok &= ltjson_ctree_print(ct, indexes[j], buf, sizeof(buf),
+                                         0) == (int)strlen(a) &&
+                      (strlen(a) >= sizeof(buf) || strcmp(buf, a) == 0);
+                free(a);
+            }
+
+            CHECK(ok);
+        }
+
+        /* A copy of a member is a root of that name, and stands alone */
+
+        node = ltjson_get_member(tree, "b", 0);
+        CHECK((sub = ltjson_ctree_new(node)) != NULL);
+        ltjson_free(&tree);
+
+        CHECK(strcmp(ltjson_ctree_name(sub, 0), "b") == 0);
+        CHECK(ltjson_ctree_ancnode(sub, 0) == -1);
+        i = ltjson_ctree_member(ct, 0, "b");
+        CHECK(ltjson_ctree_size(sub) == ltjson_ctree_end(ct, i) - i);
+        CHECK(ltjson_ctree_print(sub, 0, buf, sizeof(buf), 0) > 0);
+        CHECK(strcmp(buf, "{\"a\":[true,false,null,-0.5,\"x\","
+                     "12345678901234]}") == 0);
+
+        CHECK(ltjson_ctree_ntype(sub, ltjson_ctree_size(sub)) == -1 &&
+              errno == EINVAL);
+        CHECK(ltjson_ctree_free(&sub) == 1 && sub == NULL);
+        CHECK(ltjson_ctree_free(&ct) == 1);
+    }
+
+    free(text);
+    free(recs);
+}
+
+
+static void check_tape(void)
+{
+    static const char doc[] = "{\"s\":\"a\\u00e9\\n\\u0000\", \"\":{\"e\":[]},"
+                              "\"n\":[0,-1,12.5e-3,1E+2,-0.0],\"s\":[true,"
+                              "false,null,[[{}]]]}";
+    ltjson_node_t *tree = NULL, *ttree = NULL;
+    const ltjson_ctree_t *tape;
+    char *recs = record_text(30), part[sizeof(doc)];
+    size_t k;
+    int ok;
+
+    CHECK(ltjson_parse(&tree, recs, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(ltjson_gettape(tree) == NULL && errno == EINVAL);
+
+    CHECK(ltjson_settape(&ttree, 1) == 1);
+    CHECK(ltjson_parse(&ttree, recs, LTJSON_PARSE_USEHASH) == 1);
+    CHECK((tape = ltjson_gettape(ttree)) != NULL);
+    CHECK(ctree_agrees(tape, 0, tree, -1) == ltjson_ctree_size(tape));
+    CHECK(ctree_prints_as(tape, tree));
+
+    /* The tape is made again for the next text, split at every byte */
+
+    CHECK(ltjson_parse(&tree, doc, 0) == 1);
+
+    for (k = 1, ok = 1; k < sizeof(doc) - 1; k++)
+    {
+        memcpy(part, doc, k);
+        part[k] = '\0';
+
+        ok &= !ltjson_parse(&ttree, part, 0) && errno == EAGAIN;
+        ok &= ltjson_gettape(ttree) == NULL;
+        ok &= ltjson_parse(&ttree, doc + k, 0) == 1;
+        ok &= (tape = ltjson_gettape(ttree)) != NULL &&
+              ctree_prints_as(tape, tree) &&
+              ctree_agrees(tape, 0, tree, -1) == ltjson_ctree_size(tape);
+    }
+
+    CHECK(ok);
+
+    /* Not while open, and trees are built again without the tape */
+
+    CHECK(!ltjson_parse(&ttree, "[1,", 0) && errno == EAGAIN);
+    CHECK(ltjson_settape(&ttree, 0) == 0 && errno == EBUSY);
+    CHECK(ltjson_parse(&ttree, "2]", 0) == 1);
+    CHECK(ltjson_settape(&ttree, 0) == 1);
+    CHECK(ltjson_parse(&ttree, doc, 0) == 1 && same_tree(ttree, tree));
+    CHECK(ltjson_gettape(ttree) == NULL);
+
+    ltjson_free(&ttree);
+    ltjson_free(&tree);
+    free(recs);
+}
+
+
+/* Do the numbers of the array in text agree with strtoll and strtod?
+   offs[] are where each number starts in the text */
+
+static int numbers_agree(const char *text, const int *offs, int n,
+                         int flags)
+{
+    ltjson_node_t *tree = NULL, *node;
+    const char *s;
+    long long ll;
+    double d, want;
+    int i, ok = 1;
+
+    if (ltjson_parse(&tree, text, flags) != 1)
+        return 0;
+
+    for (node = tree->val.subnode, i = 0; node && i < n;
+         node = node->next, i++)
+    {
+        s = text + offs[i];
+        errno = 0;
+        ll = strtoll(s, NULL, 10);
+
+        if (strcspn(s, ".eE,]") == strcspn(s, ",]") && errno != ERANGE)
+        {
+            ok &= node->ntype == ((flags & LTJSON_PARSE_RAWNUM) ?
+                                  LTJSON_NTYPE_NUMRAW :
+                                  LTJSON_NTYPE_INTEGER);
+            ok &= ltjson_get_ll(node) == ll;
+        }
+        else
+        {
+            ok &= node->ntype == ((flags & LTJSON_PARSE_RAWNUM) ?
+                                  LTJSON_NTYPE_NUMRAW : LTJSON_NTYPE_FLOAT);
+            want = strtod(s, NULL);
+            d = ltjson_get_double(node);
+            ok &= memcmp(&d, &want, sizeof(d)) == 0;
+        }
+    }
+
+    ok &= !node && i == n;
+    ltjson_free(&tree);
+    return ok;
+}
+
+
+static void check_number(void)
+{
+    static const char *fixed[] = {
+        "0", "-0", "0.0", "-0.0", "1.5", "0.1", "-0.25", "1e22", "1e23",
+        "12345e25", "9007199254740992e3", "1921009885355449e23",
+        "3377645716544731e23", "2588997085368821e23", "9007199254740993",
+        "4.35", "9007199254740993.0", "123456789012345678e-5", "1E+2", "0e0",
+        "1.7976931348623157e308", "2.2250738585072011e-308",
+        "2.2250738585072014e-308", "4.9e-324", "2.4703282292062328e-324",
+        "2.4703282292062327e-324", "1e-400", "-1e-400", "1e-99999999",
+        "0e99999999", "0.0000001", "-9223372036854775808",
+        "9223372036854775807", "9223372036854775808", "-9223372036854775809",
+        "1234567890123456789", "9999999999999999999", "12345678901234567890",
+        "12345678901234567890123456789e-10", "0.000000000000000000001234",
+        "100000000000000000000000000000000000000000e-30", "-1e0",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124"
+    };
+    static const char half[] =      /* 1 + 2^-53, halfway to the next */
+        "1.00000000000000011102230246251565404236316680908203125";
+    static const char *bad[] = {
+        "1.", "-.5", ".5", "+1", "01", "-01", "00", "1e", "1e+", "1E-",
+        "-", "1.e5", "0x10", "1.5e3.2", "--1", "1-", "1e5e5", "1.5.",
+        "Infinity", "NaN", "-Infinity", "1e99999", "-1e309",
+        "17976931348623159e292"
+    };
+    char *text, *p, num[64];
+    int *offs, i, j, n, flags, ok;
+    unsigned long long bits = 2463534242ULL;
+    ltjson_node_t *tree = NULL;
+
+    text = p = malloc(1 << 20);
+    offs = malloc(25000 * sizeof(*offs));
+    if (!text || !offs)
+        exit(1);
+
+    /* The awkward ones, long ones past NUM_MAXSTRTOD digits (with and
+       without a digit deciding a tie) and random ones */
+
+    *p++ = '[';
+
+    for (n = 0; n < (int)(sizeof(fixed) / sizeof(*fixed)); n++)
+    {
+        offs[n] = (int)(p - text);
+        p += sprintf(p, "%s,", fixed[n]);
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        offs[n++] = (int)(p - text);
+        p += sprintf(p, "%s", (i & 2) ? "9" : half);
+
+        for (j = 0; j < 900; j++)
+            *p++ = '0';
+
+        p += sprintf(p, "%s%s,", (i & 1) ? "1" : "", (i & 2) ? "e-880" : "");
+    }
+
+    while (n < 24000)
+    {
+        bits ^= bits << 13;
+        bits ^= bits >> 7;
+        bits ^= bits << 17;
+
+        i = sprintf(num, "%s%llu", (bits & 1) ? "-" : "",
+                    (bits >> 8) % (bits & 2 ? 1000ULL : 100000000000000ULL));
+
+        if (bits & 4)
+            i += sprintf(num + i, ".%0*llu", (int)((bits >> 40) % 18) + 1,
+                         (bits >> 20) % 1000000000000000000ULL);
+
+        if (bits & 8)
+            i += sprintf(num + i, "e%d", (int)((bits >> 32) % 640) - 330);
+
+        if (strtod(num, NULL) - strtod(num, NULL) != 0)
+            continue;           /* Overflow */
+
+        offs[n++] = (int)(p - text);
+        p += sprintf(p, "%s,", num);
+    }
+
+    strcpy(p - 1, "]");
+
+    for (flags = 0; flags <= LTJSON_PARSE_RAWNUM; flags += LTJSON_PARSE_RAWNUM)
+    {
+        CHECK(numbers_agree(text, offs, n, flags));
+
+        /* What the JSON grammar doesn't allow, or a double can't hold */
+
+        for (i = 0, ok = 1; i < (int)(sizeof(bad) / sizeof(*bad)); i++)
+        {
+            sprintf(num, "[%s]", bad[i]);
+            ok &= !ltjson_parse(&tree, num, flags) && errno == EILSEQ;
+        }
+
+        CHECK(ok);
+    }
+
+    ltjson_free(&tree);
+    free(offs);
+    free(text);
+}
+
+
+static void check_rawnum(void)
+{
+    const char *texts[] = {"[1e999]", "[-2e308]", "[17976931348623159e292]"};
+    ltjson_node_t *tree = NULL, *node;
+    int i, raw;
+
+    for (raw = 0; raw < 2; raw++)
+    {
+        int flags = raw ? LTJSON_PARSE_RAWNUM : 0;
+
+        /* Too big for a double: the parse fails either way */
+
+        for (i = 0; i < 3; i++)
+        {
+            errno = 0;
+            CHECK(ltjson_parse(&tree, texts[i], flags) == 0 &&
+                  errno == EILSEQ);
+        }
+
+        CHECK(ltjson_parse(&tree, "[1.7976931348623157e308,1e-999,0e99999,"
+                           "1.5,12345678901234567890,-7]", flags) == 1);
+
+        node = tree->val.subnode;
+        CHECK(ltjson_get_double(node) == 1.7976931348623157e308);
+        CHECK(ltjson_get_double(node->next) == 0);
+        CHECK(ltjson_get_double(node->next->next) == 0);
+
+        node = node->next->next->next;
+        CHECK(ltjson_get_ll(node->next->next) == -7);
+
+        if (raw)
+        {
+            /* Not integers */
+
+            errno = 0;
+            CHECK(ltjson_get_ll(node) == 0 && errno == EDOM);
+            errno = 0;
+            CHECK(ltjson_get_ll(node->next) == 0 && errno == EDOM);
+        }
+    }
+
+    ltjson_free(&tree);
+}
+
+
+static void check_parallel(void)
+{
+    static const int flagsets[] = {0, LTJSON_PARSE_USEHASH,
+                                   LTJSON_PARSE_RAWNUM};
+    ltjson_node_t *tree = NULL, *ptree = NULL, *trees[5] = {0};
+    const char *texts[5];
+    char *big = record_text(2000), *small[3], *a, *b;
+    int errs[5], i, f;
+
+    CHECK(strlen(big) >= 128 * 1024);
+
+    for (i = 0; i < 3; i++)
+        small[i] = record_text(i * 40 + 1);
+
+    texts[0] = big;
+    texts[1] = small[0];
+    texts[2] = small[1];
+    texts[3] = "[1, 2";
+    texts[4] = small[2];
+
+    for (f = 0; f < 3; f++)
+    {
+        /* The big array is split between threads */
+
+        CHECK(ltjson_parse(&tree, big, flagsets[f]) == 1);
+        CHECK(ltjson_parse_parallel(&ptree, big, flagsets[f], 4) == 1);
+        a = tree_text(tree);
+        b = tree_text(ptree);
+        CHECK(strcmp(a, b) == 0);
+        free(a);
+        free(b);
+
+        /* Each text of a batch is as it would be on its own */
+
+        CHECK(ltjson_parse_batch(trees, texts, errs, 5,
+                                 flagsets[f], NULL, 3) >= 4);
+
+        for (i = 0; i < 5; i++)
+        {
+            if (i == 3)
+            {
+                CHECK(errs[i] != 0);
+                continue;
+            }
+
+            CHECK(errs[i] == 0);
+            CHECK(ltjson_parse(&tree, texts[i], flagsets[f]) == 1);
+            a = tree_text(tree);
+            b = tree_text(trees[i]);
+            CHECK(strcmp(a, b) == 0);
+            free(a);
+            free(b);
+        }
+    }
+
+    for (i = 0; i < 5; i++)
+        ltjson_free(&trees[i]);
+
+    for (i = 0; i < 3; i++)
+        free(small[i]);
+
+    ltjson_free(&ptree);
+    ltjson_free(&tree);
+    free(big);
+}
+
+
+/* Text of a tree from the next bytes of a stream, c at a time (free it) */
+
+static char *stream_text(ltjson_node_t **treeptr, const char **textp,
+                         size_t *lenp, size_t c, int flags)
+{
+    size_t n, used;
+    int ret;
+
+    do
+    {
+        n = *lenp < c ? *lenp : c;
+        ret = ltjson_parse_stream(treeptr, *textp, n, flags, &used);
+
+        if (!ret && errno != EAGAIN)
+            return NULL;
+
+        *textp += used;
+        *lenp -= used;
+    } while (!ret && *lenp > 0);
+
+    return ret ? tree_text(*treeptr) : NULL;
+}
+
+
+static void check_split(void)
+{
+    static const int flagsets[] = {0, LTJSON_PARSE_USEHASH,
+                                   LTJSON_PARSE_RAWNUM};
+    const char *doc = "{\"s\":\"a\\u00e9\\ud83d\\ude00\\\"x\\\\ y \xc3\xa9\","
+                      " \"n\": [0, -1, 12.5e-3, 1E+2, -0.0, 123456789012],"
+                      "\"l\":[true,false,null], \"e\":[],\"o\":{\"\":{}}}";
+    ltjson_node_t *tree = NULL;
+    ltjson_iovec_t iov[2], *bytes;
+    char *recs = record_text(3), *stream, *want[2], *got;
+    const char *text;
+    size_t len, slen, i, c;
+    int f, ok;
+
+    len = strlen(doc);
+    slen = len + strlen(recs) + 1;
+    stream = malloc(slen + 1);
+    bytes = malloc(len * sizeof(*bytes));
+    if (!stream || !bytes)
+        exit(1);
+
+    sprintf(stream, "%s\n%s", doc, recs);
+
+    for (i = 0; i < len; i++)
+    {
+        bytes[i].base = doc + i;
+        bytes[i].len = 1;
+    }
+
+    for (f = 0; f < 3; f++)
+    {
+        CHECK(ltjson_parse(&tree, doc, flagsets[f]) == 1);
+        want[0] = tree_text(tree);
+        CHECK(ltjson_parse(&tree, recs, flagsets[f]) == 1);
+        want[1] = tree_text(tree);
+
+        /* Two buffers split at every byte, then a buffer per byte */
+
+        for (i = 0, ok = 1; i <= len; i++)
+        {
+            iov[0].base = doc;
+            iov[0].len = i;
+            iov[1].base = doc + i;
+            iov[1].len = len - i;
+
+            if (ltjson_parsev(&tree, iov, 2, flagsets[f]) != 1)
+                ok = 0;
+            else
+            {
+                got = tree_text(tree);
+                ok &= strcmp(got, want[0]) == 0;
+                free(got);
+            }
+        }
+
+        CHECK(ok);
+        CHECK(ltjson_parsev(&tree, bytes, (int)len, flagsets[f]) == 1);
+        got = tree_text(tree);
+        CHECK(strcmp(got, want[0]) == 0);
+        free(got);
+
+        /* Two trees of a stream read in chunks of every size */
+
+        for (c = 1, ok = 1; c <= slen; c++)
+        {
+            text = stream;
+            len = slen;
+
+            for (i = 0; i < 2; i++)
+            {
+                got = stream_text(&tree, &text, &len, c, flagsets[f]);
+                ok &= got && strcmp(got, want[i]) == 0;
+                free(got);
+            }
+
+            ok &= len == 0;
+        }
+
+        CHECK(ok);
+        len = strlen(doc);
+        free(want[0]);
+        free(want[1]);
+    }
+
+    ltjson_free(&tree);
+    free(bytes);
+    free(stream);
+    free(recs);
+}
+
+
+/* The "i" members of the entries of an array, in order, as text */
+
+static const char *entry_ids(ltjson_node_t *array)
+{
+    static char ids[256];
+    ltjson_node_t *node;
+    char *p = ids;
+
+    for (node = array->val.subnode; node; node = node->next)
+        p += sprintf(p, "%lld ",
+                     ltjson_get_ll(ltjson_get_member(node, "i", 0)));
+
+    return ids;
+}
+
+
+/* Pool stats: the idle trees and then the counts, as from
+   ltjson_pool_memstat */
+
+#define PSTAT_IDLE      LTJSON_MEMSTATS
+#define PSTAT_REUSED    (LTJSON_MEMSTATS + 1)
+#define PSTAT_MADE      (LTJSON_MEMSTATS + 2)
+#define PSTAT_TRIMMED   (LTJSON_MEMSTATS + 3)
+#define PSTAT_FREED     (LTJSON_MEMSTATS + 4)
+
+
+static void check_pool(void)
+{
+    static const ltjson_sax_t sax = {ev_bobj};
+    static struct evlog log;
+    ltjson_pool_t *pool;
+    ltjson_node_t *copy = NULL, *a, *b, *c, *tree;
+    ltjson_alloc_t alloc = {live_alloc, live_resize, live_release, NULL};
+    char *text = record_text(200);
+    int stats[LTJSON_POOLSTATS + 2], tstats[LTJSON_MEMSTATS], live = 0;
+
+    CHECK(ltjson_parse(&copy, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(ltjson_pool_new(0, 0) == NULL && errno == EINVAL);
+    CHECK((pool = ltjson_pool_new(2, 0)) != NULL);
+
+    /* Acquired trees are new until some are released */
+
+    a = ltjson_pool_acquire(pool);
+    b = ltjson_pool_acquire(pool);
+    c = ltjson_pool_acquire(pool);
+    CHECK(a && b && c && a != b && b != c && a != c);
+    CHECK(ltjson_parse(&a, text, LTJSON_PARSE_USEHASH) == 1);
+
+    CHECK(ltjson_pool_release(pool, &a) == 1 && a == NULL);
+    CHECK(ltjson_pool_release(pool, &b) == 1);
+    CHECK(ltjson_pool_release(pool, &c) == 1);
+    CHECK(ltjson_pool_memstat(pool, stats, LTJSON_POOLSTATS + 2) ==
+          LTJSON_POOLSTATS);
+    CHECK(stats[PSTAT_IDLE] == 2 && stats[PSTAT_REUSED] == 0 &&
+          stats[PSTAT_MADE] == 3 && stats[PSTAT_TRIMMED] == 0 &&
+          stats[PSTAT_FREED] == 1 && stats[0] > 0);
+
+    /* A reused tree is closed and empty, and keeps no callbacks */
+
+    a = ltjson_pool_acquire(pool);
+    log.stopat = -1;
+    CHECK(ltjson_setsax(&a, &sax, &log) == 1);
+    CHECK(ltjson_parse(&a, "[{", 0) == 0 && errno == EAGAIN);
+    CHECK(ltjson_pool_release(pool, &a) == 1);
+
+    a = ltjson_pool_acquire(pool);
+    b = ltjson_pool_acquire(pool);
+    CHECK(a && b && a != b);
+    CHECK(ltjson_parse(&a, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(same_tree(a, copy));
+    CHECK(ltjson_parse(&b, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(same_tree(b, copy));
+
+    CHECK(ltjson_pool_memstat(pool, stats, LTJSON_POOLSTATS) ==
+          LTJSON_POOLSTATS);
+    CHECK(stats[PSTAT_IDLE] == 0 && stats[PSTAT_REUSED] == 3 &&
+          stats[0] == 0);
+
+    /* A tree with its own allocator isn't kept */
+
+    tree = NULL;
+    alloc.ctx = &live;
+    CHECK(ltjson_setalloc(&tree, &alloc) == 1);
+    CHECK(ltjson_pool_release(pool, &tree) == 1 && live == 0);
+    ltjson_pool_memstat(pool, stats, LTJSON_POOLSTATS);
+    CHECK(stats[PSTAT_FREED] == 2 && stats[PSTAT_IDLE] == 0);
+
+    CHECK(ltjson_pool_release(NULL, &a) == 0 && errno == EINVAL);
+    CHECK(ltjson_pool_release(pool, &tree) == 0 && errno == EINVAL);
+    CHECK(ltjson_pool_memstat(pool, stats, 0) == 0 && errno == EINVAL);
+    CHECK(ltjson_pool_free(&pool) == 1 && pool == NULL);
+    CHECK(ltjson_pool_free(&pool) == 0 && errno == EINVAL);
+
+    /* Released trees are trimmed to the pool's limit */
+
+    CHECK((pool = ltjson_pool_new(2, 4096)) != NULL);
+    CHECK(ltjson_memstat(a, tstats, LTJSON_MEMSTATS) == LTJSON_MEMSTATS &&
+          tstats[0] > 4096);
+    CHECK(ltjson_pool_release(pool, &a) == 1);
+    CHECK(ltjson_pool_release(pool, &b) == 1);
+
+    ltjson_pool_memstat(pool, stats, LTJSON_POOLSTATS);
+    CHECK(stats[PSTAT_IDLE] == 2 && stats[PSTAT_TRIMMED] == 2);
+    CHECK(stats[0] <= 2 * 4096);
+
+    a = ltjson_pool_acquire(pool);
+    CHECK(ltjson_parse(&a, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(same_tree(a, copy));
+    ltjson_free(&a);
+
+    CHECK(ltjson_pool_free(&pool) == 1);
+    ltjson_free(&copy);
+    free(text);
+}
+
+
+/* Write len bytes of text to the file at path */
+
+static void write_file(const char *path, const char *text, size_t len)
+{
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp || fwrite(text, 1, len, fp) != len || fclose(fp) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+
+static void check_file(void)
+{
+    static const int flagsets[] = {0, LTJSON_PARSE_USEHASH,
+                                   LTJSON_PARSE_INSITU};
+    static const char path[] = "ltjson_check.tmp";
+    ltjson_node_t *tree = NULL, *ftree = NULL;
+    char *text = record_text(100), page[4096], *a, *b;
+    FILE *fp;
+    size_t len = strlen(text);
+    int f;
+
+    CHECK(ltjson_parse_file(&ftree, "no/such/file.json", 0) == 0 &&
+          errno == ENOENT);
+    CHECK(ltjson_parse_file(&ftree, ".", 0) == 0 && errno == EINVAL);
+
+    /* The same tree as ltjson_parse makes of the text */
+
+    write_file(path, text, len);
+
+    for (f = 0; f < 3; f++)
+    {
+        CHECK(ltjson_parse(&tree, text, flagsets[f] &
+                           ~LTJSON_PARSE_INSITU) == 1);
+        CHECK(ltjson_parse_file(&ftree, path, flagsets[f]) == 1);
+        a = tree_text(tree);
+        b = tree_text(ftree);
+        CHECK(strcmp(a, b) == 0);
+        free(a);
+        free(b);
+    }
+
+    /* INSITU leaves the file as it was */
+
+    ltjson_free(&ftree);
+    CHECK((fp = fopen(path, "rb")) != NULL);
+    a = malloc(len + 1);
+    CHECK(a && fread(a, 1, len + 1, fp) == len && memcmp(a, text, len) == 0);
+    fclose(fp);
+    free(a);
+
+    /* A file that fills its pages exactly has no terminator after it */
+
+    memset(page, ' ', sizeof(page));
+    memcpy(page + sizeof(page) - 7, "[1,\"x\"]", 7);
+    write_file(path, page, sizeof(page));
+    CHECK(ltjson_parse_file(&ftree, path, 0) == 1);
+    CHECK(ltjson_print(ftree, page, sizeof(page), 0) == 7);
+    CHECK(strcmp(page, "[1,\"x\"]") == 0);
+
+    /* An empty file leaves the tree as it is, an incomplete one not */
+
+    write_file(path, " \n", 2);
+    CHECK(ltjson_parse_file(&ftree, path, 0) == 0 && errno == EAGAIN);
+    CHECK(ltjson_print(ftree, page, sizeof(page), 0) == 7);
+    write_file(path, "", 0);
+    CHECK(ltjson_parse_file(&ftree, path, 0) == 0 && errno == EAGAIN);
+    CHECK(ltjson_print(ftree, page, sizeof(page), 0) == 7);
+
+    write_file(path, "[1,2", 4);
+    CHECK(ltjson_parse_file(&ftree, path, 0) == 0 && errno == EAGAIN);
+    CHECK(ltjson_print(ftree, page, sizeof(page), 0) == 0);
+    CHECK(ltjson_parse_file(&ftree, path, 0) == 0 && errno == EAGAIN);
+
+    CHECK(ltjson_parse(&ftree, "[1,", 0) == 0 && errno == EAGAIN);
+    CHECK(ltjson_parse_file(&ftree, path, 0) == 0 && errno == EBUSY);
+
+    remove(path);
+    ltjson_free(&ftree);
+    ltjson_free(&tree);
+    free(text);
+}
+
+
+#ifdef LTJSON_COUNTERS
+
+/* Nodes under node (as the counters count the nodes of a tree) */
+
+static int count_nodes(ltjson_node_t *node)
+{
+    ltjson_node_t *sub;
+    int n = 0;
+
+    if (node->ntype == LTJSON_NTYPE_OBJECT ||
+        node->ntype == LTJSON_NTYPE_ARRAY)
+        for (sub = node->val.subnode; sub; sub = sub->next)
+            n += 1 + count_nodes(sub);
+
+    return n;
+}
+
+#endif
+
+
+static void check_counters(void)
+{
+    ltjson_node_t *tree = NULL, *nodes[4];
+    ltjson_counters_t c;
+    char *text = record_text(20), *big = record_text(2000), *part;
+    size_t len = strlen(text), cut = strchr(text + 40, '\\') - text;
+    int nnodes;
+
+#ifndef LTJSON_COUNTERS
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+    memset(&c, 0xFF, sizeof(c));
+    CHECK(ltjson_getcounters(tree, &c, 0) == 0 && errno == ENOSYS);
+    CHECK(c.nparses == 0 && c.nodes == 0);
+    (void)nodes, (void)part, (void)cut, (void)len, (void)nnodes;
+#else
+    CHECK(ltjson_getcounters(NULL, &c, 0) == 0 && errno == EINVAL);
+
+    /* One parse of a new tree */
+
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+    nnodes = count_nodes(tree);
+    CHECK(ltjson_getcounters(tree, &c, 1) == 1);
+    CHECK(c.nparses == 1 && c.bytes == len && c.nodes == (unsigned)nnodes);
+    CHECK(c.nodesets > 0 && c.nodereuses == 0 && c.sstorechain > 0);
+    CHECK(c.resumes == 0 && c.nsearches == 0 && c.npathrefers == 0);
+
+    /* Recycled (once to learn its size), then split inside an escape:
+       the same again, in two parses */
+
+    if ((part = malloc(cut + 1)) == NULL)
+        exit(1);
+
+    memcpy(part, text, cut);
+    part[cut] = '\0';
+
+    CHECK(ltjson_parse(&tree, text, 0) == 1);
+    CHECK(ltjson_getcounters(tree, &c, 1) == 1);
+    CHECK(c.nodesets + c.nodereuses > 0);
+
+    CHECK(!ltjson_parse(&tree, part, 0) && errno == EAGAIN);
+    CHECK(ltjson_parse(&tree, text + cut, 0) == 1);
+    CHECK(ltjson_getcounters(tree, &c, 0) == 1);
+    CHECK(c.nparses == 2 && c.bytes == len && c.nodes == (unsigned)nnodes);
+    CHECK(c.nodesets == 0 && c.nodereuses > 0 && c.resumes == 1);
+    free(part);
+
+    /* Searches count too, and the counters add up until reset */
+
+    CHECK(ltjson_search(tree, "name", NULL, 0) != NULL);
+    CHECK(ltjson_pathrefer(tree, "/[]/id", nodes, 4) == 20);
+    CHECK(ltjson_pathrefer(tree, "/[3]/id", nodes, 4) == 1);
+    CHECK(ltjson_getcounters(tree, &c, 1) == 1);
+    CHECK(c.nparses == 2 && c.nsearches == 1 && c.npathrefers == 2);
+    CHECK(ltjson_getcounters(tree, &c, 0) == 1);
+    CHECK(c.nparses == 0 && c.bytes == 0 && c.nodes == 0 &&
+          c.npathrefers == 0 && c.sstorechain > 0);
+
+    /* A parallel parse counts the work of its parts as its own */
+
+    CHECK(ltjson_parse(&tree, big, LTJSON_PARSE_USEHASH) == 1);
+    nnodes = count_nodes(tree);
+    CHECK(ltjson_getcounters(tree, &c, 1) == 1);
+    CHECK(c.nparses == 1 && c.nodes == (unsigned)nnodes);
+
+    CHECK(ltjson_parse_parallel(&tree, big, LTJSON_PARSE_USEHASH, 4) == 1);
+    CHECK(ltjson_getcounters(tree, &c, 1) == 1);
+    CHECK(c.nparses == 1 && c.bytes == strlen(big));
+    CHECK(c.nodes == (unsigned)nnodes);
+#endif
+
+    ltjson_free(&tree);
+    free(big);
+    free(text);
+}
+
+
+/* A malloc'd copy of the n bytes at text with nothing after them, so
+   that any read past them is caught by a memory checker (free it) */
+
+static char *exact_copy(const char *text, size_t n)
+{
+    char *copy = malloc(n ? n : 1);
+
+    if (!copy)
+        exit(1);
+
+    return memcpy(copy, text, n);
+}
+
+
+/* Parse n bytes of text from an exact copy: is the tree the same as
+   a parse of check, or if check is NULL, is the text EILSEQ? */
+
+static int parsen_gives(const char *text, size_t n, int flags,
+                        const char *check)
+{
+    ltjson_node_t *tree = NULL, *copy = NULL;
+    char *buf = exact_copy(text, n);
+    int ret = ltjson_parsen(&tree, buf, n, flags), err = errno;
+
+    if (check)
+        ret = ret && ltjson_parse(&copy, check, 0) == 1 &&
+              same_tree(tree, copy);
+    else
+        ret = !ret && err == EILSEQ;
+
+    ltjson_free(&copy);
+    ltjson_free(&tree);
+    free(buf);
+    return ret;
+}
+
+
+static void check_parsen(void)
+{
+    static const int flagsets[] = {0, LTJSON_PARSE_USEHASH,
+                                   LTJSON_PARSE_INSITU};
+    static const char *tokens[][2] = {
+        {"[12", "34]"}, {"[-1.5e", "-3]"}, {"[0", ".25]"}, {"[tr", "ue]"},
+        {"[nul", "l]"}, {"[\"a\\u00", "e9\"]"}, {"[\"a\\", "n\"]"},
+        {"[\"\xc3", "\xa9\"]"}, {"{\"na", "me\":{}}"}, {"{\"a\"", ":1}"}
+    };
+    const char *doc = "{\"s\":\"a\\u00e9\\\"x\\\\ y \xc3\xa9\", \"t\":\"\","
+                      " \"n\": [0, -1, 12.5e-3, 1E+2, -0.0, 123456789012],"
+                      "\"l\":[true,false,null], \"e\":[],\"o\":{\"\":{}}}";
+    ltjson_node_t *tree = NULL, *want = NULL;
+    char joined[32], *a, *b;
+    size_t len = strlen(doc), i;
+    int f, ok;
+
+    /* Cut at every byte into exact buffers, the first ending without a
+       null (the whole text when the cut is at the end) */
+
+    CHECK(ltjson_parse(&want, doc, 0) == 1);
+
+    for (f = 0; f < 3; f++)
+    {
+        for (i = 0, ok = 1; i <= len; i++)
+        {
+            a = exact_copy(doc, i);
+            b = exact_copy(doc + i, len - i);
+
+            if (i < len)
+                ok &= !ltjson_parsen(&tree, a, i, flagsets[f]) &&
+                      errno == EAGAIN &&
+                      ltjson_parsen(&tree, b, len - i, flagsets[f]) == 1;
+            else
+                ok &= ltjson_parsen(&tree, a, i, flagsets[f]) == 1;
+
+            ok &= same_tree(tree, want);
+            ltjson_free(&tree);
+            free(a);
+            free(b);
+        }
+
+        CHECK(ok);
+    }
+
+    /* A length that cuts a token waits for the rest of it */
+
+    for (i = 0, ok = 1; i < sizeof(tokens) / sizeof(tokens[0]); i++)
+    {
+        sprintf(joined, "%s%s", tokens[i][0], tokens[i][1]);
+        CHECK(ltjson_parse(&want, joined, 0) == 1);
+
+        ok &= !ltjson_parsen(&tree, tokens[i][0], strlen(tokens[i][0]), 0) &&
+              errno == EAGAIN;
+        ok &= ltjson_parsen(&tree, tokens[i][1], strlen(tokens[i][1]), 0) == 1;
+        ok &= same_tree(tree, want);
+        ltjson_free(&tree);
+    }
+
+    CHECK(ok);
+
+    /* Embedded nulls: not JSON outside a string, the end of one inside
+       it (in a name too, and after a cut), and not read past the tree */
+
+    for (f = 0; f < 3; f++)
+    {
+        CHECK(parsen_gives("[\"ab\0cd\"]", 9, flagsets[f], "[\"ab\"]"));
+        CHECK(parsen_gives("{\"a\0b\":1}", 9, flagsets[f], "{\"a\":1}"));
+        CHECK(parsen_gives("[1,\0 2]", 7, flagsets[f], NULL));
+        CHECK(parsen_gives("\0[1]", 4, flagsets[f], NULL));
+        CHECK(parsen_gives("[1]\0x", 5, flagsets[f], "[1]"));
+    }
+
+    CHECK(!ltjson_parsen(&tree, "[1]", 0, 0) && errno == EAGAIN);
+    ltjson_free(&tree);
+    CHECK(!ltjson_parsen(&tree, "[\"a\0b\\u00", 9, 0) && errno == EAGAIN);
+    CHECK(ltjson_parsen(&tree, "e9\"]", 4, 0) == 1);
+    CHECK(strcmp(tree->val.subnode->val.s, "a") == 0);
+
+    ltjson_free(&want);
+    ltjson_free(&tree);
+}
+
+
+static void check_sortby(void)
+{
+    ltjson_node_t *tree = NULL;
+
+    CHECK(ltjson_parse(&tree, "[{\"k\":0.0,\"i\":0},{\"k\":-0.0,\"i\":1},"
+                       "{\"k\":0,\"i\":2},{\"k\":-0,\"i\":3},"
+                       "{\"k\":1.5,\"i\":4},{\"k\":\"b\",\"i\":5},"
+                       "{\"i\":6},{\"k\":-1,\"i\":7},{\"k\":\"a\",\"i\":8},"
+                       "{\"k\":-0.0,\"i\":9},{\"k\":\"b\",\"i\":10}]",
+                       0) == 1);
+
+    /* Equal keys (the zeros, the "b"s) keep their order either way */
+
+    CHECK(ltjson_sortby(tree, NULL, "k", 0) == 1);
+    CHECK(strcmp(entry_ids(tree), "7 0 1 2 3 9 4 8 5 10 6 ") == 0);
+
+    CHECK(ltjson_sortby(tree, NULL, "k", LTJSON_SORT_DESCENDING) == 1);
+    CHECK(strcmp(entry_ids(tree), "4 0 1 2 3 9 7 5 10 8 6 ") == 0);
+
+    /* All integers (-0 is one) */
+
+    CHECK(ltjson_parse(&tree, "[{\"k\":0,\"i\":0},{\"k\":-0,\"i\":1},"
+                       "{\"k\":-5,\"i\":2},{\"k\":0,\"i\":3}]", 0) == 1);
+    CHECK(ltjson_sortby(tree, NULL, "k", 0) == 1);
+    CHECK(strcmp(entry_ids(tree), "2 0 1 3 ") == 0);
+
+    ltjson_free(&tree);
+}
+
+
+/* The node after node in document order within root, or NULL */
+
+static ltjson_node_t *next_in(ltjson_node_t *node, ltjson_node_t *root)
+{
+    if ((node->ntype == LTJSON_NTYPE_OBJECT ||
+         node->ntype == LTJSON_NTYPE_ARRAY) && node->val.subnode)
+        return node->val.subnode;
+
+    for (; node != root; node = node->ancnode)
+    {
+        if (node->next)
+            return node->next;
+    }
+
+    return NULL;
+}
+
+
+/* Is node in the n nodes at nodes? */
+
+static int in_nodes(const ltjson_node_t *node, ltjson_node_t **nodes, int n)
+{
+    while (n-- > 0)
+    {
+        if (nodes[n] == node)
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/* Does ltjson_searchm of names under rnode find what calls of
+   ltjson_search for one name at a time do, in document order (and
+   without matches under matches if skipping)? It must count them all
+   when it has room for only a few */
+
+static int searchm_agrees(ltjson_node_t *rnode, const char **names,
+                          int nnames, int flags)
+{
+    static ltjson_node_t *found[4096], *want[4096], *got[4096];
+    ltjson_node_t *node, *up;
+    int nfound, nwant, ngot, i;
+
+    for (nfound = i = 0; i < nnames; i++)
+    {
+        node = NULL;
+
+        while ((node = ltjson_search(rnode, names[i], node,
+                                     flags & LTJSON_SEARCH_NAMEISHASH)))
+            found[nfound++] = node;
+    }
+
+    for (nwant = 0, node = next_in(rnode, rnode); node;
+         node = next_in(node, rnode))
+    {
+        if (!in_nodes(node, found, nfound))
+            continue;
+
+        for (up = node->ancnode; up != rnode; up = up->ancnode)
+        {
+            if ((flags & LTJSON_SEARCH_SKIPMATCHED) &&
+                in_nodes(up, found, nfound))
+                break;
+        }
+
+        if (up == rnode)
+            want[nwant++] = node;
+    }
+
+    ngot = ltjson_searchm(rnode, names, nnames, got, 4096, flags);
+    if (ngot != nwant || (!ngot && errno != 0))
+        return 0;
+
+    for (i = 0; i < ngot; i++)
+    {
+        if (got[i] != want[i])
+            return 0;
+    }
+
+    got[2] = NULL;
+    return ltjson_searchm(rnode, names, nnames, got, 2, flags) == nwant &&
+           (nwant < 2 || (got[0] == want[0] && got[1] == want[1])) &&
+           got[2] == NULL;
+}
+
+
+/* Do the name sets below agree under the tree, its second record and
+   that record's "o", with and without skipping? */
+
+static int searchm_all_agree(ltjson_node_t *tree)
+{
+    static const char *sets[][3] = {
+        {"id", NULL}, {"x", "y", NULL}, {"o", "x", "y"}, {"t", "w", "id"},
+        {"name", "name", NULL}, {"", "nope", NULL}, {"e", "o", NULL}
+    };
+    ltjson_node_t *rnodes[3];
+    int s, r, n, ok = 1;
+
+    rnodes[0] = tree;
+    rnodes[1] = tree->val.subnode->next;
+    rnodes[2] = ltjson_get_member(rnodes[1], "o", 0);
+
+    for (s = 0; s < (int)(sizeof(sets) / sizeof(sets[0])); s++)
+    {
+        for (n = 0; n < 3 && sets[s][n]; n++)
+            ;
+
+        for (r = 0; r < 3; r++)
+        {
+            ok &= searchm_agrees(rnodes[r], sets[s], n, 0);
+            ok &= searchm_agrees(rnodes[r], sets[s], n,
+                                 LTJSON_SEARCH_SKIPMATCHED);
+        }
+    }
+
+    return ok;
+}
+
+
+/* Records by descending "id", for ltjson_sort */
+
+static int id_desc(ltjson_node_t *a, ltjson_node_t *b,
+                   ltjson_node_t *tree, void *extra)
+{
+    long long ia = ltjson_get_ll(ltjson_get_member(a, "id", 0));
+    long long ib = ltjson_get_ll(ltjson_get_member(b, "id", 0));
+
+    return ia < ib ? 1 : ia > ib ? -1 : 0;
+}
+
+
+static void check_searchm(void)
+{
+    static ltjson_node_t *paths[512], *nodes[512];
+    const char *hashed[2];
+    ltjson_node_t *tree = NULL, *copy = NULL, *node;
+    char *text = record_text(100);
+    int n;
+
+    /* Walked, then from the name index, with names as given and as
+       from the hash table */
+
+    CHECK(ltjson_parse(&tree, text, LTJSON_PARSE_USEHASH) == 1);
+    CHECK(searchm_all_agree(tree));
+    CHECK(ltjson_nameindex(tree) == 1);
+    CHECK(searchm_all_agree(tree));
+
+    hashed[0] = ltjson_get_hashstring(tree, "y");
+    hashed[1] = ltjson_get_hashstring(tree, "id");
+    CHECK(hashed[0] && hashed[1]);
+    CHECK(searchm_agrees(tree, hashed, 2, LTJSON_SEARCH_NAMEISHASH));
+
+    /* The same nodes as a path to them */
+
+    n = ltjson_pathrefer(tree, "/[]/o/x[1]/y", paths, 512);
+    CHECK(n == 100);
+    CHECK(ltjson_searchm(tree, hashed, 1, nodes, 512,
+                         LTJSON_SEARCH_NAMEISHASH) == n);
+    CHECK(memcmp(paths, nodes, n * sizeof(*nodes)) == 0);
+
+    n = ltjson_pathrefer(tree, "/[]/id", paths, 512);
+    CHECK(n == 100);
+    CHECK(ltjson_searchm(tree, hashed + 1, 1, nodes, 512, 0) == n);
+    CHECK(memcmp(paths, nodes, n * sizeof(*nodes)) == 0);
+
+    /* Each edit drops the index, so the walk finds the tree as it now
+       is, and indexing it again agrees */
+
+    node = ltjson_addnode_under(tree, tree->val.subnode->next,
+                                LTJSON_NTYPE_STRING, "x", "new");
+    CHECK(node && searchm_all_agree(tree));
+    CHECK(ltjson_nameindex(tree) == 1 && searchm_all_agree(tree));
+
+    CHECK(ltjson_detach(tree, tree->val.subnode->next) == 1);
+    CHECK(searchm_all_agree(tree));
+    CHECK(ltjson_nameindex(tree) == 1 && searchm_all_agree(tree));
+
+    CHECK(ltjson_sort(tree, id_desc, NULL) == 1);
+    CHECK(searchm_all_agree(tree));
+    CHECK(ltjson_nameindex(tree) == 1 && searchm_all_agree(tree));
+
+    CHECK(ltjson_promote(tree, "w") == 1);
+    CHECK(searchm_all_agree(tree));
+    CHECK(ltjson_nameindex(tree) == 1 && searchm_all_agree(tree));
+
+    CHECK(ltjson_parse(&copy, "{\"o\":{\"x\":[{\"y\":1}]},\"id\":-1}", 0));
+    CHECK(ltjson_graft(tree, tree->val.subnode, copy, "o") != NULL);
+    CHECK(searchm_all_agree(tree));
+    CHECK(ltjson_nameindex(tree) == 1 && searchm_all_agree(tree));
+
+    CHECK(ltjson_compact(tree) == 1);
+    CHECK(searchm_all_agree(tree));
+
+    ltjson_free(&copy);
+    ltjson_free(&tree);
+    free(text);
+}
+
+
+static void check_reserve(void)
+{
+    ltjson_alloc_t alloc;
+    ltjson_cursor_t cur;
+    ltjson_node_t *tree;
+    char name[16], value[16];
+    int hashed, i, nallocs, before;
+    size_t nbytes;
+
+    alloc.alloc = count_alloc;
+    alloc.resize = count_resize;
+    alloc.release = count_release;
+    alloc.ctx = &nallocs;
+
+    for (hashed = 0; hashed < 2; hashed++)
+    {
+        /* Names are new to an unhashed tree, in the hash of a hashed one */
+
+        tree = NULL;
+        nallocs = 0;
+
+        CHECK(ltjson_setalloc(&tree, &alloc) == 1);
+        CHECK(ltjson_parse(&tree, "{\"m0\":0,\"m1\":1,\"m2\":2}",
+                           hashed ? LTJSON_PARSE_USEHASH : 0) == 1);
+
+        for (nbytes = 0, i = 0; i < 300; i++)
+        {
+            sprintf(name, "m%d", i % 3);
+            sprintf(value, "v%d", i);
+            nbytes += (hashed ? 0 : strlen(name) + 1) + strlen(value) + 1;
+        }
+
+        CHECK(ltjson_reserve(tree, 301, nbytes + (hashed ? 0 : 3)) == 1);
+        before = nallocs;
+
+        CHECK(ltjson_cursor_init(&cur, tree, NULL, 0) == 1);
+        CHECK(ltjson_cursor_open(&cur, LTJSON_NTYPE_OBJECT, "m0") != NULL);
+
+        for (i = 0; i < 300; i++)
+        {
+            sprintf(name, "m%d", i % 3);
+            sprintf(value, "v%d", i);
+            CHECK(ltjson_cursor_addstring(&cur, name, value) != NULL);
+        }
+
+        CHECK(ltjson_cursor_close(&cur) == 1);
+        CHECK(nallocs == before);
+
+        ltjson_free(&tree);
+    }
+
+    /* Elements have no names */
+
+    tree = NULL;
+    CHECK(ltjson_parse(&tree, "[]", 0) == 1);
+    CHECK(ltjson_cursor_init(&cur, tree, NULL, 0) == 1);
+
+    errno = 0;
+    CHECK(ltjson_cursor_addll(&cur, "x", 1) == NULL && errno == EINVAL);
+    errno = 0;
+    CHECK(ltjson_cursor_addstring(&cur, "x", "s") == NULL && errno == EINVAL);
+    CHECK(ltjson_cursor_addll(&cur, NULL, 1) != NULL);
+    CHECK(ltjson_print(tree, value, sizeof(value), 0) > 0 &&
+          strcmp(value, "[1]") == 0);
+
+    ltjson_free(&tree);
+}
+
+
+static void check_clone(void)
+{
+    ltjson_node_t *tree = NULL, *copy = NULL, *node, *k5;
+    char *text = wide_object(40);
+
+    CHECK(ltjson_parse(&tree, text, LTJSON_PARSE_MEMBERINDEX) == 1);
+
+    /* A walk past MINDEX_MIN_MEMBERS indexes the object */
+
+    CHECK(ltjson_get_ll(ltjson_get_member(tree, "k39", 0)) == 39);
+
+    k5 = ltjson_get_member(tree, "k5", 0);
+    CHECK(k5 && ltjson_detach(tree, k5) == 1);
+
+    /* The first lookup walks (and indexes again), the second doesn't */
+
+    CHECK(ltjson_get_member(tree, "k5", 0) == NULL);
+    CHECK(ltjson_get_member(tree, "k5", 0) == NULL);
+    CHECK(ltjson_get_member(tree, "k39", 0) != NULL);
+
+    node = ltjson_addnode_under(tree, tree, LTJSON_NTYPE_STRING, "k5", "new");
+    CHECK(node && ltjson_get_member(tree, "k5", 0) == node);
+    CHECK(ltjson_get_member(tree, "k39", 0) != NULL);
+    CHECK(ltjson_get_member(tree, "k5", 0) == node);
+
+    /* Graft a duplicate name: the first member keeps it */
+
+    node = ltjson_graft(tree, tree, k5, "k6");
+    CHECK(node && ltjson_get_member(tree, "k6", 0) != node);
+    CHECK(ltjson_get_ll(ltjson_get_member(tree, "k6", 0)) == 6);
+
+    /* Graft the detached node back under its own name */
+
+    CHECK(ltjson_detach(tree, ltjson_get_member(tree, "k5", 0)) == 1);
+    node = ltjson_graft(tree, tree, k5, NULL);
+    CHECK(node && ltjson_get_member(tree, "k5", 0) == node);
+    CHECK(ltjson_get_ll(node) == 5);
+
+    CHECK(ltjson_clone(&copy, tree, LTJSON_PARSE_MEMBERINDEX) == 1);
+    CHECK(same_tree(tree, copy));
+    CHECK(ltjson_get_ll(ltjson_get_member(copy, "k39", 0)) == 39);
+    CHECK(ltjson_get_ll(ltjson_get_member(copy, "k5", 0)) == 5);
+    CHECK(ltjson_get_member(copy, "k40", 0) == NULL);
+
+    ltjson_free(&copy);
+    ltjson_free(&tree);
+    free(text);
+}
+
+
+static void check_compact(void)
+{
+    const int flagset[] = {0, LTJSON_PARSE_USEHASH,
+                           LTJSON_PARSE_INSITU | LTJSON_PARSE_RAWNUM,
+                           LTJSON_PARSE_USEHASH | LTJSON_PARSE_MEMBERINDEX};
+    ltjson_node_t *tree;
+    ltjson_alloc_t alloc;
+    char *text, *before, *after, *p;
+    int f, i, ret, left;
+
+    alloc.alloc = fail_alloc;
+    alloc.resize = fail_resize;
+    alloc.release = fail_release;
+    alloc.ctx = &left;
+
+    text = malloc(64 * 500 + 16);
+    if (!text)
+        exit(1);
+
+    for (f = 0; f < 4; f++)
+    {
+        p = text + sprintf(text, "[");
+
+        for (i = 0; i < 500; i++)
+            p += sprintf(p, "%s{\"id\":%d,\"name\":\"n%d\",\"t\":[%d.5,"
+                         "\"a\\u00e9\"],\"w\":%s}", i ? "," : "", i,
+                         i % 7, i, i % 3 ? "null" : "true");
+
+        strcpy(p, "]");
+
+        tree = NULL;
+        left = -1;
+
+        CHECK(ltjson_setalloc(&tree, &alloc) == 1);
+        CHECK(ltjson_parse(&tree, text, flagset[f]) == 1);
+        CHECK(ltjson_nameindex(tree) == 1);
+        before = tree_text(tree);
+
+        /* Running out of memory at each allocation in turn leaves the
+           tree as it was, until there is enough */
+
+        for (i = 0, ret = 0; !ret; i++)
+        {
+            left = i;
+            ret = ltjson_compact(tree);
+            left = -1;
+
+            CHECK(ret || errno == ENOMEM);
+
+            after = tree_text(tree);
+            CHECK(strcmp(before, after) == 0);
+            free(after);
+        }
+
+        /* No use of the text after (an in situ parse's included) */
+
+        memset(text, '#', strlen(text));
+
+        after = tree_text(tree);
+        CHECK(strcmp(before, after) == 0);
+        free(after);
+
+        CHECK(ltjson_get_ll(ltjson_get_member(tree->val.subnode->next,
+                                              "id", 0)) == 1);
+
+        ltjson_free(&tree);
+        free(before);
+    }
+
+    free(text);
+}
+
+
+static void run_checks(void)
+{
+    printf("\nBehaviour checks...\n");
+
+    check_scan();
+    check_insitu();
+    check_dict();
+    check_memberindex();
+    check_sax();
+    check_filter();
+    check_write();
+    check_alloc();
+    check_ctree();
+    check_tape();
+    check_number();
+    check_rawnum();
+    check_parallel();
+    check_split();
+    check_pool();
+    check_file();
+    check_counters();
+    check_parsen();
+    check_sortby();
+    check_searchm();
+    check_reserve();
+    check_clone();
+    check_compact();
+
+    printf("%d of %d checks failed\n", nfailed, nchecks);
+}
+
+
 int main()
 {
     ltjson_node_t *namenode, *srchnode;
@@ -313,6 +2752,8 @@ were_done:
     if (ret == 0)
         perror("Error on free");
 
-    return 0;
+    run_checks();
+
+    return nfailed ? 1 : 0;
 }
 